@@ -506,7 +506,14 @@ class ViewController: UIViewController, SRCountdownTimerDelegate {
     /// Handles the case where we should have the user map the local environment by panning their phone back and forth
     func handleStateTransitionToMappingLocalEnvironment() {
         AnnouncementManager.shared.announce(announcement: NSLocalizedString("scanToMapEnvironment", comment: "This is the announcement to the user to pan their phone to capture the environment"))
+        // the user is panning around the anchor point anyway, so keep a few frames facing other ways for visual alignment to choose from and stitch a panorama
+        if isVisualAlignment, let anchorTransform = beginRouteAnchorPoint.anchor?.transform {
+            VisualAlignment.startPanorama(anchorTransform)
+        }
+        capturingAnchorViews = Timer.scheduledTimer(timeInterval: 0.5, target: self, selector: #selector(captureAnchorView), userInfo: nil, repeats: true)
         DispatchQueue.main.asyncAfter(deadline: .now() + 15.0) { [self] in
+            capturingAnchorViews?.invalidate()
+            saveAnchorPanorama()
             guard let curLocation = getRealCoordinates(record: false)?.location else {
                 return
             }
@@ -561,6 +568,11 @@ class ViewController: UIViewController, SRCountdownTimerDelegate {
         if !isVisualAlignment {
             rootContainerView.countdownTimer.isHidden = false
             rootContainerView.countdownTimer.start(beginingValue: ViewController.alignmentWaitingPeriod, interval: 1)
+        } else {
+            // the user holds the phone still during the countdown, so pick the anchor point image from the last few frames of it rather than taking whichever frame is current when it ends
+            VisualAlignment.startAnchorBurst(VisualAlignmentManager.downSampleFactor, VisualAlignmentManager.shared.featureBackend, Int32(Self.maxAnchorBurstFrames))
+            anchorBurstFeaturePoints = []
+            capturingAnchorBurst = Timer.scheduledTimer(timeInterval: Self.anchorBurstFrameInterval, target: self, selector: #selector(captureAnchorBurstFrame), userInfo: nil, repeats: true)
         }
         delayTransition()
         timerContinuation = {
@@ -597,10 +609,11 @@ class ViewController: UIViewController, SRCountdownTimerDelegate {
         }
     }
     
-    func getAlignmentImageHelper()->(NSString, simd_float4)? {
+    func getAlignmentImageHelper(frame: ARFrame? = ARSessionManager.shared.currentFrame)->(NSString, simd_float4, [simd_float3])? {
         var imageFileName: NSString?
         var intrinsicsVec: simd_float4?
-        if isVisualAlignment, let currentFrame = ARSessionManager.shared.currentFrame {
+        var featurePoints: [simd_float3] = []
+        if isVisualAlignment, let currentFrame = frame {
             let anchorPointImageIdentifier = UUID()
             imageFileName = "\(anchorPointImageIdentifier).jpg" as NSString
             
@@ -613,13 +626,98 @@ class ViewController: UIViewController, SRCountdownTimerDelegate {
             
             let intrinsics = currentFrame.camera.intrinsics
             intrinsicsVec = simd_float4(intrinsics[0, 0], intrinsics[1, 1], intrinsics[2, 0], intrinsics[2, 1])
+            
+            // keep the points in front of the camera, in the camera's coordinates (it looks down its -z axis)
+            let worldToCamera = currentFrame.camera.transform.inverse
+            featurePoints = (currentFrame.rawFeaturePoints?.points ?? []).map { (worldToCamera * simd_float4($0, 1)).dropW }.filter { $0.z < 0 }
         }
         if let imageFileName = imageFileName, let intrinsicsVec = intrinsicsVec {
-            return (imageFileName, intrinsicsVec)
+            return (imageFileName, intrinsicsVec, featurePoints)
         }
         return nil
     }
     
+    /// Hand the current frame to the native anchor burst, which scores it in the background, and keep the feature points ARKit saw in it in case it is picked.
+    @objc func captureAnchorBurstFrame() {
+        guard state == .pauseWaitingPeriod, isVisualAlignment else {
+            capturingAnchorBurst?.invalidate()
+            return
+        }
+        guard let frame = ARSessionManager.shared.currentFrame else {
+            return
+        }
+        let intrinsics = frame.camera.intrinsics
+        guard VisualAlignment.addAnchorBurstFrame(frame.capturedImage, simd_float4(intrinsics[0, 0], intrinsics[1, 1], intrinsics[2, 0], intrinsics[2, 1]), frame.camera.transform, frame.timestamp) else {
+            return
+        }
+        // keep the points in front of the camera, in the camera's coordinates (it looks down its -z axis)
+        let worldToCamera = frame.camera.transform.inverse
+        anchorBurstFeaturePoints.append((frame.timestamp, (frame.rawFeaturePoints?.points ?? []).map { (worldToCamera * simd_float4($0, 1)).dropW }.filter { $0.z < 0 }))
+        if anchorBurstFeaturePoints.count > Self.maxAnchorBurstFrames {
+            anchorBurstFeaturePoints.removeFirst()
+        }
+    }
+    
+    /// Stop the anchor burst and write the best of its frames as the anchor point image.  The image is written in the background, and the anchor point only loads it once it is there.
+    ///
+    /// - Parameter anchorPoint: the anchor point the image is for (its image is loaded once it has been written, or forgotten if it couldn't be)
+    /// - Returns: the image file name, the intrinsics, and the feature points (like getAlignmentImageHelper) along with the pose of the camera that took the frame, or nil if the burst had no frames
+    func finishAnchorBurstHelper(for anchorPoint: RouteAnchorPoint)->(NSString, simd_float4, [simd_float3], simd_float4x4)? {
+        capturingAnchorBurst?.invalidate()
+        let imageFileName = "\(UUID()).jpg" as NSString
+        var candidate = VisualAlignmentAnchorCandidate()
+        guard isVisualAlignment, VisualAlignment.finishAnchorBurst([imageFileName.documentURL.path], &candidate, { written in
+            guard anchorPoint.imageFileName == imageFileName else {
+                return
+            }
+            if written > 0 {
+                anchorPoint.loadImage()
+            } else {
+                anchorPoint.imageFileName = nil
+            }
+        }) > 0 else {
+            return nil
+        }
+        let featurePoints = anchorBurstFeaturePoints.first(where: { $0.0 == candidate.timestamp })?.1 ?? []
+        anchorBurstFeaturePoints = []
+        return (imageFileName, candidate.intrinsics, featurePoints, candidate.pose)
+    }
+    
+    /// Add the current frame to the panorama of the beginning anchor point, and keep it as another view if it is sharp and faces far enough from the anchor point image and the views already kept.
+    @objc func captureAnchorView() {
+        guard state == .mappingLocalEnvironment, isVisualAlignment, let anchorTransform = beginRouteAnchorPoint.anchor?.transform else {
+            capturingAnchorViews?.invalidate()
+            return
+        }
+        // the camera looks down its -z axis, and the heading is meaningless when it points at the floor or ceiling
+        guard let frame = ARSessionManager.shared.currentFrame, abs(frame.camera.transform.columns.2.y) < 0.5 else {
+            return
+        }
+        let intrinsics = frame.camera.intrinsics
+        VisualAlignment.addPanoramaFrame(frame.capturedImage, simd_float4(intrinsics[0, 0], intrinsics[1, 1], intrinsics[2, 0], intrinsics[2, 1]), frame.camera.transform)
+        guard beginRouteAnchorPoint.additionalViews.count < RouteAnchorPoint.maxAdditionalViews else {
+            return
+        }
+        let heading = { (transform: simd_float4x4) -> Float in atan2(-transform.columns.2.x, -transform.columns.2.z) }
+        let frameHeading = heading(frame.camera.transform)
+        let keptHeadings = [heading(anchorTransform)] + beginRouteAnchorPoint.additionalViews.map { heading($0.transform) }
+        guard keptHeadings.allSatisfy({ abs(remainder(frameHeading - $0, 2*Float.pi)) >= Self.minAnchorViewHeadingChange }), VisualAlignment.frameQuality(frame.capturedImage, frame.camera.transform, frame.timestamp).is_usable, let imageAlignment = getAlignmentImageHelper(frame: frame) else {
+            return
+        }
+        beginRouteAnchorPoint.additionalViews.append(RouteAnchorPointView(imageFileName: imageAlignment.0, intrinsics: imageAlignment.1, transform: frame.camera.transform))
+    }
+    
+    /// Write the panorama stitched while the user mapped the environment and attach it to the beginning anchor point (unless it covers too little to be worth aligning to).
+    func saveAnchorPanorama() {
+        guard isVisualAlignment, VisualAlignment.panoramaCoverage() >= Self.minAnchorPanoramaCoverage else {
+            return
+        }
+        let panoramaFileName = "\(UUID())_panorama.png" as NSString
+        if VisualAlignment.savePanorama(panoramaFileName.documentURL.path) {
+            beginRouteAnchorPoint.panoramaFileName = panoramaFileName
+        }
+    }
+    
     /// Handler for the completingPauseProcedure app state
     func handleStateTransitionToCompletingPauseProcedure() {
         // TODO: we should not be able to create a route Anchor Point if we are in the relocalizing state... (might want to handle this when the user stops navigation on a route they loaded.... This would obviate the need to handle this in the recordPath code as well
@@ -630,13 +728,18 @@ class ViewController: UIViewController, SRCountdownTimerDelegate {
             }
             // make sure we log the transform
             let _ = self.getRealCoordinates(record: true)
-            beginRouteAnchorPoint.anchor = ARAnchor(transform: currentTransform)
+            // the anchor point goes where the frame picked for its image was taken
+            let burstAlignment = finishAnchorBurstHelper(for: beginRouteAnchorPoint)
+            beginRouteAnchorPoint.anchor = ARAnchor(transform: burstAlignment?.3 ?? currentTransform)
             hideAllViewsHelper()
             if isVisualAlignment {
-                if let imageAlignment = getAlignmentImageHelper() {
+                if let imageAlignment = burstAlignment.map({ ($0.0, $0.1, $0.2) }) ?? getAlignmentImageHelper() {
                     beginRouteAnchorPoint.imageFileName = imageAlignment.0
-                    beginRouteAnchorPoint.loadImage()
+                    if burstAlignment == nil {
+                        beginRouteAnchorPoint.loadImage()
+                    }
                     beginRouteAnchorPoint.intrinsics = imageAlignment.1
+                    beginRouteAnchorPoint.featurePoints = imageAlignment.2
                 }
                 SoundEffectManager.shared.playSystemSound(id: 1108)
                 state = .mappingLocalEnvironment
@@ -653,12 +756,16 @@ class ViewController: UIViewController, SRCountdownTimerDelegate {
         } else if let currentTransform = ARSessionManager.shared.currentFrame?.camera.transform {
             // make sure to log transform
             let _ = self.getRealCoordinates(record: true)
-            endRouteAnchorPoint.anchor = ARAnchor(transform: currentTransform)
+            let burstAlignment = finishAnchorBurstHelper(for: endRouteAnchorPoint)
+            endRouteAnchorPoint.anchor = ARAnchor(transform: burstAlignment?.3 ?? currentTransform)
             if isVisualAlignment {
-                if let imageAlignment = getAlignmentImageHelper() {
+                if let imageAlignment = burstAlignment.map({ ($0.0, $0.1, $0.2) }) ?? getAlignmentImageHelper() {
                     endRouteAnchorPoint.imageFileName = imageAlignment.0
-                    endRouteAnchorPoint.loadImage()
+                    if burstAlignment == nil {
+                        endRouteAnchorPoint.loadImage()
+                    }
                     endRouteAnchorPoint.intrinsics = imageAlignment.1
+                    endRouteAnchorPoint.featurePoints = imageAlignment.2
                 }
                 SoundEffectManager.shared.playSystemSound(id: 1108)
             } else {
@@ -1667,6 +1774,27 @@ class ViewController: UIViewController, SRCountdownTimerDelegate {
     /// the time we last created a cloud anchor
     var lastCloudAnchorTime = Date()
     
+    /// times the capture of more views of the beginning anchor point while the user maps the environment
+    var capturingAnchorViews: Timer?
+    
+    /// the smallest change in heading (in radians) from the anchor point image and the views already captured for a frame to be kept as another view
+    static let minAnchorViewHeadingChange: Float = 0.35
+    
+    /// the smallest fraction of the way around the anchor point a panorama has to cover to be kept
+    static let minAnchorPanoramaCoverage: Float = 0.25
+    
+    /// times the capture of frames to pick the anchor point image from during the anchoring countdown
+    var capturingAnchorBurst: Timer?
+    
+    /// the timestamps of the frames handed to the anchor burst and the feature points ARKit saw in each (in the camera's coordinates)
+    var anchorBurstFeaturePoints: [(TimeInterval, [simd_float3])] = []
+    
+    /// how often (in seconds) a frame is handed to the anchor burst
+    static let anchorBurstFrameInterval = 0.2
+    
+    /// how many of the newest frames the anchor burst keeps (passed to the native burst)
+    static let maxAnchorBurstFrames = 8
+    
     /// times the generation of haptic feedback
     var hapticTimer: Timer?
     
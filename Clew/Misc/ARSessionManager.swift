@@ -549,6 +549,7 @@ class ARData: ObservableObject {
 extension ARSessionManager: ARSessionDelegate {
     func session(_ session: ARSession, didUpdate frame: ARFrame) {
         ARData.shared.set(transform: frame.camera.transform, intrinsics: frame.camera.intrinsics, image: frame.capturedImage)
+        VisualAlignment.addFramePose(frame.camera.transform, frame.timestamp)
         if let lighting = frame.lightEstimate {
             adjustTorch(lightingIntensity: Float(lighting.ambientIntensity), timestamp: frame.timestamp)
         }
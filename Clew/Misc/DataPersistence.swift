@@ -131,6 +131,19 @@ class DataPersistence {
                         print("couldn't write file")
                     }
                 }
+                
+                /// only write the files the route refers to
+                for fileName in getAnchorViewFileNames(route: documentData.route) {
+                    guard let image = documentData.anchorViewImages[fileName as String] else {
+                        continue
+                    }
+                    let imageData = Data(base64Encoded: image)
+                    do {
+                        try imageData?.write(to: fileName.documentURL)
+                    } catch {
+                        print("couldn't write file")
+                    }
+                }
             }
         } catch {
             print("couldn't unarchive route document")
@@ -211,13 +224,22 @@ class DataPersistence {
             }
         }
         
+        /// fetch the additional views and panoramas of the anchor points
+        var anchorViewImages: [String: String] = [:]
+        for fileName in getAnchorViewFileNames(route: route) {
+            if let data = try? Data(contentsOf: fileName.documentURL) {
+                anchorViewImages[fileName as String] = data.base64EncodedString()
+            }
+        }
+        
         let routeData = RouteDocumentData(route: route,
                                           map: worldMap,
                                           beginVoiceNote: beginVoiceFile,
                                           endVoiceNote: endVoiceFile,
                                           routeVoiceNotes: routeVoiceNotes,
                                           beginImage: beginImageData,
-                                          endImage: endImageData)
+                                          endImage: endImageData,
+                                          anchorViewImages: anchorViewImages)
 
         /// fetch the documents directory where apple stores temporary files
         let documents = FileManager.default.urls(
@@ -306,6 +328,18 @@ class DataPersistence {
         if let endRouteImageFileName = route.endRouteAnchorPoint.imageFileName {
             try? FileManager().removeItem(at: endRouteImageFileName.documentURL)
         }
+        for fileName in getAnchorViewFileNames(route: route) {
+            try? FileManager().removeItem(at: fileName.documentURL)
+        }
+    }
+    
+    /// The files of the additional views and panoramas of the anchor points of a route (but not of their main images).
+    ///
+    /// - Parameter route: the route
+    /// - Returns: the file names in the documents directory
+    private func getAnchorViewFileNames(route: SavedRoute) -> [NSString] {
+        let anchorPoints = [route.beginRouteAnchorPoint, route.endRouteAnchorPoint]
+        return anchorPoints.flatMap { $0.additionalViews.map { $0.imageFileName } } + anchorPoints.compactMap { $0.panoramaFileName }
     }
     
     /// A utility method to map a file name into a URL in the app's document directory.
@@ -161,11 +161,24 @@ public struct KeypointInfo {
     }
 }
 
+/// Another image of an anchor point, taken near where the anchor point was recorded (visual alignment picks whichever view overlaps the most with what the phone is looking at).
+struct RouteAnchorPointView {
+    /// The name of the image file in the documents directory
+    let imageFileName: NSString
+    /// The intrinsics used to take the image
+    let intrinsics: simd_float4
+    /// The pose of the camera that took the image (in the same coordinates as the anchor)
+    let transform: simd_float4x4
+}
+
 /// An encapsulation of a route Anchor Point, including position, text, and audio information.
 class RouteAnchorPoint: NSObject, NSSecureCoding {
     /// Needs to be declared and assigned true to support `NSSecureCoding`
     static var supportsSecureCoding = true
     
+    /// The most views to capture in addition to the anchor point image
+    static let maxAdditionalViews = 4
+    
     /// The position and orientation encoded as an ARAnchor
     public var anchor: ARAnchor?
     /// Text to help user remember the Anchor Point
@@ -177,6 +190,12 @@ class RouteAnchorPoint: NSObject, NSSecureCoding {
     public var image: UIImage?
     /// The intrinsics used to take the anchor point image
     public var intrinsics: simd_float4?
+    /// The 3D points ARKit had found when the anchor point image was taken, in the coordinates of the camera that took it (lets visual alignment solve for a metric pose)
+    public var featurePoints: [simd_float3]?
+    /// More images of the anchor point, facing other directions
+    public var additionalViews: [RouteAnchorPointView] = []
+    /// The name of the grayscale panorama around the anchor point in the documents directory (see VisualAlignment.savePanorama)
+    public var panoramaFileName: NSString?
     private var thumbnailCache: [CGFloat: UIImage] = [:]
     
     /// Initialize the Anchor Point.
@@ -185,12 +204,14 @@ class RouteAnchorPoint: NSObject, NSSecureCoding {
     ///   - transform: the position and orientation
     ///   - information: textual description
     ///   - voiceNote: URL to auditory description
-    public init(anchor: ARAnchor? = nil, information: NSString? = nil, voiceNote: NSString? = nil, imageFileName: NSString? = nil, intrinsics: simd_float4? = nil) {
+    ///   - featurePoints: 3D points in the coordinates of the camera that took the image
+    public init(anchor: ARAnchor? = nil, information: NSString? = nil, voiceNote: NSString? = nil, imageFileName: NSString? = nil, intrinsics: simd_float4? = nil, featurePoints: [simd_float3]? = nil) {
         self.anchor = anchor
         self.information = information
         self.voiceNote = voiceNote
         self.imageFileName = imageFileName
         self.intrinsics = intrinsics
+        self.featurePoints = featurePoints
     }
     
     /// Encode the Anchor Point.
@@ -207,6 +228,17 @@ class RouteAnchorPoint: NSObject, NSSecureCoding {
         if let intrinsics = intrinsics {
             aCoder.encode([intrinsics.x, intrinsics.y, intrinsics.z, intrinsics.w], forKey: "intrinsics")
         }
+        if let featurePoints = featurePoints {
+            aCoder.encode(featurePoints.flatMap { [$0.x, $0.y, $0.z] }, forKey: "featurePoints")
+        }
+        if !additionalViews.isEmpty {
+            aCoder.encode(additionalViews.map { $0.imageFileName as String }, forKey: "additionalViewImages")
+            aCoder.encode(additionalViews.flatMap { [$0.intrinsics.x, $0.intrinsics.y, $0.intrinsics.z, $0.intrinsics.w] }, forKey: "additionalViewIntrinsics")
+            aCoder.encode(additionalViews.flatMap { view in (0..<4).flatMap { column in (0..<4).map { row in view.transform[column, row] } } }, forKey: "additionalViewTransforms")
+        }
+        if let panoramaFileName = panoramaFileName {
+            aCoder.encode(panoramaFileName as String, forKey: "panoramaImage")
+        }
     }
     
     /// Used to load the anchor point image when it is needed, given the imaguURL is non-nil
@@ -227,6 +259,7 @@ class RouteAnchorPoint: NSObject, NSSecureCoding {
         var voiceNote : NSString? = nil
         var imageFileName : NSString?
         var intrinsics : simd_float4?
+        var featurePoints : [simd_float3]?
         
         if let transformAsARAnchor = aDecoder.decodeObject(of: ARAnchor.self, forKey: "transformAsARAnchor") {
             anchor = transformAsARAnchor
@@ -240,7 +273,19 @@ class RouteAnchorPoint: NSObject, NSSecureCoding {
         if let intrinsicsArray = aDecoder.decodeObject(forKey: "intrinsics") as? [Float] {
             intrinsics = simd_float4(intrinsicsArray[0], intrinsicsArray[1], intrinsicsArray[2], intrinsicsArray[3])
         }
-        self.init(anchor: anchor, information: information, voiceNote: voiceNote, imageFileName: imageFileName, intrinsics: intrinsics)
+        if let featurePointsArray = aDecoder.decodeObject(forKey: "featurePoints") as? [Float] {
+            featurePoints = stride(from: 0, to: featurePointsArray.count - 2, by: 3).map { simd_float3(featurePointsArray[$0], featurePointsArray[$0 + 1], featurePointsArray[$0 + 2]) }
+        }
+        self.init(anchor: anchor, information: information, voiceNote: voiceNote, imageFileName: imageFileName, intrinsics: intrinsics, featurePoints: featurePoints)
+        if let viewImages = aDecoder.decodeObject(forKey: "additionalViewImages") as? [String], let viewIntrinsics = aDecoder.decodeObject(forKey: "additionalViewIntrinsics") as? [Float], let viewTransforms = aDecoder.decodeObject(forKey: "additionalViewTransforms") as? [Float], viewIntrinsics.count == 4*viewImages.count, viewTransforms.count == 16*viewImages.count {
+            additionalViews = viewImages.indices.map { i in
+                let transform = simd_float4x4(columns: (simd_float4(viewTransforms[16*i..<16*i+4]), simd_float4(viewTransforms[16*i+4..<16*i+8]), simd_float4(viewTransforms[16*i+8..<16*i+12]), simd_float4(viewTransforms[16*i+12..<16*i+16])))
+                return RouteAnchorPointView(imageFileName: viewImages[i] as NSString, intrinsics: simd_float4(viewIntrinsics[4*i..<4*i+4]), transform: transform)
+            }
+        }
+        if let panoramaImage = aDecoder.decodeObject(forKey: "panoramaImage") as? String {
+            panoramaFileName = panoramaImage as NSString
+        }
     }
     
     func getThumbnail(imageHeight: CGFloat = 100)->UIImage? {
@@ -39,12 +39,15 @@ class RouteDocumentData: NSObject, NSSecureCoding {
     /// the image for alignment at the end of the route
     public var endImage: String?
     
+    /// the images of the additional views and the panoramas of both anchor points, keyed by their file names
+    public var anchorViewImages: [String: String]
+    
     /// Initialize the sharing document.
     ///
     /// - Parameters:
     ///   - route: the route data
     ///   - map: the arkit world map
-    public init(route: SavedRoute, map: Any? = nil, beginVoiceNote: String? = nil, endVoiceNote: String? = nil, routeVoiceNotes: [NSString], beginImage: String? = nil, endImage: String? = nil) {
+    public init(route: SavedRoute, map: Any? = nil, beginVoiceNote: String? = nil, endVoiceNote: String? = nil, routeVoiceNotes: [NSString], beginImage: String? = nil, endImage: String? = nil, anchorViewImages: [String: String] = [:]) {
         self.route = route
         self.map = map
         self.beginVoiceNote = beginVoiceNote
@@ -52,6 +55,7 @@ class RouteDocumentData: NSObject, NSSecureCoding {
         self.routeVoiceNotes = routeVoiceNotes
         self.beginImage = beginImage
         self.endImage = endImage
+        self.anchorViewImages = anchorViewImages
     }
     
     /// Encodes the object to the specified coder object. Here, we combine each essential element
@@ -66,6 +70,7 @@ class RouteDocumentData: NSObject, NSSecureCoding {
         aCoder.encode(routeVoiceNotes, forKey: "routeVoiceNotes")
         aCoder.encode(beginImage as NSString?, forKey: "beginImage")
         aCoder.encode(endImage as NSString?, forKey: "endImage")
+        aCoder.encode(anchorViewImages as NSDictionary, forKey: "anchorViewImages")
     }
     
     /// Initialize an object based using data from a decoder.
@@ -92,7 +97,10 @@ class RouteDocumentData: NSObject, NSSecureCoding {
         let beginImage = aDecoder.decodeObject(of: NSString.self, forKey: "beginImage")
         let endImage = aDecoder.decodeObject(of: NSString.self, forKey: "endImage")
         
+        /// routes shared before there were additional views don't have any
+        let anchorViewImages = aDecoder.decodeObject(of: [NSDictionary.self, NSString.self], forKey: "anchorViewImages") as? [String: String] ?? [:]
+        
         /// construct a new saved route from the decoded data
-        self.init(route: route, map: newMap, beginVoiceNote: beginNote as String?, endVoiceNote: endNote as String?, routeVoiceNotes: routeVoiceNotesFinal, beginImage: beginImage as String?, endImage: endImage as String?)
+        self.init(route: route, map: newMap, beginVoiceNote: beginNote as String?, endVoiceNote: endNote as String?, routeVoiceNotes: routeVoiceNotesFinal, beginImage: beginImage as String?, endImage: endImage as String?, anchorViewImages: anchorViewImages)
     }
 }
@@ -0,0 +1,36 @@
+//
+//  AlignmentConfiguration.cpp
+//  Clew
+//
+//  Created by OccamLab on 10/19/26.
+//  Copyright © 2026 OccamLab. All rights reserved.
+//
+
+#include "AlignmentConfiguration.hpp"
+
+const std::vector<AlignmentConfiguration>& getAlignmentConfigurations() {
+    static const std::vector<AlignmentConfiguration> configurations = {
+        {"akaze-3pt", FeatureBackendType::AKAZE, AlignmentSolverType::ThreePoint, UprightScoringType::Algebraic, UprightConsensusType::YawVotes},
+        {"akaze-3pt-sampson", FeatureBackendType::AKAZE, AlignmentSolverType::ThreePoint, UprightScoringType::Sampson, UprightConsensusType::YawVotes},
+        {"akaze-3pt-best", FeatureBackendType::AKAZE, AlignmentSolverType::ThreePoint, UprightScoringType::Algebraic, UprightConsensusType::BestModel},
+        {"akaze-2pt-planar", FeatureBackendType::AKAZE, AlignmentSolverType::TwoPointPlanar, UprightScoringType::Algebraic, UprightConsensusType::YawVotes},
+        {"akaze-2pt-absolute", FeatureBackendType::AKAZE, AlignmentSolverType::TwoPointAbsolute, UprightScoringType::Algebraic, UprightConsensusType::YawVotes},
+        {"akaze-essential", FeatureBackendType::AKAZE, AlignmentSolverType::Essential, UprightScoringType::Algebraic, UprightConsensusType::YawVotes},
+        // no features at all (the backend is unused)
+        {"phase-correlation", FeatureBackendType::AKAZE, AlignmentSolverType::PhaseCorrelation, UprightScoringType::Algebraic, UprightConsensusType::YawVotes},
+        // cheaper features for older devices
+        {"orb-3pt", FeatureBackendType::ORB, AlignmentSolverType::ThreePoint, UprightScoringType::Algebraic, UprightConsensusType::YawVotes},
+        {"orb-2pt-planar", FeatureBackendType::ORB, AlignmentSolverType::TwoPointPlanar, UprightScoringType::Algebraic, UprightConsensusType::YawVotes},
+        {"brisk-3pt", FeatureBackendType::BRISK, AlignmentSolverType::ThreePoint, UprightScoringType::Algebraic, UprightConsensusType::YawVotes},
+    };
+    return configurations;
+}
+
+const AlignmentConfiguration* findAlignmentConfiguration(const std::string& name) {
+    for (const auto& configuration : getAlignmentConfigurations()) {
+        if (name == configuration.name) {
+            return &configuration;
+        }
+    }
+    return nullptr;
+}
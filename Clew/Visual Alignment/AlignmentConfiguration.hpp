@@ -0,0 +1,62 @@
+//
+//  AlignmentConfiguration.hpp
+//  Clew
+//
+//  Created by OccamLab on 10/19/26.
+//  Copyright © 2026 OccamLab. All rights reserved.
+//
+
+#ifndef AlignmentConfiguration_hpp
+#define AlignmentConfiguration_hpp
+
+#include <string>
+#include <vector>
+#include "FeatureBackend.hpp"
+#include "UprightRansac.hpp"
+
+/// The ways visual alignment can estimate the pose once features are matched.
+enum class AlignmentSolverType {
+    /// upright RANSAC with the three point solver
+    ThreePoint,
+    /// upright RANSAC with the two point planar solver
+    TwoPointPlanar,
+    /// upright RANSAC over the 3D points stored with the anchor (see runUprightAbsoluteRansac)
+    TwoPointAbsolute,
+    /// OpenCV's five point essential matrix estimation (getYaw)
+    Essential,
+    /// no features, just the phase correlation of the leveled images on a cylinder (getPhaseCorrelationYaw)
+    PhaseCorrelation,
+};
+
+/**
+ A named combination of the choices that shape visual alignment, so that the app and any offline tools can refer to the same setups.
+ */
+typedef struct {
+    /// how the configuration is looked up (e.g., "akaze-3pt")
+    const char* name;
+    FeatureBackendType backend;
+    AlignmentSolverType solver;
+    /// the residual used to score hypotheses (only used by the upright relative pose solvers)
+    UprightScoringType scoring;
+    /// how the yaw is chosen (only used by the upright relative pose solvers)
+    UprightConsensusType consensus;
+} AlignmentConfiguration;
+
+/**
+ Get every known configuration.  The first one is the default.
+ 
+ - returns: The configurations.
+ */
+const std::vector<AlignmentConfiguration>& getAlignmentConfigurations();
+
+/**
+ Look up a configuration by name.
+ 
+ - returns: The configuration, or null if there is none with that name.
+ 
+ - parameters:
+ - name: The name of the configuration.
+ */
+const AlignmentConfiguration* findAlignmentConfiguration(const std::string& name);
+
+#endif /* AlignmentConfiguration_hpp */
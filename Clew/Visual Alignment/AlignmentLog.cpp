@@ -0,0 +1,239 @@
+//
+//  AlignmentLog.cpp
+//  Clew
+//
+//  Created by OccamLab on 10/19/26.
+//  Copyright © 2026 OccamLab. All rights reserved.
+//
+
+#include "AlignmentLog.hpp"
+#include <array>
+#include <atomic>
+#include <chrono>
+#include <condition_variable>
+#include <cstdarg>
+#include <cstdio>
+#include <mutex>
+#include <thread>
+
+/// the most messages waiting for the logging thread (a power of two)
+static const size_t kLogQueueCapacity = 512;
+
+/**
+ A bounded lock-free queue that any number of threads can push to and pop from (Vyukov's bounded MPMC queue).  Each slot has a sequence number that says whether it is ready to be written or read on the current lap.
+ */
+class LogQueue {
+public:
+    LogQueue() : enqueuePosition(0), dequeuePosition(0) {
+        for (size_t i = 0; i < kLogQueueCapacity; i++) {
+            slots[i].sequence.store(i, std::memory_order_relaxed);
+        }
+    }
+    
+    /// Returns false if the queue is full.
+    bool tryPush(const AlignmentLogRecord& record) {
+        size_t position = enqueuePosition.load(std::memory_order_relaxed);
+        for (;;) {
+            Slot& slot = slots[position & (kLogQueueCapacity - 1)];
+            const size_t sequence = slot.sequence.load(std::memory_order_acquire);
+            const intptr_t difference = (intptr_t) sequence - (intptr_t) position;
+            if (difference == 0) {
+                if (enqueuePosition.compare_exchange_weak(position, position + 1, std::memory_order_relaxed)) {
+                    slot.record = record;
+                    slot.sequence.store(position + 1, std::memory_order_release);
+                    return true;
+                }
+            } else if (difference < 0) {
+                return false;
+            } else {
+                position = enqueuePosition.load(std::memory_order_relaxed);
+            }
+        }
+    }
+    
+    /// Returns false if the queue is empty.
+    bool tryPop(AlignmentLogRecord& record) {
+        size_t position = dequeuePosition.load(std::memory_order_relaxed);
+        for (;;) {
+            Slot& slot = slots[position & (kLogQueueCapacity - 1)];
+            const size_t sequence = slot.sequence.load(std::memory_order_acquire);
+            const intptr_t difference = (intptr_t) sequence - (intptr_t) (position + 1);
+            if (difference == 0) {
+                if (dequeuePosition.compare_exchange_weak(position, position + 1, std::memory_order_relaxed)) {
+                    record = slot.record;
+                    slot.sequence.store(position + kLogQueueCapacity, std::memory_order_release);
+                    return true;
+                }
+            } else if (difference < 0) {
+                return false;
+            } else {
+                position = dequeuePosition.load(std::memory_order_relaxed);
+            }
+        }
+    }
+    
+private:
+    typedef struct {
+        std::atomic<size_t> sequence;
+        AlignmentLogRecord record;
+    } Slot;
+    std::array<Slot, kLogQueueCapacity> slots;
+    alignas(64) std::atomic<size_t> enqueuePosition;
+    alignas(64) std::atomic<size_t> dequeuePosition;
+};
+
+/**
+ The queue of logged messages and the thread that drains it.  The thread sleeps on a condition variable while the queue is empty, and loggers only take the lock to wake it (once per batch of messages, since it doesn't go back to sleep until the queue is empty).
+ */
+class AlignmentLogSink {
+public:
+    AlignmentLogSink() : minimumLevel((int) AlignmentLogLevel::Debug), categoryMask(~0u), dropped(0), pending(0), isWaiting(false), isStopping(false), thread(&AlignmentLogSink::run, this) {}
+    
+    ~AlignmentLogSink() {
+        {
+            std::lock_guard<std::mutex> lock(wakeMutex);
+            isStopping = true;
+        }
+        wake.notify_one();
+        thread.join();
+    }
+    
+    bool isEnabled(AlignmentLogLevel level, AlignmentLogCategory category) const {
+        return (int) level >= minimumLevel.load(std::memory_order_relaxed) && (categoryMask.load(std::memory_order_relaxed) >> (int) category & 1);
+    }
+    
+    void push(const AlignmentLogRecord& record) {
+        if (!queue.tryPush(record)) {
+            dropped.fetch_add(1, std::memory_order_relaxed);
+            return;
+        }
+        // Either the logging thread sees the message before it sleeps, or this sees that it is asleep (both are sequentially consistent).
+        pending.fetch_add(1);
+        if (isWaiting.load()) {
+            std::lock_guard<std::mutex> lock(wakeMutex);
+            wake.notify_one();
+        }
+    }
+    
+    /// Hand every queued message to the handler.
+    void drain() {
+        std::lock_guard<std::mutex> lock(handlerMutex);
+        AlignmentLogRecord record;
+        while (queue.tryPop(record)) {
+            pending.fetch_sub(1);
+            if (handler) {
+                handler(record);
+            } else {
+                fprintf(stderr, "[%s] %s: %s\n", getAlignmentLogCategoryName(record.category), getAlignmentLogLevelName(record.level), record.message);
+            }
+        }
+    }
+    
+    void setHandler(std::function<void(const AlignmentLogRecord&)> newHandler) {
+        std::lock_guard<std::mutex> lock(handlerMutex);
+        handler = std::move(newHandler);
+    }
+    
+    std::atomic<int> minimumLevel;
+    std::atomic<uint32_t> categoryMask;
+    std::atomic<uint64_t> dropped;
+    
+private:
+    void run() {
+        std::unique_lock<std::mutex> lock(wakeMutex);
+        while (!isStopping) {
+            isWaiting = true;
+            wake.wait(lock, [this] {
+                return isStopping || pending.load() > 0;
+            });
+            isWaiting = false;
+            lock.unlock();
+            drain();
+            lock.lock();
+        }
+        lock.unlock();
+        drain();
+    }
+    
+    LogQueue queue;
+    std::mutex handlerMutex;
+    std::function<void(const AlignmentLogRecord&)> handler;
+    /// the messages pushed but not yet popped (a message may be counted after it is popped, which only costs the logging thread an extra look at the queue)
+    std::atomic<int64_t> pending;
+    /// whether the logging thread is (about to go) asleep
+    std::atomic<bool> isWaiting;
+    /// guards the sleep of the logging thread
+    std::mutex wakeMutex;
+    std::condition_variable wake;
+    std::atomic<bool> isStopping;
+    std::thread thread;
+};
+
+/// the sink (created, along with its thread, the first time it is needed)
+static AlignmentLogSink& getAlignmentLogSink() {
+    static AlignmentLogSink sink;
+    return sink;
+}
+
+void logAlignmentMessage(AlignmentLogLevel level, AlignmentLogCategory category, const char* format, ...) {
+    AlignmentLogSink& sink = getAlignmentLogSink();
+    if (!sink.isEnabled(level, category)) {
+        return;
+    }
+    AlignmentLogRecord record;
+    record.level = level;
+    record.category = category;
+    record.timestamp = std::chrono::duration<double>(std::chrono::steady_clock::now().time_since_epoch()).count();
+    va_list arguments;
+    va_start(arguments, format);
+    vsnprintf(record.message, sizeof(record.message), format, arguments);
+    va_end(arguments);
+    sink.push(record);
+}
+
+void setAlignmentLogFilter(AlignmentLogLevel minimumLevel, uint32_t categoryMask) {
+    getAlignmentLogSink().minimumLevel = (int) minimumLevel;
+    getAlignmentLogSink().categoryMask = categoryMask;
+}
+
+void setAlignmentLogHandler(std::function<void(const AlignmentLogRecord&)> handler) {
+    getAlignmentLogSink().setHandler(std::move(handler));
+}
+
+void flushAlignmentLog() {
+    getAlignmentLogSink().drain();
+}
+
+uint64_t getDroppedAlignmentLogMessages() {
+    return getAlignmentLogSink().dropped.load();
+}
+
+const char* getAlignmentLogLevelName(AlignmentLogLevel level) {
+    switch (level) {
+        case AlignmentLogLevel::Debug:
+            return "debug";
+        case AlignmentLogLevel::Info:
+            return "info";
+        case AlignmentLogLevel::Warning:
+            return "warning";
+        case AlignmentLogLevel::Error:
+        default:
+            return "error";
+    }
+}
+
+const char* getAlignmentLogCategoryName(AlignmentLogCategory category) {
+    switch (category) {
+        case AlignmentLogCategory::Features:
+            return "features";
+        case AlignmentLogCategory::Matching:
+            return "matching";
+        case AlignmentLogCategory::Solver:
+            return "solver";
+        case AlignmentLogCategory::Pipeline:
+            return "pipeline";
+        case AlignmentLogCategory::General:
+        default:
+            return "general";
+    }
+}
@@ -0,0 +1,141 @@
+//
+//  AlignmentLog.hpp
+//  Clew
+//
+//  Created by OccamLab on 10/19/26.
+//  Copyright © 2026 OccamLab. All rights reserved.
+//
+
+#ifndef AlignmentLog_hpp
+#define AlignmentLog_hpp
+
+#include <cstdint>
+#include <functional>
+
+/**
+ Logging for the alignment core.
+ 
+ Messages are logged with a severity and a category through the ALIGNMENT_LOG_* macros, which take a printf-style format.  Set CLEW_ALIGNMENT_LOG_LEVEL (e.g., add CLEW_ALIGNMENT_LOG_LEVEL=0 to the preprocessor macros) to the lowest severity to compile in: 0 for debug, 1 for info, 2 for warnings, 3 for errors, and 4 for nothing.  It defaults to info in debug builds and to warnings otherwise.  The macros for lower severities expand to nothing, so their arguments aren't even evaluated.
+ 
+ The messages that are compiled in are formatted on the calling thread into a fixed-size record and pushed onto a bounded lock-free queue (messages are dropped if it is full).  A background thread, which sleeps while the queue is empty, hands them to the handler, so logging never waits on I/O.
+ */
+
+#define CLEW_ALIGNMENT_LOG_LEVEL_DEBUG 0
+#define CLEW_ALIGNMENT_LOG_LEVEL_INFO 1
+#define CLEW_ALIGNMENT_LOG_LEVEL_WARNING 2
+#define CLEW_ALIGNMENT_LOG_LEVEL_ERROR 3
+#define CLEW_ALIGNMENT_LOG_LEVEL_OFF 4
+
+#ifndef CLEW_ALIGNMENT_LOG_LEVEL
+#if defined(DEBUG) && DEBUG
+#define CLEW_ALIGNMENT_LOG_LEVEL CLEW_ALIGNMENT_LOG_LEVEL_INFO
+#else
+#define CLEW_ALIGNMENT_LOG_LEVEL CLEW_ALIGNMENT_LOG_LEVEL_WARNING
+#endif
+#endif
+
+/// How severe a logged message is.
+enum class AlignmentLogLevel {
+    Debug = CLEW_ALIGNMENT_LOG_LEVEL_DEBUG,
+    Info = CLEW_ALIGNMENT_LOG_LEVEL_INFO,
+    Warning = CLEW_ALIGNMENT_LOG_LEVEL_WARNING,
+    Error = CLEW_ALIGNMENT_LOG_LEVEL_ERROR,
+};
+
+/// The part of the alignment core a message comes from.
+enum class AlignmentLogCategory {
+    General,
+    /// leveling images and extracting features
+    Features,
+    /// matching and tracking features
+    Matching,
+    /// the minimal solvers, RANSAC, and refinement
+    Solver,
+    /// the background alignment pipeline
+    Pipeline,
+};
+
+/// A message that was logged.
+typedef struct {
+    AlignmentLogLevel level;
+    AlignmentLogCategory category;
+    /// when the message was logged (in seconds of the steady clock)
+    double timestamp;
+    /// the formatted message (cut short if it didn't fit)
+    char message[232];
+} AlignmentLogRecord;
+
+#define ALIGNMENT_LOG(level, category, ...) logAlignmentMessage(AlignmentLogLevel::level, AlignmentLogCategory::category, __VA_ARGS__)
+
+#if CLEW_ALIGNMENT_LOG_LEVEL <= CLEW_ALIGNMENT_LOG_LEVEL_DEBUG
+/// Log a debug message (category is an AlignmentLogCategory without the prefix, followed by a printf-style format and its arguments).
+#define ALIGNMENT_LOG_DEBUG(category, ...) ALIGNMENT_LOG(Debug, category, __VA_ARGS__)
+#else
+#define ALIGNMENT_LOG_DEBUG(category, ...) ((void) 0)
+#endif
+
+#if CLEW_ALIGNMENT_LOG_LEVEL <= CLEW_ALIGNMENT_LOG_LEVEL_INFO
+/// Log an info message (see ALIGNMENT_LOG_DEBUG).
+#define ALIGNMENT_LOG_INFO(category, ...) ALIGNMENT_LOG(Info, category, __VA_ARGS__)
+#else
+#define ALIGNMENT_LOG_INFO(category, ...) ((void) 0)
+#endif
+
+#if CLEW_ALIGNMENT_LOG_LEVEL <= CLEW_ALIGNMENT_LOG_LEVEL_WARNING
+/// Log a warning (see ALIGNMENT_LOG_DEBUG).
+#define ALIGNMENT_LOG_WARNING(category, ...) ALIGNMENT_LOG(Warning, category, __VA_ARGS__)
+#else
+#define ALIGNMENT_LOG_WARNING(category, ...) ((void) 0)
+#endif
+
+#if CLEW_ALIGNMENT_LOG_LEVEL <= CLEW_ALIGNMENT_LOG_LEVEL_ERROR
+/// Log an error (see ALIGNMENT_LOG_DEBUG).
+#define ALIGNMENT_LOG_ERROR(category, ...) ALIGNMENT_LOG(Error, category, __VA_ARGS__)
+#else
+#define ALIGNMENT_LOG_ERROR(category, ...) ((void) 0)
+#endif
+
+/**
+ Log a message (use the ALIGNMENT_LOG_* macros instead so that it can be compiled out).
+ 
+ - parameters:
+ - level: The severity of the message.
+ - category: Where the message comes from.
+ - format: A printf-style format followed by its arguments.
+ */
+void logAlignmentMessage(AlignmentLogLevel level, AlignmentLogCategory category, const char* format, ...)
+#if defined(__GNUC__) || defined(__clang__)
+    __attribute__((format(printf, 3, 4)))
+#endif
+    ;
+
+/**
+ Set which of the compiled in messages are kept.  Messages that are filtered out here are dropped before they are formatted.
+ 
+ - parameters:
+ - minimumLevel: The lowest severity to keep.
+ - categoryMask: The categories to keep (bit i is the category with the value i).
+ */
+void setAlignmentLogFilter(AlignmentLogLevel minimumLevel, uint32_t categoryMask = ~0u);
+
+/**
+ Set what is done with the logged messages.  The handler is called on the logging thread, one message at a time.
+ 
+ - parameters:
+ - handler: The handler (if empty, messages are written to stderr).
+ */
+void setAlignmentLogHandler(std::function<void(const AlignmentLogRecord&)> handler);
+
+/// Hand every message logged so far to the handler before returning.
+void flushAlignmentLog();
+
+/// The number of messages dropped because the queue was full.
+uint64_t getDroppedAlignmentLogMessages();
+
+/// The name of a level (e.g., "warning").
+const char* getAlignmentLogLevelName(AlignmentLogLevel level);
+
+/// The name of a category (e.g., "solver").
+const char* getAlignmentLogCategoryName(AlignmentLogCategory category);
+
+#endif /* AlignmentLog_hpp */
@@ -0,0 +1,156 @@
+//
+//  AlignmentPipeline.cpp
+//  Clew
+//
+//  Created by OccamLab on 10/19/26.
+//  Copyright © 2026 OccamLab. All rights reserved.
+//
+
+#include "AlignmentPipeline.hpp"
+#include "AlignmentTrace.hpp"
+#include <algorithm>
+
+AlignmentPipeline::AlignmentPipeline(WorkerPool* pool) : pool(pool), running(false) {
+}
+
+AlignmentPipeline::~AlignmentPipeline() {
+    stop();
+}
+
+void AlignmentPipeline::start(const PipelineFrame& anchorFrame, const AlignmentPipelineOptions& options) {
+    stop();
+    this->options = options;
+    anchor = levelImage(anchorFrame.image, anchorFrame.intrinsics, anchorFrame.pose, std::max(1, options.downSampleFactor / options.anchorReduction));
+    if (pool) {
+        anchorFeatures = getKeyPointsAndDescriptorsTiled({anchor.image}, options.backend, *pool)[0];
+    } else {
+        anchorFeatures = getKeyPointsAndDescriptors(anchor.image, options.backend);
+    }
+    running = true;
+    extractionThread = std::thread(&AlignmentPipeline::extractionLoop, this);
+    solveThread = std::thread(&AlignmentPipeline::solveLoop, this);
+}
+
+void AlignmentPipeline::stop() {
+    running = false;
+    wake();
+    if (extractionThread.joinable()) {
+        extractionThread.join();
+    }
+    if (solveThread.joinable()) {
+        solveThread.join();
+    }
+    drain();
+}
+
+void AlignmentPipeline::drain() {
+    mailbox.take();
+    ExtractedFrame extracted;
+    while (extractedFrames.tryPop(extracted)) {
+    }
+    std::lock_guard<std::mutex> lock(resultsMutex);
+    PipelineResult result;
+    while (results.tryPop(result)) {
+    }
+}
+
+void AlignmentPipeline::submit(std::unique_ptr<PipelineFrame> frame) {
+    mailbox.put(std::move(frame));
+    wake();
+}
+
+bool AlignmentPipeline::popResult(PipelineResult& result) {
+    {
+        std::lock_guard<std::mutex> lock(resultsMutex);
+        if (!results.tryPop(result)) {
+            return false;
+        }
+    }
+    // the solving stage may be waiting for room
+    wake();
+    return true;
+}
+
+void AlignmentPipeline::wake() {
+    // Taking the lock orders the change the stages wait for before their next check, so the notification can't slip in between their check and their wait.
+    {
+        std::lock_guard<std::mutex> lock(wakeMutex);
+    }
+    stageWake.notify_all();
+}
+
+unsigned long AlignmentPipeline::getFramesDropped() const {
+    return mailbox.getDropped();
+}
+
+void AlignmentPipeline::extractionLoop() {
+    while (true) {
+        std::unique_ptr<PipelineFrame> frame;
+        {
+            std::unique_lock<std::mutex> lock(wakeMutex);
+            stageWake.wait(lock, [&] {
+                return !running || (frame = mailbox.take()) != nullptr;
+            });
+        }
+        if (!frame) {
+            return;
+        }
+        ALIGNMENT_TRACE_SCOPE("pipeline extraction");
+        ExtractedFrame extracted;
+        extracted.leveled = levelImage(frame->image, frame->intrinsics, frame->pose, options.downSampleFactor);
+        // The worker pool is left to the solving stage so the two stages don't wait on each other.
+        extracted.features = getKeyPointsAndDescriptors(extracted.leveled.image, options.backend);
+        extracted.timestamp = frame->timestamp;
+        {
+            std::unique_lock<std::mutex> lock(wakeMutex);
+            stageWake.wait(lock, [&] {
+                return !running || extractedFrames.tryPush(std::move(extracted));
+            });
+        }
+        wake();
+    }
+}
+
+void AlignmentPipeline::solveLoop() {
+    const int descriptorNorm = getDescriptorNorm(options.backend);
+    while (true) {
+        ExtractedFrame extracted;
+        bool isExtracted = false;
+        {
+            std::unique_lock<std::mutex> lock(wakeMutex);
+            stageWake.wait(lock, [&] {
+                return !running || (isExtracted = extractedFrames.tryPop(extracted));
+            });
+        }
+        if (!isExtracted) {
+            return;
+        }
+        // the extraction stage may be waiting for room
+        wake();
+        ALIGNMENT_TRACE_SCOPE("pipeline solve");
+        ALIGNMENT_TRACE_COUNTER("pipeline frames dropped", mailbox.getDropped());
+        bool useYawPrior = options.yawPriorUncertainty > 0;
+        const YawPrior yawPrior = getYawPrior(anchor, extracted.leveled, options.yawPriorUncertainty);
+        const auto matches = matchLeveledFeatures(anchor, anchorFeatures, extracted.leveled, extracted.features, useYawPrior ? &yawPrior : nullptr, descriptorNorm, useYawPrior);
+        
+        UprightRansacOptions ransacOptions;
+        ransacOptions.solver = options.solver;
+        ransacOptions.scoring = options.scoring;
+        ransacOptions.consensus = options.consensus;
+        ransacOptions.useYawPrior = useYawPrior;
+        ransacOptions.yawPrior = yawPrior;
+        ransacOptions.workerPool = pool;
+        ransacOptions.seed = getUprightRansacSeed();
+        
+        PipelineResult result;
+        result.alignment = solveUprightAlignment(anchor, anchorFeatures, extracted.leveled, extracted.features, matches, ransacOptions);
+        result.squareRotation1 = anchor.squareRotation.toRotationMatrix();
+        result.squareRotation2 = extracted.leveled.squareRotation.toRotationMatrix();
+        result.pose = extracted.leveled.pose;
+        result.timestamp = extracted.timestamp;
+        std::unique_lock<std::mutex> lock(wakeMutex);
+        stageWake.wait(lock, [&] {
+            return !running || results.tryPush(std::move(result));
+        });
+    }
+}
@@ -0,0 +1,138 @@
+//
+//  AlignmentPipeline.hpp
+//  Clew
+//
+//  Created by OccamLab on 10/19/26.
+//  Copyright © 2026 OccamLab. All rights reserved.
+//
+
+#ifndef AlignmentPipeline_hpp
+#define AlignmentPipeline_hpp
+
+#include <opencv2/opencv.hpp>
+#include <Eigen/Core>
+#include <atomic>
+#include <condition_variable>
+#include <memory>
+#include <mutex>
+#include <thread>
+#include "UprightAlignment.hpp"
+#include "LatestFrameMailbox.hpp"
+#include "SpscQueue.hpp"
+#include "WorkerPool.hpp"
+
+/**
+ A camera frame to align to the anchor.
+ */
+typedef struct {
+    /// the grayscale image as captured (landscape)
+    cv::Mat image;
+    Eigen::Matrix3f intrinsics;
+    Eigen::Matrix4f pose;
+    double timestamp;
+} PipelineFrame;
+
+/**
+ The outcome of aligning one frame to the anchor.
+ */
+typedef struct {
+    UprightAlignment alignment;
+    /// the rotations used to level the anchor and the frame (see getIdealRotation)
+    Eigen::Matrix3f squareRotation1;
+    Eigen::Matrix3f squareRotation2;
+    /// the pose and timestamp of the frame
+    Eigen::Matrix4f pose;
+    double timestamp;
+} PipelineResult;
+
+/**
+ How the pipeline aligns frames.
+ */
+struct AlignmentPipelineOptions {
+    int downSampleFactor = 2;
+    FeatureBackendType backend = FeatureBackendType::AKAZE;
+    UprightSolverType solver = UprightSolverType::ThreePoint;
+    UprightScoringType scoring = UprightScoringType::Algebraic;
+    UprightConsensusType consensus = UprightConsensusType::YawVotes;
+    /// if positive, the anchor pose is in the same coordinate frame as the frames and the yaw it implies is used as a prior with this uncertainty (in radians)
+    float yawPriorUncertainty = -1;
+    /// how many times the anchor image was shrunk when it was decoded (see loadAnchorImage), so that leveling only shrinks it by the rest of downSampleFactor
+    int anchorReduction = 1;
+};
+
+/**
+ Aligns a stream of camera frames to an anchor on two threads of its own so that the features of one frame are extracted while the previous frame is matched and solved.
+ 
+ Frames go into a LatestFrameMailbox, so submitting faster than the pipeline can keep up just skips frames.  The extraction stage levels each frame and finds its features, then hands it to the solving stage through a bounded lock-free queue.  The solving stage matches against the anchor, runs upright RANSAC (on the worker pool), and queues the result for popResult.  When a queue is full the stage upstream of it waits, and the mailbox keeps only the newest frame in the meantime.  A stage with nothing to do sleeps on a condition variable until submit, the other stage, or popResult gives it something, so an idle pipeline costs nothing.
+ */
+class AlignmentPipeline {
+public:
+    /**
+     Create a stopped pipeline.
+     
+     - parameters:
+     - pool: The workers for extracting the anchor features and for RANSAC (may be null).
+     */
+    AlignmentPipeline(WorkerPool* pool);
+    ~AlignmentPipeline();
+    
+    AlignmentPipeline(const AlignmentPipeline&) = delete;
+    AlignmentPipeline& operator=(const AlignmentPipeline&) = delete;
+    
+    /**
+     Find the anchor features and start the stages (stopping them first if they are running).
+     
+     - parameters:
+     - anchor: The anchor frame.
+     - options: How to align frames.
+     */
+    void start(const PipelineFrame& anchor, const AlignmentPipelineOptions& options);
+    
+    /// Stop the stages and discard any frames and results still in flight.
+    void stop();
+    
+    /// Offer a frame to the pipeline (it replaces any frame that hasn't been picked up yet).
+    void submit(std::unique_ptr<PipelineFrame> frame);
+    
+    /**
+     Get the next result if there is one (safe to call while another thread stops the pipeline).
+     
+     - returns: False if there is no result yet.
+     */
+    bool popResult(PipelineResult& result);
+    
+    /// the number of frames that were replaced before the extraction stage got to them
+    unsigned long getFramesDropped() const;
+    
+private:
+    typedef struct {
+        LeveledImage leveled;
+        KeyPointsAndDescriptors features;
+        double timestamp;
+    } ExtractedFrame;
+    
+    void extractionLoop();
+    void solveLoop();
+    /// Throw away everything in flight (only when the stages are stopped).
+    void drain();
+    /// Wake the stages to check their inputs and outputs again (call after changing them or running).
+    void wake();
+    
+    WorkerPool* pool;
+    AlignmentPipelineOptions options;
+    LeveledImage anchor;
+    KeyPointsAndDescriptors anchorFeatures;
+    LatestFrameMailbox<PipelineFrame> mailbox;
+    SpscQueue<ExtractedFrame, 2> extractedFrames;
+    SpscQueue<PipelineResult, 16> results;
+    /// results only allows one consumer, so popResult and drain take turns on this
+    std::mutex resultsMutex;
+    std::atomic<bool> running;
+    /// the stages wait on stageWake for a frame, for room in a queue, or for the pipeline to stop (the queues and mailbox are lock-free, the mutex only keeps notifications from being missed)
+    std::mutex wakeMutex;
+    std::condition_variable stageWake;
+    std::thread extractionThread;
+    std::thread solveThread;
+};
+
+#endif /* AlignmentPipeline_hpp */
@@ -0,0 +1,179 @@
+//
+//  AlignmentQualityController.cpp
+//  Clew
+//
+//  Created by OccamLab on 10/19/26.
+//  Copyright © 2026 OccamLab. All rights reserved.
+//
+
+#include "AlignmentQualityController.hpp"
+#include "AlignmentLog.hpp"
+#include <algorithm>
+
+/// the rung attempts start on (about what visual alignment did before it was adaptive)
+static const unsigned int kDefaultLevel = 3;
+/// how much weight the moving averages give the newest attempt
+static const double kLatencySmoothing = 0.3;
+static const double kSuccessSmoothing = 0.2;
+/// the fewest attempts to measure at a rung before moving off of it
+static const unsigned int kMinAttemptsPerLevel = 3;
+/// how far over the target a single attempt has to be to step down without waiting for more measurements
+static const double kOverloadFactor = 2.0;
+/// the fraction of the target the next rung up has to be predicted to fit in to step up to it
+static const double kStepUpHeadroom = 0.8;
+/// below this success rate the target is stretched by kStrugglingLatencyFactor (failed attempts are wasted time, so spending more on each is worth it)
+static const double kStrugglingSuccessRate = 0.3;
+static const double kStrugglingLatencyFactor = 1.5;
+/// roughly how many features AKAZE finds in a full resolution leveled image (only used to predict how the number of features changes between rungs)
+static const double kTypicalFullResolutionFeatures = 12000.0;
+
+/// the number of features expected in the live image with a budget
+static double expectedLiveFeatures(const AlignmentBudget& budget) {
+    return std::min((double) budget.maxKeypoints, kTypicalFullResolutionFeatures / (budget.downSampleFactor * budget.downSampleFactor));
+}
+
+/// the number of features expected in the anchor image with a budget (it isn't capped)
+static double expectedAnchorFeatures(const AlignmentBudget& budget) {
+    return kTypicalFullResolutionFeatures / (budget.downSampleFactor * budget.downSampleFactor);
+}
+
+/// predict how long each stage takes with one budget from how long it took with another
+static AlignmentStageLatency scaleLatency(const AlignmentStageLatency& latency, const AlignmentBudget& from, const AlignmentBudget& to) {
+    const double pixelRatio = (double) (from.downSampleFactor * from.downSampleFactor) / (to.downSampleFactor * to.downSampleFactor);
+    const double liveRatio = expectedLiveFeatures(to) / expectedLiveFeatures(from);
+    const double anchorRatio = expectedAnchorFeatures(to) / expectedAnchorFeatures(from);
+    AlignmentStageLatency scaled;
+    scaled.leveling = latency.leveling * pixelRatio;
+    scaled.features = latency.features * pixelRatio;
+    scaled.matching = latency.matching * liveRatio * anchorRatio;
+    scaled.solving = latency.solving * ((double) to.maxTrials / from.maxTrials) * liveRatio;
+    return scaled;
+}
+
+static double totalLatency(const AlignmentStageLatency& latency) {
+    return latency.leveling + latency.features + latency.matching + latency.solving;
+}
+
+const std::vector<AlignmentBudget>& AlignmentQualityController::getBudgetLadder() {
+    // The anchor image is decoded for the smallest downSampleFactor, so every rung has to be a multiple of it.
+    static const std::vector<AlignmentBudget> ladder = {
+        {4, 500, 50},
+        {4, 1000, 100},
+        {2, 1000, 100},
+        {2, 2000, 100},
+        {2, 3000, 200},
+        {2, 5000, 300},
+    };
+    return ladder;
+}
+
+AlignmentQualityController::AlignmentQualityController(double targetLatency) : targetLatency(targetLatency), thermalState(AlignmentThermalState::Nominal) {
+    reset();
+}
+
+void AlignmentQualityController::reset() {
+    std::lock_guard<std::mutex> lock(mutex);
+    level = std::min(kDefaultLevel, getMaxLevel());
+    averageLatency = {0, 0, 0, 0};
+    successRate = 1.0;
+    attemptsAtLevel = 0;
+    hasMeasurements = false;
+}
+
+void AlignmentQualityController::setTargetLatency(double targetLatency) {
+    std::lock_guard<std::mutex> lock(mutex);
+    this->targetLatency = targetLatency;
+}
+
+void AlignmentQualityController::setThermalState(AlignmentThermalState thermalState) {
+    std::lock_guard<std::mutex> lock(mutex);
+    this->thermalState = thermalState;
+    if (level > getMaxLevel()) {
+        ALIGNMENT_LOG_INFO(Pipeline, "thermal state %d caps the alignment budget at rung %u", (int) thermalState, getMaxLevel());
+        changeLevel(getMaxLevel());
+    }
+}
+
+AlignmentBudget AlignmentQualityController::getBudget() const {
+    std::lock_guard<std::mutex> lock(mutex);
+    return getBudgetLadder()[level];
+}
+
+unsigned int AlignmentQualityController::getLevel() const {
+    std::lock_guard<std::mutex> lock(mutex);
+    return level;
+}
+
+double AlignmentQualityController::getSuccessRate() const {
+    std::lock_guard<std::mutex> lock(mutex);
+    return successRate;
+}
+
+double AlignmentQualityController::getPredictedLatency() const {
+    std::lock_guard<std::mutex> lock(mutex);
+    return hasMeasurements ? predictLatency(level) : 0.0;
+}
+
+void AlignmentQualityController::recordAttempt(const AlignmentStageLatency& latency, bool success) {
+    std::lock_guard<std::mutex> lock(mutex);
+    if (!hasMeasurements) {
+        averageLatency = latency;
+        successRate = success ? 1.0 : 0.0;
+        hasMeasurements = true;
+    } else {
+        averageLatency.leveling += kLatencySmoothing * (latency.leveling - averageLatency.leveling);
+        averageLatency.features += kLatencySmoothing * (latency.features - averageLatency.features);
+        averageLatency.matching += kLatencySmoothing * (latency.matching - averageLatency.matching);
+        averageLatency.solving += kLatencySmoothing * (latency.solving - averageLatency.solving);
+        successRate += kSuccessSmoothing * ((success ? 1.0 : 0.0) - successRate);
+    }
+    attemptsAtLevel++;
+
+    const double effectiveTarget = successRate < kStrugglingSuccessRate ? kStrugglingLatencyFactor * targetLatency : targetLatency;
+    const bool overloaded = totalLatency(latency) > kOverloadFactor * effectiveTarget;
+    if (attemptsAtLevel < kMinAttemptsPerLevel && !overloaded) {
+        return;
+    }
+    if (predictLatency(level) > effectiveTarget) {
+        // drop straight to the richest rung that fits
+        unsigned int next = level;
+        while (next > 0 && predictLatency(next) > effectiveTarget) {
+            next--;
+        }
+        if (next != level) {
+            changeLevel(next);
+        }
+        return;
+    }
+    if (level < getMaxLevel() && predictLatency(level + 1) <= kStepUpHeadroom * effectiveTarget) {
+        changeLevel(level + 1);
+    }
+}
+
+double AlignmentQualityController::predictLatency(unsigned int level) const {
+    const auto& ladder = getBudgetLadder();
+    return totalLatency(scaleLatency(averageLatency, ladder[this->level], ladder[level]));
+}
+
+unsigned int AlignmentQualityController::getMaxLevel() const {
+    const unsigned int top = getBudgetLadder().size() - 1;
+    switch (thermalState) {
+        case AlignmentThermalState::Fair:
+            return top - 1;
+        case AlignmentThermalState::Serious:
+            return kDefaultLevel - 1;
+        case AlignmentThermalState::Critical:
+            return 0;
+        case AlignmentThermalState::Nominal:
+        default:
+            return top;
+    }
+}
+
+void AlignmentQualityController::changeLevel(unsigned int level) {
+    const auto& ladder = getBudgetLadder();
+    ALIGNMENT_LOG_DEBUG(Pipeline, "alignment budget rung %u -> %u (predicted %.0f ms, success rate %.2f)", this->level, level, hasMeasurements ? predictLatency(level) : 0.0, successRate);
+    averageLatency = scaleLatency(averageLatency, ladder[this->level], ladder[level]);
+    this->level = level;
+    attemptsAtLevel = 0;
+}
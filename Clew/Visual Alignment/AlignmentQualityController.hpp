@@ -0,0 +1,119 @@
+//
+//  AlignmentQualityController.hpp
+//  Clew
+//
+//  Created by OccamLab on 10/19/26.
+//  Copyright © 2026 OccamLab. All rights reserved.
+//
+
+#ifndef AlignmentQualityController_hpp
+#define AlignmentQualityController_hpp
+
+#include <mutex>
+#include <vector>
+
+/**
+ How much work an alignment attempt may do.
+ */
+typedef struct {
+    /// the factor by which to shrink the leveled images before finding features
+    int downSampleFactor;
+    /// the most features to keep in the live image
+    unsigned int maxKeypoints;
+    /// the most RANSAC trials to run
+    unsigned int maxTrials;
+} AlignmentBudget;
+
+/**
+ How long each stage of an alignment attempt took (in milliseconds).
+ */
+typedef struct {
+    /// converting and leveling the images
+    double leveling;
+    /// detecting and describing (or tracking) features
+    double features;
+    /// matching features
+    double matching;
+    /// RANSAC and recovering the pose
+    double solving;
+} AlignmentStageLatency;
+
+/// How hot the device is (the same levels as NSProcessInfoThermalState).
+enum class AlignmentThermalState {
+    Nominal,
+    Fair,
+    Serious,
+    Critical,
+};
+
+/**
+ Picks the budget of each alignment attempt so that attempts take about as long as a target, whatever the device and however hot it is.
+
+ The budgets form a ladder from cheapest to richest.  The controller keeps a moving average of how long each stage takes at the current rung and predicts how long the others would take by scaling each stage by how its work grows (leveling and features with the number of pixels, matching with the number of features in both images, and solving with trials times features).  It moves to the richest rung predicted to fit the target, stepping up one rung at a time and only with some headroom so that it doesn't oscillate.  When attempts keep failing it allows the next rung up even if it is predicted to run somewhat over the target, since a failed attempt is wasted time anyway.  The thermal state caps the rung.
+
+ All of the methods may be called from any thread.
+ */
+class AlignmentQualityController {
+public:
+    /**
+     Create a controller on the default rung.
+
+     - parameters:
+     - targetLatency: How long an attempt should take (in milliseconds).
+     */
+    AlignmentQualityController(double targetLatency = 300.0);
+
+    /// Go back to the default rung and forget the measurements (the target and thermal state are kept).
+    void reset();
+
+    /// Set how long an attempt should take (in milliseconds).
+    void setTargetLatency(double targetLatency);
+
+    /// Set how hot the device is (stepping down right away if the current rung is no longer allowed).
+    void setThermalState(AlignmentThermalState thermalState);
+
+    /// Get the budget for the next attempt.
+    AlignmentBudget getBudget() const;
+
+    /// Get the index of the current rung of getBudgetLadder.
+    unsigned int getLevel() const;
+
+    /// Get the fraction of recent attempts that succeeded.
+    double getSuccessRate() const;
+
+    /// Get the predicted latency of an attempt at the current rung (in milliseconds, or 0 before any attempt was recorded).
+    double getPredictedLatency() const;
+
+    /**
+     Record the outcome of an attempt made with the current budget and pick the budget of the next one.
+
+     - parameters:
+     - latency: How long each stage took.
+     - success: Whether the attempt found a valid alignment.
+     */
+    void recordAttempt(const AlignmentStageLatency& latency, bool success);
+
+    /// Get the budgets the controller chooses between (from cheapest to richest).
+    static const std::vector<AlignmentBudget>& getBudgetLadder();
+
+private:
+    /// predict the latency at a rung from the measurements at the current one
+    double predictLatency(unsigned int level) const;
+    /// the richest rung allowed by the thermal state
+    unsigned int getMaxLevel() const;
+    /// switch rungs, carrying the measurements over with the cost model
+    void changeLevel(unsigned int level);
+
+    mutable std::mutex mutex;
+    double targetLatency;
+    AlignmentThermalState thermalState;
+    unsigned int level;
+    /// the moving averages of each stage at the current rung
+    AlignmentStageLatency averageLatency;
+    double successRate;
+    /// the number of attempts recorded at the current rung
+    unsigned int attemptsAtLevel;
+    bool hasMeasurements;
+};
+
+#endif /* AlignmentQualityController_hpp */
@@ -0,0 +1,421 @@
+//
+//  AlignmentTrace.cpp
+//  Clew
+//
+//  Created by OccamLab on 10/19/26.
+//  Copyright © 2026 OccamLab. All rights reserved.
+//
+
+#include "AlignmentTrace.hpp"
+
+#ifdef CLEW_ALIGNMENT_TRACE
+
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <cstdint>
+#include <cstring>
+#include <fstream>
+#include <map>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <vector>
+
+// perf_event_open only exists on Linux, so elsewhere (e.g., in the app) the counters are left out
+#if defined(CLEW_ALIGNMENT_TRACE_PERF_COUNTERS) && defined(__linux__)
+#define ALIGNMENT_TRACE_USES_PERF_COUNTERS
+#endif
+
+#ifdef ALIGNMENT_TRACE_USES_PERF_COUNTERS
+#include <linux/perf_event.h>
+#include <sys/ioctl.h>
+#include <sys/syscall.h>
+#include <unistd.h>
+#endif
+
+/// the number of events each thread keeps (older ones are overwritten)
+static const uint64_t kTraceBufferCapacity = 8192;
+
+/// the counters that say how many keypoints and RANSAC hypotheses a scope worked on (the hardware counters of a scope are divided by them)
+static const char* kKeypointCounterName = "keypoints";
+static const char* kTrialCounterNames[] = {"ransac trials", "homography trials"};
+
+#ifdef ALIGNMENT_TRACE_USES_PERF_COUNTERS
+/// the hardware counters attached to each traced scope (in the order of kPerfCounterNames)
+static const unsigned int kNumPerfCounters = 5;
+static const char* kPerfCounterNames[kNumPerfCounters] = {"cycles", "instructions", "l1d_read_misses", "llc_read_misses", "branch_misses"};
+/// how deeply traced scopes may nest before the inner ones go without counters
+static const unsigned int kMaxPerfScopeDepth = 32;
+
+/// The hardware counters of the calling thread, read together as one perf_event_open group.
+class PerfCounterGroup {
+public:
+    PerfCounterGroup() : leader(-1), numOpened(0) {
+        const uint64_t cacheReadMiss = (PERF_COUNT_HW_CACHE_OP_READ << 8) | (PERF_COUNT_HW_CACHE_RESULT_MISS << 16);
+        const uint32_t types[kNumPerfCounters] = {PERF_TYPE_HARDWARE, PERF_TYPE_HARDWARE, PERF_TYPE_HW_CACHE, PERF_TYPE_HW_CACHE, PERF_TYPE_HARDWARE};
+        const uint64_t configs[kNumPerfCounters] = {PERF_COUNT_HW_CPU_CYCLES, PERF_COUNT_HW_INSTRUCTIONS, PERF_COUNT_HW_CACHE_L1D | cacheReadMiss, PERF_COUNT_HW_CACHE_LL | cacheReadMiss, PERF_COUNT_HW_BRANCH_MISSES};
+        for (unsigned int i = 0; i < kNumPerfCounters; i++) {
+            perf_event_attr attr;
+            memset(&attr, 0, sizeof(attr));
+            attr.size = sizeof(attr);
+            attr.type = types[i];
+            attr.config = configs[i];
+            attr.read_format = PERF_FORMAT_GROUP;
+            attr.exclude_kernel = 1;
+            attr.exclude_hv = 1;
+            attr.disabled = leader == -1;
+            // this thread, on any CPU
+            const int fd = (int) syscall(SYS_perf_event_open, &attr, 0, -1, leader, 0);
+            if (fd == -1) {
+                // not every counter is available everywhere (e.g., in virtual machines)
+                continue;
+            }
+            if (leader == -1) {
+                leader = fd;
+            }
+            fds[numOpened] = fd;
+            opened[numOpened++] = i;
+        }
+        if (leader != -1) {
+            ioctl(leader, PERF_EVENT_IOC_ENABLE, PERF_IOC_FLAG_GROUP);
+        }
+    }
+    ~PerfCounterGroup() {
+        for (unsigned int i = 0; i < numOpened; i++) {
+            close(fds[i]);
+        }
+    }
+    /**
+     Read the counters.
+     
+     - returns: A mask of the counters that could be read.
+     
+     - parameters:
+     - values: Filled in with the value of each counter (those that couldn't be read are left alone).
+     */
+    unsigned int read(uint64_t values[kNumPerfCounters]) const {
+        uint64_t group[kNumPerfCounters + 1];
+        if (leader == -1 || ::read(leader, group, sizeof(group)) < (ssize_t) (sizeof(uint64_t) * (numOpened + 1))) {
+            return 0;
+        }
+        unsigned int mask = 0;
+        for (unsigned int i = 0; i < numOpened && i < group[0]; i++) {
+            values[opened[i]] = group[i + 1];
+            mask |= 1 << opened[i];
+        }
+        return mask;
+    }
+private:
+    int leader;
+    int fds[kNumPerfCounters];
+    unsigned int opened[kNumPerfCounters];
+    unsigned int numOpened;
+};
+#endif
+
+typedef struct {
+    const char* name;
+    uint64_t timestamp;
+    double value;
+    uint32_t threadId;
+    char phase;
+#ifdef ALIGNMENT_TRACE_USES_PERF_COUNTERS
+    /// for the end of a scope, the counters that were read and how much each grew over the scope
+    unsigned int perfCounterMask;
+    uint64_t perfCounters[kNumPerfCounters];
+#endif
+} TraceEvent;
+
+/**
+ Where a ring buffer keeps an event.  writeAlignmentTrace copies slots while their thread may be overwriting them, so every field is an atomic (accessed with relaxed ordering, which costs no more than a plain store) and the sequence number says which event the slot holds, as in a seqlock.  A copy that overlapped a write doesn't match the sequence number and is thrown away.
+ */
+typedef struct TraceSlot {
+    /// 2 * (the index of the event) + 2 once it is written, and odd while it is being written
+    std::atomic<uint64_t> sequence;
+    std::atomic<const char*> name;
+    std::atomic<uint64_t> timestamp;
+    std::atomic<double> value;
+    std::atomic<uint32_t> threadId;
+    std::atomic<char> phase;
+#ifdef ALIGNMENT_TRACE_USES_PERF_COUNTERS
+    std::atomic<unsigned int> perfCounterMask;
+    std::atomic<uint64_t> perfCounters[kNumPerfCounters];
+#endif
+    TraceSlot() : sequence(0) {}
+} TraceSlot;
+
+/// Store the event with the given index in a slot (only the thread that owns the slot's buffer writes to it).
+static void writeTraceSlot(TraceSlot& slot, uint64_t index, const TraceEvent& event) {
+    slot.sequence.store(2 * index + 1, std::memory_order_relaxed);
+    // keeps the fields from being written before the sequence number says the slot is changing
+    std::atomic_thread_fence(std::memory_order_release);
+    slot.name.store(event.name, std::memory_order_relaxed);
+    slot.timestamp.store(event.timestamp, std::memory_order_relaxed);
+    slot.value.store(event.value, std::memory_order_relaxed);
+    slot.threadId.store(event.threadId, std::memory_order_relaxed);
+    slot.phase.store(event.phase, std::memory_order_relaxed);
+#ifdef ALIGNMENT_TRACE_USES_PERF_COUNTERS
+    slot.perfCounterMask.store(event.perfCounterMask, std::memory_order_relaxed);
+    for (unsigned int i = 0; i < kNumPerfCounters; i++) {
+        slot.perfCounters[i].store(event.perfCounters[i], std::memory_order_relaxed);
+    }
+#endif
+    slot.sequence.store(2 * index + 2, std::memory_order_release);
+}
+
+/**
+ Copy the event with the given index out of a slot (from any thread).
+ 
+ - returns: False if the slot holds another event or was written while it was being copied.
+ */
+static bool readTraceSlot(const TraceSlot& slot, uint64_t index, TraceEvent& event) {
+    if (slot.sequence.load(std::memory_order_acquire) != 2 * index + 2) {
+        return false;
+    }
+    event.name = slot.name.load(std::memory_order_relaxed);
+    event.timestamp = slot.timestamp.load(std::memory_order_relaxed);
+    event.value = slot.value.load(std::memory_order_relaxed);
+    event.threadId = slot.threadId.load(std::memory_order_relaxed);
+    event.phase = slot.phase.load(std::memory_order_relaxed);
+#ifdef ALIGNMENT_TRACE_USES_PERF_COUNTERS
+    event.perfCounterMask = slot.perfCounterMask.load(std::memory_order_relaxed);
+    for (unsigned int i = 0; i < kNumPerfCounters; i++) {
+        event.perfCounters[i] = slot.perfCounters[i].load(std::memory_order_relaxed);
+    }
+#endif
+    // keeps the fields from being read after the sequence number is checked again
+    std::atomic_thread_fence(std::memory_order_acquire);
+    return slot.sequence.load(std::memory_order_relaxed) == 2 * index + 2;
+}
+
+/// The events of one thread.  Only the owning thread writes to it.
+typedef struct TraceBuffer {
+    TraceSlot slots[kTraceBufferCapacity];
+    /// the number of events ever written (the newest is at (count - 1) % capacity)
+    std::atomic<uint64_t> count;
+    /// the count when the trace was last cleared (earlier events aren't exported)
+    std::atomic<uint64_t> clearedCount;
+    uint32_t threadId;
+    TraceBuffer() : count(0), clearedCount(0), threadId(0) {}
+} TraceBuffer;
+
+/// Every buffer that has been handed out (buffers of threads that have exited are reused rather than freed).
+static std::mutex trace_buffers_mutex;
+static std::vector<std::unique_ptr<TraceBuffer> > trace_buffers;
+static std::vector<TraceBuffer*> free_trace_buffers;
+static std::atomic<uint32_t> next_trace_thread_id(1);
+static const auto trace_start = std::chrono::steady_clock::now();
+
+/// Claims a buffer the first time a thread records an event and gives it back when the thread exits.
+class TraceBufferOwner {
+public:
+    TraceBufferOwner() {
+        std::lock_guard<std::mutex> lock(trace_buffers_mutex);
+        if (free_trace_buffers.empty()) {
+            trace_buffers.emplace_back(new TraceBuffer());
+            buffer = trace_buffers.back().get();
+        } else {
+            buffer = free_trace_buffers.back();
+            free_trace_buffers.pop_back();
+        }
+        buffer->threadId = next_trace_thread_id++;
+#ifdef ALIGNMENT_TRACE_USES_PERF_COUNTERS
+        depth = 0;
+#endif
+    }
+    ~TraceBufferOwner() {
+        std::lock_guard<std::mutex> lock(trace_buffers_mutex);
+        free_trace_buffers.push_back(buffer);
+    }
+    TraceBuffer* buffer;
+#ifdef ALIGNMENT_TRACE_USES_PERF_COUNTERS
+    PerfCounterGroup perfCounters;
+    /// the counters at the start of each open scope
+    unsigned int depth;
+    unsigned int startMasks[kMaxPerfScopeDepth];
+    uint64_t startCounters[kMaxPerfScopeDepth][kNumPerfCounters];
+#endif
+};
+
+void recordAlignmentTraceEvent(const char* name, char phase, double value) {
+    thread_local TraceBufferOwner owner;
+    TraceBuffer& buffer = *owner.buffer;
+    const uint64_t index = buffer.count.load(std::memory_order_relaxed);
+    TraceEvent event;
+    event.name = name;
+    event.timestamp = std::chrono::duration_cast<std::chrono::nanoseconds>(std::chrono::steady_clock::now() - trace_start).count();
+    event.value = value;
+    event.threadId = buffer.threadId;
+    event.phase = phase;
+#ifdef ALIGNMENT_TRACE_USES_PERF_COUNTERS
+    event.perfCounterMask = 0;
+    if (phase == 'B') {
+        if (owner.depth < kMaxPerfScopeDepth) {
+            owner.startMasks[owner.depth] = owner.perfCounters.read(owner.startCounters[owner.depth]);
+        }
+        owner.depth++;
+    } else if (phase == 'E' && owner.depth > 0) {
+        owner.depth--;
+        if (owner.depth < kMaxPerfScopeDepth) {
+            event.perfCounterMask = owner.perfCounters.read(event.perfCounters) & owner.startMasks[owner.depth];
+            for (unsigned int i = 0; i < kNumPerfCounters; i++) {
+                event.perfCounters[i] -= owner.startCounters[owner.depth][i];
+            }
+        }
+    }
+#endif
+    writeTraceSlot(buffer.slots[index % kTraceBufferCapacity], index, event);
+    buffer.count.store(index + 1, std::memory_order_release);
+}
+
+/// A scope whose beginning has been exported but not its end.
+typedef struct {
+    const char* name;
+    uint64_t timestamp;
+    /// the keypoints and RANSAC trials counted on the same thread inside the scope so far
+    double keypoints;
+    double trials;
+} OpenTraceScope;
+
+/// The totals over every exported scope with the same name.
+typedef struct {
+    unsigned int calls;
+    double milliseconds;
+    double keypoints;
+    double trials;
+#ifdef ALIGNMENT_TRACE_USES_PERF_COUNTERS
+    /// for each hardware counter, the calls it was read for and their totals (not every counter is read for every call)
+    unsigned int perfCalls[kNumPerfCounters];
+    double perfCounters[kNumPerfCounters];
+    double perfKeypoints[kNumPerfCounters];
+    double perfTrials[kNumPerfCounters];
+#endif
+} TraceScopeSummary;
+
+/// Write the counts of a scope and, where they are known, the counts per keypoint and per trial as JSON members.
+static void writeNormalizedCount(std::ofstream& file, const char* name, double count, double calls, double keypoints, double trials) {
+    file << "\"" << name << "\":" << count;
+    if (calls > 0) {
+        file << ",\"" << name << "_per_call\":" << count / calls;
+    }
+    if (keypoints > 0) {
+        file << ",\"" << name << "_per_keypoint\":" << count / keypoints;
+    }
+    if (trials > 0) {
+        file << ",\"" << name << "_per_trial\":" << count / trials;
+    }
+}
+
+bool writeAlignmentTrace(const std::string& path) {
+    std::ofstream file(path);
+    if (!file) {
+        return false;
+    }
+    file << "{\"displayTimeUnit\":\"ms\",\"traceEvents\":[";
+    bool isFirst = true;
+    std::map<std::string, TraceScopeSummary> summaries;
+    std::lock_guard<std::mutex> lock(trace_buffers_mutex);
+    for (const auto& buffer : trace_buffers) {
+        const uint64_t end = buffer->count.load(std::memory_order_acquire);
+        const uint64_t start = std::max(end > kTraceBufferCapacity ? end - kTraceBufferCapacity : 0, buffer->clearedCount.load(std::memory_order_relaxed));
+        // the scopes open on the thread (a buffer is only reused once its thread has exited, so they are reset when the thread changes)
+        std::vector<OpenTraceScope> openScopes;
+        uint32_t threadId = 0;
+        for (uint64_t i = start; i < end; i++) {
+            TraceEvent event;
+            if (!readTraceSlot(buffer->slots[i % kTraceBufferCapacity], i, event)) {
+                // the owner has wrapped around onto it since we read the count
+                continue;
+            }
+            if (event.threadId != threadId) {
+                openScopes.clear();
+                threadId = event.threadId;
+            }
+            file << (isFirst ? "" : ",") << "\n{\"name\":\"" << event.name << "\",\"ph\":\"" << event.phase << "\",\"ts\":" << event.timestamp / 1000.0 << ",\"pid\":1,\"tid\":" << event.threadId;
+            isFirst = false;
+            if (event.phase == 'B') {
+                openScopes.push_back({event.name, event.timestamp, 0, 0});
+            } else if (event.phase == 'C') {
+                file << ",\"args\":{\"value\":" << event.value << "}";
+                const bool isKeypoints = strcmp(event.name, kKeypointCounterName) == 0;
+                const bool isTrials = std::any_of(std::begin(kTrialCounterNames), std::end(kTrialCounterNames), [&](const char* name) {
+                    return strcmp(event.name, name) == 0;
+                });
+                for (auto& scope : openScopes) {
+                    scope.keypoints += isKeypoints ? event.value : 0;
+                    scope.trials += isTrials ? event.value : 0;
+                }
+            } else if (event.phase == 'E' && !openScopes.empty()) {
+                // (if its beginning was overwritten, there is nothing to add up)
+                const OpenTraceScope scope = openScopes.back();
+                openScopes.pop_back();
+                TraceScopeSummary& summary = summaries.emplace(scope.name, TraceScopeSummary()).first->second;
+                summary.calls++;
+                summary.milliseconds += (event.timestamp - scope.timestamp) / 1e6;
+                summary.keypoints += scope.keypoints;
+                summary.trials += scope.trials;
+#ifdef ALIGNMENT_TRACE_USES_PERF_COUNTERS
+                if (event.perfCounterMask) {
+                    // arguments of the end of a scope are shown along with the scope
+                    file << ",\"args\":{";
+                    bool isFirstCounter = true;
+                    for (unsigned int c = 0; c < kNumPerfCounters; c++) {
+                        if (event.perfCounterMask & (1 << c)) {
+                            file << (isFirstCounter ? "" : ",");
+                            writeNormalizedCount(file, kPerfCounterNames[c], event.perfCounters[c], 0, scope.keypoints, scope.trials);
+                            isFirstCounter = false;
+                            summary.perfCalls[c]++;
+                            summary.perfCounters[c] += event.perfCounters[c];
+                            summary.perfKeypoints[c] += scope.keypoints;
+                            summary.perfTrials[c] += scope.trials;
+                        }
+                    }
+                    file << "}";
+                }
+#endif
+            }
+            file << "}";
+        }
+    }
+    // the totals of each scope go next to the events, so that runs of different sizes can be compared without adding up the trace
+    file << "\n],\"alignmentScopes\":{";
+    bool isFirstSummary = true;
+    for (const auto& entry : summaries) {
+        const TraceScopeSummary& summary = entry.second;
+        file << (isFirstSummary ? "" : ",") << "\n\"" << entry.first << "\":{\"calls\":" << summary.calls << ",";
+        writeNormalizedCount(file, "milliseconds", summary.milliseconds, summary.calls, summary.keypoints, summary.trials);
+        file << ",\"keypoints\":" << summary.keypoints << ",\"trials\":" << summary.trials;
+#ifdef ALIGNMENT_TRACE_USES_PERF_COUNTERS
+        for (unsigned int c = 0; c < kNumPerfCounters; c++) {
+            if (summary.perfCalls[c] > 0) {
+                file << ",";
+                writeNormalizedCount(file, kPerfCounterNames[c], summary.perfCounters[c], summary.perfCalls[c], summary.perfKeypoints[c], summary.perfTrials[c]);
+            }
+        }
+#endif
+        file << "}";
+        isFirstSummary = false;
+    }
+    file << "\n}}\n";
+    return (bool) file;
+}
+
+void clearAlignmentTrace() {
+    std::lock_guard<std::mutex> lock(trace_buffers_mutex);
+    for (const auto& buffer : trace_buffers) {
+        // only the owning thread writes the count, so just skip past the current events
+        buffer->clearedCount.store(buffer->count.load(std::memory_order_acquire), std::memory_order_relaxed);
+    }
+}
+
+#else
+
+bool writeAlignmentTrace(const std::string& path) {
+    return false;
+}
+
+void clearAlignmentTrace() {
+}
+
+#endif
@@ -0,0 +1,80 @@
+//
+//  AlignmentTrace.hpp
+//  Clew
+//
+//  Created by OccamLab on 10/19/26.
+//  Copyright © 2026 OccamLab. All rights reserved.
+//
+
+#ifndef AlignmentTrace_hpp
+#define AlignmentTrace_hpp
+
+#include <string>
+
+/**
+ Tracing for the alignment core.
+ 
+ Build with CLEW_ALIGNMENT_TRACE defined (e.g., add CLEW_ALIGNMENT_TRACE=1 to the preprocessor macros) to record when each traced scope starts and ends and the values of traced counters.  Each thread records into its own ring buffer without taking any locks, and the events of all threads can be written out in the Chrome Trace Event format to be opened with chrome://tracing or Perfetto.
+ 
+ Without CLEW_ALIGNMENT_TRACE the macros expand to nothing.
+ 
+ The exported trace also sums up every scope by name next to the events: how often it ran, how long it took in all and per call, and the keypoints and RANSAC trials counted inside it (by the "keypoints", "ransac trials" and "homography trials" counters of the same thread), with the time divided by each.
+ 
+ On Linux, also defining CLEW_ALIGNMENT_TRACE_PERF_COUNTERS attaches the cycles, instructions, L1 data and last level cache read misses, and branch misses of the tracing thread over each scope (read with perf_event_open) to the end of that scope, both as they are and divided by the keypoints and trials counted inside the scope, and adds them to the sums.  Only the tracing thread is counted, so run with a single worker to measure work spread over the worker pool.  The define is ignored on other platforms.
+ */
+
+#ifdef CLEW_ALIGNMENT_TRACE
+
+#define ALIGNMENT_TRACE_CONCAT_INNER(a, b) a##b
+#define ALIGNMENT_TRACE_CONCAT(a, b) ALIGNMENT_TRACE_CONCAT_INNER(a, b)
+/// Trace the rest of the enclosing scope (name must be a string literal).
+#define ALIGNMENT_TRACE_SCOPE(name) AlignmentTraceScope ALIGNMENT_TRACE_CONCAT(alignment_trace_scope_, __LINE__)(name)
+/// Record the value of a counter (name must be a string literal).
+#define ALIGNMENT_TRACE_COUNTER(name, value) recordAlignmentTraceEvent(name, 'C', (double) (value))
+
+/**
+ Record an event on the calling thread.
+ 
+ - parameters:
+ - name: The name of the event (this has to outlive the trace, so use a string literal).
+ - phase: 'B' to begin a scope, 'E' to end it, or 'C' for a counter.
+ - value: The value of a counter.
+ */
+void recordAlignmentTraceEvent(const char* name, char phase, double value = 0);
+
+/// Records the beginning and the end of a scope.
+class AlignmentTraceScope {
+public:
+    AlignmentTraceScope(const char* name) : name(name) {
+        recordAlignmentTraceEvent(name, 'B');
+    }
+    ~AlignmentTraceScope() {
+        recordAlignmentTraceEvent(name, 'E');
+    }
+    AlignmentTraceScope(const AlignmentTraceScope&) = delete;
+    AlignmentTraceScope& operator=(const AlignmentTraceScope&) = delete;
+private:
+    const char* name;
+};
+
+#else
+
+#define ALIGNMENT_TRACE_SCOPE(name) ((void) 0)
+#define ALIGNMENT_TRACE_COUNTER(name, value) ((void) 0)
+
+#endif
+
+/**
+ Write the events recorded by every thread as Chrome Trace Event JSON.  Events recorded while this runs may be left out.
+ 
+ - returns: False if the file couldn't be written or tracing wasn't compiled in.
+ 
+ - parameters:
+ - path: The file to write.
+ */
+bool writeAlignmentTrace(const std::string& path);
+
+/// Throw away the events recorded so far.
+void clearAlignmentTrace();
+
+#endif /* AlignmentTrace_hpp */
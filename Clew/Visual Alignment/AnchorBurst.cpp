@@ -0,0 +1,211 @@
+//
+//  AnchorBurst.cpp
+//  Clew
+//
+//  Created by OccamLab on 10/19/26.
+//  Copyright © 2026 OccamLab. All rights reserved.
+//
+
+#include "AnchorBurst.hpp"
+#include "AlignmentTrace.hpp"
+#include "AlignmentLog.hpp"
+#include <algorithm>
+#include <atomic>
+
+/// the grid over the leveled image that the spread of the features is measured on
+static const int kSpreadCellsAcross = 4;
+static const int kSpreadCellsDown = 4;
+/// the fewest features for a cell of the grid to count as covered
+static const unsigned int kMinFeaturesPerCell = 5;
+
+AnchorBurst::AnchorBurst(WorkerPool* pool) : pool(pool), downSampleFactor(2), backend(FeatureBackendType::AKAZE), maxCandidates(8), running(false) {
+}
+
+AnchorBurst::~AnchorBurst() {
+    reset();
+}
+
+void AnchorBurst::start(int downSampleFactor, FeatureBackendType backend, unsigned int maxCandidates) {
+    reset();
+    this->downSampleFactor = downSampleFactor;
+    this->backend = backend;
+    this->maxCandidates = std::max(1u, maxCandidates);
+    running = true;
+    scoringThread = std::thread(&AnchorBurst::scoringLoop, this);
+}
+
+bool AnchorBurst::add(AnchorCandidate candidate) {
+    {
+        std::lock_guard<std::mutex> lock(mutex);
+        if (!running) {
+            return false;
+        }
+    }
+    auto entry = std::make_shared<Entry>();
+    // The cheap checks need the poses in order, so they are done now rather than when the candidate is scored.
+    qualityGate.addPose(candidate.pose, candidate.timestamp);
+    entry->quality = qualityGate.evaluate(candidate.luma, candidate.pose, candidate.timestamp);
+    entry->candidate = std::move(candidate);
+    entry->featureSpread = 0;
+    entry->scored = false;
+    std::lock_guard<std::mutex> lock(mutex);
+    entries.push_back(entry);
+    while (entries.size() > maxCandidates) {
+        // the scoring thread keeps its own reference if it is working on it
+        entries.pop_front();
+    }
+    changed.notify_all();
+    return true;
+}
+
+void AnchorBurst::scoringLoop() {
+    std::unique_lock<std::mutex> lock(mutex);
+    while (true) {
+        std::vector<std::shared_ptr<Entry>> batch;
+        changed.wait(lock, [&] {
+            batch.clear();
+            for (const auto& entry : entries) {
+                if (!entry->scored) {
+                    batch.push_back(entry);
+                }
+            }
+            return !running || !batch.empty();
+        });
+        if (batch.empty()) {
+            return;
+        }
+        lock.unlock();
+        ALIGNMENT_TRACE_SCOPE("AnchorBurst::score");
+        if (pool) {
+            std::atomic<unsigned int> next(0);
+            pool->run([&](unsigned int) {
+                for (unsigned int i = next++; i < batch.size(); i = next++) {
+                    scoreEntry(*batch[i]);
+                }
+            });
+        } else {
+            for (const auto& entry : batch) {
+                scoreEntry(*entry);
+            }
+        }
+        lock.lock();
+        for (const auto& entry : batch) {
+            entry->scored = true;
+        }
+        changed.notify_all();
+    }
+}
+
+void AnchorBurst::scoreEntry(Entry& entry) const {
+    const AnchorCandidate& candidate = entry.candidate;
+    entry.view.leveled = levelImage(candidate.luma, candidate.intrinsics, candidate.pose, downSampleFactor);
+    // each candidate is scored on a single worker, so its features are extracted without tiling
+    entry.view.features = getKeyPointsAndDescriptors(entry.view.leveled.image, backend);
+    entry.view.overlapDescriptors = selectOverlapDescriptors(entry.view.features);
+
+    const cv::Size size = entry.view.leveled.image.size();
+    std::vector<unsigned int> cellFeatures(kSpreadCellsAcross * kSpreadCellsDown, 0);
+    for (const auto& keypoint : entry.view.features.keypoints) {
+        const int column = std::min(kSpreadCellsAcross - 1, std::max(0, (int) (keypoint.pt.x * kSpreadCellsAcross / size.width)));
+        const int row = std::min(kSpreadCellsDown - 1, std::max(0, (int) (keypoint.pt.y * kSpreadCellsDown / size.height)));
+        cellFeatures[row * kSpreadCellsAcross + column]++;
+    }
+    entry.featureSpread = std::count_if(cellFeatures.begin(), cellFeatures.end(), [](unsigned int count) {
+        return count >= kMinFeaturesPerCell;
+    }) / (float) cellFeatures.size();
+}
+
+void AnchorBurst::stopScoring() {
+    {
+        std::lock_guard<std::mutex> lock(mutex);
+        running = false;
+        changed.notify_all();
+    }
+    if (scoringThread.joinable()) {
+        scoringThread.join();
+    }
+}
+
+std::vector<AnchorCandidateScore> AnchorBurst::finish() {
+    ALIGNMENT_TRACE_SCOPE("AnchorBurst::finish");
+    // the scoring thread finishes the candidates that are left before it stops
+    stopScoring();
+    const unsigned int numCandidates = entries.size();
+    std::vector<AnchorCandidateScore> scores(numCandidates);
+    if (numCandidates == 0) {
+        return scores;
+    }
+
+    // Candidates a moment apart see nearly the same thing, so a feature that isn't found again in the others is unlikely to be matched later either.
+    const int normType = getDescriptorNorm(backend);
+    auto scoreMatchability = [&](unsigned int i) {
+        const cv::Mat& descriptors = entries[i]->view.overlapDescriptors;
+        if (numCandidates == 1 || descriptors.rows == 0) {
+            scores[i].matchability = numCandidates == 1 ? 1 : 0;
+            return;
+        }
+        double found = 0;
+        for (unsigned int j = 0; j < numCandidates; j++) {
+            if (j != i) {
+                found += estimateAnchorViewOverlap(descriptors, entries[j]->view.overlapDescriptors, normType);
+            }
+        }
+        scores[i].matchability = found / ((numCandidates - 1) * descriptors.rows);
+    };
+    if (pool) {
+        std::atomic<unsigned int> next(0);
+        pool->run([&](unsigned int) {
+            for (unsigned int i = next++; i < numCandidates; i = next++) {
+                scoreMatchability(i);
+            }
+        });
+    } else {
+        for (unsigned int i = 0; i < numCandidates; i++) {
+            scoreMatchability(i);
+        }
+    }
+
+    float maxSharpness = 0;
+    for (unsigned int i = 0; i < numCandidates; i++) {
+        const FrameQuality& quality = entries[i]->quality;
+        scores[i].candidate = i;
+        scores[i].quality = quality;
+        scores[i].sharpness = quality.gradientEnergy > 0 ? quality.laplacianVariance / quality.gradientEnergy : 0;
+        scores[i].featureSpread = entries[i]->featureSpread;
+        maxSharpness = std::max(maxSharpness, scores[i].sharpness);
+    }
+    for (auto& score : scores) {
+        score.score = score.featureSpread * score.matchability * (maxSharpness > 0 ? score.sharpness / maxSharpness : 0);
+    }
+    // ties go to the earlier candidate
+    std::stable_sort(scores.begin(), scores.end(), [](const AnchorCandidateScore& a, const AnchorCandidateScore& b) {
+        if (a.quality.is_usable != b.quality.is_usable) {
+            return a.quality.is_usable;
+        }
+        return a.score > b.score;
+    });
+    ALIGNMENT_LOG_INFO(Features, "picked anchor candidate %u of %u (score %f, sharpness %f, spread %f, matchability %f)", scores[0].candidate, numCandidates, scores[0].score, scores[0].sharpness, scores[0].featureSpread, scores[0].matchability);
+    return scores;
+}
+
+void AnchorBurst::reset() {
+    {
+        std::lock_guard<std::mutex> lock(mutex);
+        // the scoring thread stops without finishing what is left
+        entries.clear();
+    }
+    stopScoring();
+}
+
+unsigned int AnchorBurst::size() const {
+    std::lock_guard<std::mutex> lock(mutex);
+    return entries.size();
+}
+
+const AnchorCandidate& AnchorBurst::getCandidate(unsigned int candidate) const {
+    return entries[candidate]->candidate;
+}
+
+const AnchorView& AnchorBurst::getView(unsigned int candidate) const {
+    return entries[candidate]->view;
+}
@@ -0,0 +1,141 @@
+//
+//  AnchorBurst.hpp
+//  Clew
+//
+//  Created by OccamLab on 10/19/26.
+//  Copyright © 2026 OccamLab. All rights reserved.
+//
+
+#ifndef AnchorBurst_hpp
+#define AnchorBurst_hpp
+
+#include <opencv2/opencv.hpp>
+#include <Eigen/Core>
+#include <condition_variable>
+#include <deque>
+#include <memory>
+#include <mutex>
+#include <thread>
+#include <vector>
+#include "FrameQuality.hpp"
+#include "AnchorViews.hpp"
+#include "WorkerPool.hpp"
+
+/**
+ A frame captured while an anchor point is being recorded, any of which could become the anchor image.
+ */
+typedef struct {
+    /// the luma plane as captured (landscape)
+    cv::Mat luma;
+    /// the interleaved CbCr plane at half the resolution of the luma plane (empty if only the luma plane was kept)
+    cv::Mat chroma;
+    Eigen::Matrix3f intrinsics;
+    Eigen::Matrix4f pose;
+    double timestamp;
+} AnchorCandidate;
+
+/**
+ How good an anchor image a candidate would make.
+ */
+typedef struct {
+    /// the index of the candidate (in the order they were added, counting only those still kept)
+    unsigned int candidate;
+    /// the checks of FrameQualityGate, including how fast the phone was moving between candidates
+    FrameQuality quality;
+    /// the ratio of the variance of the Laplacian to the gradient energy, which drops as blur smears out edges
+    float sharpness;
+    /// the fraction of the cells of a grid over the leveled image that have a few features in them
+    float featureSpread;
+    /// the fraction of the strongest features that are found again in the other candidates (features that come and go between nearly identical frames won't be matched later either)
+    float matchability;
+    /// the product of the feature spread, the matchability, and the sharpness relative to the sharpest candidate
+    float score;
+} AnchorCandidateScore;
+
+/**
+ Picks the anchor image from a burst of frames rather than taking whichever frame happened to be current when the anchor point was recorded, which may be blurred or badly composed and then makes every later alignment to it fail.
+
+ Candidates are leveled, have their features extracted, and are scored on a thread of the burst's own as they arrive, several at a time on the worker pool, so by the time the burst is finished only the comparison of the candidates with each other is left.  The features of the candidates that are kept are the ones alignment would use (see getView).
+ */
+class AnchorBurst {
+public:
+    /**
+     Create an empty burst.
+
+     - parameters:
+     - pool: The workers to score candidates on (may be null).
+     */
+    AnchorBurst(WorkerPool* pool);
+    ~AnchorBurst();
+
+    AnchorBurst(const AnchorBurst&) = delete;
+    AnchorBurst& operator=(const AnchorBurst&) = delete;
+
+    /**
+     Start a new burst, throwing away any candidates there already were.
+
+     - parameters:
+     - downSampleFactor: The factor the leveled candidates are shrunk by (the same as for alignment, so the features are the ones alignment will use).
+     - backend: The feature detector and descriptor to use.
+     - maxCandidates: How many of the newest candidates to keep.
+     */
+    void start(int downSampleFactor, FeatureBackendType backend, unsigned int maxCandidates = 8);
+
+    /**
+     Add a candidate to the burst, dropping the oldest one if there are already maxCandidates.  This only queues the candidate for scoring.
+
+     - returns: False if the burst wasn't started.
+
+     - parameters:
+     - candidate: The frame.
+     */
+    bool add(AnchorCandidate candidate);
+
+    /**
+     Wait for the candidates to be scored and rank them.  The burst stops taking candidates, but they are kept until the next call of start or reset.
+
+     - returns: The scores of the candidates, best first (those that fail the checks of FrameQualityGate come after all of those that pass).
+     */
+    std::vector<AnchorCandidateScore> finish();
+
+    /// Stop scoring and forget the candidates.
+    void reset();
+
+    /// the number of candidates kept
+    unsigned int size() const;
+
+    /// a candidate (only after finish)
+    const AnchorCandidate& getCandidate(unsigned int candidate) const;
+
+    /// the leveled image and features of a candidate (only after finish)
+    const AnchorView& getView(unsigned int candidate) const;
+
+private:
+    typedef struct {
+        AnchorCandidate candidate;
+        FrameQuality quality;
+        AnchorView view;
+        float featureSpread;
+        bool scored;
+    } Entry;
+
+    void scoringLoop();
+    /// Level, extract the features of, and score one entry (on one thread of the pool).
+    void scoreEntry(Entry& entry) const;
+    void stopScoring();
+
+    WorkerPool* pool;
+    int downSampleFactor;
+    FeatureBackendType backend;
+    unsigned int maxCandidates;
+    /// measures the motion between candidates (it is only used by add, which is called in order)
+    FrameQualityGate qualityGate;
+    /// guards everything below
+    mutable std::mutex mutex;
+    std::condition_variable changed;
+    std::deque<std::shared_ptr<Entry>> entries;
+    bool running;
+    std::thread scoringThread;
+};
+
+#endif /* AnchorBurst_hpp */
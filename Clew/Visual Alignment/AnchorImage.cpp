@@ -0,0 +1,51 @@
+//
+//  AnchorImage.cpp
+//  Clew
+//
+//  Created by OccamLab on 10/19/26.
+//  Copyright © 2026 OccamLab. All rights reserved.
+//
+
+#include "AnchorImage.hpp"
+#include "AlignmentTrace.hpp"
+#include "AlignmentLog.hpp"
+#include <algorithm>
+
+/// the largest reduction OpenCV can decode to
+static const int kMaxAnchorReduction = 8;
+
+bool loadAnchorImage(const std::string& path, const Eigen::Matrix3f& intrinsics, int downSampleFactor, AnchorImage& anchor) {
+    ALIGNMENT_TRACE_SCOPE("loadAnchorImage");
+    int reduction = 1;
+    while (reduction < kMaxAnchorReduction && downSampleFactor % (2*reduction) == 0) {
+        reduction *= 2;
+    }
+    int flags = cv::IMREAD_GRAYSCALE;
+    switch (reduction) {
+        case 2:
+            flags = cv::IMREAD_REDUCED_GRAYSCALE_2;
+            break;
+        case 4:
+            flags = cv::IMREAD_REDUCED_GRAYSCALE_4;
+            break;
+        case 8:
+            flags = cv::IMREAD_REDUCED_GRAYSCALE_8;
+            break;
+    }
+    anchor.image = cv::imread(path, flags);
+    if (anchor.image.empty()) {
+        ALIGNMENT_LOG_WARNING(Features, "couldn't decode the anchor image %s", path.c_str());
+        return false;
+    }
+    anchor.reduction = reduction;
+    // pixel i of the reduced image covers pixels reduction*i through reduction*(i + 1) - 1 of the stored one
+    anchor.intrinsics = intrinsics;
+    anchor.intrinsics.topRows(2) /= reduction;
+    anchor.intrinsics(0, 2) += 0.5f/reduction - 0.5f;
+    anchor.intrinsics(1, 2) += 0.5f/reduction - 0.5f;
+    return true;
+}
+
+LeveledImage levelAnchorImage(const AnchorImage& anchor, const Eigen::Matrix4f& pose, int downSampleFactor) {
+    return levelImage(anchor.image, anchor.intrinsics, pose, std::max(1, downSampleFactor / anchor.reduction));
+}
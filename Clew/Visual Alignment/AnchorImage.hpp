@@ -0,0 +1,54 @@
+//
+//  AnchorImage.hpp
+//  Clew
+//
+//  Created by OccamLab on 10/19/26.
+//  Copyright © 2026 OccamLab. All rights reserved.
+//
+
+#ifndef AnchorImage_hpp
+#define AnchorImage_hpp
+
+#include <opencv2/opencv.hpp>
+#include <Eigen/Core>
+#include <string>
+#include "UprightAlignment.hpp"
+
+/**
+ A stored anchor image decoded straight to grayscale at a reduced resolution.
+ */
+typedef struct {
+    /// the grayscale image as captured (landscape), shrunk by reduction
+    cv::Mat image;
+    /// the intrinsics of the shrunk image
+    Eigen::Matrix3f intrinsics;
+    /// how many times smaller the image is than the one that was stored (1, 2, 4, or 8)
+    int reduction;
+} AnchorImage;
+
+/**
+ Decode a stored anchor image for leveling.  The image is leveled and then downsampled anyway, so it is decoded straight to grayscale at the largest reduction that divides the downsampling (JPEGs are scaled in the DCT domain by libjpeg, so the full color image is never held in memory).
+ 
+ - returns: False if the image couldn't be read.
+ 
+ - parameters:
+ - path: The JPEG or PNG file.
+ - intrinsics: The intrinsics of the camera that captured the stored image.
+ - downSampleFactor: The factor the leveled image will be shrunk by.
+ - anchor: Filled in with the decoded image.
+ */
+bool loadAnchorImage(const std::string& path, const Eigen::Matrix3f& intrinsics, int downSampleFactor, AnchorImage& anchor);
+
+/**
+ Level a decoded anchor image (see levelImage).
+ 
+ - returns: The leveled image (downsampled by downSampleFactor relative to the stored image).
+ 
+ - parameters:
+ - anchor: The decoded anchor image.
+ - pose: The pose of the camera that captured the image.
+ - downSampleFactor: The factor by which to shrink the stored image.
+ */
+LeveledImage levelAnchorImage(const AnchorImage& anchor, const Eigen::Matrix4f& pose, int downSampleFactor);
+
+#endif /* AnchorImage_hpp */
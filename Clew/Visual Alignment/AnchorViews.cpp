@@ -0,0 +1,118 @@
+//
+//  AnchorViews.cpp
+//  Clew
+//
+//  Created by OccamLab on 10/19/26.
+//  Copyright © 2026 OccamLab. All rights reserved.
+//
+
+#include "AnchorViews.hpp"
+#include "AnchorImage.hpp"
+#include "AlignmentTrace.hpp"
+#include "AlignmentLog.hpp"
+#include <algorithm>
+#include <atomic>
+#include <numeric>
+
+/// how the leveled, downsampled views are split up for feature extraction
+static const unsigned int kViewTilesAcross = 2;
+static const unsigned int kViewTilesDown = 2;
+
+cv::Mat selectOverlapDescriptors(const KeyPointsAndDescriptors& features, unsigned int maxFeatures) {
+    if (features.keypoints.size() <= maxFeatures) {
+        return features.descriptors;
+    }
+    std::vector<int> strongest(features.keypoints.size());
+    std::iota(strongest.begin(), strongest.end(), 0);
+    std::partial_sort(strongest.begin(), strongest.begin() + maxFeatures, strongest.end(), [&](int a, int b) {
+        return features.keypoints[a].response > features.keypoints[b].response;
+    });
+    cv::Mat descriptors;
+    for (unsigned int i = 0; i < maxFeatures; i++) {
+        descriptors.push_back(features.descriptors.row(strongest[i]));
+    }
+    return descriptors;
+}
+
+int estimateAnchorViewOverlap(const cv::Mat& viewOverlapDescriptors, const cv::Mat& liveOverlapDescriptors, int normType) {
+    // the ratio test needs two neighbors
+    if (viewOverlapDescriptors.empty() || liveOverlapDescriptors.rows < 2) {
+        return 0;
+    }
+    return getMatches(viewOverlapDescriptors, liveOverlapDescriptors, normType).size();
+}
+
+AnchorViewSet::AnchorViewSet() : downSampleFactor(1), hasFeatures(false), featureBackend(FeatureBackendType::AKAZE) {
+}
+
+void AnchorViewSet::reset() {
+    views.clear();
+    hasFeatures = false;
+}
+
+bool AnchorViewSet::load(const std::vector<std::string>& paths, const std::vector<Eigen::Matrix3f>& intrinsics, const std::vector<Eigen::Matrix4f>& poses, int downSampleFactor) {
+    ALIGNMENT_TRACE_SCOPE("AnchorViewSet::load");
+    reset();
+    std::vector<AnchorView> loadedViews(paths.size());
+    for (unsigned int i = 0; i < paths.size(); i++) {
+        AnchorImage image;
+        if (!loadAnchorImage(paths[i], intrinsics[i], downSampleFactor, image)) {
+            return false;
+        }
+        loadedViews[i].leveled = levelAnchorImage(image, poses[i], downSampleFactor);
+    }
+    views.swap(loadedViews);
+    this->downSampleFactor = downSampleFactor;
+    ALIGNMENT_LOG_INFO(Features, "loaded %zu anchor views", views.size());
+    return true;
+}
+
+unsigned int AnchorViewSet::size() const {
+    return views.size();
+}
+
+int AnchorViewSet::getDownSampleFactor() const {
+    return downSampleFactor;
+}
+
+void AnchorViewSet::extractFeatures(FeatureBackendType backend, WorkerPool& pool) {
+    if (hasFeatures && featureBackend == backend) {
+        return;
+    }
+    ALIGNMENT_TRACE_SCOPE("AnchorViewSet::extractFeatures");
+    std::vector<cv::Mat> images;
+    for (const auto& view : views) {
+        images.push_back(view.leveled.image);
+    }
+    const auto features = getKeyPointsAndDescriptorsTiled(images, backend, pool, kViewTilesAcross, kViewTilesDown);
+    for (unsigned int i = 0; i < views.size(); i++) {
+        views[i].features = features[i];
+        views[i].overlapDescriptors = selectOverlapDescriptors(features[i]);
+    }
+    hasFeatures = true;
+    featureBackend = backend;
+}
+
+const AnchorView& AnchorViewSet::getView(unsigned int view, FeatureBackendType backend, WorkerPool& pool) {
+    extractFeatures(backend, pool);
+    return views[view];
+}
+
+std::vector<AnchorViewOverlap> AnchorViewSet::rank(const cv::Mat& liveOverlapDescriptors, FeatureBackendType backend, WorkerPool& pool) {
+    ALIGNMENT_TRACE_SCOPE("AnchorViewSet::rank");
+    extractFeatures(backend, pool);
+    const int normType = getDescriptorNorm(backend);
+    std::vector<AnchorViewOverlap> overlaps(views.size());
+    std::atomic<unsigned int> nextView(0);
+    pool.run([&](unsigned int) {
+        for (unsigned int i = nextView++; i < views.size(); i = nextView++) {
+            overlaps[i].view = i;
+            overlaps[i].overlap = estimateAnchorViewOverlap(views[i].overlapDescriptors, liveOverlapDescriptors, normType);
+        }
+    });
+    // ties go to the earlier view (the anchor image itself comes first)
+    std::stable_sort(overlaps.begin(), overlaps.end(), [](const AnchorViewOverlap& a, const AnchorViewOverlap& b) {
+        return a.overlap > b.overlap;
+    });
+    return overlaps;
+}
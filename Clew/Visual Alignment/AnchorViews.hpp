@@ -0,0 +1,126 @@
+//
+//  AnchorViews.hpp
+//  Clew
+//
+//  Created by OccamLab on 10/19/26.
+//  Copyright © 2026 OccamLab. All rights reserved.
+//
+
+#ifndef AnchorViews_hpp
+#define AnchorViews_hpp
+
+#include <opencv2/opencv.hpp>
+#include <Eigen/Core>
+#include <string>
+#include <vector>
+#include "UprightAlignment.hpp"
+#include "WorkerPool.hpp"
+
+/**
+ One of several images of an anchor point (the anchor image itself or a frame captured near it while recording), leveled and with its features extracted.
+ */
+typedef struct {
+    LeveledImage leveled;
+    KeyPointsAndDescriptors features;
+    /// the descriptors of the strongest features, which are all that is compared when ranking the views (see selectOverlapDescriptors)
+    cv::Mat overlapDescriptors;
+} AnchorView;
+
+/**
+ How much an anchor view is expected to overlap a live image.
+ */
+typedef struct {
+    /// the index of the view
+    unsigned int view;
+    /// the number of the strongest features of the view that match one of the strongest features of the live image
+    int overlap;
+} AnchorViewOverlap;
+
+/**
+ Get the descriptors of the strongest features, which are enough to tell how much two images overlap at a fraction of the cost of matching all of their features.
+
+ - returns: The descriptors of (at most) the maxFeatures strongest features.
+
+ - parameters:
+ - features: The features of a leveled image.
+ - maxFeatures: How many features to keep.
+ */
+cv::Mat selectOverlapDescriptors(const KeyPointsAndDescriptors& features, unsigned int maxFeatures = 300);
+
+/**
+ Estimate how much an anchor view overlaps a live image by matching their strongest features with the ratio test.
+
+ - returns: The number of matches.
+
+ - parameters:
+ - viewOverlapDescriptors: The strongest descriptors of the anchor view.
+ - liveOverlapDescriptors: The strongest descriptors of the live image.
+ - normType: The norm to compare descriptors with (see getDescriptorNorm).
+ */
+int estimateAnchorViewOverlap(const cv::Mat& viewOverlapDescriptors, const cv::Mat& liveOverlapDescriptors, int normType);
+
+/**
+ The images of an anchor point, decoded once and with their features extracted the first time they are aligned to.
+
+ A single image of the anchor only covers about 60 degrees, so when the user isn't facing the way the phone was facing when it was taken every attempt fails.  With several views, the one that overlaps the live image the most is picked cheaply before any full matching is done.
+ */
+class AnchorViewSet {
+public:
+    AnchorViewSet();
+
+    /// Forget the views.
+    void reset();
+
+    /**
+     Decode and level the images of an anchor, replacing any views already loaded.  Nothing is kept unless all of them can be read.
+
+     - returns: False if an image couldn't be read.
+
+     - parameters:
+     - paths: The JPEG or PNG files.
+     - intrinsics: The intrinsics of the camera that captured each image.
+     - poses: The pose of the camera that captured each image (all in the coordinate frame of the session the anchor was recorded in).
+     - downSampleFactor: The factor by which to shrink the leveled images.
+     */
+    bool load(const std::vector<std::string>& paths, const std::vector<Eigen::Matrix3f>& intrinsics, const std::vector<Eigen::Matrix4f>& poses, int downSampleFactor);
+
+    /// the number of views
+    unsigned int size() const;
+
+    /// the factor the views were shrunk by
+    int getDownSampleFactor() const;
+
+    /**
+     Get a view, extracting the features of all of the views first if they haven't been extracted with this backend.
+
+     - returns: The view.
+
+     - parameters:
+     - view: The index of the view.
+     - backend: The feature detector and descriptor to use.
+     - pool: The threads to spread feature extraction over.
+     */
+    const AnchorView& getView(unsigned int view, FeatureBackendType backend, WorkerPool& pool);
+
+    /**
+     Order the views by how much they are expected to overlap a live image.  The views are compared on the threads of the pool.
+
+     - returns: The views in order of decreasing overlap.
+
+     - parameters:
+     - liveOverlapDescriptors: The strongest descriptors of the live image (see selectOverlapDescriptors).
+     - backend: The feature detector and descriptor the live descriptors came from.
+     - pool: The threads to spread the work over.
+     */
+    std::vector<AnchorViewOverlap> rank(const cv::Mat& liveOverlapDescriptors, FeatureBackendType backend, WorkerPool& pool);
+
+private:
+    void extractFeatures(FeatureBackendType backend, WorkerPool& pool);
+
+    std::vector<AnchorView> views;
+    int downSampleFactor;
+    bool hasFeatures;
+    FeatureBackendType featureBackend;
+};
+
+#endif /* AnchorViews_hpp */
@@ -0,0 +1,261 @@
+//
+//  CylindricalPanorama.cpp
+//  Clew
+//
+//  Created by OccamLab on 10/19/26.
+//  Copyright © 2026 OccamLab. All rights reserved.
+//
+
+#include "CylindricalPanorama.hpp"
+#include "VisualAlignmentUtils.hpp"
+#include "AlignmentTrace.hpp"
+#include "AlignmentLog.hpp"
+#include <algorithm>
+#include <cmath>
+
+/// the width of the panorama (half a degree per column)
+static const int kPanoramaWidth = 720;
+/// how far above and below the horizon the panorama reaches (in height, i.e. y over the horizontal distance)
+static const float kPanoramaHalfHeight = 0.5f;
+/// how many horizontal bands each column signature has
+static const int kSignatureBands = 8;
+/// the standard deviation of the smoothing of the signatures across columns (in columns), which keeps sub-column offsets from decorrelating them
+static const double kSignatureSmoothing = 1.0;
+/// frames closer than this (in radians) to one that was already added are skipped
+static const float kMinFrameSpacing = 0.1f;
+/// the fraction of the columns of the live image that have to overlap the panorama for a yaw to be scored
+static const float kMinOverlapFraction = 0.5f;
+/// the weakest correlation to accept, and how much it has to beat the best one at any other yaw by
+static const float kMinCorrelation = 0.6f;
+static const float kMinCorrelationMargin = 0.05f;
+/// how far (in columns) another peak has to be from the best one to count as a different yaw
+static const int kPeakExclusionColumns = 10;
+
+static float getPixelsPerRadian() {
+    return kPanoramaWidth / (2 * M_PI);
+}
+
+/// the number of rows of the panorama
+static int getPanoramaRows() {
+    return (int) std::round(2 * kPanoramaHalfHeight * getPixelsPerRadian()) + 1;
+}
+
+/// the yaw from the reference camera to the camera that took a leveled image, predicted by their poses
+static float getFrameYaw(const Eigen::Matrix4f& referencePose, const Eigen::AngleAxisf& referenceSquareRotation, const LeveledImage& leveled) {
+    return getPredictedYaw(getLeveledCameraRotation(referencePose.block(0, 0, 3, 3), referenceSquareRotation), getLeveledCameraRotation(leveled.pose.block(0, 0, 3, 3), leveled.squareRotation));
+}
+
+ColumnSignatures getColumnSignatures(const cv::Mat& cylinder, const cv::Mat& coverage) {
+    cv::Mat values, mask;
+    cylinder.convertTo(values, CV_32F);
+    (coverage != 0).convertTo(mask, CV_32F, 1.0 / 255);
+    const cv::Mat maskedValues = values.mul(mask);
+
+    ColumnSignatures result;
+    result.signatures = cv::Mat::zeros(kSignatureBands, cylinder.cols, CV_32F);
+    result.covered.assign(cylinder.cols, true);
+    for (int band = 0; band < kSignatureBands; band++) {
+        const cv::Range rows(band * cylinder.rows / kSignatureBands, (band + 1) * cylinder.rows / kSignatureBands);
+        cv::Mat sums, counts;
+        cv::reduce(maskedValues.rowRange(rows), sums, 0, cv::REDUCE_SUM, CV_32F);
+        cv::reduce(mask.rowRange(rows), counts, 0, cv::REDUCE_SUM, CV_32F);
+        float* signature = result.signatures.ptr<float>(band);
+        for (int column = 0; column < cylinder.cols; column++) {
+            const float count = counts.at<float>(0, column);
+            signature[column] = count > 0 ? sums.at<float>(0, column) / count : 0;
+            if (count < 0.5f * rows.size()) {
+                result.covered[column] = false;
+            }
+        }
+    }
+    cv::GaussianBlur(result.signatures, result.signatures, cv::Size(0, 1), kSignatureSmoothing, 0);
+    return result;
+}
+
+CylindricalPanorama::CylindricalPanorama() : referencePose(Eigen::Matrix4f::Identity()), referenceSquareRotation(Eigen::AngleAxisf::Identity()) {
+}
+
+void CylindricalPanorama::reset() {
+    sum.release();
+    weight.release();
+    frameYaws.clear();
+    image.release();
+    signatures.signatures.release();
+    signatures.covered.clear();
+}
+
+void CylindricalPanorama::start(const Eigen::Matrix4f& referencePose) {
+    reset();
+    this->referencePose = referencePose;
+    referenceSquareRotation = getIdealRotation(referencePose);
+    sum = cv::Mat::zeros(getPanoramaRows(), kPanoramaWidth, CV_32F);
+    weight = cv::Mat::zeros(getPanoramaRows(), kPanoramaWidth, CV_32F);
+}
+
+bool CylindricalPanorama::addFrame(const LeveledImage& leveled) {
+    if (sum.empty()) {
+        ALIGNMENT_LOG_ERROR(Features, "a frame was added to a panorama that wasn't started");
+        return false;
+    }
+    const float yaw = getFrameYaw(referencePose, referenceSquareRotation, leveled);
+    for (float frameYaw : frameYaws) {
+        if (std::abs(std::remainder(yaw - frameYaw, 2 * M_PI)) < kMinFrameSpacing) {
+            return false;
+        }
+    }
+    ALIGNMENT_TRACE_SCOPE("CylindricalPanorama::addFrame");
+    // A point at azimuth a in the panorama is at azimuth a + yaw in the frame, and the first column of the panorama is at -pi.
+    const float pixelsPerRadian = getPixelsPerRadian();
+    float minAzimuth, maxAzimuth;
+    getAzimuthRange(leveled, minAzimuth, maxAzimuth);
+    const int firstColumn = (int) std::ceil((minAzimuth - yaw + M_PI) * pixelsPerRadian);
+    const int lastColumn = (int) std::floor((maxAzimuth - yaw + M_PI) * pixelsPerRadian);
+    if (lastColumn < firstColumn) {
+        return false;
+    }
+    CylinderRange range;
+    range.minAzimuth = firstColumn / pixelsPerRadian - M_PI + yaw;
+    range.maxAzimuth = range.minAzimuth + (lastColumn - firstColumn) / pixelsPerRadian;
+    range.minHeight = -kPanoramaHalfHeight;
+    range.maxHeight = range.minHeight + (sum.rows - 1) / pixelsPerRadian;
+    range.pixelsPerRadian = pixelsPerRadian;
+    cv::Mat coverage;
+    const cv::Mat cylinder = reprojectToCylinder(leveled, range, &coverage);
+
+    for (int i = 0; i < cylinder.rows; i++) {
+        const float* value = cylinder.ptr<float>(i);
+        const uchar* covered = coverage.ptr<uchar>(i);
+        float* sumRow = sum.ptr<float>(i);
+        float* weightRow = weight.ptr<float>(i);
+        for (int j = 0; j < cylinder.cols; j++) {
+            if (!covered[j]) {
+                continue;
+            }
+            // favor the middle of each frame, where leveling stretches it the least
+            const float w = std::cos(range.minAzimuth + j / pixelsPerRadian);
+            const int column = ((firstColumn + j) % kPanoramaWidth + kPanoramaWidth) % kPanoramaWidth;
+            sumRow[column] += w * value[j];
+            weightRow[column] += w;
+        }
+    }
+    frameYaws.push_back(yaw);
+
+    // keep 0 for pixels that no frame covered
+    cv::Mat stitched;
+    cv::divide(sum, cv::max(weight, 1e-6), stitched);
+    stitched = cv::max(stitched, 1.0);
+    stitched.setTo(0, weight <= 0);
+    stitched.convertTo(image, CV_8U);
+    signatures = getColumnSignatures(image, image);
+    ALIGNMENT_LOG_DEBUG(Features, "added a frame at yaw %f to the panorama (coverage %f)", yaw, getCoverage());
+    return true;
+}
+
+float CylindricalPanorama::getCoverage() const {
+    if (signatures.covered.empty()) {
+        return 0;
+    }
+    return std::count(signatures.covered.begin(), signatures.covered.end(), true) / (float) signatures.covered.size();
+}
+
+bool CylindricalPanorama::isEmpty() const {
+    return image.empty();
+}
+
+const cv::Mat& CylindricalPanorama::getImage() const {
+    return image;
+}
+
+bool CylindricalPanorama::setImage(const cv::Mat& image, const Eigen::Matrix4f& referencePose) {
+    if (image.type() != CV_8UC1 || image.cols != kPanoramaWidth || image.rows != getPanoramaRows()) {
+        ALIGNMENT_LOG_ERROR(Features, "a %dx%d image of type %d isn't a panorama", image.cols, image.rows, image.type());
+        return false;
+    }
+    reset();
+    this->referencePose = referencePose;
+    referenceSquareRotation = getIdealRotation(referencePose);
+    this->image = image;
+    signatures = getColumnSignatures(image, image);
+    return true;
+}
+
+Eigen::AngleAxisf CylindricalPanorama::getReferenceSquareRotation() const {
+    return referenceSquareRotation;
+}
+
+PanoramaYaw CylindricalPanorama::align(const LeveledImage& live) const {
+    ALIGNMENT_TRACE_SCOPE("CylindricalPanorama::align");
+    PanoramaYaw result;
+    result.is_valid = false;
+    result.yaw = 0;
+    result.correlation = 0;
+    result.secondCorrelation = 0;
+    if (image.empty()) {
+        return result;
+    }
+    const float pixelsPerRadian = getPixelsPerRadian();
+    CylinderRange range;
+    getAzimuthRange(live, range.minAzimuth, range.maxAzimuth);
+    range.minHeight = -kPanoramaHalfHeight;
+    range.maxHeight = range.minHeight + (image.rows - 1) / pixelsPerRadian;
+    range.pixelsPerRadian = pixelsPerRadian;
+    cv::Mat coverage;
+    const cv::Mat cylinder = reprojectToCylinder(live, range, &coverage);
+    const ColumnSignatures liveSignatures = getColumnSignatures(cylinder, coverage);
+
+    // Score every placement of the live columns around the panorama by the correlation of the overlapping signatures.
+    const int liveColumns = cylinder.cols;
+    const int minOverlap = (int) std::ceil(kMinOverlapFraction * liveColumns);
+    std::vector<float> scores(kPanoramaWidth, -1);
+    for (int shift = 0; shift < kPanoramaWidth; shift++) {
+        double sumX = 0, sumY = 0, sumXX = 0, sumYY = 0, sumXY = 0;
+        int overlap = 0;
+        for (int j = 0; j < liveColumns; j++) {
+            const int column = (shift + j) % kPanoramaWidth;
+            if (!liveSignatures.covered[j] || !signatures.covered[column]) {
+                continue;
+            }
+            overlap++;
+            for (int band = 0; band < kSignatureBands; band++) {
+                const double x = liveSignatures.signatures.at<float>(band, j);
+                const double y = signatures.signatures.at<float>(band, column);
+                sumX += x;
+                sumY += y;
+                sumXX += x * x;
+                sumYY += y * y;
+                sumXY += x * y;
+            }
+        }
+        if (overlap < minOverlap) {
+            continue;
+        }
+        const double n = overlap * kSignatureBands;
+        const double denominator = std::sqrt((n * sumXX - sumX * sumX) * (n * sumYY - sumY * sumY));
+        if (denominator > 0) {
+            scores[shift] = (n * sumXY - sumX * sumY) / denominator;
+        }
+    }
+    const int best = std::max_element(scores.begin(), scores.end()) - scores.begin();
+    for (int shift = 0; shift < kPanoramaWidth; shift++) {
+        const int distance = std::abs(shift - best);
+        if (std::min(distance, kPanoramaWidth - distance) > kPeakExclusionColumns) {
+            result.secondCorrelation = std::max(result.secondCorrelation, scores[shift]);
+        }
+    }
+    // fit a parabola through the peak and its neighbors for a fraction of a column
+    const float before = scores[(best + kPanoramaWidth - 1) % kPanoramaWidth];
+    const float after = scores[(best + 1) % kPanoramaWidth];
+    const float curvature = before - 2 * scores[best] + after;
+    const float offset = before >= 0 && after >= 0 && curvature < 0 ? 0.5f * (before - after) / curvature : 0;
+
+    // The first live column lands on column shift of the panorama when minAzimuth - yaw + pi = shift / pixelsPerRadian.
+    result.yaw = std::remainder(range.minAzimuth + M_PI - (best + offset) / pixelsPerRadian, 2 * M_PI);
+    result.correlation = scores[best];
+    result.is_valid = result.correlation >= kMinCorrelation && result.correlation - result.secondCorrelation >= kMinCorrelationMargin;
+    ALIGNMENT_LOG_DEBUG(Matching, "panorama yaw %f (correlation %f, next best %f)", result.yaw, result.correlation, result.secondCorrelation);
+    return result;
+}
+
+int CylindricalPanorama::getWidth() {
+    return kPanoramaWidth;
+}
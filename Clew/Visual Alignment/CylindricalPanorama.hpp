@@ -0,0 +1,131 @@
+//
+//  CylindricalPanorama.hpp
+//  Clew
+//
+//  Created by OccamLab on 10/19/26.
+//  Copyright © 2026 OccamLab. All rights reserved.
+//
+
+#ifndef CylindricalPanorama_hpp
+#define CylindricalPanorama_hpp
+
+#include <opencv2/opencv.hpp>
+#include <Eigen/Core>
+#include <Eigen/Geometry>
+#include <vector>
+#include "UprightAlignment.hpp"
+#include "PhaseCorrelationYaw.hpp"
+
+/**
+ A compact description of each column of a cylindrical image: the mean of each of several horizontal bands, smoothed a little across columns, along with whether the image covers the column.
+ */
+typedef struct {
+    /// one row per band and one column per column of the image (single channel floating point)
+    cv::Mat signatures;
+    /// whether each column is covered (most of every band has to be)
+    std::vector<bool> covered;
+} ColumnSignatures;
+
+/**
+ The yaw between the reference of a panorama and a live image.  The yaw means the same as in UprightAlignment (with the reference camera of the panorama as the first camera).
+ */
+typedef struct {
+    /// whether the best match was both strong and clearly better than any match at another yaw
+    bool is_valid;
+    float yaw;
+    /// the correlation of the column signatures at the best yaw
+    float correlation;
+    /// the best correlation at any yaw that isn't near the best one
+    float secondCorrelation;
+} PanoramaYaw;
+
+/**
+ Get the signature of every column of a cylindrical image.
+
+ - returns: The signatures.
+
+ - parameters:
+ - cylinder: The image (single channel, any depth).
+ - coverage: Non-zero where the image is covered.
+ */
+ColumnSignatures getColumnSignatures(const cv::Mat& cylinder, const cv::Mat& coverage);
+
+/**
+ A grayscale panorama all the way around an anchor point, stitched from frames taken while the user turned in place.  It is a strip of a cylinder around the camera whose first column faces directly behind the reference camera (the camera that took the anchor point image), so that the yaw of a live image is found by sliding its column signatures around the strip, which is much cheaper than matching features and works whichever way the user is facing.
+
+ Frames are placed by the yaw between them and the reference that their poses predict, so they have to come from the session the anchor point was recorded in.  The panorama itself is an 8 bit image where 0 means that no frame covered the pixel (see getImage and setImage), and the column signatures are recomputed from it whenever it changes.
+ */
+class CylindricalPanorama {
+public:
+    CylindricalPanorama();
+
+    /// Forget the frames and the panorama.
+    void reset();
+
+    /**
+     Start stitching a new panorama, forgetting any frames or panorama there already were.
+
+     - parameters:
+     - referencePose: The pose of the camera that took the anchor point image.
+     */
+    void start(const Eigen::Matrix4f& referencePose);
+
+    /**
+     Add a frame to the panorama.  Frames facing nearly the same way as one that was already added are skipped.
+
+     - returns: Whether the frame was added.
+
+     - parameters:
+     - leveled: The leveled frame (its pose has to be in the same coordinate frame as the reference pose).
+     */
+    bool addFrame(const LeveledImage& leveled);
+
+    /// the fraction of the columns that are covered
+    float getCoverage() const;
+
+    /// whether there is a panorama to align to
+    bool isEmpty() const;
+
+    /// the panorama as an 8 bit grayscale image (0 wherever no frame covered it)
+    const cv::Mat& getImage() const;
+
+    /**
+     Replace the panorama with one that was saved (see getImage).
+
+     - returns: False if the image isn't a panorama.
+
+     - parameters:
+     - image: The panorama (single channel, 8 bit, all the way around the cylinder).
+     - referencePose: The pose of the camera that took the anchor point image (in the coordinates of the session the anchor point will be aligned in).
+     */
+    bool setImage(const cv::Mat& image, const Eigen::Matrix4f& referencePose);
+
+    /// the rotation in global coordinates that levels the reference camera (see getIdealRotation)
+    Eigen::AngleAxisf getReferenceSquareRotation() const;
+
+    /**
+     Find the yaw from the reference camera to the camera that took a live image by correlating the column signatures of the live image with those of the panorama at every yaw.
+
+     - returns: The yaw.
+
+     - parameters:
+     - live: The leveled live image.
+     */
+    PanoramaYaw align(const LeveledImage& live) const;
+
+    /// the width of every panorama (in pixels, all the way around)
+    static int getWidth();
+
+private:
+    Eigen::Matrix4f referencePose;
+    Eigen::AngleAxisf referenceSquareRotation;
+    /// the weighted sum of the frames and the sum of the weights, while stitching
+    cv::Mat sum;
+    cv::Mat weight;
+    /// the predicted yaws of the frames added so far
+    std::vector<float> frameYaws;
+    cv::Mat image;
+    ColumnSignatures signatures;
+};
+
+#endif /* CylindricalPanorama_hpp */
@@ -0,0 +1,90 @@
+//
+//  FeatureBackend.hpp
+//  Clew
+//
+//  Created by OccamLab on 10/19/26.
+//  Copyright © 2026 OccamLab. All rights reserved.
+//
+
+#ifndef FeatureBackend_hpp
+#define FeatureBackend_hpp
+
+#include <opencv2/opencv.hpp>
+#include <opencv2/features2d.hpp>
+#include <vector>
+
+/// The feature detectors and descriptors that visual alignment can use.
+enum class FeatureBackendType {
+    /// upright MLDB descriptors on AKAZE's nonlinear scale space (accurate but the most expensive)
+    AKAZE,
+    /// ORB with the orientation of every keypoint fixed to zero so the descriptors are upright like the AKAZE ones
+    ORB,
+    /// BRISK (OpenCV doesn't expose an upright mode, so these descriptors are rotation invariant)
+    BRISK,
+};
+
+/**
+ A feature detector and descriptor along with how its descriptors are laid out and compared.
+ 
+ Each specialization provides:
+ - norm: The norm to use when matching descriptors.
+ - descriptorType: The OpenCV type of each descriptor element.
+ - descriptorBytes: The number of bytes in each descriptor.
+ - create(): Create the detector.
+ - detectAndCompute(...): Find keypoints and compute their descriptors.
+ */
+template <FeatureBackendType type>
+struct FeatureBackend;
+
+template <>
+struct FeatureBackend<FeatureBackendType::AKAZE> {
+    static constexpr int norm = cv::NORM_HAMMING;
+    static constexpr int descriptorType = CV_8U;
+    /// the full 486 bit MLDB descriptor
+    static constexpr int descriptorBytes = 61;
+    
+    static cv::Ptr<cv::AKAZE> create() {
+        return cv::AKAZE::create(cv::AKAZE::DESCRIPTOR_MLDB_UPRIGHT);
+    }
+    
+    static void detectAndCompute(cv::AKAZE& detector, const cv::Mat& image, std::vector<cv::KeyPoint>& keypoints, cv::Mat& descriptors) {
+        detector.detectAndCompute(image, cv::Mat(), keypoints, descriptors);
+    }
+};
+
+template <>
+struct FeatureBackend<FeatureBackendType::ORB> {
+    static constexpr int norm = cv::NORM_HAMMING;
+    static constexpr int descriptorType = CV_8U;
+    static constexpr int descriptorBytes = 32;
+    
+    static cv::Ptr<cv::ORB> create() {
+        return cv::ORB::create(1000);
+    }
+    
+    static void detectAndCompute(cv::ORB& detector, const cv::Mat& image, std::vector<cv::KeyPoint>& keypoints, cv::Mat& descriptors) {
+        detector.detect(image, keypoints);
+        // The images are leveled, so drop the orientation to get upright descriptors (this makes them more discriminative).
+        for (auto& keypoint : keypoints) {
+            keypoint.angle = 0;
+        }
+        detector.compute(image, keypoints, descriptors);
+    }
+};
+
+template <>
+struct FeatureBackend<FeatureBackendType::BRISK> {
+    static constexpr int norm = cv::NORM_HAMMING;
+    static constexpr int descriptorType = CV_8U;
+    static constexpr int descriptorBytes = 64;
+    
+    static cv::Ptr<cv::BRISK> create() {
+        return cv::BRISK::create();
+    }
+    
+    static void detectAndCompute(cv::BRISK& detector, const cv::Mat& image, std::vector<cv::KeyPoint>& keypoints, cv::Mat& descriptors) {
+        detector.detectAndCompute(image, cv::Mat(), keypoints, descriptors);
+    }
+};
+
+#endif /* FeatureBackend_hpp */
@@ -0,0 +1,95 @@
+//
+//  FeatureTracker.cpp
+//  Clew
+//
+//  Created by OccamLab on 10/19/26.
+//  Copyright © 2026 OccamLab. All rights reserved.
+//
+
+#include "FeatureTracker.hpp"
+#include "AlignmentTrace.hpp"
+#include <opencv2/opencv.hpp>
+
+/// the most a track may move when tracked forward and then back again before we consider it lost (in pixels)
+static const float kMaxForwardBackwardError = 1.0;
+
+FeatureTracker::FeatureTracker(unsigned int minimumTracks) : minimumTracks(minimumTracks), anchorBackend(FeatureBackendType::AKAZE), hasAnchorManhattanFrame(false) {
+}
+
+void FeatureTracker::reset() {
+    anchorKey.clear();
+    anchorFeatures = KeyPointsAndDescriptors();
+    hasAnchorManhattanFrame = false;
+    clearTracks();
+}
+
+void FeatureTracker::clearTracks() {
+    previousImage = cv::Mat();
+    previousPoints.clear();
+    anchorIndices.clear();
+}
+
+const KeyPointsAndDescriptors& FeatureTracker::getAnchorFeatures(const cv::Mat& image, const std::vector<float>& anchorKey, FeatureBackendType backend) {
+    if (!hasAnchorFeatures(anchorKey, backend)) {
+        setAnchorFeatures(anchorKey, backend, getKeyPointsAndDescriptors(image, backend));
+    }
+    return anchorFeatures;
+}
+
+bool FeatureTracker::hasAnchorFeatures(const std::vector<float>& anchorKey, FeatureBackendType backend) const {
+    return anchorKey == this->anchorKey && backend == anchorBackend;
+}
+
+const KeyPointsAndDescriptors& FeatureTracker::setAnchorFeatures(const std::vector<float>& anchorKey, FeatureBackendType backend, const KeyPointsAndDescriptors& features) {
+    // the tracks refer to the old anchor features by index, so they are no longer meaningful
+    clearTracks();
+    this->anchorKey = anchorKey;
+    anchorBackend = backend;
+    anchorFeatures = features;
+    hasAnchorManhattanFrame = false;
+    return anchorFeatures;
+}
+
+const ManhattanFrame& FeatureTracker::getAnchorManhattanFrame(const LeveledImage& leveled) {
+    if (!hasAnchorManhattanFrame) {
+        anchorManhattanFrame = estimateManhattanFrame(leveled);
+        hasAnchorManhattanFrame = true;
+    }
+    return anchorManhattanFrame;
+}
+
+bool FeatureTracker::track(const cv::Mat& image, KeyPointsAndDescriptors& keypoints_and_descriptors, std::vector<cv::DMatch>& matches) {
+    ALIGNMENT_TRACE_SCOPE("FeatureTracker::track");
+    keypoints_and_descriptors = KeyPointsAndDescriptors();
+    matches.clear();
+    if (previousImage.empty() || previousPoints.size() < minimumTracks || previousImage.size() != image.size()) {
+        return false;
+    }
+    std::vector<cv::Point2f> trackedPoints, backtrackedPoints;
+    std::vector<uchar> status, backStatus;
+    std::vector<float> error, backError;
+    cv::calcOpticalFlowPyrLK(previousImage, image, previousPoints, trackedPoints, status, error);
+    // Track back again to weed out the tracks that latched onto something else.
+    cv::calcOpticalFlowPyrLK(image, previousImage, trackedPoints, backtrackedPoints, backStatus, backError);
+    
+    const cv::Rect bounds(0, 0, image.cols, image.rows);
+    for (unsigned int i = 0; i < previousPoints.size(); i++) {
+        if (!status[i] || !backStatus[i] || cv::norm(backtrackedPoints[i] - previousPoints[i]) > kMaxForwardBackwardError || !bounds.contains(trackedPoints[i])) {
+            continue;
+        }
+        matches.push_back(cv::DMatch(anchorIndices[i], (int) keypoints_and_descriptors.keypoints.size(), 0.0));
+        keypoints_and_descriptors.keypoints.push_back(cv::KeyPoint(trackedPoints[i], 1.0));
+    }
+    clearTracks();
+    return matches.size() >= minimumTracks;
+}
+
+void FeatureTracker::update(const cv::Mat& image, const std::vector<cv::KeyPoint>& keypoints, const std::vector<cv::DMatch>& inlier_matches) {
+    previousImage = image.clone();
+    previousPoints.clear();
+    anchorIndices.clear();
+    for (const auto& match : inlier_matches) {
+        previousPoints.push_back(keypoints[match.trainIdx].pt);
+        anchorIndices.push_back(match.queryIdx);
+    }
+}
@@ -0,0 +1,119 @@
+//
+//  FeatureTracker.hpp
+//  Clew
+//
+//  Created by OccamLab on 10/19/26.
+//  Copyright © 2026 OccamLab. All rights reserved.
+//
+
+#ifndef FeatureTracker_hpp
+#define FeatureTracker_hpp
+
+#include <opencv2/opencv.hpp>
+#include <vector>
+#include "VisualAlignmentUtils.hpp"
+#include "ManhattanYaw.hpp"
+
+/**
+ Carries correspondences with the anchor image from one visual alignment attempt to the next.
+ 
+ Consecutive attempts look at nearly the same view, so rather than detecting and describing features in every new live image we track the inliers of the last successful attempt into the new image with pyramidal Lucas-Kanade.  Each track keeps the index of the anchor feature it was matched to.  The anchor features are cached as well since neither the anchor image nor its leveling change between attempts, and so is the Manhattan frame of the anchor image.
+ */
+class FeatureTracker {
+public:
+    /**
+     Create a tracker.
+     
+     - parameters:
+     - minimumTracks: The fewest tracks that have to survive for tracking to be used instead of detection.
+     */
+    FeatureTracker(unsigned int minimumTracks = 15);
+    
+    /// Forget the anchor features and the tracks (call this when starting to align to a new anchor).
+    void reset();
+    
+    /// Forget the tracks but keep the anchor features (e.g., after a failed attempt).
+    void clearTracks();
+    
+    /**
+     Get the features of the anchor image, only computing them if the anchor has changed.
+     
+     - returns: The features of the anchor image.
+     
+     - parameters:
+     - image: The leveled, downsampled anchor image.
+     - anchorKey: Values that identify the anchor image and how it was leveled (e.g., its intrinsics and pose).
+     - backend: The feature detector and descriptor to use.
+     */
+    const KeyPointsAndDescriptors& getAnchorFeatures(const cv::Mat& image, const std::vector<float>& anchorKey, FeatureBackendType backend);
+    
+    /**
+     Check whether the features of an anchor are already cached.
+     
+     - returns: True if getAnchorFeatures would not have to compute anything.
+     
+     - parameters:
+     - anchorKey: Values that identify the anchor image and how it was leveled.
+     - backend: The feature detector and descriptor to use.
+     */
+    bool hasAnchorFeatures(const std::vector<float>& anchorKey, FeatureBackendType backend) const;
+    
+    /**
+     Cache anchor features that were computed elsewhere (e.g., alongside the features of a live image).
+     
+     - returns: The cached features.
+     
+     - parameters:
+     - anchorKey: Values that identify the anchor image and how it was leveled.
+     - backend: The feature detector and descriptor the features came from.
+     - features: The features of the leveled, downsampled anchor image.
+     */
+    const KeyPointsAndDescriptors& setAnchorFeatures(const std::vector<float>& anchorKey, FeatureBackendType backend, const KeyPointsAndDescriptors& features);
+    
+    /**
+     Get the Manhattan frame of the anchor image (see estimateManhattanFrame), only estimating it the first time it is asked for after the anchor features are set.
+     
+     - returns: The Manhattan frame of the anchor image.
+     
+     - parameters:
+     - leveled: The leveled anchor image the cached anchor features came from.
+     */
+    const ManhattanFrame& getAnchorManhattanFrame(const LeveledImage& leveled);
+    
+    /**
+     Track the inliers of the last attempt into a new live image.
+     
+     The tracks are used up either way, so call update after a successful attempt to provide new ones.
+     
+     - returns: True if enough tracks survived.  Otherwise the caller should fall back on detecting and matching features.
+     
+     - parameters:
+     - image: The leveled, downsampled live image.
+     - keypoints_and_descriptors: Filled in with a keypoint for each surviving track (there are no descriptors).
+     - matches: Filled in with the matches between the anchor features and the tracked keypoints.
+     */
+    bool track(const cv::Mat& image, KeyPointsAndDescriptors& keypoints_and_descriptors, std::vector<cv::DMatch>& matches);
+    
+    /**
+     Remember the inliers of an attempt so they can be tracked into the next live image.
+     
+     - parameters:
+     - image: The leveled, downsampled live image.
+     - keypoints: The keypoints of the live image.
+     - inlier_matches: The matches between the anchor features and the live keypoints that agree with the estimated pose.
+     */
+    void update(const cv::Mat& image, const std::vector<cv::KeyPoint>& keypoints, const std::vector<cv::DMatch>& inlier_matches);
+    
+private:
+    unsigned int minimumTracks;
+    std::vector<float> anchorKey;
+    FeatureBackendType anchorBackend;
+    KeyPointsAndDescriptors anchorFeatures;
+    bool hasAnchorManhattanFrame;
+    ManhattanFrame anchorManhattanFrame;
+    cv::Mat previousImage;
+    std::vector<cv::Point2f> previousPoints;
+    std::vector<int> anchorIndices;
+};
+
+#endif /* FeatureTracker_hpp */
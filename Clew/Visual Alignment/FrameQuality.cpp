@@ -0,0 +1,94 @@
+//
+//  FrameQuality.cpp
+//  Clew
+//
+//  Created by OccamLab on 10/19/26.
+//  Copyright © 2026 OccamLab. All rights reserved.
+//
+
+#include "FrameQuality.hpp"
+#include <opencv2/opencv.hpp>
+#include <Eigen/Core>
+#include <Eigen/Geometry>
+#include <cmath>
+
+/// how long (in seconds) to keep poses around
+static const double kPoseHistoryDuration = 0.5;
+
+FrameQualityGate::FrameQualityGate(FrameQualityThresholds thresholds) : thresholds(thresholds) {
+}
+
+void FrameQualityGate::addPose(const Eigen::Matrix4f& pose, double timestamp) {
+    std::lock_guard<std::mutex> lock(poseHistoryMutex);
+    if (!poseHistory.empty() && timestamp < poseHistory.back().first) {
+        // the session restarted
+        poseHistory.clear();
+    }
+    poseHistory.push_back(std::make_pair(timestamp, pose));
+    while (poseHistory.front().first < timestamp - kPoseHistoryDuration) {
+        poseHistory.pop_front();
+    }
+}
+
+FrameQuality FrameQualityGate::evaluate(const cv::Mat& luma, const Eigen::Matrix4f& pose, double timestamp) {
+    FrameQuality quality;
+    quality.angularSpeed = 0;
+    quality.linearSpeed = 0;
+    {
+        // Compare against the most recent pose that is at least one motion window old (if we don't have one we can't say anything about motion).
+        std::lock_guard<std::mutex> lock(poseHistoryMutex);
+        for (auto it = poseHistory.rbegin(); it != poseHistory.rend(); ++it) {
+            const double elapsed = timestamp - it->first;
+            if (elapsed >= thresholds.motionWindow) {
+                const Eigen::Matrix3f relative_rotation = it->second.block<3, 3>(0, 0).transpose() * pose.block<3, 3>(0, 0);
+                quality.angularSpeed = Eigen::AngleAxisf(relative_rotation).angle() / elapsed;
+                quality.linearSpeed = (pose.block<3, 1>(0, 3) - it->second.block<3, 1>(0, 3)).norm() / elapsed;
+                break;
+            }
+        }
+    }
+    
+    // Shrink the luma plane by averaging rather than sampling it, since differences between samples far apart alias and make a blurred frame look sharp.
+    cv::Mat small = luma;
+    if (luma.cols > thresholds.analysisWidth) {
+        const int analysisHeight = std::max(3, (int) std::lround((double) luma.rows*thresholds.analysisWidth/luma.cols));
+        cv::resize(luma, small, cv::Size(thresholds.analysisWidth, analysisHeight), 0, 0, cv::INTER_AREA);
+    }
+    const int cols = small.cols;
+    const int rows = small.rows;
+    double laplacianSum = 0, laplacianSquaredSum = 0, gradientSquaredSum = 0;
+    unsigned int saturatedCount = 0;
+    for (int row = 1; row < rows - 1; row++) {
+        const uchar* above = small.ptr<uchar>(row - 1);
+        const uchar* center = small.ptr<uchar>(row);
+        const uchar* below = small.ptr<uchar>(row + 1);
+        for (int x = 1; x < cols - 1; x++) {
+            const int value = center[x];
+            const int left = center[x - 1];
+            const int right = center[x + 1];
+            const int up = above[x];
+            const int down = below[x];
+            const int laplacian = left + right + up + down - 4*value;
+            const int gx = right - left;
+            const int gy = down - up;
+            laplacianSum += laplacian;
+            laplacianSquaredSum += laplacian*laplacian;
+            gradientSquaredSum += gx*gx + gy*gy;
+            if (value <= thresholds.blackLevel || value >= thresholds.whiteLevel) {
+                saturatedCount++;
+            }
+        }
+    }
+    const int samples = std::max(1, (rows - 2)*(cols - 2));
+    const double laplacianMean = laplacianSum / samples;
+    quality.laplacianVariance = laplacianSquaredSum / samples - laplacianMean*laplacianMean;
+    quality.gradientEnergy = gradientSquaredSum / samples;
+    quality.saturatedFraction = (float) saturatedCount / samples;
+    
+    quality.is_usable = quality.gradientEnergy >= thresholds.minGradientEnergy &&
+        quality.laplacianVariance >= thresholds.minSharpnessRatio*quality.gradientEnergy &&
+        quality.saturatedFraction <= thresholds.maxSaturatedFraction &&
+        quality.angularSpeed <= thresholds.maxAngularSpeed &&
+        quality.linearSpeed <= thresholds.maxLinearSpeed;
+    return quality;
+}
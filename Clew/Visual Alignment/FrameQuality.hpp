@@ -0,0 +1,95 @@
+//
+//  FrameQuality.hpp
+//  Clew
+//
+//  Created by OccamLab on 10/19/26.
+//  Copyright © 2026 OccamLab. All rights reserved.
+//
+
+#ifndef FrameQuality_hpp
+#define FrameQuality_hpp
+
+#include <opencv2/opencv.hpp>
+#include <Eigen/Core>
+#include <Eigen/Geometry>
+#include <deque>
+#include <mutex>
+#include <utility>
+
+/**
+ The measurements used to decide whether a frame is worth running visual alignment on.
+ */
+typedef struct {
+    /// variance of the Laplacian of the shrunken luma image
+    float laplacianVariance;
+    /// mean squared gradient magnitude of the shrunken luma image
+    float gradientEnergy;
+    /// fraction of the shrunken luma image that is clipped to black or white
+    float saturatedFraction;
+    /// how fast the camera is rotating (radians per second)
+    float angularSpeed;
+    /// how fast the camera is moving (meters per second)
+    float linearSpeed;
+    bool is_usable;
+} FrameQuality;
+
+/**
+ The limits a frame has to be within to be used for visual alignment.
+ 
+ These are deliberately loose so that only frames that are clearly going to fail are rejected.
+ */
+struct FrameQualityThresholds {
+    /// the number of columns to shrink the luma image to (by averaging) before measuring it
+    int analysisWidth = 160;
+    /// frames with less texture than this are too dark or too blank to find features in
+    float minGradientEnergy = 50.0;
+    /// the ratio of the Laplacian variance to the gradient energy drops as blur smears out edges
+    float minSharpnessRatio = 0.1;
+    /// pixel values at or below this count as clipped to black
+    int blackLevel = 5;
+    /// pixel values at or above this count as clipped to white
+    int whiteLevel = 250;
+    float maxSaturatedFraction = 0.3;
+    float maxAngularSpeed = 0.5;
+    float maxLinearSpeed = 1.0;
+    /// how far back (in seconds) to look in the pose history when computing speeds
+    double motionWindow = 0.1;
+};
+
+/**
+ A cheap check of whether a frame is sharp, well exposed, and captured while the phone was steady.
+ 
+ Running visual alignment on a frame that is blurred from walking or captured in the middle of an exposure change wastes the whole pipeline and a retry, so this is meant to run first.  It looks at a copy of the luma plane shrunk by area averaging (a few thousand pixels) and at the camera poses of recent frames.
+ */
+class FrameQualityGate {
+public:
+    FrameQualityGate(FrameQualityThresholds thresholds = FrameQualityThresholds());
+    
+    /**
+     Record the pose of a frame so that the camera's speed can be estimated.
+     
+     - parameters:
+     - pose: The pose of the camera.
+     - timestamp: When the frame was captured (in seconds).
+     */
+    void addPose(const Eigen::Matrix4f& pose, double timestamp);
+    
+    /**
+     Measure the quality of a frame.
+     
+     - returns: The measurements and whether the frame passes all of the checks.
+     
+     - parameters:
+     - luma: The 8 bit luma plane of the frame.
+     - pose: The pose of the camera when the frame was captured.
+     - timestamp: When the frame was captured (in seconds).
+     */
+    FrameQuality evaluate(const cv::Mat& luma, const Eigen::Matrix4f& pose, double timestamp);
+    
+private:
+    FrameQualityThresholds thresholds;
+    std::deque<std::pair<double, Eigen::Matrix4f>> poseHistory;
+    std::mutex poseHistoryMutex;
+};
+
+#endif /* FrameQuality_hpp */
@@ -0,0 +1,56 @@
+//
+//  LatestFrameMailbox.hpp
+//  Clew
+//
+//  Created by OccamLab on 10/19/26.
+//  Copyright © 2026 OccamLab. All rights reserved.
+//
+
+#ifndef LatestFrameMailbox_hpp
+#define LatestFrameMailbox_hpp
+
+#include <atomic>
+#include <memory>
+
+/**
+ A single slot that always holds the newest value put into it.  Putting a value replaces (and frees) one that hasn't been taken yet, so a slow consumer only ever sees the latest frame rather than a backlog of stale ones.
+ 
+ Both put and take are a single atomic exchange, so neither side ever waits on the other.
+ */
+template <typename T>
+class LatestFrameMailbox {
+public:
+    LatestFrameMailbox() : slot(nullptr), dropped(0) {}
+    
+    ~LatestFrameMailbox() {
+        delete slot.exchange(nullptr);
+    }
+    
+    LatestFrameMailbox(const LatestFrameMailbox&) = delete;
+    LatestFrameMailbox& operator=(const LatestFrameMailbox&) = delete;
+    
+    /// Leave a value for the consumer, discarding any value it hasn't taken yet.
+    void put(std::unique_ptr<T> value) {
+        T* previous = slot.exchange(value.release(), std::memory_order_acq_rel);
+        if (previous) {
+            dropped.fetch_add(1, std::memory_order_relaxed);
+            delete previous;
+        }
+    }
+    
+    /// Take the latest value (null if nothing new has been put since the last take).
+    std::unique_ptr<T> take() {
+        return std::unique_ptr<T>(slot.exchange(nullptr, std::memory_order_acq_rel));
+    }
+    
+    /// the number of values that were replaced before being taken
+    unsigned long getDropped() const {
+        return dropped.load(std::memory_order_relaxed);
+    }
+    
+private:
+    std::atomic<T*> slot;
+    std::atomic<unsigned long> dropped;
+};
+
+#endif /* LatestFrameMailbox_hpp */
@@ -0,0 +1,150 @@
+//
+//  ManhattanYaw.cpp
+//  Clew
+//
+//  Created by OccamLab on 10/19/26.
+//  Copyright © 2026 OccamLab. All rights reserved.
+//
+
+#include "ManhattanYaw.hpp"
+#include "AlignmentTrace.hpp"
+#include "AlignmentLog.hpp"
+#include <algorithm>
+#include <cmath>
+
+/// the size of the window the structure tensor is averaged over
+static const int kTensorWindow = 5;
+/// only every this many pixels (in each direction) votes
+static const int kSampleStep = 2;
+/// how many pixels around the black corners left by leveling are ignored (their edges aren't lines in the scene)
+static const int kBorderMargin = 4;
+/// the weakest gradient (the square root of the trace of the structure tensor, for Sobel gradients) of a line pixel
+static const float kMinGradient = 30.0f;
+/// the least coherence of the orientation of a line pixel (1 for a perfectly straight edge)
+static const float kMinCoherence = 0.9f;
+/// how far from vertical a line can be and still count as vertical
+static const float kVerticalTolerance = std::sin(10.0f * M_PI / 180);
+/// how far from horizontal a line has to be to vote (nearly horizontal lines barely move when their vanishing point does)
+static const float kMinHorizontalSlope = std::sin(20.0f * M_PI / 180);
+/// how far from the horizon (as a fraction of the focal length) a line pixel has to be to vote (the horizon itself lines up with every vanishing point)
+static const float kMinHorizonDistance = 0.05f;
+/// the number of bins of the histogram of azimuths over [0, pi / 2)
+static const int kHistogramBins = 180;
+/// the peak is the bins within this many of the best one (about a degree)
+static const int kPeakBins = 2;
+/// what it takes to be a Manhattan scene
+static const float kMinPeakFraction = 0.2f;
+static const float kMinVerticalFraction = 0.1f;
+static const int kMinSupport = 100;
+
+ManhattanFrame estimateManhattanFrame(const LeveledImage& leveled) {
+    ALIGNMENT_TRACE_SCOPE("estimateManhattanFrame");
+    ManhattanFrame result;
+    result.is_valid = false;
+    result.azimuth = 0;
+    result.peakFraction = 0;
+    result.verticalFraction = 0;
+    result.support = 0;
+
+    cv::Mat gray;
+    if (leveled.image.channels() == 1) {
+        gray = leveled.image;
+    } else {
+        cv::cvtColor(leveled.image, gray, cv::COLOR_BGR2GRAY);
+    }
+    cv::Mat gradX, gradY;
+    cv::Sobel(gray, gradX, CV_32F, 1, 0, 3);
+    cv::Sobel(gray, gradY, CV_32F, 0, 1, 3);
+    cv::Mat jxx, jyy, jxy;
+    cv::boxFilter(gradX.mul(gradX), jxx, -1, cv::Size(kTensorWindow, kTensorWindow));
+    cv::boxFilter(gradY.mul(gradY), jyy, -1, cv::Size(kTensorWindow, kTensorWindow));
+    cv::boxFilter(gradX.mul(gradY), jxy, -1, cv::Size(kTensorWindow, kTensorWindow));
+    cv::Mat invalid;
+    cv::dilate(gray == 0, invalid, cv::Mat(), cv::Point(-1, -1), kBorderMargin);
+
+    Eigen::Matrix3f intrinsics = leveled.intrinsics;
+    intrinsics.block(0, 0, 2, 3) /= leveled.downSampleFactor;
+    const float fx = intrinsics(0, 0), fy = intrinsics(1, 1), cx = intrinsics(0, 2), cy = intrinsics(1, 2);
+
+    std::vector<float> histogram(kHistogramBins, 0);
+    int linePixels = 0, verticalPixels = 0;
+    for (int i = 0; i < gray.rows; i += kSampleStep) {
+        const float* xx = jxx.ptr<float>(i);
+        const float* yy = jyy.ptr<float>(i);
+        const float* xy = jxy.ptr<float>(i);
+        const uchar* isInvalid = invalid.ptr<uchar>(i);
+        const float v = i - cy;
+        for (int j = 0; j < gray.cols; j += kSampleStep) {
+            const float trace = xx[j] + yy[j];
+            if (isInvalid[j] || trace < kMinGradient * kMinGradient) {
+                continue;
+            }
+            const float difference = xx[j] - yy[j];
+            if (std::sqrt(difference * difference + 4 * xy[j] * xy[j]) < kMinCoherence * trace) {
+                continue;
+            }
+            linePixels++;
+            // the line runs across the dominant gradient
+            const float gradientAngle = 0.5f * std::atan2(2 * xy[j], difference);
+            const float dx = -std::sin(gradientAngle), dy = std::cos(gradientAngle);
+            if (std::abs(dx) < kVerticalTolerance) {
+                verticalPixels++;
+                continue;
+            }
+            if (std::abs(dy) < kMinHorizontalSlope || std::abs(v) < kMinHorizonDistance * fy) {
+                continue;
+            }
+            // where the line crosses the horizon (the sign of dy doesn't matter modulo pi / 2)
+            const float azimuth = std::atan2((j - cx) * dy - v * dx, fx * dy);
+            float folded = std::fmod(azimuth, (float) M_PI_2);
+            if (folded < 0) {
+                folded += M_PI_2;
+            }
+            const int bin = std::min((int) (folded / M_PI_2 * kHistogramBins), kHistogramBins - 1);
+            // steeper lines pin down their vanishing point better
+            histogram[bin] += std::sqrt(trace) * std::abs(dy);
+            result.support++;
+        }
+    }
+    result.verticalFraction = linePixels > 0 ? (float) verticalPixels / linePixels : 0;
+    double total = 0;
+    for (float votes : histogram) {
+        total += votes;
+    }
+    if (result.support < kMinSupport || total <= 0) {
+        ALIGNMENT_LOG_DEBUG(Solver, "too few line pixels (%d) for a Manhattan frame", result.support);
+        return result;
+    }
+
+    std::vector<float> smoothed(kHistogramBins);
+    for (int bin = 0; bin < kHistogramBins; bin++) {
+        smoothed[bin] = 0.25f * histogram[(bin + kHistogramBins - 1) % kHistogramBins] + 0.5f * histogram[bin] + 0.25f * histogram[(bin + 1) % kHistogramBins];
+    }
+    const int best = std::max_element(smoothed.begin(), smoothed.end()) - smoothed.begin();
+    // fit a parabola through the peak and its neighbors for a fraction of a bin
+    const float before = smoothed[(best + kHistogramBins - 1) % kHistogramBins];
+    const float after = smoothed[(best + 1) % kHistogramBins];
+    const float curvature = before - 2 * smoothed[best] + after;
+    const float offset = curvature < 0 ? 0.5f * (before - after) / curvature : 0;
+    result.azimuth = std::fmod((best + 0.5f + offset) / kHistogramBins * (float) M_PI_2 + (float) M_PI_2, (float) M_PI_2);
+    double peak = 0;
+    for (int k = -kPeakBins; k <= kPeakBins; k++) {
+        peak += histogram[(best + k + kHistogramBins) % kHistogramBins];
+    }
+    result.peakFraction = peak / total;
+    result.is_valid = result.peakFraction >= kMinPeakFraction && result.verticalFraction >= kMinVerticalFraction;
+    ALIGNMENT_LOG_DEBUG(Solver, "Manhattan azimuth %f (peak fraction %f, vertical fraction %f, %d votes)", result.azimuth, result.peakFraction, result.verticalFraction, result.support);
+    return result;
+}
+
+std::vector<float> getManhattanYawHypotheses(const ManhattanFrame& anchor, const ManhattanFrame& live) {
+    std::vector<float> yaws;
+    if (!anchor.is_valid || !live.is_valid) {
+        return yaws;
+    }
+    // a direction at azimuth a in the first camera is at azimuth a + yaw in the second
+    for (int quarter = 0; quarter < 4; quarter++) {
+        yaws.push_back(std::remainder(live.azimuth - anchor.azimuth + quarter * M_PI_2, 2 * M_PI));
+    }
+    return yaws;
+}
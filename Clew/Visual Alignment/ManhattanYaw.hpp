@@ -0,0 +1,53 @@
+//
+//  ManhattanYaw.hpp
+//  Clew
+//
+//  Created by OccamLab on 10/19/26.
+//  Copyright © 2026 OccamLab. All rights reserved.
+//
+
+#ifndef ManhattanYaw_hpp
+#define ManhattanYaw_hpp
+
+#include <opencv2/opencv.hpp>
+#include <vector>
+#include "UprightAlignment.hpp"
+
+/**
+ The horizontal directions of the walls in a leveled image of a Manhattan scene (one whose walls meet at right angles, like most corridors and rooms).  After leveling, every horizontal line in the scene passes through the vanishing point of its direction on the horizon, so each line votes for the azimuth of its direction, and the azimuths of perpendicular walls differ by a multiple of pi / 2.
+ */
+typedef struct {
+    /// whether the scene looked like a Manhattan scene (enough vertical lines and a clear peak of horizontal directions)
+    bool is_valid;
+    /// the azimuth (the angle to the right of the optical axis) of one of the horizontal directions, in [0, pi / 2)
+    float azimuth;
+    /// the fraction of the votes of the horizontal lines within a degree of the peak
+    float peakFraction;
+    /// the fraction of the line pixels that are on vertical lines
+    float verticalFraction;
+    /// the number of line pixels that voted
+    int support;
+} ManhattanFrame;
+
+/**
+ Estimate the horizontal directions of a Manhattan scene from the lines in a leveled image.  Rather than detecting segments, every pixel whose gradient has a single clear orientation (by the structure tensor) votes for the azimuth of the vanishing point of the line through it, which takes a few milliseconds and needs no texture beyond the edges of walls, doors and floors.  Lines close to horizontal in the image are left out since their vanishing points are poorly constrained.
+
+ - returns: The horizontal directions.
+
+ - parameters:
+ - leveled: The leveled image.
+ */
+ManhattanFrame estimateManhattanFrame(const LeveledImage& leveled);
+
+/**
+ Get the yaws that line up the horizontal directions of two Manhattan scenes.  There are four since the directions are only known up to a multiple of pi / 2.  The yaws mean the same as in UprightAlignment.
+
+ - returns: The four yaws (in (-pi, pi]), or none if either scene isn't valid.
+
+ - parameters:
+ - anchor: The horizontal directions in the first leveled image.
+ - live: The horizontal directions in the second leveled image.
+ */
+std::vector<float> getManhattanYawHypotheses(const ManhattanFrame& anchor, const ManhattanFrame& live);
+
+#endif /* ManhattanYaw_hpp */
@@ -0,0 +1,119 @@
+//
+//  MemoryAccounting.cpp
+//  Clew
+//
+//  Created by OccamLab on 10/19/26.
+//  Copyright © 2026 OccamLab. All rights reserved.
+//
+
+#include "MemoryAccounting.hpp"
+#include "AlignmentTrace.hpp"
+#include <mutex>
+
+CountingMatAllocator::CountingMatAllocator() : allocator(cv::Mat::getStdAllocator()), currentBytes(0), totalBytes(0) {
+    for (unsigned int i = 0; i < kMaxPeakTrackers; i++) {
+        isTracking[i] = false;
+        trackedPeakBytes[i] = 0;
+    }
+}
+
+cv::UMatData* CountingMatAllocator::allocate(int dims, const int* sizes, int type, void* data, size_t* step, cv::AccessFlag flags, cv::UMatUsageFlags usageFlags) const {
+    cv::UMatData* u = allocator->allocate(dims, sizes, type, data, step, flags, usageFlags);
+    // route the release of the Mat back through us
+    u->prevAllocator = u->currAllocator = this;
+    if (!(u->flags & cv::UMatData::USER_ALLOCATED)) {
+        const size_t current = currentBytes.fetch_add(u->size) + u->size;
+        totalBytes.fetch_add(u->size);
+        for (unsigned int i = 0; i < kMaxPeakTrackers; i++) {
+            if (!isTracking[i].load(std::memory_order_relaxed)) {
+                continue;
+            }
+            size_t peak = trackedPeakBytes[i].load();
+            while (current > peak && !trackedPeakBytes[i].compare_exchange_weak(peak, current)) {
+            }
+        }
+        ALIGNMENT_TRACE_COUNTER("cv::Mat bytes", current);
+    }
+    return u;
+}
+
+bool CountingMatAllocator::allocate(cv::UMatData* data, cv::AccessFlag accessFlags, cv::UMatUsageFlags usageFlags) const {
+    return allocator->allocate(data, accessFlags, usageFlags);
+}
+
+void CountingMatAllocator::deallocate(cv::UMatData* data) const {
+    if (!data) {
+        return;
+    }
+    if (!(data->flags & cv::UMatData::USER_ALLOCATED)) {
+        const size_t current = currentBytes.fetch_sub(data->size) - data->size;
+        ALIGNMENT_TRACE_COUNTER("cv::Mat bytes", current);
+    }
+    allocator->deallocate(data);
+}
+
+size_t CountingMatAllocator::getCurrentBytes() const {
+    return currentBytes.load();
+}
+
+size_t CountingMatAllocator::getTotalBytes() const {
+    return totalBytes.load();
+}
+
+int CountingMatAllocator::claimPeakTracker() const {
+    for (unsigned int i = 0; i < kMaxPeakTrackers; i++) {
+        bool wasTracking = false;
+        if (isTracking[i].compare_exchange_strong(wasTracking, true)) {
+            // released trackers are left at 0, so this only ever raises the peak to something seen since the claim
+            size_t peak = trackedPeakBytes[i].load();
+            const size_t current = currentBytes.load();
+            while (current > peak && !trackedPeakBytes[i].compare_exchange_weak(peak, current)) {
+            }
+            return i;
+        }
+    }
+    return -1;
+}
+
+size_t CountingMatAllocator::getTrackedPeakBytes(int tracker) const {
+    return tracker >= 0 ? trackedPeakBytes[tracker].load() : 0;
+}
+
+void CountingMatAllocator::releasePeakTracker(int tracker) const {
+    if (tracker >= 0) {
+        trackedPeakBytes[tracker].store(0);
+        isTracking[tracker].store(false);
+    }
+}
+
+CountingMatAllocator& getCountingMatAllocator() {
+    // never destroyed since Mats may outlive static destruction
+    static CountingMatAllocator* allocator = new CountingMatAllocator();
+    return *allocator;
+}
+
+void installCountingMatAllocator() {
+    static std::once_flag installed;
+    std::call_once(installed, [] {
+        cv::Mat::setDefaultAllocator(&getCountingMatAllocator());
+    });
+}
+
+MemoryAccountingScope::MemoryAccountingScope(const CountingMatAllocator& allocator) : allocator(allocator), baselineBytes(allocator.getCurrentBytes()), baselineTotalBytes(allocator.getTotalBytes()), peakTracker(allocator.claimPeakTracker()) {
+}
+
+MemoryAccountingScope::~MemoryAccountingScope() {
+    allocator.releasePeakTracker(peakTracker);
+}
+
+size_t MemoryAccountingScope::getPeakBytes() const {
+    if (peakTracker < 0) {
+        return 0;
+    }
+    const size_t peak = allocator.getTrackedPeakBytes(peakTracker);
+    return peak > baselineBytes ? peak - baselineBytes : 0;
+}
+
+size_t MemoryAccountingScope::getAllocatedBytes() const {
+    return allocator.getTotalBytes() - baselineTotalBytes;
+}
@@ -0,0 +1,92 @@
+//
+//  MemoryAccounting.hpp
+//  Clew
+//
+//  Created by OccamLab on 10/19/26.
+//  Copyright © 2026 OccamLab. All rights reserved.
+//
+
+#ifndef MemoryAccounting_hpp
+#define MemoryAccounting_hpp
+
+#include <opencv2/opencv.hpp>
+#include <atomic>
+#include <cstddef>
+
+/// how many MemoryAccountingScopes can measure their peaks at once
+static const unsigned int kMaxPeakTrackers = 8;
+
+/**
+ A cv::MatAllocator that counts the bytes of the cv::Mat buffers it hands out and otherwise leaves the work to OpenCV's own allocator.  Images, pyramids, and descriptors make up almost all of what the alignment code allocates, so this is a good measure of its memory use.
+ 
+ When tracing is compiled in (see AlignmentTrace.hpp), the bytes in use are recorded as the "cv::Mat bytes" counter every time they change so that they line up with the traced stages.
+ */
+class CountingMatAllocator : public cv::MatAllocator {
+public:
+    CountingMatAllocator();
+    
+    cv::UMatData* allocate(int dims, const int* sizes, int type, void* data, size_t* step, cv::AccessFlag flags, cv::UMatUsageFlags usageFlags) const override;
+    bool allocate(cv::UMatData* data, cv::AccessFlag accessFlags, cv::UMatUsageFlags usageFlags) const override;
+    void deallocate(cv::UMatData* data) const override;
+    
+    /// the bytes currently allocated
+    size_t getCurrentBytes() const;
+    /// the bytes ever allocated
+    size_t getTotalBytes() const;
+    
+    /**
+     Start measuring the most bytes allocated at once, independently of any other measurement.
+     
+     - returns: The tracker to pass to getTrackedPeakBytes and releasePeakTracker, or -1 if all kMaxPeakTrackers are in use.
+     */
+    int claimPeakTracker() const;
+    /// the most bytes allocated at once since the tracker was claimed
+    size_t getTrackedPeakBytes(int tracker) const;
+    /// Stop measuring the peak of a tracker so that it can be claimed again.
+    void releasePeakTracker(int tracker) const;
+    
+private:
+    const cv::MatAllocator* allocator;
+    mutable std::atomic<size_t> currentBytes;
+    mutable std::atomic<size_t> totalBytes;
+    /// whether each tracker is claimed, and the peak it has seen (only updated while it is claimed)
+    mutable std::atomic<bool> isTracking[kMaxPeakTrackers];
+    mutable std::atomic<size_t> trackedPeakBytes[kMaxPeakTrackers];
+};
+
+/**
+ Install the counting allocator as the default cv::Mat allocator.  This should be called once at startup, before any alignment work, since Mats allocated before then are neither counted nor affected.  Calling it again does nothing.
+ */
+void installCountingMatAllocator();
+
+/**
+ Get the allocator (which counts nothing until installCountingMatAllocator is called).
+ 
+ - returns: The allocator.
+ */
+CountingMatAllocator& getCountingMatAllocator();
+
+/**
+ Measures the cv::Mat memory allocated from its construction on.  Allocations on every thread are counted, so calls that overlap each other are measured together, but each scope has a peak of its own, so overlapping scopes don't reset each other's.  If more than kMaxPeakTrackers scopes are open at once, the extra ones report a peak of 0.
+ */
+class MemoryAccountingScope {
+public:
+    MemoryAccountingScope(const CountingMatAllocator& allocator);
+    ~MemoryAccountingScope();
+    
+    MemoryAccountingScope(const MemoryAccountingScope&) = delete;
+    MemoryAccountingScope& operator=(const MemoryAccountingScope&) = delete;
+    
+    /// the most bytes allocated at once beyond those allocated when the scope started
+    size_t getPeakBytes() const;
+    /// the bytes allocated since the scope started (whether or not they were freed)
+    size_t getAllocatedBytes() const;
+    
+private:
+    const CountingMatAllocator& allocator;
+    size_t baselineBytes;
+    size_t baselineTotalBytes;
+    int peakTracker;
+};
+
+#endif /* MemoryAccounting_hpp */
@@ -0,0 +1,121 @@
+//
+//  PhaseCorrelationYaw.cpp
+//  Clew
+//
+//  Created by OccamLab on 10/19/26.
+//  Copyright © 2026 OccamLab. All rights reserved.
+//
+
+#include "PhaseCorrelationYaw.hpp"
+#include "AlignmentTrace.hpp"
+#include "AlignmentLog.hpp"
+#include <algorithm>
+#include <cmath>
+
+/// the smallest cylindrical image worth correlating (in either direction)
+static const int kMinCylinderSize = 16;
+
+/// the intrinsics of the downsampled leveled image
+static Eigen::Matrix3f getDownsampledIntrinsics(const LeveledImage& leveled) {
+    Eigen::Matrix3f intrinsics = leveled.intrinsics;
+    intrinsics.block(0, 0, 2, 3) /= leveled.downSampleFactor;
+    return intrinsics;
+}
+
+void getAzimuthRange(const LeveledImage& leveled, float& minAzimuth, float& maxAzimuth) {
+    const Eigen::Matrix3f intrinsics = getDownsampledIntrinsics(leveled);
+    minAzimuth = std::atan2(-intrinsics(0, 2), intrinsics(0, 0));
+    maxAzimuth = std::atan2(leveled.image.cols - 1 - intrinsics(0, 2), intrinsics(0, 0));
+}
+
+bool getCommonCylinderRange(const LeveledImage& anchor, const LeveledImage& live, float scale, CylinderRange& range) {
+    float minAzimuth = -M_PI_2, maxAzimuth = M_PI_2;
+    float minY = -INFINITY, maxY = INFINITY;
+    for (const LeveledImage* leveled : {&anchor, &live}) {
+        const Eigen::Matrix3f intrinsics = getDownsampledIntrinsics(*leveled);
+        float imageMinAzimuth, imageMaxAzimuth;
+        getAzimuthRange(*leveled, imageMinAzimuth, imageMaxAzimuth);
+        minAzimuth = std::max(minAzimuth, imageMinAzimuth);
+        maxAzimuth = std::min(maxAzimuth, imageMaxAzimuth);
+        minY = std::max(minY, -intrinsics(1, 2) / intrinsics(1, 1));
+        maxY = std::min(maxY, (leveled->image.rows - 1 - intrinsics(1, 2)) / intrinsics(1, 1));
+    }
+    // A row of the cylinder curves in the image, getting closest to the horizon at the edges, so the heights have to fit at the widest azimuth.
+    const float edgeCos = std::cos(std::max(std::abs(minAzimuth), std::abs(maxAzimuth)));
+    range.minAzimuth = minAzimuth;
+    range.maxAzimuth = maxAzimuth;
+    range.minHeight = minY * edgeCos;
+    range.maxHeight = maxY * edgeCos;
+    range.pixelsPerRadian = scale * getDownsampledIntrinsics(anchor)(0, 0);
+    return (range.maxAzimuth - range.minAzimuth) * range.pixelsPerRadian >= kMinCylinderSize && (range.maxHeight - range.minHeight) * range.pixelsPerRadian >= kMinCylinderSize;
+}
+
+cv::Mat reprojectToCylinder(const LeveledImage& leveled, const CylinderRange& range, cv::Mat* coverage) {
+    const Eigen::Matrix3f intrinsics = getDownsampledIntrinsics(leveled);
+    const int cols = (int) std::round((range.maxAzimuth - range.minAzimuth) * range.pixelsPerRadian) + 1;
+    const int rows = (int) std::round((range.maxHeight - range.minHeight) * range.pixelsPerRadian) + 1;
+    cv::Mat mapX(rows, cols, CV_32F), mapY(rows, cols, CV_32F);
+    std::vector<float> columnX(cols), columnSecant(cols);
+    for (int j = 0; j < cols; j++) {
+        const float azimuth = range.minAzimuth + j / range.pixelsPerRadian;
+        columnX[j] = intrinsics(0, 0) * std::tan(azimuth) + intrinsics(0, 2);
+        columnSecant[j] = 1.0f / std::cos(azimuth);
+    }
+    for (int i = 0; i < rows; i++) {
+        const float height = range.minHeight + i / range.pixelsPerRadian;
+        float* x = mapX.ptr<float>(i);
+        float* y = mapY.ptr<float>(i);
+        for (int j = 0; j < cols; j++) {
+            x[j] = columnX[j];
+            y[j] = intrinsics(1, 1) * height * columnSecant[j] + intrinsics(1, 2);
+        }
+    }
+
+    cv::Mat gray;
+    if (leveled.image.channels() == 1) {
+        gray = leveled.image;
+    } else {
+        cv::cvtColor(leveled.image, gray, cv::COLOR_BGR2GRAY);
+    }
+    // leveling leaves the corners it couldn't fill black
+    const cv::Mat invalid = gray == 0;
+    const double fill = cv::mean(gray, ~invalid)[0];
+    cv::Mat image;
+    gray.convertTo(image, CV_32F);
+    image.setTo(fill, invalid);
+    cv::Mat cylinder;
+    cv::remap(image, cylinder, mapX, mapY, cv::INTER_LINEAR, cv::BORDER_CONSTANT, cv::Scalar(fill));
+    if (coverage) {
+        cv::remap(~invalid, *coverage, mapX, mapY, cv::INTER_NEAREST, cv::BORDER_CONSTANT, cv::Scalar(0));
+    }
+    return cylinder;
+}
+
+PhaseCorrelationYaw getPhaseCorrelationYaw(const LeveledImage& anchor, const LeveledImage& live, float minConfidence, float scale) {
+    ALIGNMENT_TRACE_SCOPE("getPhaseCorrelationYaw");
+    PhaseCorrelationYaw result;
+    result.is_valid = false;
+    result.yaw = 0;
+    result.confidence = 0;
+    result.verticalShift = 0;
+
+    CylinderRange range;
+    if (!getCommonCylinderRange(anchor, live, scale, range)) {
+        ALIGNMENT_LOG_DEBUG(Solver, "the leveled images share too little of the cylinder for phase correlation");
+        return result;
+    }
+    const cv::Mat anchorCylinder = reprojectToCylinder(anchor, range);
+    const cv::Mat liveCylinder = reprojectToCylinder(live, range);
+    // the window keeps the edges of the images from showing up as a peak at no shift
+    cv::Mat window;
+    cv::createHanningWindow(window, anchorCylinder.size(), CV_32F);
+    double response = 0;
+    const cv::Point2d shift = cv::phaseCorrelate(anchorCylinder, liveCylinder, window, &response);
+
+    result.yaw = shift.x / range.pixelsPerRadian;
+    result.verticalShift = shift.y / range.pixelsPerRadian;
+    result.confidence = response;
+    result.is_valid = response >= minConfidence;
+    ALIGNMENT_LOG_DEBUG(Solver, "phase correlation yaw %f (confidence %f, vertical shift %f)", result.yaw, result.confidence, result.verticalShift);
+    return result;
+}
@@ -0,0 +1,90 @@
+//
+//  PhaseCorrelationYaw.hpp
+//  Clew
+//
+//  Created by OccamLab on 10/19/26.
+//  Copyright © 2026 OccamLab. All rights reserved.
+//
+
+#ifndef PhaseCorrelationYaw_hpp
+#define PhaseCorrelationYaw_hpp
+
+#include <opencv2/opencv.hpp>
+#include "UprightAlignment.hpp"
+
+/**
+ The part of the cylinder around a leveled camera that an image is reprojected onto.  Columns are spaced evenly in azimuth (the angle to the right of the optical axis) and rows evenly in height (y over the horizontal distance to the point), so that a yaw of the camera only shifts the columns.
+ */
+typedef struct {
+    /// the azimuth of the first and last column (in radians)
+    float minAzimuth;
+    float maxAzimuth;
+    /// the height of the first and last row
+    float minHeight;
+    float maxHeight;
+    /// how many columns (and rows) there are per radian
+    float pixelsPerRadian;
+} CylinderRange;
+
+/**
+ The yaw between two leveled images found by phase correlation.  The yaw means the same as in UprightAlignment.
+ */
+typedef struct {
+    /// whether the peak of the correlation was sharp enough to trust
+    bool is_valid;
+    float yaw;
+    /// the height of the peak of the correlation (near 1 when the images only differ by a yaw and near 0 when they are unrelated)
+    float confidence;
+    /// how far the live image was shifted up or down on the cylinder (in units of height), which is only large when the camera moved
+    float verticalShift;
+} PhaseCorrelationYaw;
+
+/**
+ Get the azimuths of the left and right edges of a leveled image.
+
+ - parameters:
+ - leveled: The leveled image.
+ - minAzimuth: Set to the azimuth of the first column (in radians).
+ - maxAzimuth: Set to the azimuth of the last column (in radians).
+ */
+void getAzimuthRange(const LeveledImage& leveled, float& minAzimuth, float& maxAzimuth);
+
+/**
+ Get the part of the cylinder that both leveled images cover.
+
+ - returns: False if the images don't share any of the cylinder.
+
+ - parameters:
+ - anchor: The first leveled image.
+ - live: The second leveled image.
+ - scale: How many pixels of the cylinder there are per pixel of the (downsampled) first image at its center.
+ - range: The range that both images cover (only set when there is one).
+ */
+bool getCommonCylinderRange(const LeveledImage& anchor, const LeveledImage& live, float scale, CylinderRange& range);
+
+/**
+ Reproject a leveled image onto a cylinder around its camera.  Pixels that are outside of the image or that were left black by leveling are set to the mean of the rest, so that the edges they leave don't dominate the correlation.
+
+ - returns: The cylindrical image (single channel floating point).
+
+ - parameters:
+ - leveled: The leveled image.
+ - range: The part of the cylinder to reproject onto.
+ - coverage: If not null, set to 255 where the image covers the cylinder and 0 elsewhere.
+ */
+cv::Mat reprojectToCylinder(const LeveledImage& leveled, const CylinderRange& range, cv::Mat* coverage = nullptr);
+
+/**
+ Estimate the yaw between two leveled images without features.  After reprojection onto a common cylinder, a pure yaw is a horizontal shift, which is found by phase correlation of the windowed images.  This takes a few milliseconds, but it assumes that the camera only turned (or that the scene is far away), so it is meant for a fast first guess or as a fallback when the images have too little texture for features.
+
+ - returns: The yaw.
+
+ - parameters:
+ - anchor: The first leveled image.
+ - live: The second leveled image.
+ - minConfidence: The lowest peak of the correlation to accept.
+ - scale: How finely to sample the cylinder (see getCommonCylinderRange).
+ */
+PhaseCorrelationYaw getPhaseCorrelationYaw(const LeveledImage& anchor, const LeveledImage& live, float minConfidence = 0.1, float scale = 0.5);
+
+#endif /* PhaseCorrelationYaw_hpp */
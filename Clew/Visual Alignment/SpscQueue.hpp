@@ -0,0 +1,65 @@
+//
+//  SpscQueue.hpp
+//  Clew
+//
+//  Created by OccamLab on 10/19/26.
+//  Copyright © 2026 OccamLab. All rights reserved.
+//
+
+#ifndef SpscQueue_hpp
+#define SpscQueue_hpp
+
+#include <array>
+#include <atomic>
+#include <cstddef>
+#include <utility>
+
+/**
+ A bounded lock-free queue between exactly one producer thread and one consumer thread.
+ 
+ - parameters:
+ - T: The type of the elements (it has to be default constructible and movable).
+ - Capacity: The most elements the queue can hold.
+ */
+template <typename T, size_t Capacity>
+class SpscQueue {
+public:
+    SpscQueue() : head(0), tail(0) {}
+    
+    SpscQueue(const SpscQueue&) = delete;
+    SpscQueue& operator=(const SpscQueue&) = delete;
+    
+    /// Add an element (producer only).  Returns false (leaving value alone) if the queue is full.
+    bool tryPush(T&& value) {
+        const size_t currentTail = tail.load(std::memory_order_relaxed);
+        const size_t nextTail = (currentTail + 1) % (Capacity + 1);
+        if (nextTail == head.load(std::memory_order_acquire)) {
+            return false;
+        }
+        slots[currentTail] = std::move(value);
+        tail.store(nextTail, std::memory_order_release);
+        return true;
+    }
+    
+    /// Remove the oldest element (consumer only).  Returns false if the queue is empty.
+    bool tryPop(T& value) {
+        const size_t currentHead = head.load(std::memory_order_relaxed);
+        if (currentHead == tail.load(std::memory_order_acquire)) {
+            return false;
+        }
+        value = std::move(slots[currentHead]);
+        // don't hold on to the element's resources (e.g., image buffers) until the slot is reused
+        slots[currentHead] = T();
+        head.store((currentHead + 1) % (Capacity + 1), std::memory_order_release);
+        return true;
+    }
+    
+private:
+    /// one slot is always left empty to tell a full queue from an empty one
+    std::array<T, Capacity + 1> slots;
+    /// the next element to pop (written by the consumer) and the next slot to push into (written by the producer), kept on separate cache lines
+    alignas(64) std::atomic<size_t> head;
+    alignas(64) std::atomic<size_t> tail;
+};
+
+#endif /* SpscQueue_hpp */
@@ -0,0 +1,167 @@
+//
+//  UprightAbsolutePose.cpp
+//  Clew
+//
+//  Created by OccamLab on 10/19/26.
+//  Copyright © 2026 OccamLab. All rights reserved.
+//
+
+#include "UprightAbsolutePose.hpp"
+#include "AlignmentTrace.hpp"
+#include <Eigen/Geometry>
+#include <Eigen/QR>
+#include <random>
+
+/// the number of times local optimization refits and rescores a new best pose
+static const unsigned int kAbsoluteRefinementRounds = 3;
+
+int scoreUprightAbsolutePose(double yaw, const Eigen::Vector3d& translation, const UprightAbsoluteCorrespondences& correspondences, double threshold, double& inlierResidualSum, std::vector<int>* inliers) {
+    const Eigen::Matrix3d rotation = Eigen::AngleAxisd(yaw, Eigen::Vector3d::UnitY()).toRotationMatrix();
+    int totalInliers = 0;
+    inlierResidualSum = 0.0;
+    for (unsigned int j = 0; j < correspondences.points.size(); j++) {
+        const Eigen::Vector3d projected = rotation * correspondences.points[j] + translation;
+        const Eigen::Vector3d& ray = correspondences.rays[j];
+        if (projected.z() <= 0 || ray.z() <= 0) {
+            // behind the camera
+            continue;
+        }
+        const double error = (projected.head<2>() / projected.z() - ray.head<2>() / ray.z()).norm();
+        if (error < threshold) {
+            totalInliers++;
+            inlierResidualSum += error;
+            if (inliers) {
+                inliers->push_back(j);
+            }
+        }
+    }
+    return totalInliers;
+}
+
+bool refineUprightAbsolutePose(const UprightAbsoluteCorrespondences& correspondences, const std::vector<int>& inliers, double& yaw, Eigen::Vector3d& translation) {
+    if (inliers.size() < 2) {
+        return false;
+    }
+    // the same rows as TwoPointUprightAbsolutePose, in (cos(yaw), sin(yaw), tx, ty, tz)
+    Eigen::MatrixXd A(2*inliers.size(), 5);
+    Eigen::VectorXd b(2*inliers.size());
+    for (unsigned int i = 0; i < inliers.size(); i++) {
+        const Eigen::Vector3d& X = correspondences.points[inliers[i]];
+        const Eigen::Vector3d& r = correspondences.rays[inliers[i]];
+        A.row(2*i) << r.z()*X.x() - r.x()*X.z(), r.z()*X.z() + r.x()*X.x(), r.z(), 0.0, -r.x();
+        b(2*i) = 0.0;
+        A.row(2*i + 1) << -r.y()*X.z(), r.y()*X.x(), 0.0, r.z(), -r.y();
+        b(2*i + 1) = -r.z()*X.y();
+    }
+    const Eigen::VectorXd x = A.colPivHouseholderQr().solve(b);
+    if (!x.allFinite() || x.head<2>().norm() == 0) {
+        return false;
+    }
+    const double fittedYaw = atan2(x(1), x(0));
+    
+    // (cos, sin) from the least squares fit is not quite unit length, so fit the translation again with the yaw fixed
+    const Eigen::Matrix3d rotation = Eigen::AngleAxisd(fittedYaw, Eigen::Vector3d::UnitY()).toRotationMatrix();
+    Eigen::MatrixXd B(2*inliers.size(), 3);
+    Eigen::VectorXd c(2*inliers.size());
+    for (unsigned int i = 0; i < inliers.size(); i++) {
+        const Eigen::Vector3d rotated = rotation * correspondences.points[inliers[i]];
+        const Eigen::Vector3d& r = correspondences.rays[inliers[i]];
+        B.row(2*i) << r.z(), 0.0, -r.x();
+        c(2*i) = r.x()*rotated.z() - r.z()*rotated.x();
+        B.row(2*i + 1) << 0.0, r.z(), -r.y();
+        c(2*i + 1) = r.y()*rotated.z() - r.z()*rotated.y();
+    }
+    const Eigen::Vector3d fittedTranslation = B.colPivHouseholderQr().solve(c);
+    if (!fittedTranslation.allFinite()) {
+        return false;
+    }
+    yaw = fittedYaw;
+    translation = fittedTranslation;
+    return true;
+}
+
+UprightAbsoluteResult runUprightAbsoluteRansac(const UprightAbsoluteCorrespondences& correspondences, const UprightRansacOptions& options) {
+    ALIGNMENT_TRACE_SCOPE("runUprightAbsoluteRansac");
+    const unsigned int numCorrespondences = correspondences.points.size();
+    const unsigned int sampleSize = 2;
+    UprightAbsoluteResult result;
+    result.found = false;
+    result.yaw = 0;
+    result.translation = Eigen::Vector3d::Zero();
+    result.inlierCount = -1;
+    result.inlierResidualSum = -1;
+    result.refined = false;
+    result.trials = 0;
+    if (numCorrespondences < sampleSize) {
+        return result;
+    }
+    
+    std::mt19937_64 generator(options.seed);
+    std::uniform_int_distribution<unsigned int> pick(0, numCorrespondences - 1);
+    unsigned int trialsNeeded = options.maxTrials;
+    unsigned int trial = 0;
+    for (; trial < trialsNeeded; trial++) {
+        const unsigned int first = pick(generator);
+        unsigned int second;
+        do {
+            second = pick(generator);
+        } while (second == first);
+        const Eigen::Vector3d points[2] = {correspondences.points[first], correspondences.points[second]};
+        const Eigen::Vector3d rays[2] = {correspondences.rays[first], correspondences.rays[second]};
+        std::vector<double> soln_yaws;
+        std::vector<Eigen::Vector3d> soln_translations;
+        TwoPointUprightAbsolutePose(points, rays, &soln_yaws, &soln_translations);
+        
+        bool improved = false;
+        for (unsigned int i = 0; i < soln_yaws.size(); i++) {
+            if (!isYawAllowed(soln_yaws[i], options)) {
+                continue;
+            }
+            double inlierResidualSum;
+            const int inlierCount = scoreUprightAbsolutePose(soln_yaws[i], soln_translations[i], correspondences, options.reprojectionThreshold, inlierResidualSum);
+            if (inlierCount > result.inlierCount || (inlierCount == result.inlierCount && inlierResidualSum < result.inlierResidualSum)) {
+                result.found = true;
+                result.yaw = soln_yaws[i];
+                result.translation = soln_translations[i];
+                result.inlierCount = inlierCount;
+                result.inlierResidualSum = inlierResidualSum;
+                result.refined = false;
+                improved = true;
+            }
+        }
+        if (!improved) {
+            continue;
+        }
+        
+        if (options.localOptimization) {
+            // refit the new best pose to all of its inliers for as long as that picks up more of them
+            for (unsigned int round = 0; round < kAbsoluteRefinementRounds; round++) {
+                std::vector<int> inliers;
+                double unusedResidualSum;
+                scoreUprightAbsolutePose(result.yaw, result.translation, correspondences, options.reprojectionThreshold, unusedResidualSum, &inliers);
+                double refinedYaw;
+                Eigen::Vector3d refinedTranslation;
+                if (!refineUprightAbsolutePose(correspondences, inliers, refinedYaw, refinedTranslation)) {
+                    break;
+                }
+                if (!isYawAllowed(refinedYaw, options)) {
+                    break;
+                }
+                double refinedResidualSum;
+                const int refinedInliers = scoreUprightAbsolutePose(refinedYaw, refinedTranslation, correspondences, options.reprojectionThreshold, refinedResidualSum);
+                if (refinedInliers < result.inlierCount || (refinedInliers == result.inlierCount && refinedResidualSum >= result.inlierResidualSum)) {
+                    break;
+                }
+                result.yaw = refinedYaw;
+                result.translation = refinedTranslation;
+                result.inlierCount = refinedInliers;
+                result.inlierResidualSum = refinedResidualSum;
+                result.refined = true;
+            }
+        }
+        trialsNeeded = adaptiveRansacTrials((double) result.inlierCount / numCorrespondences, sampleSize, options.confidence, options.maxTrials);
+    }
+    result.trials = trial;
+    ALIGNMENT_TRACE_COUNTER("ransac trials", result.trials);
+    return result;
+}
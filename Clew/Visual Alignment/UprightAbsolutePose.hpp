@@ -0,0 +1,84 @@
+//
+//  UprightAbsolutePose.hpp
+//  Clew
+//
+//  Created by OccamLab on 10/19/26.
+//  Copyright © 2026 OccamLab. All rights reserved.
+//
+
+#ifndef UprightAbsolutePose_hpp
+#define UprightAbsolutePose_hpp
+
+#include <Eigen/Core>
+#include <vector>
+#include "UprightRansac.hpp"
+
+/**
+ 3D points seen from one leveled camera matched to rays of another.
+ */
+typedef struct {
+    /// the points in the coordinates of the first (leveled anchor) camera
+    std::vector<Eigen::Vector3d> points;
+    /// the rays to the same points in the second (leveled) camera
+    std::vector<Eigen::Vector3d> rays;
+} UprightAbsoluteCorrespondences;
+
+/**
+ The outcome of upright absolute pose RANSAC.  The pose maps points of the first camera into the second (ray ~ Ry(yaw) * point + translation).
+ */
+typedef struct {
+    /// whether any hypothesis was scored
+    bool found;
+    double yaw;
+    /// the translation (in the units of the points)
+    Eigen::Vector3d translation;
+    int inlierCount;
+    double inlierResidualSum;
+    /// whether the best pose came out of refinement
+    bool refined;
+    /// the number of samples drawn
+    unsigned int trials;
+} UprightAbsoluteResult;
+
+/**
+ Score an upright pose against 2D-3D correspondences by reprojection error.
+ 
+ - returns: The number of inliers.
+ 
+ - parameters:
+ - yaw: The yaw of the pose.
+ - translation: The translation of the pose.
+ - correspondences: The correspondences.
+ - threshold: The largest reprojection error (in normalized image coordinates) of an inlier.
+ - inlierResidualSum: Set to the sum of the reprojection errors of the inliers.
+ - inliers: If not null, the indices of the inliers are appended to it.
+ */
+int scoreUprightAbsolutePose(double yaw, const Eigen::Vector3d& translation, const UprightAbsoluteCorrespondences& correspondences, double threshold, double& inlierResidualSum, std::vector<int>* inliers = nullptr);
+
+/**
+ Fit an upright pose to a set of 2D-3D correspondences with linear least squares (the yaw from the same linear system TwoPointUprightAbsolutePose uses, and then the translation with the yaw held fixed).
+ 
+ - returns: False if the correspondences are degenerate.
+ 
+ - parameters:
+ - correspondences: The correspondences.
+ - inliers: The indices of the correspondences to fit.
+ - yaw: Set to the fitted yaw.
+ - translation: Set to the fitted translation.
+ */
+bool refineUprightAbsolutePose(const UprightAbsoluteCorrespondences& correspondences, const std::vector<int>& inliers, double& yaw, Eigen::Vector3d& translation);
+
+/**
+ Find the yaw and metric translation of a leveled camera from 2D-3D correspondences with RANSAC over TwoPointUprightAbsolutePose.
+ 
+ Two point samples are all inliers far more often than three point ones, so this runs on the calling thread (options.workerPool and options.sprt are ignored).  The solver, inlierThreshold, scoring, and consensus options only apply to relative pose, and reprojectionThreshold is used instead.
+ 
+ - returns: The best pose and its support.
+ 
+ - parameters:
+ - correspondences: The correspondences.
+ - options: How to run RANSAC.
+ */
+UprightAbsoluteResult runUprightAbsoluteRansac(const UprightAbsoluteCorrespondences& correspondences, const UprightRansacOptions& options);
+
+#endif /* UprightAbsolutePose_hpp */
@@ -0,0 +1,444 @@
+//
+//  UprightAlignment.cpp
+//  Clew
+//
+//  Created by OccamLab on 10/19/26.
+//  Copyright © 2026 OccamLab. All rights reserved.
+//
+
+#include "UprightAlignment.hpp"
+#include "AlignmentTrace.hpp"
+#include <opencv2/opencv.hpp>
+#include <opencv2/core/eigen.hpp>
+#include <Eigen/Core>
+#include <Eigen/Geometry>
+#include <limits>
+
+LeveledImage levelImage(const cv::Mat& image, Eigen::Matrix3f intrinsics, const Eigen::Matrix4f& pose, int downSampleFactor) {
+    ALIGNMENT_TRACE_SCOPE("levelImage");
+    LeveledImage leveled;
+    cv::Mat rotated_image;
+    cv::rotate(image, rotated_image, cv::ROTATE_90_CLOCKWISE);
+    
+    // Since the image was rotated clockwise, we have to swap entries in the intrinsic matrices as well.
+    // I use matrix multiplication for this.
+    Eigen::Matrix3f swap_matrix;
+    swap_matrix << 0, 1, 0, 1, 0, 0, 0, 0, 1;
+    leveled.intrinsics = swap_matrix * intrinsics * swap_matrix;
+    leveled.intrinsics(0, 2) = rotated_image.cols - leveled.intrinsics(0, 2);
+    leveled.pose = pose;
+    leveled.squareRotation = getIdealRotation(pose);
+    leveled.downSampleFactor = downSampleFactor;
+    
+    const auto square_image = warpPerspectiveWithGlobalRotation(rotated_image, leveled.intrinsics, pose.block(0, 0, 3, 3), leveled.squareRotation);
+    cv::resize(square_image, leveled.image, cv::Size(square_image.size().width/downSampleFactor, square_image.size().height/downSampleFactor));
+    return leveled;
+}
+
+YawPrior getYawPrior(const LeveledImage& anchor, const LeveledImage& live, float uncertainty) {
+    YawPrior prior;
+    prior.yaw = getPredictedYaw(getLeveledCameraRotation(anchor.pose.block(0, 0, 3, 3), anchor.squareRotation), getLeveledCameraRotation(live.pose.block(0, 0, 3, 3), live.squareRotation));
+    prior.uncertainty = uncertainty;
+    return prior;
+}
+
+std::vector<cv::DMatch> matchLeveledFeatures(const LeveledImage& anchor, const KeyPointsAndDescriptors& anchorFeatures, const LeveledImage& live, const KeyPointsAndDescriptors& liveFeatures, const YawPrior* prior, int normType, bool& usedPrior) {
+    ALIGNMENT_TRACE_SCOPE("matchLeveledFeatures");
+    usedPrior = false;
+    if (prior) {
+        // the keypoints are in the coordinates of the downsampled images
+        Eigen::Matrix3f intrinsics1_downsampled = anchor.intrinsics;
+        Eigen::Matrix3f intrinsics2_downsampled = live.intrinsics;
+        intrinsics1_downsampled.topRows(2) /= anchor.downSampleFactor;
+        intrinsics2_downsampled.topRows(2) /= live.downSampleFactor;
+        const auto matches = getGuidedMatches(anchorFeatures, intrinsics1_downsampled, liveFeatures, intrinsics2_downsampled, *prior, 0.1*live.image.cols, normType);
+        // if there are too few, the prior is likely off (e.g., ARKit has drifted), so don't let it veto the visual evidence
+        if (matches.size() >= kMinUprightMatches) {
+            usedPrior = true;
+            return matches;
+        }
+    }
+    return getMatches(anchorFeatures.descriptors, liveFeatures.descriptors, normType);
+}
+
+void getMatchedPoints(const LeveledImage& anchor, const KeyPointsAndDescriptors& anchorFeatures, const LeveledImage& live, const KeyPointsAndDescriptors& liveFeatures, const std::vector<cv::DMatch>& matches, std::vector<cv::Point2f>& points1, std::vector<cv::Point2f>& points2) {
+    points1.clear();
+    points2.clear();
+    const Eigen::Matrix3f live_to_anchor = anchor.intrinsics * live.intrinsics.inverse();
+    for (const auto& match : matches) {
+        const auto keypoint1 = anchorFeatures.keypoints[match.queryIdx];
+        const auto keypoint2 = liveFeatures.keypoints[match.trainIdx];
+        // correct for the downsampling
+        points1.push_back((float) anchor.downSampleFactor*keypoint1.pt);
+        
+        // Convert the second keypoint to one with the intrinsics of the first camera.
+        Eigen::Vector3f keypoint2vec;
+        keypoint2vec << live.downSampleFactor*keypoint2.pt.x, live.downSampleFactor*keypoint2.pt.y, 1;
+        Eigen::Vector3f keypoint2projected = live_to_anchor * keypoint2vec;
+        points2.push_back(cv::Point2f(keypoint2projected(0), keypoint2projected(1)));
+    }
+}
+
+/// how far in pixels (of the downsampled leveled image) a feature may be from an epipolar line in guided re-matching
+static const float kGuidedBandWidth = 2.0;
+/// the ratio test threshold of guided re-matching (looser than getMatches since the band leaves few competitors)
+static const float kGuidedRatio = 0.85;
+/// how many times to refine the pose on the guided matches and then score them again
+static const unsigned int kGuidedRefinementRounds = 2;
+/// the share of the combined homography and essential matrix scores (see getModelSelectionScore) above which the homography is chosen (an essential matrix fits a planar scene as well as the homography does, but a homography fits a general scene much worse)
+static const double kHomographySelectionRatio = 0.45;
+/// the share of the inliers of the essential matrix that a homography fit to all of them has to explain for the scene to look planar enough to run homography RANSAC
+static const double kMinPlanarInlierShare = 0.5;
+/// how far in pixels (of the downsampled leveled image) an anchor feature may be from the projection of a 3D point to take it
+static const float kAnchorPointRadius = 3.0;
+
+/**
+ Score a model for model selection by its truncated residuals, as in MSAC: every inlier counts for how far its residual is inside the inlier threshold, from 1 for a perfect fit to 0 at the threshold.  Residuals are relative to each model's own threshold, so the one-dimensional epipolar residuals of the essential matrix and the two-dimensional transfer errors of the homography score alike.  RANSAC only keeps the sum of the residuals of the inliers, which is why the residuals aren't squared (as the chi-square scores of ORB-SLAM are).
+ 
+ - returns: The score.
+ 
+ - parameters:
+ - inlierCount: The number of inliers of the model.
+ - inlierResidualSum: The sum of the residuals of the inliers.
+ - threshold: The largest residual of an inlier.
+ */
+static double getModelSelectionScore(int inlierCount, double inlierResidualSum, double threshold) {
+    return std::max(0.0, inlierCount - inlierResidualSum / threshold);
+}
+
+/**
+ Check whether the inliers of the essential matrix could be on a single vertical plane, in which case the essential matrix is degenerate and the homography should be tried.  This fits one homography to all of the inliers by least squares rather than running RANSAC, so it costs about as much as scoring a hypothesis.
+ 
+ - returns: True if the homography explains enough of the inliers.
+ 
+ - parameters:
+ - correspondences: The matched features.
+ - result: The essential matrix RANSAC found.
+ - options: How RANSAC was run.
+ */
+static bool looksPlanar(const UprightCorrespondences& correspondences, const UprightRansacResult& result, const UprightRansacOptions& options) {
+    std::vector<int> inliers;
+    double inlierResidualSum;
+    scoreEssential(result.essential, correspondences.rays1, correspondences.rays2, options.inlierThreshold, inlierResidualSum, &inliers, options.scoring);
+    Eigen::Matrix3d homography;
+    if (inliers.size() < (size_t) kMinUprightInliers || !refineUprightHomography(correspondences.rays1, correspondences.rays2, inliers, homography)) {
+        return false;
+    }
+    const int planarInliers = scoreUprightHomography(homography, correspondences.rays1, correspondences.rays2, options.homographyThreshold, inlierResidualSum);
+    return planarInliers >= kMinPlanarInlierShare * inliers.size();
+}
+
+/// Get the points and rays of matched features that upright RANSAC works on.
+static UprightCorrespondences getUprightCorrespondences(const LeveledImage& anchor, const KeyPointsAndDescriptors& anchorFeatures, const LeveledImage& live, const KeyPointsAndDescriptors& liveFeatures, const std::vector<cv::DMatch>& matches) {
+    UprightCorrespondences correspondences;
+    getMatchedPoints(anchor, anchorFeatures, live, liveFeatures, matches, correspondences.points1, correspondences.points2);
+    correspondences.focal = anchor.intrinsics(0, 0);
+    correspondences.principalPoint = cv::Point2d(anchor.intrinsics(0, 2), anchor.intrinsics(1, 2));
+    const Eigen::Matrix3f intrinsics1_inverse = anchor.intrinsics.inverse();
+    const Eigen::Matrix3f intrinsics2_inverse = live.intrinsics.inverse();
+    
+    for (unsigned int i = 0; i < matches.size(); i++) {
+        const auto& match = matches[i];
+        const auto keypoint1 = anchorFeatures.keypoints[match.queryIdx];
+        const auto keypoint2 = liveFeatures.keypoints[match.trainIdx];
+        // correct for the downsampling
+        Eigen::Vector3f homogeneousKp1(anchor.downSampleFactor*keypoint1.pt.x, anchor.downSampleFactor*keypoint1.pt.y, 1.0);
+        Eigen::Vector3f image_1_ray = intrinsics1_inverse * homogeneousKp1;
+        correspondences.rays1.push_back(Eigen::Vector3d(image_1_ray.x(), image_1_ray.y(), image_1_ray.z()));
+        Eigen::Vector3f homogeneousKp2(live.downSampleFactor*keypoint2.pt.x, live.downSampleFactor*keypoint2.pt.y, 1.0);
+        Eigen::Vector3f image_2_ray = intrinsics2_inverse * homogeneousKp2;
+        correspondences.rays2.push_back(Eigen::Vector3d(image_2_ray.x(), image_2_ray.y(), image_2_ray.z()));
+    }
+    return correspondences;
+}
+
+/**
+ Match the features again along the epipolar lines of the RANSAC model (see getEpipolarGuidedMatches) and refine the model on the larger set of matches.  The ratio test throws away many true matches in repetitive texture (floor tiles, shelves), and this wins back the ones that agree with the model.
+ 
+ - returns: Whether the refined model has more inliers than the RANSAC model (only then are matches and correspondences replaced with the inliers of the refined model, and essential with the refined model).
+ 
+ - parameters:
+ - anchor: The first leveled image.
+ - anchorFeatures: The features of the first leveled image.
+ - live: The second leveled image.
+ - liveFeatures: The features of the second leveled image.
+ - options: How RANSAC was run.
+ - result: The outcome of RANSAC on matches.
+ - matches: The matches RANSAC was run on.
+ - correspondences: The correspondences of matches.
+ - essential: The essential matrix.
+ */
+static bool rematchAlongEpipolarLines(const LeveledImage& anchor, const KeyPointsAndDescriptors& anchorFeatures, const LeveledImage& live, const KeyPointsAndDescriptors& liveFeatures, const UprightRansacOptions& options, const UprightRansacResult& result, std::vector<cv::DMatch>& matches, UprightCorrespondences& correspondences, Eigen::Matrix3d& essential) {
+    ALIGNMENT_TRACE_SCOPE("rematchAlongEpipolarLines");
+    // tracked features have no descriptors to match with
+    if (anchorFeatures.descriptors.rows != (int) anchorFeatures.keypoints.size() || liveFeatures.descriptors.rows != (int) liveFeatures.keypoints.size()) {
+        return false;
+    }
+    // the matches RANSAC accepted show how far apart the descriptors of true matches get
+    std::vector<int> inliers;
+    double inlierResidualSum;
+    scoreEssential(result.essential, correspondences.rays1, correspondences.rays2, options.inlierThreshold, inlierResidualSum, &inliers, options.scoring);
+    float maxDistance = 0;
+    for (const int j : inliers) {
+        maxDistance = std::max(maxDistance, matches[j].distance);
+    }
+    if (maxDistance <= 0) {
+        return false;
+    }
+    
+    Eigen::Matrix3f intrinsics1_downsampled = anchor.intrinsics;
+    Eigen::Matrix3f intrinsics2_downsampled = live.intrinsics;
+    intrinsics1_downsampled.topRows(2) /= anchor.downSampleFactor;
+    intrinsics2_downsampled.topRows(2) /= live.downSampleFactor;
+    const std::vector<cv::DMatch> guidedMatches = getEpipolarGuidedMatches(anchorFeatures, intrinsics1_downsampled, liveFeatures, intrinsics2_downsampled, result.essential, kGuidedBandWidth, maxDistance, kGuidedRatio);
+    // Start from the matches RANSAC accepted and add the guided ones that don't reuse their features, so the outliers of the original matches can't vote for the refined model.
+    std::vector<cv::DMatch> candidateMatches;
+    std::vector<bool> usedAnchor(anchorFeatures.keypoints.size(), false), usedLive(liveFeatures.keypoints.size(), false);
+    for (const int j : inliers) {
+        candidateMatches.push_back(matches[j]);
+        usedAnchor[matches[j].queryIdx] = true;
+        usedLive[matches[j].trainIdx] = true;
+    }
+    for (const auto& match : guidedMatches) {
+        if (!usedAnchor[match.queryIdx] && !usedLive[match.trainIdx]) {
+            candidateMatches.push_back(match);
+        }
+    }
+    
+    const UprightCorrespondences guidedCorrespondences = getUprightCorrespondences(anchor, anchorFeatures, live, liveFeatures, candidateMatches);
+    std::vector<int> guidedInliers;
+    Eigen::Matrix3d guidedEssential = result.essential;
+    int guidedInlierCount = scoreEssential(guidedEssential, guidedCorrespondences.rays1, guidedCorrespondences.rays2, options.inlierThreshold, inlierResidualSum, &guidedInliers, options.scoring);
+    double yaw = result.yaw;
+    Eigen::Vector3d translation = result.translation;
+    for (unsigned int round = 0; round < kGuidedRefinementRounds; round++) {
+        if (!refineUprightPose(guidedCorrespondences.rays1, guidedCorrespondences.rays2, guidedInliers, options.solver == UprightSolverType::TwoPointPlanar, yaw, translation)) {
+            break;
+        }
+        if (!isYawAllowed(yaw, options)) {
+            break;
+        }
+        Eigen::Matrix3d refinedEssential = CrossProductMatrix(translation) * Eigen::AngleAxisd(yaw, Eigen::Vector3d::UnitY()).toRotationMatrix();
+        refinedEssential.normalize();
+        std::vector<int> refinedInliers;
+        const int refinedInlierCount = scoreEssential(refinedEssential, guidedCorrespondences.rays1, guidedCorrespondences.rays2, options.inlierThreshold, inlierResidualSum, &refinedInliers, options.scoring);
+        if (refinedInlierCount < guidedInlierCount) {
+            break;
+        }
+        guidedEssential = refinedEssential;
+        guidedInlierCount = refinedInlierCount;
+        guidedInliers.swap(refinedInliers);
+    }
+    ALIGNMENT_TRACE_COUNTER("guided inliers", guidedInlierCount);
+    if (guidedInlierCount <= result.inlierCount) {
+        return false;
+    }
+    // keep only the inliers of the refined model, so that recoverPose counts those and not every match that happens to be in front of both cameras
+    std::vector<cv::DMatch> refinedMatches;
+    for (const int j : guidedInliers) {
+        refinedMatches.push_back(candidateMatches[j]);
+    }
+    matches.swap(refinedMatches);
+    correspondences = getUprightCorrespondences(anchor, anchorFeatures, live, liveFeatures, matches);
+    essential = guidedEssential;
+    return true;
+}
+
+UprightAlignment solveUprightAlignment(const LeveledImage& anchor, const KeyPointsAndDescriptors& anchorFeatures, const LeveledImage& live, const KeyPointsAndDescriptors& liveFeatures, const std::vector<cv::DMatch>& matches, const UprightRansacOptions& options, std::vector<cv::DMatch>* inlier_matches) {
+    ALIGNMENT_TRACE_SCOPE("solveUprightAlignment");
+    UprightAlignment alignment;
+    alignment.yaw = 0;
+    alignment.is_valid = false;
+    alignment.numInliers = 0;
+    alignment.numMatches = matches.size();
+    alignment.residualAngle = 0;
+    alignment.tx = 0;
+    alignment.ty = 0;
+    alignment.tz = 0;
+    alignment.numTrials = 0;
+    if (inlier_matches) {
+        inlier_matches->clear();
+    }
+    if (matches.size() < kMinUprightMatches) {
+        return alignment;
+    }
+    
+    std::vector<cv::DMatch> solvedMatches = matches;
+    UprightCorrespondences correspondences = getUprightCorrespondences(anchor, anchorFeatures, live, liveFeatures, solvedMatches);
+    
+    // We'll do RANSAC to find the best three (or two) points
+    const UprightRansacResult result = runUprightRansac(correspondences, options);
+    alignment.numTrials = result.trials;
+    // Facing a wall, door, or shelf, the essential matrix is degenerate and its pose is unreliable, so fall back on the homography if it explains the matches about as well.  Homography RANSAC is only run when the essential matrix found nothing or its inliers look planar, so general scenes don't pay for it.
+    if (options.modelSelection && (!result.found || looksPlanar(correspondences, result, options))) {
+        // two poses explain the same plane, so take the one closer to what the essential matrix found
+        const UprightHomographyResult homography = runUprightHomographyRansac(correspondences, options, result.found ? &result.yaw : nullptr);
+        alignment.numTrials += homography.trials;
+        const double homographyScore = homography.found ? getModelSelectionScore(homography.inlierCount, homography.inlierResidualSum, options.homographyThreshold) : 0.0;
+        const double essentialScore = result.found ? getModelSelectionScore(result.inlierCount, result.inlierResidualSum, options.inlierThreshold) : 0.0;
+        if (homography.found && homographyScore > kHomographySelectionRatio*(homographyScore + essentialScore)) {
+            ALIGNMENT_TRACE_COUNTER("homography selected", 1);
+            // the rotation is about the vertical axis by construction, so there is no residual rotation
+            alignment.yaw = homography.yaw;
+            alignment.tx = homography.translation.x();
+            alignment.ty = homography.translation.y();
+            alignment.tz = homography.translation.z();
+            alignment.numInliers = homography.inlierCount;
+            alignment.is_valid = homography.inlierCount >= kMinUprightInliers;
+            if (alignment.is_valid && inlier_matches) {
+                std::vector<int> inliers;
+                double inlierResidualSum;
+                scoreUprightHomography(homography.homography, correspondences.rays1, correspondences.rays2, options.homographyThreshold, inlierResidualSum, &inliers);
+                for (const int j : inliers) {
+                    inlier_matches->push_back(solvedMatches[j]);
+                }
+            }
+            return alignment;
+        }
+        ALIGNMENT_TRACE_COUNTER("homography selected", 0);
+    }
+    if (!result.found) {
+        // no hypothesis survived (degenerate samples or all of them outside the prior)
+        return alignment;
+    }
+    Eigen::Matrix3d essential = result.essential;
+    bool refined = result.refined;
+    if (options.guidedRematching && rematchAlongEpipolarLines(anchor, anchorFeatures, live, liveFeatures, options, result, solvedMatches, correspondences, essential)) {
+        refined = true;
+    }
+    
+    float bestConsensusYaw = 0.0;
+    cv::Mat bestConsensusTranslation = cv::Mat(3,1, CV_64F, 0.0);
+    unsigned long mostQuantized = 0;
+    for (auto i = result.centiradQuantization.begin(); i != result.centiradQuantization.end(); ++i) {
+        if (i->second.size() > mostQuantized) {
+            mostQuantized = i->second.size();
+            bestConsensusYaw = 0.0;
+            // take the average of all elements in the bucket
+            for (auto j = i->second.begin(); j != i->second.end(); ++j) {
+                bestConsensusYaw += *j / mostQuantized;
+            }
+            bestConsensusTranslation = cv::Mat(3,1, CV_64F, 0.0);
+            for (const auto& translation : result.centiradQuantizationTranslations.at(i->first)) {
+                bestConsensusTranslation += translation;
+            }
+            bestConsensusTranslation = bestConsensusTranslation / cv::norm(bestConsensusTranslation);
+        }
+        
+    }
+    // The refined model is fit to all of its inliers, so it is a better estimate than averaging the minimal-sample votes.
+    const bool useConsensus = mostQuantized > 0 && !refined;
+    
+    cv::Mat bestEssentialCV;
+    eigen2cv(essential, bestEssentialCV);
+    cv::Mat dcm_mat, translation_mat;
+    
+    int numInliers = cv::recoverPose(bestEssentialCV, correspondences.points1, correspondences.points2, dcm_mat, translation_mat, correspondences.focal, correspondences.principalPoint);
+    Eigen::Matrix3f dcm;
+    cv2eigen(dcm_mat, dcm);
+    const auto rotated = dcm * Eigen::Vector3f::UnitZ();
+    const float yaw = atan2(rotated(0), rotated(2));
+    float residualAngle = abs(yaw) - acos((dcm.trace() - 1)/2);
+    alignment.yaw = useConsensus ? bestConsensusYaw : yaw;
+    alignment.residualAngle = residualAngle;
+    alignment.tx = useConsensus ? bestConsensusTranslation.at<double>(0, 0) : translation_mat.at<double>(0, 0);
+    alignment.ty = useConsensus ? bestConsensusTranslation.at<double>(0, 1) : translation_mat.at<double>(0, 1);
+    alignment.tz = useConsensus ? bestConsensusTranslation.at<double>(0, 2) : translation_mat.at<double>(0, 2);
+    alignment.is_valid = numInliers >= kMinUprightInliers;
+    alignment.numInliers = numInliers;
+    if (alignment.is_valid && inlier_matches) {
+        std::vector<int> inliers;
+        double inlierResidualSum;
+        scoreEssential(essential, correspondences.rays1, correspondences.rays2, options.inlierThreshold, inlierResidualSum, &inliers, options.scoring);
+        for (const int j : inliers) {
+            inlier_matches->push_back(solvedMatches[j]);
+        }
+    }
+    return alignment;
+}
+
+std::vector<Eigen::Vector3d> getAnchorFeaturePoints(const LeveledImage& anchor, const KeyPointsAndDescriptors& anchorFeatures, const std::vector<Eigen::Vector3f>& cameraPoints) {
+    ALIGNMENT_TRACE_SCOPE("getAnchorFeaturePoints");
+    std::vector<Eigen::Vector3d> featurePoints(anchorFeatures.keypoints.size(), Eigen::Vector3d::Constant(std::numeric_limits<double>::quiet_NaN()));
+    std::vector<float> featureDistances(anchorFeatures.keypoints.size(), kAnchorPointRadius);
+    // from the ARKit camera to the leveled camera (they share an origin)
+    const Eigen::Matrix3f cameraRotation = anchor.pose.block<3, 3>(0, 0);
+    const Eigen::Matrix3f camera_to_leveled = getLeveledCameraRotation(cameraRotation, anchor.squareRotation).transpose() * cameraRotation;
+    Eigen::Matrix3f intrinsics_downsampled = anchor.intrinsics;
+    intrinsics_downsampled.topRows(2) /= anchor.downSampleFactor;
+    for (const auto& cameraPoint : cameraPoints) {
+        const Eigen::Vector3f leveledPoint = camera_to_leveled * cameraPoint;
+        if (leveledPoint.z() <= 0) {
+            continue;
+        }
+        const Eigen::Vector3f projected = intrinsics_downsampled * leveledPoint;
+        const cv::Point2f pixel(projected.x() / projected.z(), projected.y() / projected.z());
+        for (unsigned int i = 0; i < anchorFeatures.keypoints.size(); i++) {
+            const float distance = cv::norm(anchorFeatures.keypoints[i].pt - pixel);
+            if (distance < featureDistances[i]) {
+                featureDistances[i] = distance;
+                featurePoints[i] = leveledPoint.cast<double>();
+            }
+        }
+    }
+    return featurePoints;
+}
+
+UprightAlignment solveUprightAbsoluteAlignment(const LeveledImage& anchor, const KeyPointsAndDescriptors& anchorFeatures, const std::vector<Eigen::Vector3d>& anchorFeaturePoints, const LeveledImage& live, const KeyPointsAndDescriptors& liveFeatures, const std::vector<cv::DMatch>& matches, const UprightRansacOptions& options, std::vector<cv::DMatch>* inlier_matches) {
+    ALIGNMENT_TRACE_SCOPE("solveUprightAbsoluteAlignment");
+    UprightAlignment alignment;
+    alignment.yaw = 0;
+    alignment.is_valid = false;
+    alignment.numInliers = 0;
+    alignment.numMatches = 0;
+    alignment.residualAngle = 0;
+    alignment.tx = 0;
+    alignment.ty = 0;
+    alignment.tz = 0;
+    alignment.numTrials = 0;
+    if (inlier_matches) {
+        inlier_matches->clear();
+    }
+    
+    UprightAbsoluteCorrespondences correspondences;
+    std::vector<cv::DMatch> pointMatches;
+    const Eigen::Matrix3f intrinsics2_inverse = live.intrinsics.inverse();
+    for (const auto& match : matches) {
+        const Eigen::Vector3d& point = anchorFeaturePoints[match.queryIdx];
+        if (!point.allFinite()) {
+            continue;
+        }
+        const auto keypoint2 = liveFeatures.keypoints[match.trainIdx];
+        // correct for the downsampling
+        const Eigen::Vector3f image_2_ray = intrinsics2_inverse * Eigen::Vector3f(live.downSampleFactor*keypoint2.pt.x, live.downSampleFactor*keypoint2.pt.y, 1.0);
+        correspondences.points.push_back(point);
+        correspondences.rays.push_back(image_2_ray.cast<double>());
+        pointMatches.push_back(match);
+    }
+    alignment.numMatches = pointMatches.size();
+    if (pointMatches.size() < kMinUprightMatches) {
+        return alignment;
+    }
+    
+    const UprightAbsoluteResult result = runUprightAbsoluteRansac(correspondences, options);
+    alignment.numTrials = result.trials;
+    if (!result.found) {
+        return alignment;
+    }
+    // the rotation is about the vertical axis by construction, so there is no residual rotation
+    alignment.yaw = result.yaw;
+    alignment.tx = result.translation.x();
+    alignment.ty = result.translation.y();
+    alignment.tz = result.translation.z();
+    alignment.numInliers = result.inlierCount;
+    alignment.is_valid = result.inlierCount >= kMinUprightInliers;
+    if (alignment.is_valid && inlier_matches) {
+        std::vector<int> inliers;
+        double inlierResidualSum;
+        scoreUprightAbsolutePose(result.yaw, result.translation, correspondences, options.reprojectionThreshold, inlierResidualSum, &inliers);
+        for (const int j : inliers) {
+            inlier_matches->push_back(pointMatches[j]);
+        }
+    }
+    return alignment;
+}
@@ -0,0 +1,156 @@
+//
+//  UprightAlignment.hpp
+//  Clew
+//
+//  Created by OccamLab on 10/19/26.
+//  Copyright © 2026 OccamLab. All rights reserved.
+//
+
+#ifndef UprightAlignment_hpp
+#define UprightAlignment_hpp
+
+#include <opencv2/opencv.hpp>
+#include <Eigen/Core>
+#include <Eigen/Geometry>
+#include <vector>
+#include "VisualAlignmentUtils.hpp"
+#include "UprightRansac.hpp"
+#include "UprightAbsolutePose.hpp"
+#include "UprightHomography.hpp"
+
+/// the fewest matches to run upright RANSAC on (and the fewest matches with an anchor point to trust the two point absolute solver)
+static const size_t kMinUprightMatches = 6;
+/// the fewest inliers for an upright alignment to be valid
+static const int kMinUprightInliers = 6;
+
+/**
+ A camera image that has been rotated to portrait, warped to an ideal vertical position (so that only yaw separates two such images), and downsampled.
+ */
+typedef struct {
+    /// the leveled image after downsampling
+    cv::Mat image;
+    /// the intrinsics of the leveled image before downsampling
+    Eigen::Matrix3f intrinsics;
+    /// the pose of the camera that took the image
+    Eigen::Matrix4f pose;
+    /// the rotation in global coordinates that was used to level the image (see getIdealRotation)
+    Eigen::AngleAxisf squareRotation;
+    int downSampleFactor;
+} LeveledImage;
+
+/**
+ The yaw (and translation up to scale) between two leveled images.  The fields mean the same as in VisualAlignmentReturn.
+ */
+typedef struct {
+    float yaw;
+    bool is_valid;
+    int numInliers;
+    int numMatches;
+    float residualAngle;
+    float tx;
+    float ty;
+    float tz;
+    int numTrials;
+} UprightAlignment;
+
+/**
+ Level a grayscale camera image.
+ 
+ - returns: The leveled image.
+ 
+ - parameters:
+ - image: The grayscale image as captured (landscape).
+ - intrinsics: The intrinsics of the camera that captured the image.
+ - pose: The pose of the camera that captured the image.
+ - downSampleFactor: The factor by which to shrink the leveled image.
+ */
+LeveledImage levelImage(const cv::Mat& image, Eigen::Matrix3f intrinsics, const Eigen::Matrix4f& pose, int downSampleFactor);
+
+/**
+ Get the yaw between two leveled images predicted by their poses (only meaningful when both poses are in the same coordinate frame).
+ 
+ - returns: The prior on the yaw from the first leveled camera to the second.
+ 
+ - parameters:
+ - anchor: The first leveled image.
+ - live: The second leveled image.
+ - uncertainty: How far in radians the true yaw may be from the predicted one.
+ */
+YawPrior getYawPrior(const LeveledImage& anchor, const LeveledImage& live, float uncertainty);
+
+/**
+ Match the features of two leveled images, guided by a yaw prior if there is one.
+ 
+ - returns: The matches.
+ 
+ - parameters:
+ - anchor: The first leveled image.
+ - anchorFeatures: The features of the first leveled image.
+ - live: The second leveled image.
+ - liveFeatures: The features of the second leveled image.
+ - prior: The yaw prior (null to match without one).
+ - normType: The norm to compare descriptors with.
+ - usedPrior: Set to whether the prior was used (it is dropped if guided matching finds too few matches, since then the prior is likely off).
+ */
+std::vector<cv::DMatch> matchLeveledFeatures(const LeveledImage& anchor, const KeyPointsAndDescriptors& anchorFeatures, const LeveledImage& live, const KeyPointsAndDescriptors& liveFeatures, const YawPrior* prior, int normType, bool& usedPrior);
+
+/**
+ Get the pixel coordinates of matched features at full resolution, with those of the second image converted to the intrinsics of the first.
+ 
+ - parameters:
+ - anchor: The first leveled image.
+ - anchorFeatures: The features of the first leveled image.
+ - live: The second leveled image.
+ - liveFeatures: The features of the second leveled image.
+ - matches: The matches.
+ - points1: Filled in with the points in the first image.
+ - points2: Filled in with the points in the second image.
+ */
+void getMatchedPoints(const LeveledImage& anchor, const KeyPointsAndDescriptors& anchorFeatures, const LeveledImage& live, const KeyPointsAndDescriptors& liveFeatures, const std::vector<cv::DMatch>& matches, std::vector<cv::Point2f>& points1, std::vector<cv::Point2f>& points2);
+
+/**
+ Find the yaw between two leveled images from matched features with upright RANSAC.
+ 
+ - returns: The yaw, translation, and how well they are supported.
+ 
+ - parameters:
+ - anchor: The first leveled image.
+ - anchorFeatures: The features of the first leveled image.
+ - live: The second leveled image.
+ - liveFeatures: The features of the second leveled image.
+ - matches: The matches.
+ - options: How to run RANSAC.
+ - inlier_matches: If not null, filled in with the matches that agree with the estimated pose.
+ */
+UprightAlignment solveUprightAlignment(const LeveledImage& anchor, const KeyPointsAndDescriptors& anchorFeatures, const LeveledImage& live, const KeyPointsAndDescriptors& liveFeatures, const std::vector<cv::DMatch>& matches, const UprightRansacOptions& options, std::vector<cv::DMatch>* inlier_matches = nullptr);
+
+/**
+ Attach the 3D points that ARKit saw when the anchor image was captured to the anchor's features.  Each point is projected into the leveled anchor image and given to the closest feature within a few pixels.
+ 
+ - returns: For each anchor feature, its point in the coordinates of the leveled anchor camera (NaN if it has none).
+ 
+ - parameters:
+ - anchor: The leveled anchor image.
+ - anchorFeatures: The features of the leveled anchor image.
+ - cameraPoints: The points in the coordinates of the ARKit camera that took the anchor image (in meters).
+ */
+std::vector<Eigen::Vector3d> getAnchorFeaturePoints(const LeveledImage& anchor, const KeyPointsAndDescriptors& anchorFeatures, const std::vector<Eigen::Vector3f>& cameraPoints);
+
+/**
+ Find the yaw and metric translation between two leveled images from the matches whose anchor features have 3D points, with upright absolute pose RANSAC.
+ 
+ - returns: The yaw, translation (in meters), and how well they are supported.  numMatches is the number of matches that had a 3D point (too few means the relative solver should be used instead).
+ 
+ - parameters:
+ - anchor: The first leveled image.
+ - anchorFeatures: The features of the first leveled image.
+ - anchorFeaturePoints: The 3D points of the features of the first leveled image (see getAnchorFeaturePoints).
+ - live: The second leveled image.
+ - liveFeatures: The features of the second leveled image.
+ - matches: The matches.
+ - options: How to run RANSAC.
+ - inlier_matches: If not null, filled in with the matches that agree with the estimated pose.
+ */
+UprightAlignment solveUprightAbsoluteAlignment(const LeveledImage& anchor, const KeyPointsAndDescriptors& anchorFeatures, const std::vector<Eigen::Vector3d>& anchorFeaturePoints, const LeveledImage& live, const KeyPointsAndDescriptors& liveFeatures, const std::vector<cv::DMatch>& matches, const UprightRansacOptions& options, std::vector<cv::DMatch>* inlier_matches = nullptr);
+
+#endif /* UprightAlignment_hpp */
@@ -0,0 +1,218 @@
+//
+//  UprightHomography.cpp
+//  Clew
+//
+//  Created by OccamLab on 10/19/26.
+//  Copyright © 2026 OccamLab. All rights reserved.
+//
+
+#include "UprightHomography.hpp"
+#include "AlignmentTrace.hpp"
+#include <Eigen/QR>
+#include <algorithm>
+#include <random>
+
+/// the number of times local optimization refits and rescores a new best homography
+static const unsigned int kHomographyRefinementRounds = 3;
+
+int scoreUprightHomography(const Eigen::Matrix3d& homography, const std::vector<Eigen::Vector3d>& rays1, const std::vector<Eigen::Vector3d>& rays2, double threshold, double& inlierResidualSum, std::vector<int>* inliers) {
+    int totalInliers = 0;
+    inlierResidualSum = 0.0;
+    for (unsigned int j = 0; j < rays1.size(); j++) {
+        const Eigen::Vector3d transferred = homography * rays1[j];
+        const Eigen::Vector3d& ray = rays2[j];
+        if (transferred.z() <= 0 || ray.z() <= 0) {
+            // behind the camera
+            continue;
+        }
+        const double error = (transferred.head<2>() / transferred.z() - ray.head<2>() / ray.z()).norm();
+        if (error < threshold) {
+            totalInliers++;
+            inlierResidualSum += error;
+            if (inliers) {
+                inliers->push_back(j);
+            }
+        }
+    }
+    return totalInliers;
+}
+
+bool refineUprightHomography(const std::vector<Eigen::Vector3d>& rays1, const std::vector<Eigen::Vector3d>& rays2, const std::vector<int>& inliers, Eigen::Matrix3d& homography) {
+    if (inliers.size() < 2) {
+        return false;
+    }
+    // the same rows as TwoPointUprightHomography, in (h1, h2, h3, h4)
+    Eigen::MatrixXd A(2*inliers.size(), 4);
+    Eigen::VectorXd b(2*inliers.size());
+    for (unsigned int i = 0; i < inliers.size(); i++) {
+        const Eigen::Vector3d& q1 = rays1[inliers[i]];
+        const Eigen::Vector3d& q2 = rays2[inliers[i]];
+        A.row(2*i) << -q2.z()*q1.x(), -q2.z()*q1.z(), q2.x()*q1.x(), q2.x()*q1.z();
+        b(2*i) = 0.0;
+        A.row(2*i + 1) << 0.0, 0.0, q2.y()*q1.x(), q2.y()*q1.z();
+        b(2*i + 1) = q2.z()*q1.y();
+    }
+    const auto qr = A.colPivHouseholderQr();
+    if (qr.rank() < 4) {
+        return false;
+    }
+    const Eigen::Vector4d h = qr.solve(b);
+    if (!h.allFinite()) {
+        return false;
+    }
+    homography << h(0), 0.0, h(1), 0.0, 1.0, 0.0, h(2), 0.0, h(3);
+    return true;
+}
+
+bool decomposeUprightHomography(const Eigen::Matrix3d& homography, const std::vector<Eigen::Vector3d>& rays1, const std::vector<int>& inliers, const YawPrior* prior, const double* referenceYaw, double& yaw, Eigen::Vector3d& translation, Eigen::Vector3d& normal) {
+    // In the x-z plane the homography is M = R + t * n' with R = [c s; -s c], so M - R has rank one: det(M - R) = 0 works out to
+    // (h1 + h4) * c + (h2 - h3) * s = det(M) + 1.
+    const Eigen::Matrix2d M = (Eigen::Matrix2d() << homography(0, 0), homography(0, 2), homography(2, 0), homography(2, 2)).finished();
+    const double A = M(0, 0) + M(1, 1);
+    const double B = M(0, 1) - M(1, 0);
+    const double C = M.determinant() + 1;
+    const double magnitude = sqrt(A*A + B*B);
+    if (magnitude == 0) {
+        return false;
+    }
+    // a homography fit to noisy correspondences is only nearly decomposable, so take the closest yaw
+    const double offset = acos(std::max(-1.0, std::min(1.0, C / magnitude)));
+    const double center = atan2(B, A);
+    
+    // the yaw to break ties with (both decompositions usually put every point in front of both cameras)
+    const bool hasReference = referenceYaw || prior;
+    const double reference = referenceYaw ? *referenceYaw : (prior ? prior->yaw : 0.0);
+    bool found = false;
+    int bestInFront = -1;
+    double bestReferenceDistance = 0;
+    for (const double candidateYaw : {center + offset, center - offset}) {
+        if (prior && !isYawWithinPrior(candidateYaw, *prior)) {
+            continue;
+        }
+        const double c = cos(candidateYaw), s = sin(candidateYaw);
+        const Eigen::Matrix2d rankOne = M - (Eigen::Matrix2d() << c, s, -s, c).finished();
+        // t is along the larger column of t * n' (either will do when there is no translation)
+        Eigen::Vector2d t = rankOne.col(0).squaredNorm() >= rankOne.col(1).squaredNorm() ? rankOne.col(0) : rankOne.col(1);
+        if (t.norm() == 0) {
+            t = Eigen::Vector2d(0, 1);
+        }
+        t.normalize();
+        Eigen::Vector2d n = rankOne.transpose() * t;
+        // points on the plane satisfy n' * X = 1, so pick the sign that puts most of them in front of the first camera
+        int inFrontOfFirst = 0;
+        for (const int j : inliers) {
+            inFrontOfFirst += n.dot(Eigen::Vector2d(rays1[j].x(), rays1[j].z())) > 0;
+        }
+        if (2*inFrontOfFirst < (int) inliers.size()) {
+            t = -t;
+            n = -n;
+        }
+        int inFront = 0;
+        for (const int j : inliers) {
+            const Eigen::Vector2d ray(rays1[j].x(), rays1[j].z());
+            const double inverseDepth = n.dot(ray);
+            inFront += inverseDepth > 0 && -s*ray.x() + c*ray.y() + t.y()*inverseDepth > 0;
+        }
+        const double referenceDistance = hasReference ? fabs(remainder(candidateYaw - reference, 2*M_PI)) : 0.0;
+        if (inFront > bestInFront || (inFront == bestInFront && referenceDistance < bestReferenceDistance)) {
+            found = true;
+            bestInFront = inFront;
+            bestReferenceDistance = referenceDistance;
+            yaw = candidateYaw;
+            translation = Eigen::Vector3d(t.x(), 0, t.y());
+            normal = Eigen::Vector3d(n.x(), 0, n.y());
+        }
+    }
+    return found;
+}
+
+UprightHomographyResult runUprightHomographyRansac(const UprightCorrespondences& correspondences, const UprightRansacOptions& options, const double* referenceYaw) {
+    ALIGNMENT_TRACE_SCOPE("runUprightHomographyRansac");
+    const auto& rays1 = correspondences.rays1;
+    const auto& rays2 = correspondences.rays2;
+    const unsigned int numCorrespondences = rays1.size();
+    const unsigned int sampleSize = 2;
+    const YawPrior* prior = options.useYawPrior ? &options.yawPrior : nullptr;
+    UprightHomographyResult result;
+    result.found = false;
+    result.homography = Eigen::Matrix3d::Identity();
+    result.yaw = 0;
+    result.translation = Eigen::Vector3d::Zero();
+    result.normal = Eigen::Vector3d::Zero();
+    result.inlierCount = -1;
+    result.inlierResidualSum = -1;
+    result.refined = false;
+    result.trials = 0;
+    if (numCorrespondences < sampleSize) {
+        return result;
+    }
+    
+    std::mt19937_64 generator(options.seed);
+    std::uniform_int_distribution<unsigned int> pick(0, numCorrespondences - 1);
+    unsigned int trialsNeeded = options.maxTrials;
+    unsigned int trial = 0;
+    for (; trial < trialsNeeded; trial++) {
+        const unsigned int first = pick(generator);
+        unsigned int second;
+        do {
+            second = pick(generator);
+        } while (second == first);
+        const Eigen::Vector3d sample_rays1[2] = {rays1[first], rays1[second]};
+        const Eigen::Vector3d sample_rays2[2] = {rays2[first], rays2[second]};
+        Eigen::Matrix3d homography;
+        if (!TwoPointUprightHomography(sample_rays1, sample_rays2, &homography)) {
+            continue;
+        }
+        std::vector<int> inliers;
+        double inlierResidualSum;
+        const int inlierCount = scoreUprightHomography(homography, rays1, rays2, options.homographyThreshold, inlierResidualSum, &inliers);
+        if (inlierCount < result.inlierCount || (inlierCount == result.inlierCount && inlierResidualSum >= result.inlierResidualSum)) {
+            continue;
+        }
+        double yaw;
+        Eigen::Vector3d translation, normal;
+        if (!decomposeUprightHomography(homography, rays1, inliers, prior, referenceYaw, yaw, translation, normal) || !isYawAllowed(yaw, options)) {
+            // ARKit (or the yaw hypotheses) say the pose is implausible
+            continue;
+        }
+        result.found = true;
+        result.homography = homography;
+        result.yaw = yaw;
+        result.translation = translation;
+        result.normal = normal;
+        result.inlierCount = inlierCount;
+        result.inlierResidualSum = inlierResidualSum;
+        result.refined = false;
+        
+        if (options.localOptimization) {
+            // refit the new best homography to all of its inliers for as long as that picks up more of them
+            for (unsigned int round = 0; round < kHomographyRefinementRounds; round++) {
+                Eigen::Matrix3d refinedHomography;
+                if (!refineUprightHomography(rays1, rays2, inliers, refinedHomography)) {
+                    break;
+                }
+                std::vector<int> refinedInliers;
+                double refinedResidualSum;
+                const int refinedInlierCount = scoreUprightHomography(refinedHomography, rays1, rays2, options.homographyThreshold, refinedResidualSum, &refinedInliers);
+                if (refinedInlierCount < result.inlierCount || (refinedInlierCount == result.inlierCount && refinedResidualSum >= result.inlierResidualSum)) {
+                    break;
+                }
+                if (!decomposeUprightHomography(refinedHomography, rays1, refinedInliers, prior, referenceYaw, yaw, translation, normal) || !isYawAllowed(yaw, options)) {
+                    break;
+                }
+                result.homography = refinedHomography;
+                result.yaw = yaw;
+                result.translation = translation;
+                result.normal = normal;
+                result.inlierCount = refinedInlierCount;
+                result.inlierResidualSum = refinedResidualSum;
+                result.refined = true;
+                inliers.swap(refinedInliers);
+            }
+        }
+        trialsNeeded = adaptiveRansacTrials((double) result.inlierCount / numCorrespondences, sampleSize, options.confidence, options.maxTrials);
+    }
+    result.trials = trial;
+    ALIGNMENT_TRACE_COUNTER("homography trials", result.trials);
+    return result;
+}
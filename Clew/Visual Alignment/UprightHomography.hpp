@@ -0,0 +1,95 @@
+//
+//  UprightHomography.hpp
+//  Clew
+//
+//  Created by OccamLab on 10/19/26.
+//  Copyright © 2026 OccamLab. All rights reserved.
+//
+
+#ifndef UprightHomography_hpp
+#define UprightHomography_hpp
+
+#include <Eigen/Core>
+#include <vector>
+#include "UprightRansac.hpp"
+
+/**
+ The outcome of upright homography RANSAC (see TwoPointUprightHomography).  The pose follows the conventions of UprightRansacResult (ray_in_image_2 ~ Ry(yaw) * ray_in_image_1 + t).
+ */
+typedef struct {
+    /// whether any hypothesis was scored
+    bool found;
+    Eigen::Matrix3d homography;
+    double yaw;
+    /// the unit translation (in the x-z plane)
+    Eigen::Vector3d translation;
+    /// the normal of the plane divided by its distance from the first camera (in units of the translation)
+    Eigen::Vector3d normal;
+    int inlierCount;
+    double inlierResidualSum;
+    /// whether the best homography came out of refinement
+    bool refined;
+    /// the number of samples drawn
+    unsigned int trials;
+} UprightHomographyResult;
+
+/**
+ Score a homography by its transfer error.
+ 
+ - returns: The number of inliers.
+ 
+ - parameters:
+ - homography: The homography from the first camera to the second.
+ - rays1: The rays in the first camera.
+ - rays2: The rays in the second camera.
+ - threshold: The largest transfer error (in normalized image coordinates) of an inlier.
+ - inlierResidualSum: Set to the sum of the transfer errors of the inliers.
+ - inliers: If not null, the indices of the inliers are appended to it.
+ */
+int scoreUprightHomography(const Eigen::Matrix3d& homography, const std::vector<Eigen::Vector3d>& rays1, const std::vector<Eigen::Vector3d>& rays2, double threshold, double& inlierResidualSum, std::vector<int>* inliers = nullptr);
+
+/**
+ Fit an upright homography to a set of correspondences with linear least squares (the same linear system TwoPointUprightHomography uses).
+ 
+ - returns: False if the correspondences are degenerate.
+ 
+ - parameters:
+ - rays1: The rays in the first camera.
+ - rays2: The rays in the second camera.
+ - inliers: The indices of the correspondences to fit.
+ - homography: Set to the fitted homography.
+ */
+bool refineUprightHomography(const std::vector<Eigen::Vector3d>& rays1, const std::vector<Eigen::Vector3d>& rays2, const std::vector<int>& inliers, Eigen::Matrix3d& homography);
+
+/**
+ Split an upright homography into the yaw, translation, and plane that induce it.  There are up to two decompositions, and of those within the yaw prior (if any) the one that puts the most of the given correspondences in front of both cameras is kept.  Usually both decompositions put all of them in front, and then the one closest to the reference yaw (or to the yaw of the prior) is kept.
+ 
+ - returns: False if the homography doesn't come from an upright pose (or no decomposition is within the yaw prior).
+ 
+ - parameters:
+ - homography: The homography.
+ - rays1: The rays in the first camera.
+ - inliers: The indices of the correspondences that are on the plane.
+ - prior: If not null, decompositions with yaws outside of it are rejected.
+ - referenceYaw: If not null, the yaw to pick the decomposition closest to when neither puts more correspondences in front of the cameras.
+ - yaw: Set to the yaw.
+ - translation: Set to the unit translation.
+ - normal: Set to the normal of the plane divided by its distance (in units of the translation).
+ */
+bool decomposeUprightHomography(const Eigen::Matrix3d& homography, const std::vector<Eigen::Vector3d>& rays1, const std::vector<int>& inliers, const YawPrior* prior, const double* referenceYaw, double& yaw, Eigen::Vector3d& translation, Eigen::Vector3d& normal);
+
+/**
+ Find the homography induced by a dominant vertical plane with RANSAC over TwoPointUprightHomography.
+ 
+ Like runUprightAbsoluteRansac, this runs on the calling thread and ignores options.workerPool and options.sprt.  It uses homographyThreshold rather than inlierThreshold.
+ 
+ - returns: The best homography, its decomposition, and its support.
+ 
+ - parameters:
+ - correspondences: The matched features.
+ - options: How to run RANSAC.
+ - referenceYaw: If not null, the yaw used to choose between the two decompositions of a homography (see decomposeUprightHomography).
+ */
+UprightHomographyResult runUprightHomographyRansac(const UprightCorrespondences& correspondences, const UprightRansacOptions& options, const double* referenceYaw = nullptr);
+
+#endif /* UprightHomography_hpp */
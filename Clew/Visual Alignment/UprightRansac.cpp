@@ -0,0 +1,554 @@
+//
+//  UprightRansac.cpp
+//  Clew
+//
+//  Created by OccamLab on 10/19/26.
+//  Copyright © 2026 OccamLab. All rights reserved.
+//
+
+#include "UprightRansac.hpp"
+#include "UprightRansacPolicies.hpp"
+#include "AlignmentTrace.hpp"
+#include <opencv2/opencv.hpp>
+#include <opencv2/core/eigen.hpp>
+#include <Eigen/Core>
+#include <Eigen/Geometry>
+#include <Eigen/Cholesky>
+#include <algorithm>
+#include <atomic>
+#include <cmath>
+#include <functional>
+#include <limits>
+
+/// the most times to refine and rescore a new best hypothesis
+static const unsigned int kLocalOptimizationRounds = 3;
+
+/// the scale (in normalized image coordinates) of the Cauchy weights used when refining
+static const double kRefinementRobustScale = 0.001;
+
+/// the number of correspondences checked between updates of the SPRT likelihood ratio
+static const unsigned int kSprtBlockSize = 16;
+
+/// how many correspondences the initial guess of the bad model consistency is worth
+static const double kSprtPriorWeight = 500;
+
+template <class Residual>
+static int scoreEssentialWith(const Eigen::Matrix3d& essential_matrix, const std::vector<Eigen::Vector3d>& rays1, const std::vector<Eigen::Vector3d>& rays2, double threshold, double& inlierResidualSum, std::vector<int>* inliers) {
+    int totalInliers = 0;
+    inlierResidualSum = 0.0;
+    for (unsigned int j = 0; j < rays1.size(); j++) {
+        const double pointResidual = Residual::evaluate(essential_matrix, rays1[j], rays2[j]);
+        if (pointResidual < threshold) { // TODO: this threshold is not correct, we need to figure out how to make this into something consistent (e.g., distance in pixels to epipolar line)
+            totalInliers++;
+            inlierResidualSum += pointResidual;
+            if (inliers) {
+                inliers->push_back(j);
+            }
+        }
+    }
+    return totalInliers;
+}
+
+int scoreEssential(const Eigen::Matrix3d& essential_matrix, const std::vector<Eigen::Vector3d>& rays1, const std::vector<Eigen::Vector3d>& rays2, double threshold, double& inlierResidualSum, std::vector<int>* inliers, UprightScoringType scoring) {
+    if (scoring == UprightScoringType::Sampson) {
+        return scoreEssentialWith<EpipolarResidual<UprightScoringType::Sampson> >(essential_matrix, rays1, rays2, threshold, inlierResidualSum, inliers);
+    }
+    return scoreEssentialWith<EpipolarResidual<UprightScoringType::Algebraic> >(essential_matrix, rays1, rays2, threshold, inlierResidualSum, inliers);
+}
+
+SprtTest::SprtTest(double inlierRatio, double badModelConsistency, double modelCost) : epsilon(inlierRatio), delta(badModelConsistency), modelCost(modelCost), rejectedTested(kSprtPriorWeight), rejectedConsistent(kSprtPriorWeight*badModelConsistency), samples(0), models(0) {
+    updateDecisionThreshold();
+}
+
+void SprtTest::setInlierRatio(double inlierRatio) {
+    epsilon = std::min(inlierRatio, 0.99);
+    updateDecisionThreshold();
+}
+
+void SprtTest::addSample(unsigned int numModels) {
+    samples++;
+    models += numModels;
+}
+
+double SprtTest::getAcceptanceProbability() const {
+    return 1.0 - 1.0/decisionThreshold;
+}
+
+void SprtTest::updateDecisionThreshold() {
+    if (epsilon <= delta) {
+        // a good model can't be told apart from a bad one, so never abandon anything
+        decisionThreshold = std::numeric_limits<double>::infinity();
+        logDecisionThreshold = std::numeric_limits<double>::infinity();
+        logConsistent = 0;
+        logInconsistent = 0;
+        return;
+    }
+    logConsistent = log(delta / epsilon);
+    logInconsistent = log((1 - delta) / (1 - epsilon));
+    // the optimal threshold is the fixed point of A = modelCost * C / modelsPerSample + 1 + log(A)
+    const double C = (1 - delta)*logInconsistent + delta*logConsistent;
+    const double modelsPerSample = samples > 0 && models > 0 ? (double) models / samples : 1.0;
+    const double A0 = modelCost * C / modelsPerSample + 1;
+    double A = A0;
+    for (unsigned int i = 0; i < 10; i++) {
+        A = A0 + log(A);
+    }
+    decisionThreshold = A;
+    logDecisionThreshold = log(A);
+}
+
+void SprtTest::addRejection(unsigned int tested, unsigned int consistent) {
+    rejectedTested += tested;
+    rejectedConsistent += consistent;
+    delta = rejectedConsistent / rejectedTested;
+    updateDecisionThreshold();
+}
+
+template <UprightScoringType scoring>
+bool SprtTest::evaluate(const Eigen::Matrix3d& essential_matrix, const std::vector<Eigen::Vector3d>& rays1, const std::vector<Eigen::Vector3d>& rays2, double threshold, int& totalInliers, double& inlierResidualSum, unsigned int& tested) const {
+    const unsigned int numCorrespondences = rays1.size();
+    double logLikelihoodRatio = 0;
+    tested = 0;
+    totalInliers = 0;
+    inlierResidualSum = 0.0;
+    for (unsigned int blockStart = 0; blockStart < numCorrespondences; blockStart += kSprtBlockSize) {
+        const unsigned int blockEnd = std::min(numCorrespondences, blockStart + kSprtBlockSize);
+        int blockInliers = 0;
+        // no early exits inside a block so that the compiler can vectorize it
+        for (unsigned int j = blockStart; j < blockEnd; j++) {
+            const double pointResidual = EpipolarResidual<scoring>::evaluate(essential_matrix, rays1[j], rays2[j]);
+            const bool isInlier = pointResidual < threshold;
+            blockInliers += isInlier;
+            inlierResidualSum += isInlier ? pointResidual : 0.0;
+        }
+        totalInliers += blockInliers;
+        tested = blockEnd;
+        logLikelihoodRatio += blockInliers*logConsistent + (int) (blockEnd - blockStart - blockInliers)*logInconsistent;
+        if (logLikelihoodRatio > logDecisionThreshold) {
+            return false;
+        }
+    }
+    return true;
+}
+
+template bool SprtTest::evaluate<UprightScoringType::Algebraic>(const Eigen::Matrix3d&, const std::vector<Eigen::Vector3d>&, const std::vector<Eigen::Vector3d>&, double, int&, double&, unsigned int&) const;
+template bool SprtTest::evaluate<UprightScoringType::Sampson>(const Eigen::Matrix3d&, const std::vector<Eigen::Vector3d>&, const std::vector<Eigen::Vector3d>&, double, int&, double&, unsigned int&) const;
+
+bool refineUprightPose(const std::vector<Eigen::Vector3d>& rays1, const std::vector<Eigen::Vector3d>& rays2, const std::vector<int>& inliers, bool planar, double& yaw, Eigen::Vector3d& translation, unsigned int iterations) {
+    // The parameters are the yaw and a step in the tangent plane of the unit translation (one direction if the translation has to stay horizontal).
+    const int numParameters = planar ? 2 : 3;
+    if ((int) inliers.size() < numParameters + 1 || translation.norm() == 0) {
+        return false;
+    }
+    double currentYaw = yaw;
+    Eigen::Vector3d currentTranslation = translation.normalized();
+    const Eigen::Vector3d up = Eigen::Vector3d::UnitY();
+    
+    for (unsigned int iteration = 0; iteration < iterations; iteration++) {
+        Eigen::Vector3d tangents[2];
+        if (planar) {
+            tangents[0] = Eigen::Vector3d(currentTranslation.z(), 0, -currentTranslation.x());
+        } else {
+            tangents[0] = currentTranslation.unitOrthogonal();
+            tangents[1] = currentTranslation.cross(tangents[0]);
+        }
+        const Eigen::Matrix3d rotation = Eigen::AngleAxisd(currentYaw, up).toRotationMatrix();
+        Eigen::Matrix3d JtJ = Eigen::Matrix3d::Zero();
+        Eigen::Vector3d Jte = Eigen::Vector3d::Zero();
+        
+        for (const int j : inliers) {
+            const Eigen::Vector3d rotated = rotation * rays1[j];
+            const Eigen::Vector3d& q2 = rays2[j];
+            // epipolar residual q2' * [t]x * R * q1 and its Sampson normalization
+            const Eigen::Vector3d epipolarLine1 = currentTranslation.cross(rotated);
+            const Eigen::Vector3d epipolarLine2 = rotation.transpose() * q2.cross(currentTranslation);
+            const double residual = q2.dot(epipolarLine1);
+            const double sampsonScale = epipolarLine1.head<2>().squaredNorm() + epipolarLine2.head<2>().squaredNorm();
+            if (sampsonScale <= 0) {
+                continue;
+            }
+            const double normalization = 1.0 / sqrt(sampsonScale);
+            const double error = residual * normalization;
+            
+            // d/dyaw R = [up]x R and d/dt = the tangent directions
+            Eigen::Vector3d jacobian = Eigen::Vector3d::Zero();
+            jacobian(0) = q2.dot(currentTranslation.cross(up.cross(rotated))) * normalization;
+            for (int k = 1; k < numParameters; k++) {
+                jacobian(k) = q2.dot(tangents[k - 1].cross(rotated)) * normalization;
+            }
+            // Cauchy weights keep the stray outliers in the inlier set from dragging the solution around
+            const double weight = 1.0 / (1.0 + error*error / (kRefinementRobustScale*kRefinementRobustScale));
+            JtJ += weight * jacobian * jacobian.transpose();
+            Jte += weight * jacobian * error;
+        }
+        
+        const auto system = JtJ.topLeftCorner(numParameters, numParameters).ldlt();
+        if (system.info() != Eigen::Success || !system.isPositive()) {
+            return false;
+        }
+        const Eigen::VectorXd step = -system.solve(Jte.head(numParameters));
+        if (!step.allFinite()) {
+            return false;
+        }
+        currentYaw += step(0);
+        for (int k = 1; k < numParameters; k++) {
+            currentTranslation += step(k) * tangents[k - 1];
+        }
+        currentTranslation.normalize();
+        if (step.norm() < 1e-9) {
+            break;
+        }
+    }
+    yaw = currentYaw;
+    translation = currentTranslation;
+    return true;
+}
+
+/// A hypothesis that survived scoring.
+typedef struct {
+    Eigen::Matrix3d essential;
+    double yaw;
+    Eigen::Vector3d translation;
+    int inlierCount;
+    double inlierResidualSum;
+    unsigned int trial;
+} ScoredHypothesis;
+
+/// Everything one trial produced (each is written by exactly one worker).
+typedef struct {
+    bool hasHypothesis;
+    /// the best hypothesis from the trial's sample
+    ScoredHypothesis best;
+    /// the number of hypotheses the solver produced
+    unsigned int numModels;
+    /// the (tested, consistent) counts of each hypothesis that SPRT abandoned
+    std::vector<std::pair<unsigned int, unsigned int> > rejections;
+} TrialOutcome;
+
+/// A vote for the yaw from a hypothesis that had a consensus.
+typedef struct {
+    unsigned int trial;
+    unsigned int solution;
+    float yaw;
+    cv::Mat translation;
+} YawVote;
+
+/// the votes of one worker, bucketed by centiradian
+typedef std::map<int, std::vector<YawVote> > YawHistogram;
+
+/// the number of trials whose outcomes are combined at once (this doesn't depend on the number of workers so that the result doesn't either)
+static const unsigned int kTrialsPerRound = 8;
+
+bool isYawAllowed(double yaw, const UprightRansacOptions& options) {
+    if (options.useYawPrior && !isYawWithinPrior(yaw, options.yawPrior)) {
+        return false;
+    }
+    if (options.yawHypotheses.empty()) {
+        return true;
+    }
+    for (float hypothesis : options.yawHypotheses) {
+        if (std::abs(std::remainder(yaw - hypothesis, 2 * M_PI)) <= options.yawHypothesisTolerance) {
+            return true;
+        }
+    }
+    return false;
+}
+
+/// A small counter-based generator (SplitMix64) so that every trial can have its own stream.
+static uint64_t nextRandom(uint64_t& state) {
+    uint64_t z = (state += 0x9E3779B97F4A7C15ULL);
+    z = (z ^ (z >> 30)) * 0xBF58476D1CE4E5B9ULL;
+    z = (z ^ (z >> 27)) * 0x94D049BB133111EBULL;
+    return z ^ (z >> 31);
+}
+
+uint64_t getUprightRansacSeed() {
+    static std::atomic<uint64_t> calls(0);
+    uint64_t state = calls.fetch_add(1, std::memory_order_relaxed);
+    return nextRandom(state);
+}
+
+/// Whether hypothesis a beats hypothesis b (more inliers, then a smaller residual, then the earlier trial).
+static bool isBetterHypothesis(const ScoredHypothesis& a, const ScoredHypothesis& b) {
+    if (a.inlierCount != b.inlierCount) {
+        return a.inlierCount > b.inlierCount;
+    }
+    if (a.inlierResidualSum != b.inlierResidualSum) {
+        return a.inlierResidualSum < b.inlierResidualSum;
+    }
+    return a.trial < b.trial;
+}
+
+/**
+ Draw a minimal sample, generate hypotheses from it, and score them.
+ 
+ - parameters:
+ - correspondences: The matched features.
+ - options: How to run RANSAC.
+ - sprt: The test to score hypotheses with (only read).
+ - trial: The index of the trial, which picks the random stream.
+ - outcome: Filled in with the best surviving hypothesis and the SPRT statistics.
+ - histogram: Gets the votes of the hypotheses that had a consensus (if the consensus strategy collects them).
+ */
+template <class Solver, UprightScoringType scoring, class Consensus>
+static void runUprightRansacTrial(const UprightCorrespondences& correspondences, const UprightRansacOptions& options, const SprtTest& sprt, unsigned int trial, TrialOutcome& outcome, YawHistogram& histogram) {
+    const auto& all_rays_image_1 = correspondences.rays1;
+    const auto& all_rays_image_2 = correspondences.rays2;
+    const unsigned int numCorrespondences = all_rays_image_1.size();
+    const unsigned int sampleSize = Solver::sampleSize;
+    outcome.hasHypothesis = false;
+    outcome.numModels = 0;
+    outcome.rejections.clear();
+    
+    // draw distinct correspondences
+    uint64_t randomState = options.seed ^ ((uint64_t) trial * 0xD1B54A32D192ED03ULL);
+    unsigned int sample[3];
+    for (unsigned int i = 0; i < sampleSize; i++) {
+        bool isRepeat;
+        do {
+            sample[i] = nextRandom(randomState) % numCorrespondences;
+            isRepeat = std::find(sample, sample + i, sample[i]) != sample + i;
+        } while (isRepeat);
+    }
+    
+    std::vector<cv::Point2f> vectors1_ransac, vectors2_ransac;
+    Eigen::Vector3d image_1_rays[3];
+    Eigen::Vector3d image_2_rays[3];
+    std::vector<Eigen::Quaterniond> soln_rotations;
+    std::vector<Eigen::Vector3d> soln_translations;
+    for (unsigned int i = 0; i < sampleSize; i++) {
+        image_1_rays[i] = all_rays_image_1[sample[i]];
+        image_2_rays[i] = all_rays_image_2[sample[i]];
+        if (Consensus::collectsVotes) {
+            vectors1_ransac.push_back(correspondences.points1[sample[i]]);
+            vectors2_ransac.push_back(correspondences.points2[sample[i]]);
+        }
+    }
+    
+    Solver::solve(image_1_rays, image_2_rays, &soln_rotations, &soln_translations);
+    outcome.numModels = soln_rotations.size();
+    for (unsigned int i = 0; i < soln_rotations.size(); i++) {
+        const Eigen::Matrix3d relative_rotation = soln_rotations[i].toRotationMatrix();
+        const Eigen::Vector3d rotated = relative_rotation * Eigen::Vector3d::UnitZ();
+        const double hypothesisYaw = atan2(rotated(0), rotated(2));
+        if (!isYawAllowed(hypothesisYaw, options)) {
+            // don't bother scoring hypotheses that ARKit says are implausible
+            continue;
+        }
+        Eigen::Matrix3d essential_matrix = CrossProductMatrix(soln_translations[i]) * relative_rotation;
+        essential_matrix.normalize();
+        int totalInliers;
+        double inlierResidualSum;
+        if (options.sprt) {
+            unsigned int tested;
+            if (!sprt.template evaluate<scoring>(essential_matrix, all_rays_image_1, all_rays_image_2, options.inlierThreshold, totalInliers, inlierResidualSum, tested)) {
+                outcome.rejections.push_back(std::make_pair(tested, (unsigned int) totalInliers));
+                continue;
+            }
+        } else {
+            totalInliers = scoreEssentialWith<EpipolarResidual<scoring> >(essential_matrix, all_rays_image_1, all_rays_image_2, options.inlierThreshold, inlierResidualSum, nullptr);
+        }
+        
+        // TODO this needs to be tuned in a smarter way (e.g., by running some iterations of RANSAC first and then adapting the threshold as a proportion of the best inlier count
+        if (Consensus::collectsVotes && totalInliers > options.consensusFraction*numCorrespondences) {
+            // compute pose for averaging purposes
+            cv::Mat essential_matrixCV;
+            eigen2cv(essential_matrix, essential_matrixCV);
+            cv::Mat dcm_mat, translation_mat;
+            
+            int numInliers = cv::recoverPose(essential_matrixCV, vectors1_ransac, vectors2_ransac, dcm_mat, translation_mat, correspondences.focal, correspondences.principalPoint);
+            if (numInliers < (int) sampleSize) {
+                // one of the correspondences is behind the camera
+                continue;
+            }
+            Eigen::Matrix3f dcm;
+            cv2eigen(dcm_mat, dcm);
+            const auto rotated = dcm * Eigen::Vector3f::UnitZ();
+            YawVote vote;
+            vote.trial = trial;
+            vote.solution = i;
+            vote.yaw = atan2(rotated(0), rotated(2));
+            vote.translation = translation_mat;
+            histogram[(int) (vote.yaw*100)].push_back(vote);
+        }
+        ScoredHypothesis hypothesis;
+        hypothesis.essential = essential_matrix;
+        hypothesis.yaw = hypothesisYaw;
+        hypothesis.translation = soln_translations[i];
+        hypothesis.inlierCount = totalInliers;
+        hypothesis.inlierResidualSum = inlierResidualSum;
+        hypothesis.trial = trial;
+        if (!outcome.hasHypothesis || isBetterHypothesis(hypothesis, outcome.best)) {
+            outcome.hasHypothesis = true;
+            outcome.best = hypothesis;
+        }
+    }
+}
+
+/// runUprightRansac with the policies picked from its options.
+template <class Solver, UprightScoringType scoring, class Consensus>
+static UprightRansacResult runUprightRansacWith(const UprightCorrespondences& correspondences, const UprightRansacOptions& options) {
+    const auto& all_rays_image_1 = correspondences.rays1;
+    const auto& all_rays_image_2 = correspondences.rays2;
+    const unsigned int numCorrespondences = all_rays_image_1.size();
+    // the number of correspondences in a minimal sample
+    const unsigned int sampleSize = Solver::sampleSize;
+    
+    UprightRansacResult result;
+    result.found = false;
+    result.yaw = 0;
+    result.translation = Eigen::Vector3d::Zero();
+    result.refined = false;
+    result.trials = 0;
+    result.sprtRejections = 0;
+    result.inlierCount = -1;
+    result.inlierResidualSum = -1;
+    if (numCorrespondences < sampleSize) {
+        return result;
+    }
+    
+    SprtTest sprt;
+    const unsigned int numWorkers = options.workerPool ? options.workerPool->size() : 1;
+    std::vector<TrialOutcome> outcomes(kTrialsPerRound);
+    std::vector<YawHistogram> histograms(numWorkers);
+    // stop early once we are confident that an all-inlier sample has been drawn
+    unsigned int trialsNeeded = options.maxTrials;
+    unsigned int trial = 0;
+    while (trial < trialsNeeded) {
+        // The workers claim the trials of a round one at a time and publish the index of the best outcome without locking.  The SPRT parameters and the best model are only updated between rounds, so every trial is scored the same way no matter which worker ran it.
+        const unsigned int roundStart = trial;
+        const unsigned int roundEnd = std::min(trialsNeeded, roundStart + kTrialsPerRound);
+        std::atomic<unsigned int> nextTrial(roundStart);
+        std::atomic<int> roundBest(-1);
+        const std::function<void(unsigned int)> work = [&](unsigned int worker) {
+            for (unsigned int t = nextTrial++; t < roundEnd; t = nextTrial++) {
+                const int slot = t - roundStart;
+                TrialOutcome& outcome = outcomes[slot];
+                runUprightRansacTrial<Solver, scoring, Consensus>(correspondences, options, sprt, t, outcome, histograms[worker]);
+                if (!outcome.hasHypothesis) {
+                    continue;
+                }
+                int current = roundBest.load();
+                while (current < 0 || isBetterHypothesis(outcome.best, outcomes[current].best)) {
+                    if (roundBest.compare_exchange_weak(current, slot)) {
+                        break;
+                    }
+                }
+            }
+        };
+        if (options.workerPool) {
+            options.workerPool->run(work);
+        } else {
+            work(0);
+        }
+        trial = roundEnd;
+        
+        // fold in the statistics in trial order
+        for (unsigned int t = roundStart; t < roundEnd; t++) {
+            const TrialOutcome& outcome = outcomes[t - roundStart];
+            sprt.addSample(outcome.numModels);
+            for (const auto& rejection : outcome.rejections) {
+                sprt.addRejection(rejection.first, rejection.second);
+            }
+            result.sprtRejections += outcome.rejections.size();
+        }
+        
+        const int winner = roundBest.load();
+        if (winner < 0) {
+            continue;
+        }
+        const ScoredHypothesis& best = outcomes[winner].best;
+        if (result.found && (best.inlierCount < result.inlierCount || (best.inlierCount == result.inlierCount && best.inlierResidualSum >= result.inlierResidualSum))) {
+            continue;
+        }
+        result.found = true;
+        result.inlierCount = best.inlierCount;
+        result.essential = best.essential;
+        result.yaw = best.yaw;
+        result.translation = best.translation;
+        result.inlierResidualSum = best.inlierResidualSum;
+        result.refined = false;
+        
+        if (options.localOptimization) {
+            // Polish the new best hypothesis against all of its inliers, which usually picks up more inliers (and lets us stop sooner).
+            double refinedYaw = best.yaw;
+            Eigen::Vector3d refinedTranslation = best.translation;
+            for (unsigned int round = 0; round < kLocalOptimizationRounds; round++) {
+                std::vector<int> inliers;
+                double unusedResidualSum;
+                scoreEssentialWith<EpipolarResidual<scoring> >(result.essential, all_rays_image_1, all_rays_image_2, options.inlierThreshold, unusedResidualSum, &inliers);
+                if (!refineUprightPose(all_rays_image_1, all_rays_image_2, inliers, Solver::planar, refinedYaw, refinedTranslation)) {
+                    break;
+                }
+                if (!isYawAllowed(refinedYaw, options)) {
+                    break;
+                }
+                Eigen::Matrix3d refined_essential = CrossProductMatrix(refinedTranslation) * Eigen::AngleAxisd(refinedYaw, Eigen::Vector3d::UnitY()).toRotationMatrix();
+                refined_essential.normalize();
+                double refinedResidualSum;
+                const int refinedInliers = scoreEssentialWith<EpipolarResidual<scoring> >(refined_essential, all_rays_image_1, all_rays_image_2, options.inlierThreshold, refinedResidualSum, nullptr);
+                if (refinedInliers < result.inlierCount || (refinedInliers == result.inlierCount && refinedResidualSum >= result.inlierResidualSum)) {
+                    break;
+                }
+                result.inlierCount = refinedInliers;
+                result.essential = refined_essential;
+                result.yaw = refinedYaw;
+                result.translation = refinedTranslation;
+                result.inlierResidualSum = refinedResidualSum;
+                result.refined = true;
+            }
+        }
+        double inlierRatio = (double) result.inlierCount / numCorrespondences;
+        if (options.sprt) {
+            sprt.setInlierRatio(inlierRatio);
+            // an all-inlier sample only counts if its model also survives the test
+            inlierRatio *= pow(sprt.getAcceptanceProbability(), 1.0 / sampleSize);
+        }
+        trialsNeeded = adaptiveRansacTrials(inlierRatio, sampleSize, options.confidence, options.maxTrials);
+    }
+    result.trials = trial;
+    ALIGNMENT_TRACE_COUNTER("ransac trials", trial);
+    
+    // merge the workers' votes in trial order so that the averages come out the same however the trials were split up
+    std::map<int, std::vector<YawVote> > votes;
+    for (const auto& histogram : histograms) {
+        for (const auto& bucket : histogram) {
+            votes[bucket.first].insert(votes[bucket.first].end(), bucket.second.begin(), bucket.second.end());
+        }
+    }
+    for (auto& bucket : votes) {
+        std::sort(bucket.second.begin(), bucket.second.end(), [](const YawVote& a, const YawVote& b) {
+            return a.trial < b.trial || (a.trial == b.trial && a.solution < b.solution);
+        });
+        for (const auto& vote : bucket.second) {
+            result.centiradQuantization[bucket.first].push_back(vote.yaw);
+            result.centiradQuantizationTranslations[bucket.first].push_back(vote.translation);
+        }
+    }
+    return result;
+}
+
+template <class Solver, UprightScoringType scoring>
+static UprightRansacResult runUprightRansacWithScoring(const UprightCorrespondences& correspondences, const UprightRansacOptions& options) {
+    if (options.consensus == UprightConsensusType::BestModel) {
+        return runUprightRansacWith<Solver, scoring, ConsensusStrategy<UprightConsensusType::BestModel> >(correspondences, options);
+    }
+    return runUprightRansacWith<Solver, scoring, ConsensusStrategy<UprightConsensusType::YawVotes> >(correspondences, options);
+}
+
+template <class Solver>
+static UprightRansacResult runUprightRansacWithSolver(const UprightCorrespondences& correspondences, const UprightRansacOptions& options) {
+    if (options.scoring == UprightScoringType::Sampson) {
+        return runUprightRansacWithScoring<Solver, UprightScoringType::Sampson>(correspondences, options);
+    }
+    return runUprightRansacWithScoring<Solver, UprightScoringType::Algebraic>(correspondences, options);
+}
+
+UprightRansacResult runUprightRansac(const UprightCorrespondences& correspondences, const UprightRansacOptions& options) {
+    ALIGNMENT_TRACE_SCOPE("runUprightRansac");
+    // pick the policies once here rather than in every trial
+    if (options.solver == UprightSolverType::TwoPointPlanar) {
+        return runUprightRansacWithSolver<UprightMinimalSolver<UprightSolverType::TwoPointPlanar> >(correspondences, options);
+    }
+    return runUprightRansacWithSolver<UprightMinimalSolver<UprightSolverType::ThreePoint> >(correspondences, options);
+}
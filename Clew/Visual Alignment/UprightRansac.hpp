@@ -0,0 +1,258 @@
+//
+//  UprightRansac.hpp
+//  Clew
+//
+//  Created by OccamLab on 10/19/26.
+//  Copyright © 2026 OccamLab. All rights reserved.
+//
+
+#ifndef UprightRansac_hpp
+#define UprightRansac_hpp
+
+#include <opencv2/opencv.hpp>
+#include <Eigen/Core>
+#include <Eigen/Geometry>
+#include <cstdint>
+#include <map>
+#include <vector>
+#include "VisualAlignmentUtils.hpp"
+#include "WorkerPool.hpp"
+
+/// The minimal solvers that can generate upright (yaw only) pose hypotheses.
+enum class UprightSolverType {
+    /// theia::ThreePointRelativePosePartialRotation
+    ThreePoint,
+    /// TwoPointPlanarRelativePose
+    TwoPointPlanar,
+};
+
+/// How far a correspondence is from agreeing with an essential matrix.
+enum class UprightScoringType {
+    /// |ray2' * E * ray1| (cheap, but it grows with the distance of the features from the image centers)
+    Algebraic,
+    /// the Sampson approximation of the distance to the epipolar lines (in normalized image coordinates)
+    Sampson,
+};
+
+/// How the yaw is chosen once RANSAC is done.
+enum class UprightConsensusType {
+    /// average the yaws of all hypotheses that agreed with consensusFraction of the correspondences (falling back to the best model if none did or it was refined)
+    YawVotes,
+    /// use the best model alone (skips recovering the pose of every hypothesis with a consensus, and so the check that its points are in front of the cameras)
+    BestModel,
+};
+
+/**
+ The correspondences between two leveled images that upright RANSAC works on.
+ */
+typedef struct {
+    /// the rays (with a z component of 1) of the features in the first leveled camera
+    std::vector<Eigen::Vector3d> rays1;
+    /// the rays (with a z component of 1) of the matching features in the second leveled camera
+    std::vector<Eigen::Vector3d> rays2;
+    /// the features in the first image in pixels
+    std::vector<cv::Point2f> points1;
+    /// the matching features in the second image in pixels (converted to the intrinsics of the first camera)
+    std::vector<cv::Point2f> points2;
+    /// the focal length of the first camera
+    double focal;
+    /// the principal point of the first camera
+    cv::Point2d principalPoint;
+} UprightCorrespondences;
+
+/**
+ How to run upright RANSAC.
+ */
+struct UprightRansacOptions {
+    UprightSolverType solver = UprightSolverType::ThreePoint;
+    unsigned int maxTrials = 100;
+    /// the probability of having drawn an all-inlier sample at which to stop early
+    double confidence = 0.99;
+    /// the largest epipolar residual (with the essential matrix normalized) for a correspondence to count as an inlier
+    double inlierThreshold = 0.001;
+    /// the residual compared against inlierThreshold
+    UprightScoringType scoring = UprightScoringType::Algebraic;
+    /// how the yaw is chosen
+    UprightConsensusType consensus = UprightConsensusType::YawVotes;
+    /// the largest reprojection error (in normalized image coordinates) for a 2D-3D correspondence to count as an inlier (absolute pose only)
+    double reprojectionThreshold = 0.004;
+    /// the largest transfer error (in normalized image coordinates) for a correspondence to count as an inlier of a homography (roughly as strict as inlierThreshold, allowing for the error being in two dimensions rather than one)
+    double homographyThreshold = 0.002;
+    /// the fraction of the correspondences a hypothesis must agree with to vote on the yaw
+    double consensusFraction = 0.5;
+    /// refine the yaw and translation on the inliers each time a new best hypothesis is found
+    bool localOptimization = true;
+    /// abandon hypotheses with Wald's sequential probability ratio test once they are clearly bad
+    bool sprt = true;
+    /// match again along the epipolar lines of the best hypothesis and refine on the larger set (only used by solveUprightAlignment)
+    bool guidedRematching = true;
+    /// when the inliers of the essential matrix look planar, also fit the homography of a vertical plane and use it instead if it scores about as well (only used by solveUprightAlignment)
+    bool modelSelection = true;
+    /// reject hypotheses whose yaw is outside of yawPrior before scoring them
+    bool useYawPrior = false;
+    YawPrior yawPrior;
+    /// if not empty, also reject hypotheses whose yaw isn't within yawHypothesisTolerance of one of these (e.g., the yaws that line up the vanishing directions of a Manhattan scene, see getManhattanYawHypotheses)
+    std::vector<float> yawHypotheses;
+    float yawHypothesisTolerance = 0.05f;
+    /// the threads to generate and score hypotheses on (the calling thread does all the work if this is null)
+    WorkerPool* workerPool = nullptr;
+    /// the seed of the random samples (each trial draws from its own stream, so the result doesn't depend on the number of threads).  The same seed draws the same samples, so callers take a new one from getUprightRansacSeed for each attempt, or a retry on the same frames could never recover from an unlucky draw.
+    uint64_t seed = 0;
+};
+
+/**
+ The outcome of upright RANSAC.
+ */
+typedef struct {
+    /// whether any hypothesis was scored
+    bool found;
+    /// the best essential matrix (normalized)
+    Eigen::Matrix3d essential;
+    /// the yaw and unit translation that make up essential
+    double yaw;
+    Eigen::Vector3d translation;
+    int inlierCount;
+    double inlierResidualSum;
+    /// whether the best essential matrix came out of local optimization
+    bool refined;
+    /// the number of samples drawn
+    unsigned int trials;
+    /// the number of hypotheses abandoned by the sequential probability ratio test
+    unsigned int sprtRejections;
+    /// the yaws of the hypotheses that had a consensus, bucketed by centiradian
+    std::map<int, std::vector<float> > centiradQuantization;
+    /// the translations that go with each yaw in centiradQuantization
+    std::map<int, std::vector<cv::Mat> > centiradQuantizationTranslations;
+} UprightRansacResult;
+
+/**
+ Wald's sequential probability ratio test for verifying hypotheses (Chum and Matas, "Optimal Randomized RANSAC").
+ 
+ The correspondences are checked in fixed-size blocks so that the residuals within a block can be computed without branching, and the likelihood ratio is only updated between blocks.
+ */
+class SprtTest {
+public:
+    /**
+     Set up the test.
+     
+     - parameters:
+     - inlierRatio: The initial guess of the fraction of correspondences consistent with a good model.
+     - badModelConsistency: The initial guess of the fraction of correspondences consistent with a bad model.
+     - modelCost: The time it takes to generate a hypothesis in units of the time to check one correspondence.
+     */
+    SprtTest(double inlierRatio = 0.2, double badModelConsistency = 0.05, double modelCost = 200);
+    
+    /**
+     Score an essential matrix, stopping as soon as it is likely to be a bad model.  This doesn't change the test, so it is safe to call from several threads at once.
+     
+     - returns: False if the hypothesis was abandoned (in which case totalInliers and inlierResidualSum only cover the correspondences that were checked).
+     
+     - parameters:
+     - essential_matrix: The (normalized) essential matrix.
+     - rays1: The rays in the first camera.
+     - rays2: The rays in the second camera.
+     - threshold: The largest epipolar residual (of the given scoring type) of an inlier.
+     - totalInliers: Set to the number of inliers.
+     - inlierResidualSum: Set to the sum of the residuals of the inliers.
+     - tested: Set to the number of correspondences that were checked.
+     */
+    template <UprightScoringType scoring>
+    bool evaluate(const Eigen::Matrix3d& essential_matrix, const std::vector<Eigen::Vector3d>& rays1, const std::vector<Eigen::Vector3d>& rays2, double threshold, int& totalInliers, double& inlierResidualSum, unsigned int& tested) const;
+    
+    /// Use what was seen of an abandoned (presumably bad) model to update the estimate of the fraction of correspondences consistent with a bad model.
+    void addRejection(unsigned int tested, unsigned int consistent);
+    
+    /// Update the fraction of correspondences consistent with a good model (e.g., when a new best model is found).
+    void setInlierRatio(double inlierRatio);
+    
+    /// Record how many hypotheses the last sample produced.
+    void addSample(unsigned int numModels);
+    
+    /// The probability that the test accepts a good model.
+    double getAcceptanceProbability() const;
+    
+private:
+    void updateDecisionThreshold();
+    
+    /// the probability that a correspondence is consistent with a good model
+    double epsilon;
+    /// the probability that a correspondence is consistent with a bad model
+    double delta;
+    double modelCost;
+    /// the decision threshold on the likelihood ratio (and its log)
+    double decisionThreshold;
+    double logDecisionThreshold;
+    /// what the log likelihood ratio changes by for each consistent and inconsistent correspondence
+    double logConsistent;
+    double logInconsistent;
+    /// statistics for estimating delta and the number of models per sample
+    double rejectedTested;
+    double rejectedConsistent;
+    unsigned int samples;
+    unsigned int models;
+};
+
+/**
+ Check whether a yaw hypothesis is consistent with the yaw prior and the yaw hypotheses of the options (if they are used).
+ 
+ - returns: True if RANSAC should consider the yaw.
+ 
+ - parameters:
+ - yaw: The yaw hypothesis.
+ - options: How RANSAC is being run.
+ */
+bool isYawAllowed(double yaw, const UprightRansacOptions& options);
+
+/**
+ Get a seed for upright RANSAC that differs from call to call (it is safe to call from any thread).
+ 
+ - returns: The seed.
+ */
+uint64_t getUprightRansacSeed();
+
+/**
+ Find the rotation about the vertical axis (and the translation up to scale) between two leveled cameras.
+ 
+ - returns: The best hypothesis and the votes for the yaw.
+ 
+ - parameters:
+ - correspondences: The matched features.
+ - options: How to run RANSAC.
+ */
+UprightRansacResult runUprightRansac(const UprightCorrespondences& correspondences, const UprightRansacOptions& options);
+
+/**
+ Count the correspondences that agree with an essential matrix.
+ 
+ - returns: The number of inliers.
+ 
+ - parameters:
+ - essential_matrix: The (normalized) essential matrix.
+ - rays1: The rays in the first camera.
+ - rays2: The rays in the second camera.
+ - threshold: The largest epipolar residual of an inlier.
+ - inlierResidualSum: Set to the sum of the residuals of the inliers.
+ - inliers: If not null, filled in with the indices of the inliers.
+ - scoring: The residual to compare against the threshold.
+ */
+int scoreEssential(const Eigen::Matrix3d& essential_matrix, const std::vector<Eigen::Vector3d>& rays1, const std::vector<Eigen::Vector3d>& rays2, double threshold, double& inlierResidualSum, std::vector<int>* inliers = nullptr, UprightScoringType scoring = UprightScoringType::Algebraic);
+
+/**
+ Refine an upright pose against a set of correspondences with iteratively reweighted Gauss-Newton on the Sampson error.
+ 
+ The rotation is R = AngleAxis(yaw, UnitY) and the translation is a unit vector (constrained to the horizontal plane if planar is set), with ray_in_image_2 ~ R * ray_in_image_1 + t.
+ 
+ - returns: False if the problem was degenerate (the pose is left unchanged).
+ 
+ - parameters:
+ - rays1: The rays in the first camera.
+ - rays2: The rays in the second camera.
+ - inliers: The indices of the correspondences to refine against.
+ - planar: Whether to keep the translation horizontal.
+ - yaw: The initial yaw, which is updated in place.
+ - translation: The initial translation, which is updated in place.
+ - iterations: The maximum number of Gauss-Newton steps.
+ */
+bool refineUprightPose(const std::vector<Eigen::Vector3d>& rays1, const std::vector<Eigen::Vector3d>& rays2, const std::vector<int>& inliers, bool planar, double& yaw, Eigen::Vector3d& translation, unsigned int iterations = 5);
+
+#endif /* UprightRansac_hpp */
@@ -0,0 +1,91 @@
+//
+//  UprightRansacPolicies.hpp
+//  Clew
+//
+//  Created by OccamLab on 10/19/26.
+//  Copyright © 2026 OccamLab. All rights reserved.
+//
+
+#ifndef UprightRansacPolicies_hpp
+#define UprightRansacPolicies_hpp
+
+#include <Eigen/Core>
+#include <Eigen/Geometry>
+#include <cmath>
+#include <vector>
+#include "UprightRansac.hpp"
+#include "AlignmentTrace.hpp"
+
+/**
+ The pieces of upright RANSAC that run inside its hot loops.  runUprightRansac picks one of each from its options once per call, so every combination is compiled into its own loop with no branching on the options per trial or per correspondence.
+ 
+ A minimal solver provides:
+ - sampleSize: The number of correspondences in a sample.
+ - planar: Whether the translation is kept in the horizontal plane.
+ - solve(...): Generate the hypotheses (ray_in_image_2 = Q * ray_in_image_1 + t) of a sample.
+ 
+ A residual provides:
+ - evaluate(...): How far a correspondence is from agreeing with an essential matrix (compared against inlierThreshold).
+ 
+ A consensus strategy provides:
+ - collectsVotes: Whether hypotheses with a consensus vote on the yaw (which costs a recoverPose per vote).
+ */
+template <UprightSolverType type>
+struct UprightMinimalSolver;
+
+template <>
+struct UprightMinimalSolver<UprightSolverType::ThreePoint> {
+    static constexpr unsigned int sampleSize = 3;
+    static constexpr bool planar = false;
+    
+    static void solve(const Eigen::Vector3d image_1_rays[3], const Eigen::Vector3d image_2_rays[3], std::vector<Eigen::Quaterniond>* soln_rotations, std::vector<Eigen::Vector3d>* soln_translations) {
+        ALIGNMENT_TRACE_SCOPE("theia::ThreePointRelativePosePartialRotation");
+        theia::ThreePointRelativePosePartialRotation(Eigen::Vector3d::UnitY(), image_1_rays, image_2_rays, soln_rotations, soln_translations);
+    }
+};
+
+template <>
+struct UprightMinimalSolver<UprightSolverType::TwoPointPlanar> {
+    static constexpr unsigned int sampleSize = 2;
+    static constexpr bool planar = true;
+    
+    static void solve(const Eigen::Vector3d image_1_rays[2], const Eigen::Vector3d image_2_rays[2], std::vector<Eigen::Quaterniond>* soln_rotations, std::vector<Eigen::Vector3d>* soln_translations) {
+        ALIGNMENT_TRACE_SCOPE("TwoPointPlanarRelativePose");
+        TwoPointPlanarRelativePose(image_1_rays, image_2_rays, soln_rotations, soln_translations);
+    }
+};
+
+template <UprightScoringType type>
+struct EpipolarResidual;
+
+template <>
+struct EpipolarResidual<UprightScoringType::Algebraic> {
+    static double evaluate(const Eigen::Matrix3d& essential_matrix, const Eigen::Vector3d& ray1, const Eigen::Vector3d& ray2) {
+        return std::abs(ray2.dot(essential_matrix * ray1));
+    }
+};
+
+template <>
+struct EpipolarResidual<UprightScoringType::Sampson> {
+    static double evaluate(const Eigen::Matrix3d& essential_matrix, const Eigen::Vector3d& ray1, const Eigen::Vector3d& ray2) {
+        const Eigen::Vector3d epipolarLine2 = essential_matrix * ray1;
+        const Eigen::Vector3d epipolarLine1 = essential_matrix.transpose() * ray2;
+        const double scale = epipolarLine2.head<2>().squaredNorm() + epipolarLine1.head<2>().squaredNorm();
+        return scale > 0 ? std::abs(ray2.dot(epipolarLine2)) / std::sqrt(scale) : 0.0;
+    }
+};
+
+template <UprightConsensusType type>
+struct ConsensusStrategy;
+
+template <>
+struct ConsensusStrategy<UprightConsensusType::YawVotes> {
+    static constexpr bool collectsVotes = true;
+};
+
+template <>
+struct ConsensusStrategy<UprightConsensusType::BestModel> {
+    static constexpr bool collectsVotes = false;
+};
+
+#endif /* UprightRansacPolicies_hpp */
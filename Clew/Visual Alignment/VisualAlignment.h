@@ -9,6 +9,7 @@
 #import <Foundation/Foundation.h>
 #import <UIKit/UIKit.h>
 #import <simd/SIMD.h>
+#import <CoreVideo/CoreVideo.h>
 
 NS_ASSUME_NONNULL_BEGIN
 
@@ -20,11 +21,93 @@ typedef struct {
     int numInliers;
     int numMatches;
     float residualAngle;
+    /// the translation (up to scale, except with the two point absolute solver where it is in meters)
     float tx;
     float ty;
     float tz;
+    int numTrials;
+    int numTracked;
+    /// the most memory held by OpenCV images and descriptors at once during the call (in bytes, beyond what was held before it)
+    long peakBytes;
+    /// the memory allocated for OpenCV images and descriptors over the whole call (in bytes)
+    long allocatedBytes;
+    /// the index of the view aligned to by visualYawToAnchorViews (the yaw and square_rotation1 are relative to it), or -1
+    int anchorView;
+    /// the peak of the phase correlation when the yaw came from it (near 1 for a pure rotation), otherwise 0
+    float phaseCorrelationConfidence;
 } VisualAlignmentReturn;
 
+/// The measurements used to decide whether a frame is worth running visualYaw on.
+typedef struct {
+    float laplacianVariance;
+    float gradientEnergy;
+    float saturatedFraction;
+    float angularSpeed;
+    float linearSpeed;
+    bool is_usable;
+} VisualAlignmentFrameQuality;
+
+/// How a frame of the anchor burst was scored (see finishAnchorBurst).
+typedef struct {
+    /// the camera intrinsics used to take the frame in the format [fx, fy, ppx, ppy]
+    simd_float4 intrinsics;
+    /// the pose of the camera when the frame was captured
+    simd_float4x4 pose;
+    /// the timestamp of the frame
+    double timestamp;
+    /// the ratio of the variance of the Laplacian to the gradient energy (higher is sharper)
+    float sharpness;
+    /// the fraction of a grid over the leveled frame that has features in it
+    float featureSpread;
+    /// the fraction of the strongest features that were found again in the other frames
+    float matchability;
+    /// the three combined (the frames are ranked by it)
+    float score;
+    /// whether the frame passed the checks of frameQuality
+    bool is_usable;
+} VisualAlignmentAnchorCandidate;
+
+/// A result of the alignment pipeline along with the frame it came from.
+typedef struct {
+    VisualAlignmentReturn alignment;
+    /// the pose of the camera when the frame was captured
+    simd_float4x4 pose;
+    /// the timestamp of the frame
+    double timestamp;
+} VisualAlignmentPipelineResult;
+
+/// The minimal solver used to generate RANSAC hypotheses in visualYaw.
+typedef NS_ENUM(NSInteger, VisualAlignmentSolver) {
+    /// three correspondences, rotation about the vertical axis and translation up to scale in any direction
+    VisualAlignmentSolverThreePoint,
+    /// two correspondences, rotation about the vertical axis and translation up to scale in the horizontal plane (the user walking on a floor)
+    VisualAlignmentSolverTwoPointPlanar,
+    /// OpenCV's five point essential matrix estimation with no gravity prior
+    VisualAlignmentSolverEssential,
+    /// two 2D-3D correspondences from the 3D points stored with the anchor, rotation about the vertical axis and metric translation (falls back to the three point solver when too few matches have a point)
+    VisualAlignmentSolverTwoPointAbsolute,
+    /// no features, just the phase correlation of the leveled images reprojected onto a cylinder (only the yaw, and only right when the camera turned rather than moved; the other calls use the three point solver instead)
+    VisualAlignmentSolverPhaseCorrelation,
+};
+
+/// The feature detector and descriptor used in visualYaw.
+typedef NS_ENUM(NSInteger, VisualAlignmentFeatureBackend) {
+    /// upright AKAZE (the most accurate and the most expensive)
+    VisualAlignmentFeatureBackendAKAZE,
+    /// upright ORB (much cheaper, for older devices)
+    VisualAlignmentFeatureBackendORB,
+    /// BRISK
+    VisualAlignmentFeatureBackendBRISK,
+};
+
+/// How severe a message logged by the alignment code is (messages below CLEW_ALIGNMENT_LOG_LEVEL aren't compiled in).
+typedef NS_ENUM(NSInteger, VisualAlignmentLogLevel) {
+    VisualAlignmentLogLevelDebug,
+    VisualAlignmentLogLevelInfo,
+    VisualAlignmentLogLevelWarning,
+    VisualAlignmentLogLevelError,
+};
+
 @interface VisualAlignment : NSObject
 /**
  Deduce the yaw between two images.
@@ -32,17 +115,307 @@ typedef struct {
  - returns: The yaw in radians between the pictures assuming portrait orientation.
  
  - parameters:
- - image1: The image the returned yaw is relative to.
- - intrinsics1: The camera intrinsics used to take image1 in the format [fx, fy, ppx, ppy].
+ - image1: The image the returned yaw is relative to, or nil to use the one decoded by loadAnchorImage.
+ - intrinsics1: The camera intrinsics used to take image1 in the format [fx, fy, ppx, ppy] (the ones given to loadAnchorImage are used if image1 is nil).
  - pose1: The pose of the camera in the arsession used to take the first image.
  - image2: The image the returned yaw rotates to.
  - intrinsics2: The camera intrinsics used to take image2 in the format [fx, fy, ppx, ppy].
  - pose2: The pose of the camera in the arsession used to take the second image.
+ - downSampleFactor: The factor by which to shrink the leveled images before finding features.
+ - solver: The minimal solver to use for generating pose hypotheses.
+ - featureBackend: The feature detector and descriptor to use.
+ - yawPriorUncertainty: If positive, pose1 and pose2 are assumed to be in the same coordinate frame and the yaw they imply is used to guide matching and to reject RANSAC hypotheses that are more than this many radians away from it.
+ - anchorPoints: The 3D points ARKit saw when image1 was taken, in the coordinates of the camera that took it (only used by the two point absolute solver).
+ - numAnchorPoints: The number of anchorPoints.
  */
 
 + (nullable UIImage*) getDebugImage;
 
-+ (VisualAlignmentReturn) visualYaw :(UIImage *)image1 :(simd_float4)intrinsics1 :(simd_float4x4)pose1 :(UIImage *)image2 :(simd_float4)intrinsics2 :(simd_float4x4)pose2 :(int) downSampleFactor;
+/**
+ Forget the anchor features and feature tracks carried between calls of visualYaw.  Call this before aligning to a new anchor point.
+ */
++ (void) resetTracking;
+
+/**
+ Record the pose of an ARKit frame so that the camera's speed can be estimated by frameQuality.
+ 
+ - parameters:
+ - pose: The pose of the camera.
+ - timestamp: The timestamp of the frame.
+ */
++ (void) addFramePose :(simd_float4x4)pose :(double)timestamp;
+
+/**
+ Check whether a frame is sharp, well exposed, and was captured while the phone was steady.
+ 
+ This takes about a millisecond (most of it shrinking the luma plane), so it should be used to skip frames before running visualYaw on them.
+ 
+ - returns: The measurements of the frame and whether it is usable.
+ 
+ - parameters:
+ - pixelBuffer: The captured image of the frame (the luma plane is used).
+ - pose: The pose of the camera.
+ - timestamp: The timestamp of the frame.
+ */
++ (VisualAlignmentFrameQuality) frameQuality :(CVPixelBufferRef)pixelBuffer :(simd_float4x4)pose :(double)timestamp;
+
++ (VisualAlignmentReturn) visualYaw :(nullable UIImage *)image1 :(simd_float4)intrinsics1 :(simd_float4x4)pose1 :(UIImage *)image2 :(simd_float4)intrinsics2 :(simd_float4x4)pose2 :(int) downSampleFactor :(VisualAlignmentSolver) solver :(VisualAlignmentFeatureBackend) featureBackend :(float) yawPriorUncertainty :(const simd_float3 * _Nullable) anchorPoints :(int) numAnchorPoints;
+
+/**
+ Let the quality controller pick how much work visualYaw does.  It measures how long each stage of visualYaw takes and how often it succeeds (leaving out the first attempt against an anchor and attempts that only tracked features), and picks the downSampleFactor (see recommendedDownSampleFactor), how many features to keep in the live image, and how many RANSAC trials to run so that calls take about targetLatency.  It is only fed by (and only changes) the upright solvers of visualYaw.
+ 
+ - parameters:
+ - enabled: Whether visualYaw uses the budget picked by the controller (the controller keeps what it has learned either way).
+ - targetLatency: How long a call of visualYaw should take (in milliseconds).
+ */
++ (void) setAdaptiveQuality :(bool)enabled :(double)targetLatency;
+
+/**
+ Make the quality controller forget what it has measured and go back to its default budget (the target latency and thermal state are kept).  Call this when alignment to a new anchor starts, since how long attempts take depends on the anchor image.
+ */
++ (void) resetAdaptiveQuality;
+
+/**
+ Get the downSampleFactor the quality controller picked for the next call of visualYaw (the anchor image should be decoded with the smallest, which is 2).
+ 
+ - returns: The downSampleFactor.
+ */
++ (int) recommendedDownSampleFactor;
+
+/**
+ Start counting the memory OpenCV allocates for images and descriptors (see the peakBytes and allocatedBytes of VisualAlignmentReturn).  This should be called once at startup, before any other method, since memory allocated before then isn't counted.  Calling it again does nothing.
+ */
++ (void) installMemoryAccounting;
+
+/**
+ Tell the quality controller how hot the device is (it does less work as the device heats up).
+ 
+ - parameters:
+ - thermalState: The thermal state of the device.
+ */
++ (void) setThermalState :(NSProcessInfoThermalState)thermalState;
+
+/**
+ Decode a stored anchor image for later calls of visualYaw and startPipeline (pass them nil for the anchor image).  The image is decoded straight to grayscale at a reduced resolution, which takes a fraction of the time and memory of loading it as a UIImage.
+ 
+ - returns: False if the image couldn't be read.
+ 
+ - parameters:
+ - path: The JPEG or PNG file.
+ - intrinsics: The camera intrinsics used to take the image in the format [fx, fy, ppx, ppy].
+ - downSampleFactor: The downSampleFactor that will be passed to visualYaw and startPipeline.
+ */
++ (bool) loadAnchorImage :(NSString *)path :(simd_float4)intrinsics :(int)downSampleFactor;
+
+/**
+ Decode several images of the same anchor for visualYawToAnchorViews, replacing any loaded before (resetTracking forgets them as well).  Their features are extracted the first time they are aligned to.
+ 
+ - returns: False if one of the images couldn't be read (in which case none are kept).
+ 
+ - parameters:
+ - paths: The JPEG or PNG files (the anchor image itself should come first since it wins ties).
+ - intrinsics: The camera intrinsics used to take each image in the format [fx, fy, ppx, ppy] (one per path).
+ - poses: The pose of the camera used to take each image (one per path, all in the coordinate frame the anchor was recorded in).
+ - downSampleFactor: The factor by which to shrink the leveled images before finding features.
+ */
++ (bool) loadAnchorViews :(NSArray<NSString *> *)paths :(const simd_float4 *)intrinsics :(const simd_float4x4 *)poses :(int)downSampleFactor;
+
+/**
+ Deduce the yaw between the anchor view loaded by loadAnchorViews that best overlaps an image and the image.  Every view is scored against the image (in parallel) by matching only the strongest features, and full alignment is only run against the best one, and against the second best if that fails.  Neither feature tracking nor the debug image is used, and the essential matrix and two point absolute solvers fall back on the three point solver.
+ 
+ - returns: The yaw in radians from the view given by anchorView to the image.
+ 
+ - parameters:
+ - image: The image the returned yaw rotates to.
+ - intrinsics: The camera intrinsics used to take the image in the format [fx, fy, ppx, ppy].
+ - pose: The pose of the camera in the arsession used to take the image.
+ - solver: The minimal solver to use for generating pose hypotheses.
+ - featureBackend: The feature detector and descriptor to use.
+ - yawPriorUncertainty: If positive, the poses of the views are in the same coordinate frame as pose (see visualYaw).
+ */
++ (VisualAlignmentReturn) visualYawToAnchorViews :(UIImage *)image :(simd_float4)intrinsics :(simd_float4x4)pose :(VisualAlignmentSolver)solver :(VisualAlignmentFeatureBackend)featureBackend :(float)yawPriorUncertainty;
+
+/**
+ Start stitching a panorama around an anchor point from frames added by addPanoramaFrame, discarding any panorama being stitched.  The panorama is a grayscale strip all the way around a cylinder, placed relative to the camera that took the anchor image.
+ 
+ - parameters:
+ - referencePose: The pose of the camera that took the anchor image.
+ */
++ (void) startPanorama :(simd_float4x4)referencePose;
+
+/**
+ Add a frame to the panorama being stitched.  The frame is placed by its pose, so it has to come from the session the anchor was recorded in, and frames facing nearly the same way as one already added are skipped.
+ 
+ - returns: Whether the frame was added.
+ 
+ - parameters:
+ - pixelBuffer: The image ARKit captured.
+ - intrinsics: The camera intrinsics used to take the image in the format [fx, fy, ppx, ppy].
+ - pose: The pose of the camera that took the image.
+ */
++ (bool) addPanoramaFrame :(CVPixelBufferRef)pixelBuffer :(simd_float4)intrinsics :(simd_float4x4)pose;
+
+/**
+ Get how much of the way around the panorama being stitched covers.
+ 
+ - returns: The fraction of the columns that are covered.
+ */
++ (float) panoramaCoverage;
+
+/**
+ Write the panorama being stitched to a PNG file.
+ 
+ - returns: False if no frame was added or the file couldn't be written.
+ 
+ - parameters:
+ - path: The file to write.
+ */
++ (bool) savePanorama :(NSString *)path;
+
+/**
+ Read a panorama written by savePanorama for visualYawToPanorama, replacing any loaded before (resetTracking forgets it as well).
+ 
+ - returns: False if the file isn't a panorama.
+ 
+ - parameters:
+ - path: The PNG file.
+ - referencePose: The pose of the camera that took the anchor image (the one passed to visualYaw).
+ */
++ (bool) loadPanorama :(NSString *)path :(simd_float4x4)referencePose;
+
+/**
+ Deduce the yaw between the anchor image and an image by sliding the column signatures of the image around the panorama loaded by loadPanorama.  This takes a few milliseconds and works whichever way the phone is facing, but it assumes the phone is about where the panorama was taken and only reports the yaw (the translation is 0 and there are no matches).
+ 
+ - returns: The yaw in radians from the anchor image to the image.
+ 
+ - parameters:
+ - image: The image the returned yaw rotates to.
+ - intrinsics: The camera intrinsics used to take the image in the format [fx, fy, ppx, ppy].
+ - pose: The pose of the camera in the arsession used to take the image.
+ */
++ (VisualAlignmentReturn) visualYawToPanorama :(UIImage *)image :(simd_float4)intrinsics :(simd_float4x4)pose;
+
+/**
+ Start collecting a burst of frames to pick the anchor image from, discarding any collected before.  The frames are leveled, have their features extracted, and are scored on worker threads of the burst's own as they are added (so alignment never waits on them), and finishAnchorBurst only has to compare them.
+ 
+ - parameters:
+ - downSampleFactor: The factor by which to shrink the leveled frames before finding features (the one alignment will use).
+ - featureBackend: The feature detector and descriptor to use.
+ - maxFrames: How many of the newest frames to keep.
+ */
++ (void) startAnchorBurst :(int)downSampleFactor :(VisualAlignmentFeatureBackend)featureBackend :(int)maxFrames;
+
+/**
+ Add a frame to the anchor burst, dropping the oldest frame once there are maxFrames (see startAnchorBurst).  The planes of the frame are copied, so the buffer isn't held on to.
+ 
+ - returns: False if there is no burst to add to.
+ 
+ - parameters:
+ - pixelBuffer: The image ARKit captured.
+ - intrinsics: The camera intrinsics used to take the image in the format [fx, fy, ppx, ppy].
+ - pose: The pose of the camera that took the image.
+ - timestamp: When the frame was captured (in seconds).
+ */
++ (bool) addAnchorBurstFrame :(CVPixelBufferRef)pixelBuffer :(simd_float4)intrinsics :(simd_float4x4)pose :(double)timestamp;
+
+/**
+ Stop the anchor burst, rank its frames by sharpness, the spread of their features, and how many of their features the other frames found again, and write the best of them as JPEGs.  Encoding the JPEGs takes tens of milliseconds, so they are written in the background after this returns.
+ 
+ - returns: The number of frames picked (at most the number of paths, and 0 if no frames were added).
+ 
+ - parameters:
+ - paths: The files to write the best frame, the next best frame, and so on to.
+ - candidates: Filled in with the frames that were picked (there has to be room for as many as there are paths).
+ - completion: Called on the main queue once the frames have been written, with the number written (those after one that couldn't be written aren't tried).
+ */
++ (int) finishAnchorBurst :(NSArray<NSString *> *)paths :(VisualAlignmentAnchorCandidate *)candidates :(void (^ _Nullable)(int written))completion;
+
+/**
+ Start aligning frames to an anchor in the background.  Frames are leveled and have their features extracted on one thread while the previous frame is matched and solved on another.  Feature tracking isn't used (the next frame is extracted before the current one is solved), and neither the essential matrix solver nor the two point absolute solver is supported (the three point solver is used instead).
+ 
+ - parameters:
+ - anchorImage: The image to align frames to, or nil to use the one decoded by loadAnchorImage.
+ - anchorIntrinsics: The camera intrinsics used to take the anchor image in the format [fx, fy, ppx, ppy].
+ - anchorPose: The pose of the camera used to take the anchor image.
+ - downSampleFactor: The factor by which to shrink the leveled images before finding features.
+ - solver: The minimal solver to use for generating pose hypotheses.
+ - featureBackend: The feature detector and descriptor to use.
+ - yawPriorUncertainty: If positive, the anchor pose is in the same coordinate frame as the frames (see visualYaw).
+ */
++ (void) startPipeline :(nullable UIImage *)anchorImage :(simd_float4)anchorIntrinsics :(simd_float4x4)anchorPose :(int)downSampleFactor :(VisualAlignmentSolver)solver :(VisualAlignmentFeatureBackend)featureBackend :(float)yawPriorUncertainty;
+
+/**
+ Offer a frame to the pipeline.  This only copies the luma plane, and the frame replaces any frame the pipeline hasn't started on yet.
+ 
+ - parameters:
+ - pixelBuffer: The captured image of the frame.
+ - intrinsics: The camera intrinsics in the format [fx, fy, ppx, ppy].
+ - pose: The pose of the camera.
+ - timestamp: The timestamp of the frame.
+ */
++ (void) submitPipelineFrame :(CVPixelBufferRef)pixelBuffer :(simd_float4)intrinsics :(simd_float4x4)pose :(double)timestamp;
+
+/**
+ Get the next result of the pipeline.
+ 
+ - returns: False if no frame has finished since the last call.
+ 
+ - parameters:
+ - result: Filled in with the result.
+ */
++ (bool) popPipelineResult :(VisualAlignmentPipelineResult *)result;
+
+/**
+ Stop the pipeline and discard any frames and results still in flight.
+ */
++ (void) stopPipeline;
+
+/**
+ Get the names of the alignment configurations that selectConfiguration accepts (the first is the default).
+ 
+ - returns: The names.
+ */
++ (NSArray<NSString *> *) configurationNames;
+
+/**
+ Pick a named alignment configuration.  The selected configuration is only kept here: how RANSAC scores hypotheses and picks the yaw is used by every later call of visualYaw and startPipeline, and the solver and feature backend to pass to them are read back with selectedSolver and selectedFeatureBackend.
+ 
+ - returns: False if there is no configuration with that name (in which case nothing changes).
+ 
+ - parameters:
+ - name: The name of the configuration (e.g., "akaze-3pt").
+ */
++ (bool) selectConfiguration :(NSString *)name;
+
+/// The solver of the selected configuration (see selectConfiguration).
++ (VisualAlignmentSolver) selectedSolver;
+
+/// The feature backend of the selected configuration (see selectConfiguration).
++ (VisualAlignmentFeatureBackend) selectedFeatureBackend;
+
+/**
+ Set what is done with the messages logged by the alignment code.  They are handed over on a background thread (not the one that logged them), one at a time.
+ 
+ - parameters:
+ - minimumLevel: The lowest severity to keep.
+ - handler: Gets the severity, category, and text of each message (if nil, messages are written to stderr).
+ */
++ (void) setLogHandler :(VisualAlignmentLogLevel)minimumLevel :(void (^ _Nullable)(VisualAlignmentLogLevel level, NSString *category, NSString *message))handler;
+
+/**
+ Write the events traced by the alignment code as Chrome Trace Event JSON (open it with chrome://tracing or Perfetto).  Nothing is traced unless the app is built with CLEW_ALIGNMENT_TRACE defined.
+ 
+ - returns: False if the file couldn't be written or tracing isn't compiled in.
+ 
+ - parameters:
+ - path: The file to write.
+ */
++ (bool) writeTrace :(NSString *)path;
+
+/**
+ Throw away the events traced so far.
+ */
++ (void) clearTrace;
 
 /**
  Get the amount of features in the image.
@@ -14,8 +14,29 @@
 #import <opencv2/core/eigen.hpp>
 #import "VisualAlignment.h"
 #import "VisualAlignmentUtils.hpp"
+#import "FeatureTracker.hpp"
+#import "FrameQuality.hpp"
+#import "UprightRansac.hpp"
+#import "UprightAlignment.hpp"
+#import "AlignmentPipeline.hpp"
+#import "WorkerPool.hpp"
+#import "AlignmentTrace.hpp"
+#import "AlignmentConfiguration.hpp"
+#import "AlignmentLog.hpp"
+#import "AnchorImage.hpp"
+#import "AnchorViews.hpp"
+#import "PhaseCorrelationYaw.hpp"
+#import "CylindricalPanorama.hpp"
+#import "ManhattanYaw.hpp"
+#import "AnchorBurst.hpp"
+#import "AlignmentQualityController.hpp"
+#import "MemoryAccounting.hpp"
 #import <UIKit/UIKit.h>
+#import <atomic>
+#import <chrono>
 #import <fstream>
+#import <mutex>
+#import <thread>
 
 
 @implementation VisualAlignment
@@ -24,241 +45,866 @@
 
 UIImage *debug_match_image_ui = 0;
 
+/// carries anchor features and inlier tracks from one call of visualYaw to the next
+FeatureTracker feature_tracker;
+std::mutex feature_tracker_mutex;
+
+/// the anchor image decoded by loadAnchorImage (guarded by feature_tracker_mutex)
+AnchorImage loaded_anchor_image;
+
+/// the views of the anchor decoded by loadAnchorViews (guarded by feature_tracker_mutex)
+AnchorViewSet anchor_views;
+
+/// the panorama loaded by loadPanorama (guarded by feature_tracker_mutex)
+CylindricalPanorama anchor_panorama;
+
+/// the panorama being stitched while an anchor is recorded (see startPanorama)
+CylindricalPanorama recording_panorama;
+std::mutex recording_panorama_mutex;
+
+/// screens frames before visualYaw is run on them
+FrameQualityGate frame_quality_gate;
+
+/// picks the budget of each call of visualYaw from how long the last ones took (see setAdaptiveQuality)
+AlignmentQualityController quality_controller;
+std::atomic<bool> adaptive_quality_enabled(false);
+
+/// the threads that feature extraction and RANSAC spread their work over (created the first time they are needed)
+static WorkerPool& getWorkerPool() {
+    static WorkerPool worker_pool(std::min(4u, std::max(1u, std::thread::hardware_concurrency())));
+    return worker_pool;
+}
+
+/// the workers the pipeline's RANSAC runs on, its own since its solving stage runs alongside visualYaw and the worker pool only runs one task at a time
+static const unsigned int kAlignmentPipelineWorkers = 2;
+/// aligns frames in the background (see startPipeline)
+static AlignmentPipeline& getAlignmentPipeline() {
+    static WorkerPool alignment_pipeline_pool(std::min(kAlignmentPipelineWorkers, std::max(1u, std::thread::hardware_concurrency())));
+    static AlignmentPipeline alignment_pipeline(&alignment_pipeline_pool);
+    return alignment_pipeline;
+}
+std::mutex alignment_pipeline_mutex;
+
+/// the workers the anchor burst is scored on (including its scoring thread), fewer than alignment gets since the burst only has to keep up with a few frames a second
+static const unsigned int kAnchorBurstWorkers = 2;
+/// the frames an anchor image is picked from (see startAnchorBurst), scored on workers of their own since the worker pool only runs one task at a time and alignment shouldn't wait on the burst (or the burst on alignment)
+static AnchorBurst& getAnchorBurst() {
+    static WorkerPool anchor_burst_pool(kAnchorBurstWorkers);
+    static AnchorBurst anchor_burst(&anchor_burst_pool);
+    return anchor_burst;
+}
+std::mutex anchor_burst_mutex;
+
+/// how the leveled, downsampled images are split up for feature extraction
+static const unsigned int kFeatureTilesAcross = 2;
+static const unsigned int kFeatureTilesDown = 2;
+
+/// the fewest matches to estimate an essential matrix from
+static const size_t kMinEssentialMatches = 10;
+/// the lowest peak of the phase correlation to accept when it was asked for
+static const float kMinPhaseCorrelationConfidence = 0.1f;
+/// the lowest peak of the phase correlation to accept when it stands in for too few matches (unrelated images often correlate at 0.1 to 0.2)
+static const float kMinFallbackPhaseCorrelationConfidence = 0.3f;
+/// the least peak fraction (see ManhattanFrame) of both images for the lines of a Manhattan scene to overrule a valid yaw from features
+static const float kMinConfidentManhattanPeakFraction = 0.35f;
+/// how many times as many inliers the solve restricted to the Manhattan yaws needs to replace a valid yaw from features
+static const float kManhattanInlierAdvantage = 1.5f;
+/// how many of the anchor views that overlap the live image the most are aligned to (the next is only tried if the one before it fails)
+static const unsigned int kAlignedAnchorViews = 2;
+/// how much frames are shrunk before they are leveled for a panorama (which is much coarser than even the most downsampled leveled images)
+static const int kPanoramaFrameReduction = 4;
+
+/// the configuration picked by selectConfiguration (the default until then), which is the only record of it
+static AlignmentConfiguration selected_configuration = getAlignmentConfigurations()[0];
+std::mutex alignment_configuration_mutex;
+
 + (nullable UIImage*) getDebugImage {
     return debug_match_image_ui;
 }
 
-+ (VisualAlignmentReturn) visualYaw :(UIImage *)image1 :(simd_float4)intrinsics1 :(simd_float4x4)pose1
-                    :(UIImage *)image2 :(simd_float4)intrinsics2 :(simd_float4x4)pose2 :(int)downSampleFactor {
+static double millisecondsSince(std::chrono::steady_clock::time_point start) {
+    return std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - start).count();
+}
+
+static FeatureBackendType toFeatureBackendType(VisualAlignmentFeatureBackend featureBackend) {
+    switch (featureBackend) {
+        case VisualAlignmentFeatureBackendORB:
+            return FeatureBackendType::ORB;
+        case VisualAlignmentFeatureBackendBRISK:
+            return FeatureBackendType::BRISK;
+        case VisualAlignmentFeatureBackendAKAZE:
+        default:
+            return FeatureBackendType::AKAZE;
+    }
+}
+
++ (void) resetTracking {
+    std::lock_guard<std::mutex> lock(feature_tracker_mutex);
+    feature_tracker.reset();
+    anchor_views.reset();
+    anchor_panorama.reset();
+}
+
++ (void) addFramePose :(simd_float4x4)pose :(double)timestamp {
+    // marks the ARKit frame callbacks in the trace
+    ALIGNMENT_TRACE_SCOPE("addFramePose");
+    frame_quality_gate.addPose(poseToMatrix(pose), timestamp);
+}
+
++ (VisualAlignmentFrameQuality) frameQuality :(CVPixelBufferRef)pixelBuffer :(simd_float4x4)pose :(double)timestamp {
+    CVPixelBufferLockBaseAddress(pixelBuffer, kCVPixelBufferLock_ReadOnly);
+    // ARKit gives us bi-planar YCbCr, so the first plane is the luma (wrap it rather than copying it)
+    const bool isPlanar = CVPixelBufferIsPlanar(pixelBuffer);
+    cv::Mat luma((int) (isPlanar ? CVPixelBufferGetHeightOfPlane(pixelBuffer, 0) : CVPixelBufferGetHeight(pixelBuffer)),
+                 (int) (isPlanar ? CVPixelBufferGetWidthOfPlane(pixelBuffer, 0) : CVPixelBufferGetWidth(pixelBuffer)),
+                 CV_8UC1,
+                 isPlanar ? CVPixelBufferGetBaseAddressOfPlane(pixelBuffer, 0) : CVPixelBufferGetBaseAddress(pixelBuffer),
+                 isPlanar ? CVPixelBufferGetBytesPerRowOfPlane(pixelBuffer, 0) : CVPixelBufferGetBytesPerRow(pixelBuffer));
+    const FrameQuality quality = frame_quality_gate.evaluate(luma, poseToMatrix(pose), timestamp);
+    CVPixelBufferUnlockBaseAddress(pixelBuffer, kCVPixelBufferLock_ReadOnly);
+    
+    VisualAlignmentFrameQuality ret;
+    ret.laplacianVariance = quality.laplacianVariance;
+    ret.gradientEnergy = quality.gradientEnergy;
+    ret.saturatedFraction = quality.saturatedFraction;
+    ret.angularSpeed = quality.angularSpeed;
+    ret.linearSpeed = quality.linearSpeed;
+    ret.is_usable = quality.is_usable;
+    return ret;
+}
+
+/// Fill in the yaw from the phase correlation of two leveled images (there are no matches and no translation), keeping it only if the peak of the correlation is at least minConfidence.
+static void alignByPhaseCorrelation(const LeveledImage& leveled1, const LeveledImage& leveled2, float minConfidence, VisualAlignmentReturn& ret) {
+    const PhaseCorrelationYaw phase = getPhaseCorrelationYaw(leveled1, leveled2, minConfidence);
+    ret.yaw = phase.yaw;
+    ret.is_valid = phase.is_valid;
+    ret.phaseCorrelationConfidence = phase.confidence;
+    ret.numInliers = 0;
+    ret.residualAngle = 0;
+    ret.tx = 0;
+    ret.ty = 0;
+    ret.tz = 0;
+}
+
+/**
+ Without ARKit to restrict the yaw, check the yaw from features against the yaws that line up the walls of a Manhattan scene.  If the scene is one and the yaw from features isn't near any of those (or there wasn't one), solve again with RANSAC restricted to them.  An invalid alignment is replaced by any valid one found that way, but a valid one only if both images clearly show a Manhattan scene and the restricted solve has clearly more inliers, so the lines never overrule features on their own.
+ 
+ - parameters:
+ - anchorFrame: The Manhattan frame of the anchor image (cached with its features).
+ - leveled1: The leveled anchor image.
+ - features1: The features of the anchor image.
+ - leveled2: The leveled live image.
+ - features2: The features of the live image.
+ - matches: The matches between them.
+ - options: How RANSAC was run.
+ - alignment: The alignment from features (replaced if solving again finds a better one).
+ - inlier_matches: The inliers of the alignment (replaced along with it).
+ */
+static void reconcileWithManhattanYaw(const ManhattanFrame& anchorFrame, const LeveledImage& leveled1, const KeyPointsAndDescriptors& features1, const LeveledImage& leveled2, const KeyPointsAndDescriptors& features2, const std::vector<cv::DMatch>& matches, const UprightRansacOptions& options, UprightAlignment& alignment, std::vector<cv::DMatch>& inlier_matches) {
+    if (!anchorFrame.is_valid) {
+        // the live image doesn't matter then
+        return;
+    }
+    const ManhattanFrame liveFrame = estimateManhattanFrame(leveled2);
+    UprightRansacOptions seededOptions = options;
+    seededOptions.yawHypotheses = getManhattanYawHypotheses(anchorFrame, liveFrame);
+    if (seededOptions.yawHypotheses.empty() || (alignment.is_valid && isYawAllowed(alignment.yaw, seededOptions))) {
+        return;
+    }
+    const bool isConfident = anchorFrame.peakFraction >= kMinConfidentManhattanPeakFraction && liveFrame.peakFraction >= kMinConfidentManhattanPeakFraction;
+    if (alignment.is_valid && !isConfident) {
+        return;
+    }
+    std::vector<cv::DMatch> seededInliers;
+    const UprightAlignment seeded = solveUprightAlignment(leveled1, features1, leveled2, features2, matches, seededOptions, &seededInliers);
+    ALIGNMENT_TRACE_COUNTER("manhattan reseeded", seeded.is_valid ? 1 : 0);
+    if (!seeded.is_valid || (alignment.is_valid && seeded.numInliers < kManhattanInlierAdvantage * alignment.numInliers)) {
+        return;
+    }
+    ALIGNMENT_LOG_INFO(Solver, "the lines of the scene picked yaw %f (%d inliers) over %f (%s, %d inliers)", seeded.yaw, seeded.numInliers, alignment.yaw, alignment.is_valid ? "valid" : "invalid", alignment.numInliers);
+    alignment = seeded;
+    inlier_matches.swap(seededInliers);
+}
+
+/// The body of visualYaw (the caller holds feature_tracker_mutex and fills in the memory use).
+static VisualAlignmentReturn alignToAnchor(UIImage *image1, simd_float4 intrinsics1, simd_float4x4 pose1,
+                                           UIImage *image2, simd_float4 intrinsics2, simd_float4x4 pose2, int downSampleFactor, VisualAlignmentSolver solver, VisualAlignmentFeatureBackend featureBackend, float yawPriorUncertainty, const simd_float3 *anchorPoints, int numAnchorPoints) {
     debug_match_image_ui = 0;
-    bool useThreePoint = true;
+    const bool useThreePoint = solver != VisualAlignmentSolverEssential;
     VisualAlignmentReturn ret;
-    // Convert the UIImages to cv::Mats and rotate them.
-    cv::Mat image_mat1, image_mat2;
-    UIImageToMat(image1, image_mat1);
+    ret.numTrials = 0;
+    ret.numTracked = 0;
+    ret.anchorView = -1;
+    ret.phaseCorrelationConfidence = 0;
+    const FeatureBackendType backend = toFeatureBackendType(featureBackend);
+    const int descriptorNorm = getDescriptorNorm(backend);
+    const bool isAdaptive = adaptive_quality_enabled;
+    const AlignmentBudget budget = quality_controller.getBudget();
+    const unsigned int maxKeypoints = isAdaptive ? budget.maxKeypoints : 0;
+    AlignmentStageLatency latency = {0, 0, 0, 0};
+    auto stageStart = std::chrono::steady_clock::now();
+    // Convert the UIImages to grayscale cv::Mats and level them (the anchor may already be decoded to grayscale).
+    cv::Mat image_mat2;
     UIImageToMat(image2, image_mat2);
-
-    cv::cvtColor(image_mat1, image_mat1, cv::COLOR_RGB2GRAY);
-    cv::rotate(image_mat1, image_mat1, cv::ROTATE_90_CLOCKWISE);
     cv::cvtColor(image_mat2, image_mat2, cv::COLOR_RGB2GRAY);
-    cv::rotate(image_mat2, image_mat2, cv::ROTATE_90_CLOCKWISE);
-    
-    Eigen::Matrix3f intrinsics1_matrix_unrotated = intrinsicsToMatrix(intrinsics1);
-    Eigen::Matrix3f intrinsics2_matrix_unrotated = intrinsicsToMatrix(intrinsics2);
-    
-    // Since the image was rotated clockwise, we have to swap entries in the intrinsic matrices as well.
-    // I use matrix multiplication for this.
-    Eigen::Matrix3f swap_matrix;
-    swap_matrix << 0, 1, 0, 1, 0, 0, 0, 0, 1;
-    
-    Eigen::Matrix3f intrinsics1_matrix = swap_matrix * intrinsics1_matrix_unrotated * swap_matrix;
-    Eigen::Matrix3f intrinsics2_matrix = swap_matrix * intrinsics2_matrix_unrotated * swap_matrix;
-    
-    intrinsics1_matrix(0, 2) = image_mat1.cols - intrinsics1_matrix(0, 2);
-    intrinsics2_matrix(0, 2) = image_mat2.cols - intrinsics2_matrix(0, 2);
-    const Eigen::Matrix4f pose1_matrix = poseToMatrix(pose1);
-    const Eigen::Matrix4f pose2_matrix = poseToMatrix(pose2);
-    
-    const Eigen::AngleAxisf square_rotation1 = getIdealRotation(pose1_matrix);
-    const Eigen::AngleAxisf square_rotation2 = getIdealRotation(pose2_matrix);
     
-    ret.square_rotation1 = rotationToSIMD((Eigen::Matrix3f) square_rotation1);
-    ret.square_rotation2 = rotationToSIMD((Eigen::Matrix3f) square_rotation2);
+    LeveledImage leveled1;
+    if (image1) {
+        cv::Mat image_mat1;
+        UIImageToMat(image1, image_mat1);
+        cv::cvtColor(image_mat1, image_mat1, cv::COLOR_RGB2GRAY);
+        leveled1 = levelImage(image_mat1, intrinsicsToMatrix(intrinsics1), poseToMatrix(pose1), downSampleFactor);
+    } else if (!loaded_anchor_image.image.empty()) {
+        leveled1 = levelAnchorImage(loaded_anchor_image, poseToMatrix(pose1), downSampleFactor);
+    } else {
+        ALIGNMENT_LOG_ERROR(General, "visualYaw was called without an anchor image");
+        ret.is_valid = false;
+        ret.yaw = 0;
+        ret.numMatches = 0;
+        return ret;
+    }
+    const LeveledImage leveled2 = levelImage(image_mat2, intrinsicsToMatrix(intrinsics2), poseToMatrix(pose2), downSampleFactor);
     
-    const auto square_image_mat1 = warpPerspectiveWithGlobalRotation(image_mat1, intrinsics1_matrix, pose1_matrix.block(0, 0, 3, 3), square_rotation1);
-    const auto square_image_mat2 = warpPerspectiveWithGlobalRotation(image_mat2, intrinsics2_matrix, pose2_matrix.block(0, 0, 3, 3), square_rotation2);
-    cv::Mat square_image_mat1_resized, square_image_mat2_resized;
-    cv::resize(square_image_mat1, square_image_mat1_resized, cv::Size(square_image_mat1.size().width/downSampleFactor, square_image_mat1.size().height/downSampleFactor));
-    cv::resize(square_image_mat2, square_image_mat2_resized, cv::Size(square_image_mat2.size().width/downSampleFactor, square_image_mat2.size().height/downSampleFactor));
+    ret.square_rotation1 = rotationToSIMD((Eigen::Matrix3f) leveled1.squareRotation);
+    ret.square_rotation2 = rotationToSIMD((Eigen::Matrix3f) leveled2.squareRotation);
+    latency.leveling = millisecondsSince(stageStart);
+    stageStart = std::chrono::steady_clock::now();
+    if (solver == VisualAlignmentSolverPhaseCorrelation) {
+        ret.numMatches = 0;
+        alignByPhaseCorrelation(leveled1, leveled2, kMinPhaseCorrelationConfidence, ret);
+        return ret;
+    }
     
-    const auto keypoints_and_descriptors1 = getKeyPointsAndDescriptors(square_image_mat1_resized);
-    const auto keypoints_and_descriptors2 = getKeyPointsAndDescriptors(square_image_mat2_resized);
+    // The anchor features only change if the anchor (or how it is leveled) does.
+    const std::vector<float> anchorKey = {intrinsics1.x, intrinsics1.y, intrinsics1.z, intrinsics1.w,
+        pose1.columns[0].x, pose1.columns[0].y, pose1.columns[0].z,
+        pose1.columns[1].x, pose1.columns[1].y, pose1.columns[1].z,
+        pose1.columns[2].x, pose1.columns[2].y, pose1.columns[2].z,
+        (float) leveled1.image.cols, (float) leveled1.image.rows};
+    KeyPointsAndDescriptors keypoints_and_descriptors2;
+    std::vector<cv::DMatch> matches;
+    bool isTracking = false;
+    const bool isNewAnchor = !feature_tracker.hasAnchorFeatures(anchorKey, backend);
+    if (!isNewAnchor) {
+        // Follow the inliers of the last attempt if we can since that is much cheaper than detecting and matching features.
+        isTracking = feature_tracker.track(leveled2.image, keypoints_and_descriptors2, matches);
+        if (isTracking) {
+            ret.numTracked = matches.size();
+        } else {
+            keypoints_and_descriptors2 = getKeyPointsAndDescriptorsTiled({leveled2.image}, backend, getWorkerPool(), kFeatureTilesAcross, kFeatureTilesDown, 32, maxKeypoints)[0];
+        }
+    } else if (maxKeypoints > 0) {
+        // a new anchor, but only the live image is held to the keypoint budget
+        feature_tracker.setAnchorFeatures(anchorKey, backend, getKeyPointsAndDescriptorsTiled({leveled1.image}, backend, getWorkerPool(), kFeatureTilesAcross, kFeatureTilesDown)[0]);
+        keypoints_and_descriptors2 = getKeyPointsAndDescriptorsTiled({leveled2.image}, backend, getWorkerPool(), kFeatureTilesAcross, kFeatureTilesDown, 32, maxKeypoints)[0];
+    } else {
+        // a new anchor, so extract its features and those of the live image together
+        const auto features = getKeyPointsAndDescriptorsTiled({leveled1.image, leveled2.image}, backend, getWorkerPool(), kFeatureTilesAcross, kFeatureTilesDown);
+        feature_tracker.setAnchorFeatures(anchorKey, backend, features[0]);
+        keypoints_and_descriptors2 = features[1];
+    }
+    const auto& keypoints_and_descriptors1 = feature_tracker.getAnchorFeatures(leveled1.image, anchorKey, backend);
+    latency.features = millisecondsSince(stageStart);
+    stageStart = std::chrono::steady_clock::now();
+    // The first attempt against an anchor also extracts the anchor's features, which would make this device look slower than it is, and tracked attempts skip detection and matching, which would make it look faster.
+    const bool recordLatency = isAdaptive && !isNewAnchor && !isTracking;
 
-    const auto matches = getMatches(keypoints_and_descriptors1.descriptors, keypoints_and_descriptors2.descriptors);
-    
-    
-    std::vector<cv::Point2f> vectors1, vectors2;
-    
-    for (const auto& match : matches) {
-        const auto keypoint1 = keypoints_and_descriptors1.keypoints[match.queryIdx];
-        const auto keypoint2 = keypoints_and_descriptors2.keypoints[match.trainIdx];
-        // correct for the downsampling
-        vectors1.push_back(downSampleFactor*keypoint1.pt);
-        
-        // Convert the second keypoint to one with the intrinsics of the first camera.
-        Eigen::Vector3f keypoint2vec;
-        keypoint2vec << downSampleFactor*keypoint2.pt.x, downSampleFactor*keypoint2.pt.y, 1;
-        Eigen::Vector3f keypoint2projected = intrinsics1_matrix * intrinsics2_matrix.inverse() * keypoint2vec;
-        vectors2.push_back(cv::Point2f(keypoint2projected(0), keypoint2projected(1)));
+    // If the poses come from the same ARKit session, use them to restrict both matching and the RANSAC hypotheses.
+    bool useYawPrior = yawPriorUncertainty > 0;
+    const YawPrior yawPrior = getYawPrior(leveled1, leveled2, yawPriorUncertainty);
+    if (!isTracking) {
+        matches = matchLeveledFeatures(leveled1, keypoints_and_descriptors1, leveled2, keypoints_and_descriptors2, useYawPrior ? &yawPrior : nullptr, descriptorNorm, useYawPrior);
     }
+    latency.matching = millisecondsSince(stageStart);
+    stageStart = std::chrono::steady_clock::now();
 
+    ALIGNMENT_TRACE_COUNTER("matches", matches.size());
     if (useThreePoint) {
         ret.numMatches = matches.size();
-        if (matches.size() < 6) {
-            ret.is_valid = false;
-            ret.yaw = 0;
+        if (matches.size() < kMinUprightMatches) {
+            ALIGNMENT_LOG_INFO(Matching, "only %zu matches, too few for upright RANSAC, falling back on phase correlation", matches.size());
+            // too little texture for features may still be enough to line the images up, but the images may just as well not overlap, so the peak has to be clear
+            alignByPhaseCorrelation(leveled1, leveled2, kMinFallbackPhaseCorrelationConfidence, ret);
+            if (recordLatency) {
+                quality_controller.recordAttempt(latency, false);
+            }
             return ret;
         }
-        std::vector<Eigen::Vector3d> all_rays_image_1, all_rays_image_2;
-
-        for (unsigned int i = 0; i < matches.size(); i++) {
-            const auto& match = matches[i];
-            const auto keypoint1 = keypoints_and_descriptors1.keypoints[match.queryIdx];
-            const auto keypoint2 = keypoints_and_descriptors2.keypoints[match.trainIdx];
-            // correct for the downsampling
-            Eigen::Vector3f homogeneousKp1(downSampleFactor*keypoint1.pt.x, downSampleFactor*keypoint1.pt.y, 1.0);
-            Eigen::Vector3f image_1_ray = intrinsics1_matrix.inverse() * homogeneousKp1;
-            all_rays_image_1.push_back(Eigen::Vector3d(image_1_ray.x(), image_1_ray.y(), image_1_ray.z()));
-            Eigen::Vector3f homogeneousKp2(downSampleFactor*keypoint2.pt.x, downSampleFactor*keypoint2.pt.y, 1.0);
-            Eigen::Vector3f image_2_ray = intrinsics2_matrix.inverse() * homogeneousKp2;
-            all_rays_image_2.push_back(Eigen::Vector3d(image_2_ray.x(), image_2_ray.y(), image_2_ray.z()));
+        UprightRansacOptions options;
+        if (isAdaptive) {
+            options.maxTrials = budget.maxTrials;
         }
-        
-        // We'll do RANSAC to find the best three points
-        Eigen::Matrix3d bestEssential;
-        int bestInlierCount = -1;
-        double bestInlierResidualSum = -1;
-
-        // to allow us to randomize for RANSAC
-        unsigned int* indices = new unsigned int[matches.size()];
-        for (unsigned int i = 0; i < matches.size(); i++) {
-            indices[i] = i;
+        options.solver = solver == VisualAlignmentSolverTwoPointPlanar ? UprightSolverType::TwoPointPlanar : UprightSolverType::ThreePoint;
+        options.useYawPrior = useYawPrior;
+        options.yawPrior = yawPrior;
+        options.workerPool = &getWorkerPool();
+        options.seed = getUprightRansacSeed();
+        {
+            std::lock_guard<std::mutex> configurationLock(alignment_configuration_mutex);
+            options.scoring = selected_configuration.scoring;
+            options.consensus = selected_configuration.consensus;
         }
-        std::map<int, std::vector<float> > centiradQuantization;
-        std::map<int, std::vector<cv::Mat> > centiradQuantizationTranslations;
-
-        for (unsigned int trial = 0; trial < 100; trial++) {
-            std::random_shuffle(indices, indices+matches.size());
-            std::vector<cv::Point2f> vectors1_ransac, vectors2_ransac;
-            Eigen::Vector3d rotation_axis = Eigen::Vector3d(0, 1, 0);
-            Eigen::Vector3d image_1_rays[3];
-            Eigen::Vector3d image_2_rays[3];
-            std::vector<Eigen::Quaterniond> soln_rotations;
-            std::vector<Eigen::Vector3d> soln_translations;
-            for (unsigned int i = 0; i < 3; i++) {
-                const auto& match = matches[indices[i]];
-                const auto keypoint1 = keypoints_and_descriptors1.keypoints[match.queryIdx];
-                const auto keypoint2 = keypoints_and_descriptors2.keypoints[match.trainIdx];
-                // correct for the downsampling
-                Eigen::Vector3f homogeneousKp1(downSampleFactor*keypoint1.pt.x, downSampleFactor*keypoint1.pt.y, 1.0);
-                Eigen::Vector3f image_1_ray = intrinsics1_matrix.inverse() * homogeneousKp1;
-                image_1_rays[i] = Eigen::Vector3d(image_1_ray.x(), image_1_ray.y(), image_1_ray.z());
-                Eigen::Vector3f homogeneousKp2(downSampleFactor*keypoint2.pt.x, downSampleFactor*keypoint2.pt.y, 1.0);
-                Eigen::Vector3f image_2_ray = intrinsics2_matrix.inverse() * homogeneousKp2;
-                image_2_rays[i] = Eigen::Vector3d(image_2_ray.x(), image_2_ray.y(), image_2_ray.z());
-                vectors1_ransac.push_back(vectors1[indices[i]]);
-                vectors2_ransac.push_back(vectors2[indices[i]]);
-            }
-
-            theia::ThreePointRelativePosePartialRotation(rotation_axis,
-                                                  image_1_rays,
-                                                  image_2_rays,
-                                                  &soln_rotations,
-                                                  &soln_translations);
-            for (unsigned int i = 0; i < soln_rotations.size(); i++) {
-                const Eigen::Matrix3d relative_rotation = soln_rotations[i].toRotationMatrix();
-                Eigen::Matrix3d essential_matrix = CrossProductMatrix(soln_translations[i]) * relative_rotation;
-                essential_matrix.normalize();
-                int totalInliers = 0;
-                double inlierResidualSum = 0.0;
-                for (unsigned int j = 0; j < all_rays_image_1.size(); j++) {
-                    double pointResidual = abs(all_rays_image_2[j].transpose() * essential_matrix * all_rays_image_1[j]);
-                    if (pointResidual < 0.001) { // TODO: this threshold is not correct, we need to figure out how to make this into something consistent (e.g., distance in pixels to epipolar line)
-                        totalInliers++;
-                        inlierResidualSum += pointResidual;
-                    }
-                }
-                
-                // TODO this needs to be tuned in a smarter way (e.g., by running some iterations of RANSAC first and then adapting the threshold as a proportion of the best inlier count
-                if (totalInliers > 0.5*all_rays_image_1.size()) {
-                    // compute pose for averaging purposes
-                    cv::Mat essential_matrixCV;
-                    eigen2cv(essential_matrix, essential_matrixCV);
-                    cv::Mat dcm_mat, translation_mat;
-
-                    int numInliers = cv::recoverPose(essential_matrixCV, vectors1_ransac, vectors2_ransac, dcm_mat, translation_mat, intrinsics1_matrix(0, 0), cv::Point2f(intrinsics1_matrix(0, 2), intrinsics1_matrix(1, 2)));
-                    if (numInliers < 3) {
-                        // one of the correspondences is behind the camera
-                        continue;
-                    }
-                    Eigen::Matrix3f dcm;
-                    cv2eigen(dcm_mat, dcm);
-                    const auto rotated = dcm * Eigen::Vector3f::UnitZ();
-                    float yaw = atan2(rotated(0), rotated(2));
-                    int quantized = (int) (yaw*100);
-                    if (centiradQuantization.find(quantized) == centiradQuantization.end()) {
-                        centiradQuantization[quantized] = std::vector<float>();
-                        centiradQuantizationTranslations[quantized] = std::vector<cv::Mat>();
-                    }
-                    centiradQuantization[quantized].push_back(yaw);
-                    centiradQuantizationTranslations[quantized].push_back(translation_mat);
-                }
-                if (bestInlierCount < 0 || totalInliers > bestInlierCount || (totalInliers == bestInlierCount && inlierResidualSum < bestInlierResidualSum)) {
-                    bestInlierCount = totalInliers;
-                    bestEssential = essential_matrix;
-                    bestInlierResidualSum = inlierResidualSum;
-                }
+        std::vector<cv::DMatch> inlier_matches;
+        UprightAlignment alignment;
+        bool solvedAbsolute = false;
+        if (solver == VisualAlignmentSolverTwoPointAbsolute && anchorPoints && numAnchorPoints > 0) {
+            std::vector<Eigen::Vector3f> cameraPoints;
+            for (int i = 0; i < numAnchorPoints; i++) {
+                cameraPoints.push_back(Eigen::Vector3f(anchorPoints[i].x, anchorPoints[i].y, anchorPoints[i].z));
             }
+            const auto anchorFeaturePoints = getAnchorFeaturePoints(leveled1, keypoints_and_descriptors1, cameraPoints);
+            alignment = solveUprightAbsoluteAlignment(leveled1, keypoints_and_descriptors1, anchorFeaturePoints, leveled2, keypoints_and_descriptors2, matches, options, &inlier_matches);
+            // too few of the matched anchor features had a point to say anything either way
+            solvedAbsolute = alignment.numMatches >= (int) kMinUprightMatches;
+            alignment.numMatches = matches.size();
         }
-        
-        float bestConsensusYaw = 0.0;
-        cv::Mat bestConsensusTranslation = cv::Mat(3,1, CV_64F, 0.0);
-        unsigned long mostQuantized = 0;
-        for (std::map<int, std::vector<float> >::iterator i = centiradQuantization.begin(); i != centiradQuantization.end(); ++i) {
-            if (i->second.size() > mostQuantized) {
-                mostQuantized = i->second.size();
-                bestConsensusYaw = 0.0;
-                // take the average of all elements in the bucket
-                for (std::vector<float>::iterator j = i->second.begin(); j != i->second.end(); ++j) {
-                    bestConsensusYaw += *j / mostQuantized;
-                }
-                bestConsensusTranslation = cv::Mat(3,1, CV_64F, 0.0);
-                for (unsigned long j = 0; j < centiradQuantizationTranslations[i->first].size(); j++) {
-                    bestConsensusTranslation += centiradQuantizationTranslations[i->first][j];
-                }
-                bestConsensusTranslation = bestConsensusTranslation / cv::norm(bestConsensusTranslation);
+        if (!solvedAbsolute) {
+            alignment = solveUprightAlignment(leveled1, keypoints_and_descriptors1, leveled2, keypoints_and_descriptors2, matches, options, &inlier_matches);
+            if (!useYawPrior) {
+                reconcileWithManhattanYaw(feature_tracker.getAnchorManhattanFrame(leveled1), leveled1, keypoints_and_descriptors1, leveled2, keypoints_and_descriptors2, matches, options, alignment, inlier_matches);
             }
-            
         }
+        ALIGNMENT_TRACE_COUNTER("inliers", alignment.numInliers);
+        ret.numTrials = alignment.numTrials;
+        ret.yaw = alignment.yaw;
+        ret.is_valid = alignment.is_valid;
+        ret.numInliers = alignment.numInliers;
+        ret.residualAngle = alignment.residualAngle;
+        ret.tx = alignment.tx;
+        ret.ty = alignment.ty;
+        ret.tz = alignment.tz;
+        // the debug image isn't part of the attempt proper
+        latency.solving = millisecondsSince(stageStart);
         
         cv::Mat debug_match_image;
-        cv::drawMatches(square_image_mat1_resized, keypoints_and_descriptors1.keypoints, square_image_mat2_resized, keypoints_and_descriptors2.keypoints, matches, debug_match_image);
+        cv::drawMatches(leveled1.image, keypoints_and_descriptors1.keypoints, leveled2.image, keypoints_and_descriptors2.keypoints, matches, debug_match_image);
         debug_match_image_ui = MatToUIImage(debug_match_image);
-        cv::Mat bestEssentialCV;
-        eigen2cv(bestEssential, bestEssentialCV);
-        cv::Mat dcm_mat, translation_mat;
-
-        int numInliers = cv::recoverPose(bestEssentialCV, vectors1, vectors2, dcm_mat, translation_mat, intrinsics1_matrix(0, 0), cv::Point2f(intrinsics1_matrix(0, 2), intrinsics1_matrix(1, 2)));
-        Eigen::Matrix3f dcm;
-        cv2eigen(dcm_mat, dcm);
-        const auto rotated = dcm * Eigen::Vector3f::UnitZ();
-        const float yaw = atan2(rotated(0), rotated(2));
-        float residualAngle = abs(yaw) - acos((dcm.trace() - 1)/2);
-        ret.yaw = mostQuantized > 0 ? bestConsensusYaw : yaw;
-        ret.residualAngle = residualAngle;
-        ret.tx = mostQuantized > 0 ? bestConsensusTranslation.at<double>(0, 0) : translation_mat.at<double>(0, 0);
-        ret.ty = mostQuantized > 0 ? bestConsensusTranslation.at<double>(0, 1) : translation_mat.at<double>(0, 1);
-        ret.tz = mostQuantized > 0 ? bestConsensusTranslation.at<double>(0, 2) : translation_mat.at<double>(0, 2);
-        ret.is_valid = numInliers >= 6;
-        ret.numInliers = numInliers;
-        delete[] indices;
+        if (ret.is_valid) {
+            // hand the inliers to the tracker so the next attempt can follow them
+            feature_tracker.update(leveled2.image, keypoints_and_descriptors2.keypoints, inlier_matches);
+        }
+        if (recordLatency) {
+            quality_controller.recordAttempt(latency, ret.is_valid);
+        }
         return ret;
     } else {
+        std::vector<cv::Point2f> vectors1, vectors2;
+        getMatchedPoints(leveled1, keypoints_and_descriptors1, leveled2, keypoints_and_descriptors2, matches, vectors1, vectors2);
         ret.numMatches = vectors1.size();
-        if (matches.size() < 10) {
+        if (matches.size() < kMinEssentialMatches) {
+            ALIGNMENT_LOG_INFO(Matching, "only %zu matches, too few for the essential matrix", matches.size());
+            // whatever tracks are left belong to an earlier live image
+            feature_tracker.clearTracks();
             ret.is_valid = false;
             ret.yaw = 0;
             return ret;
         }
         ret.is_valid = true;
-        const auto yaw = getYaw(vectors1, vectors2, intrinsics1_matrix, ret.numInliers, ret.residualAngle, ret.tx, ret.ty, ret.tz);
+        std::vector<int> inliers;
+        const auto yaw = getYaw(vectors1, vectors2, leveled1.intrinsics, ret.numInliers, ret.residualAngle, ret.tx, ret.ty, ret.tz, &inliers);
+        // hand the inliers to the tracker so the next attempt follows this live image, as the upright path does
+        std::vector<cv::DMatch> inlier_matches;
+        for (const int i : inliers) {
+            inlier_matches.push_back(matches[i]);
+        }
+        feature_tracker.update(leveled2.image, keypoints_and_descriptors2.keypoints, inlier_matches);
 
         ret.yaw = yaw;
-        std::cout << "ret.yaw " << ret.yaw << std::endl;
         return ret;
     }
 }
 
++ (VisualAlignmentReturn) visualYaw :(UIImage *)image1 :(simd_float4)intrinsics1 :(simd_float4x4)pose1
+                    :(UIImage *)image2 :(simd_float4)intrinsics2 :(simd_float4x4)pose2 :(int)downSampleFactor :(VisualAlignmentSolver)solver :(VisualAlignmentFeatureBackend)featureBackend :(float)yawPriorUncertainty :(const simd_float3 *)anchorPoints :(int)numAnchorPoints {
+    ALIGNMENT_TRACE_SCOPE("visualYaw");
+    std::lock_guard<std::mutex> lock(feature_tracker_mutex);
+    const MemoryAccountingScope memory(getCountingMatAllocator());
+    VisualAlignmentReturn ret = alignToAnchor(image1, intrinsics1, pose1, image2, intrinsics2, pose2, downSampleFactor, solver, featureBackend, yawPriorUncertainty, anchorPoints, numAnchorPoints);
+    ret.peakBytes = memory.getPeakBytes();
+    ret.allocatedBytes = memory.getAllocatedBytes();
+    return ret;
+}
+
++ (void) setAdaptiveQuality :(bool)enabled :(double)targetLatency {
+    quality_controller.setTargetLatency(targetLatency);
+    adaptive_quality_enabled = enabled;
+}
+
++ (void) resetAdaptiveQuality {
+    quality_controller.reset();
+}
+
++ (int) recommendedDownSampleFactor {
+    return quality_controller.getBudget().downSampleFactor;
+}
+
++ (void) installMemoryAccounting {
+    installCountingMatAllocator();
+}
+
++ (void) setThermalState :(NSProcessInfoThermalState)thermalState {
+    switch (thermalState) {
+        case NSProcessInfoThermalStateFair:
+            quality_controller.setThermalState(AlignmentThermalState::Fair);
+            break;
+        case NSProcessInfoThermalStateSerious:
+            quality_controller.setThermalState(AlignmentThermalState::Serious);
+            break;
+        case NSProcessInfoThermalStateCritical:
+            quality_controller.setThermalState(AlignmentThermalState::Critical);
+            break;
+        case NSProcessInfoThermalStateNominal:
+        default:
+            quality_controller.setThermalState(AlignmentThermalState::Nominal);
+            break;
+    }
+}
+
++ (bool) loadAnchorImage :(NSString *)path :(simd_float4)intrinsics :(int)downSampleFactor {
+    std::lock_guard<std::mutex> lock(feature_tracker_mutex);
+    if (!loadAnchorImage(std::string([path UTF8String]), intrinsicsToMatrix(intrinsics), downSampleFactor, loaded_anchor_image)) {
+        loaded_anchor_image.image.release();
+        return false;
+    }
+    return true;
+}
+
++ (bool) loadAnchorViews :(NSArray<NSString *> *)paths :(const simd_float4 *)intrinsics :(const simd_float4x4 *)poses :(int)downSampleFactor {
+    std::vector<std::string> viewPaths;
+    std::vector<Eigen::Matrix3f> viewIntrinsics;
+    std::vector<Eigen::Matrix4f> viewPoses;
+    for (NSUInteger i = 0; i < paths.count; i++) {
+        viewPaths.push_back(std::string([paths[i] UTF8String]));
+        viewIntrinsics.push_back(intrinsicsToMatrix(intrinsics[i]));
+        viewPoses.push_back(poseToMatrix(poses[i]));
+    }
+    std::lock_guard<std::mutex> lock(feature_tracker_mutex);
+    return anchor_views.load(viewPaths, viewIntrinsics, viewPoses, downSampleFactor);
+}
+
+/// The body of visualYawToAnchorViews (the caller holds feature_tracker_mutex and fills in the memory use).
+static VisualAlignmentReturn alignToAnchorViews(UIImage *image, simd_float4 intrinsics, simd_float4x4 pose, VisualAlignmentSolver solver, VisualAlignmentFeatureBackend featureBackend, float yawPriorUncertainty) {
+    debug_match_image_ui = 0;
+    VisualAlignmentReturn ret;
+    ret.yaw = 0;
+    ret.is_valid = false;
+    ret.numInliers = 0;
+    ret.numMatches = 0;
+    ret.residualAngle = 0;
+    ret.tx = 0;
+    ret.ty = 0;
+    ret.tz = 0;
+    ret.numTrials = 0;
+    ret.numTracked = 0;
+    ret.anchorView = -1;
+    ret.phaseCorrelationConfidence = 0;
+    if (anchor_views.size() == 0) {
+        ALIGNMENT_LOG_ERROR(General, "visualYawToAnchorViews was called without any anchor views");
+        return ret;
+    }
+    const FeatureBackendType backend = toFeatureBackendType(featureBackend);
+    const int descriptorNorm = getDescriptorNorm(backend);
+    cv::Mat image_mat;
+    UIImageToMat(image, image_mat);
+    cv::cvtColor(image_mat, image_mat, cv::COLOR_RGB2GRAY);
+    const LeveledImage live = levelImage(image_mat, intrinsicsToMatrix(intrinsics), poseToMatrix(pose), anchor_views.getDownSampleFactor());
+    ret.square_rotation2 = rotationToSIMD((Eigen::Matrix3f) live.squareRotation);
+    const KeyPointsAndDescriptors liveFeatures = getKeyPointsAndDescriptorsTiled({live.image}, backend, getWorkerPool(), kFeatureTilesAcross, kFeatureTilesDown)[0];
+    
+    // Only the strongest features are compared, so ranking all of the views costs less than matching one of them.
+    const auto overlaps = anchor_views.rank(selectOverlapDescriptors(liveFeatures), backend, getWorkerPool());
+    
+    UprightRansacOptions options;
+    options.solver = solver == VisualAlignmentSolverTwoPointPlanar ? UprightSolverType::TwoPointPlanar : UprightSolverType::ThreePoint;
+    options.workerPool = &getWorkerPool();
+    options.seed = getUprightRansacSeed();
+    {
+        std::lock_guard<std::mutex> configurationLock(alignment_configuration_mutex);
+        options.scoring = selected_configuration.scoring;
+        options.consensus = selected_configuration.consensus;
+    }
+    for (unsigned int i = 0; i < overlaps.size() && i < kAlignedAnchorViews; i++) {
+        const AnchorView& view = anchor_views.getView(overlaps[i].view, backend, getWorkerPool());
+        ALIGNMENT_LOG_DEBUG(Matching, "aligning to anchor view %u (overlap %d)", overlaps[i].view, overlaps[i].overlap);
+        bool useYawPrior = yawPriorUncertainty > 0;
+        const YawPrior yawPrior = getYawPrior(view.leveled, live, yawPriorUncertainty);
+        const auto matches = matchLeveledFeatures(view.leveled, view.features, live, liveFeatures, useYawPrior ? &yawPrior : nullptr, descriptorNorm, useYawPrior);
+        ALIGNMENT_TRACE_COUNTER("matches", matches.size());
+        if (matches.size() < kMinUprightMatches) {
+            ALIGNMENT_LOG_INFO(Matching, "only %zu matches with anchor view %u, too few for upright RANSAC", matches.size(), overlaps[i].view);
+            continue;
+        }
+        options.useYawPrior = useYawPrior;
+        options.yawPrior = yawPrior;
+        const UprightAlignment alignment = solveUprightAlignment(view.leveled, view.features, live, liveFeatures, matches, options);
+        ALIGNMENT_TRACE_COUNTER("inliers", alignment.numInliers);
+        ret.numTrials += alignment.numTrials;
+        if (ret.anchorView >= 0 && !alignment.is_valid) {
+            // keep the failure we already have
+            continue;
+        }
+        ret.anchorView = overlaps[i].view;
+        ret.square_rotation1 = rotationToSIMD((Eigen::Matrix3f) view.leveled.squareRotation);
+        ret.yaw = alignment.yaw;
+        ret.is_valid = alignment.is_valid;
+        ret.numInliers = alignment.numInliers;
+        ret.numMatches = alignment.numMatches;
+        ret.residualAngle = alignment.residualAngle;
+        ret.tx = alignment.tx;
+        ret.ty = alignment.ty;
+        ret.tz = alignment.tz;
+        if (alignment.is_valid) {
+            break;
+        }
+    }
+    return ret;
+}
+
++ (VisualAlignmentReturn) visualYawToAnchorViews :(UIImage *)image :(simd_float4)intrinsics :(simd_float4x4)pose :(VisualAlignmentSolver)solver :(VisualAlignmentFeatureBackend)featureBackend :(float)yawPriorUncertainty {
+    ALIGNMENT_TRACE_SCOPE("visualYawToAnchorViews");
+    std::lock_guard<std::mutex> lock(feature_tracker_mutex);
+    const MemoryAccountingScope memory(getCountingMatAllocator());
+    VisualAlignmentReturn ret = alignToAnchorViews(image, intrinsics, pose, solver, featureBackend, yawPriorUncertainty);
+    ret.peakBytes = memory.getPeakBytes();
+    ret.allocatedBytes = memory.getAllocatedBytes();
+    return ret;
+}
+
+/// Shrink a grayscale frame for a panorama and level it.
+static LeveledImage levelPanoramaFrame(const cv::Mat& image, simd_float4 intrinsics, simd_float4x4 pose) {
+    cv::Mat reduced;
+    cv::resize(image, reduced, cv::Size(image.cols / kPanoramaFrameReduction, image.rows / kPanoramaFrameReduction), 0, 0, cv::INTER_AREA);
+    return levelImage(reduced, intrinsicsToMatrix(intrinsics / kPanoramaFrameReduction), poseToMatrix(pose), 1);
+}
+
++ (void) startPanorama :(simd_float4x4)referencePose {
+    std::lock_guard<std::mutex> lock(recording_panorama_mutex);
+    recording_panorama.start(poseToMatrix(referencePose));
+}
+
++ (bool) addPanoramaFrame :(CVPixelBufferRef)pixelBuffer :(simd_float4)intrinsics :(simd_float4x4)pose {
+    CVPixelBufferLockBaseAddress(pixelBuffer, kCVPixelBufferLock_ReadOnly);
+    // ARKit gives us bi-planar YCbCr, so the first plane is the grayscale image (it is only read while the buffer is locked)
+    const bool isPlanar = CVPixelBufferIsPlanar(pixelBuffer);
+    cv::Mat luma((int) (isPlanar ? CVPixelBufferGetHeightOfPlane(pixelBuffer, 0) : CVPixelBufferGetHeight(pixelBuffer)),
+                 (int) (isPlanar ? CVPixelBufferGetWidthOfPlane(pixelBuffer, 0) : CVPixelBufferGetWidth(pixelBuffer)),
+                 CV_8UC1,
+                 isPlanar ? CVPixelBufferGetBaseAddressOfPlane(pixelBuffer, 0) : CVPixelBufferGetBaseAddress(pixelBuffer),
+                 isPlanar ? CVPixelBufferGetBytesPerRowOfPlane(pixelBuffer, 0) : CVPixelBufferGetBytesPerRow(pixelBuffer));
+    const LeveledImage leveled = levelPanoramaFrame(luma, intrinsics, pose);
+    CVPixelBufferUnlockBaseAddress(pixelBuffer, kCVPixelBufferLock_ReadOnly);
+    std::lock_guard<std::mutex> lock(recording_panorama_mutex);
+    return recording_panorama.addFrame(leveled);
+}
+
++ (float) panoramaCoverage {
+    std::lock_guard<std::mutex> lock(recording_panorama_mutex);
+    return recording_panorama.getCoverage();
+}
+
++ (bool) savePanorama :(NSString *)path {
+    std::lock_guard<std::mutex> lock(recording_panorama_mutex);
+    if (recording_panorama.isEmpty()) {
+        return false;
+    }
+    return cv::imwrite(std::string([path UTF8String]), recording_panorama.getImage());
+}
+
++ (bool) loadPanorama :(NSString *)path :(simd_float4x4)referencePose {
+    const cv::Mat image = cv::imread(std::string([path UTF8String]), cv::IMREAD_GRAYSCALE);
+    std::lock_guard<std::mutex> lock(feature_tracker_mutex);
+    if (image.empty() || !anchor_panorama.setImage(image, poseToMatrix(referencePose))) {
+        ALIGNMENT_LOG_ERROR(General, "couldn't load the panorama %s", [path UTF8String]);
+        anchor_panorama.reset();
+        return false;
+    }
+    return true;
+}
+
++ (VisualAlignmentReturn) visualYawToPanorama :(UIImage *)image :(simd_float4)intrinsics :(simd_float4x4)pose {
+    ALIGNMENT_TRACE_SCOPE("visualYawToPanorama");
+    std::lock_guard<std::mutex> lock(feature_tracker_mutex);
+    const MemoryAccountingScope memory(getCountingMatAllocator());
+    VisualAlignmentReturn ret;
+    ret.yaw = 0;
+    ret.is_valid = false;
+    ret.numInliers = 0;
+    ret.numMatches = 0;
+    ret.residualAngle = 0;
+    ret.tx = 0;
+    ret.ty = 0;
+    ret.tz = 0;
+    ret.numTrials = 0;
+    ret.numTracked = 0;
+    ret.anchorView = -1;
+    ret.phaseCorrelationConfidence = 0;
+    if (anchor_panorama.isEmpty()) {
+        ALIGNMENT_LOG_ERROR(General, "visualYawToPanorama was called without a panorama");
+    } else {
+        cv::Mat image_mat;
+        UIImageToMat(image, image_mat);
+        cv::cvtColor(image_mat, image_mat, cv::COLOR_RGB2GRAY);
+        const LeveledImage live = levelPanoramaFrame(image_mat, intrinsics, pose);
+        const PanoramaYaw panoramaYaw = anchor_panorama.align(live);
+        ret.square_rotation1 = rotationToSIMD((Eigen::Matrix3f) anchor_panorama.getReferenceSquareRotation());
+        ret.square_rotation2 = rotationToSIMD((Eigen::Matrix3f) live.squareRotation);
+        ret.yaw = panoramaYaw.yaw;
+        ret.is_valid = panoramaYaw.is_valid;
+    }
+    ret.peakBytes = memory.getPeakBytes();
+    ret.allocatedBytes = memory.getAllocatedBytes();
+    return ret;
+}
+
++ (void) startAnchorBurst :(int)downSampleFactor :(VisualAlignmentFeatureBackend)featureBackend :(int)maxFrames {
+    std::lock_guard<std::mutex> lock(anchor_burst_mutex);
+    getAnchorBurst().start(downSampleFactor, toFeatureBackendType(featureBackend), std::max(1, maxFrames));
+}
+
++ (bool) addAnchorBurstFrame :(CVPixelBufferRef)pixelBuffer :(simd_float4)intrinsics :(simd_float4x4)pose :(double)timestamp {
+    ALIGNMENT_TRACE_SCOPE("addAnchorBurstFrame");
+    AnchorCandidate candidate;
+    CVPixelBufferLockBaseAddress(pixelBuffer, kCVPixelBufferLock_ReadOnly);
+    // ARKit gives us bi-planar YCbCr (copy both planes so the color image can be written if this frame is picked)
+    const bool isPlanar = CVPixelBufferIsPlanar(pixelBuffer);
+    cv::Mat((int) (isPlanar ? CVPixelBufferGetHeightOfPlane(pixelBuffer, 0) : CVPixelBufferGetHeight(pixelBuffer)),
+            (int) (isPlanar ? CVPixelBufferGetWidthOfPlane(pixelBuffer, 0) : CVPixelBufferGetWidth(pixelBuffer)),
+            CV_8UC1,
+            isPlanar ? CVPixelBufferGetBaseAddressOfPlane(pixelBuffer, 0) : CVPixelBufferGetBaseAddress(pixelBuffer),
+            isPlanar ? CVPixelBufferGetBytesPerRowOfPlane(pixelBuffer, 0) : CVPixelBufferGetBytesPerRow(pixelBuffer)).copyTo(candidate.luma);
+    if (isPlanar && CVPixelBufferGetPlaneCount(pixelBuffer) > 1) {
+        cv::Mat((int) CVPixelBufferGetHeightOfPlane(pixelBuffer, 1),
+                (int) CVPixelBufferGetWidthOfPlane(pixelBuffer, 1),
+                CV_8UC2,
+                CVPixelBufferGetBaseAddressOfPlane(pixelBuffer, 1),
+                CVPixelBufferGetBytesPerRowOfPlane(pixelBuffer, 1)).copyTo(candidate.chroma);
+    }
+    CVPixelBufferUnlockBaseAddress(pixelBuffer, kCVPixelBufferLock_ReadOnly);
+    candidate.intrinsics = intrinsicsToMatrix(intrinsics);
+    candidate.pose = poseToMatrix(pose);
+    candidate.timestamp = timestamp;
+    std::lock_guard<std::mutex> lock(anchor_burst_mutex);
+    return getAnchorBurst().add(std::move(candidate));
+}
+
+/// Write a frame of the anchor burst as a JPEG (in color unless only its luma plane was kept).
+static bool writeAnchorCandidate(const AnchorCandidate& candidate, const std::string& path) {
+    cv::Mat image = candidate.luma;
+    if (!candidate.chroma.empty()) {
+        // ARKit's YCbCr is full range, but OpenCV converts from video range
+        cv::Mat luma, chroma, nv12;
+        candidate.luma.convertTo(luma, CV_8U, 219.0 / 255, 16);
+        candidate.chroma.convertTo(chroma, CV_8U, 224.0 / 255, 128 * (1 - 224.0 / 255));
+        cv::vconcat(luma, chroma.reshape(1, chroma.rows), nv12);
+        cv::cvtColor(nv12, image, cv::COLOR_YUV2BGR_NV12);
+    }
+    return cv::imwrite(path, image, {cv::IMWRITE_JPEG_QUALITY, 100});
+}
+
++ (int) finishAnchorBurst :(NSArray<NSString *> *)paths :(VisualAlignmentAnchorCandidate *)candidates :(void (^)(int))completion {
+    ALIGNMENT_TRACE_SCOPE("finishAnchorBurst");
+    // the Mats share their planes, so the picked frames outlive the reset of the burst without being copied
+    std::vector<AnchorCandidate> picked;
+    std::vector<std::string> pickedPaths;
+    {
+        std::lock_guard<std::mutex> lock(anchor_burst_mutex);
+        AnchorBurst& burst = getAnchorBurst();
+        const std::vector<AnchorCandidateScore> scores = burst.finish();
+        for (unsigned int i = 0; i < paths.count && i < scores.size(); i++) {
+            const AnchorCandidateScore& score = scores[i];
+            const AnchorCandidate& candidate = burst.getCandidate(score.candidate);
+            picked.push_back(candidate);
+            pickedPaths.push_back(std::string([paths[i] UTF8String]));
+            VisualAlignmentAnchorCandidate& ret = candidates[i];
+            ret.intrinsics = matrixToIntrinsics(candidate.intrinsics);
+            ret.pose = matrixToPose(candidate.pose);
+            ret.timestamp = candidate.timestamp;
+            ret.sharpness = score.sharpness;
+            ret.featureSpread = score.featureSpread;
+            ret.matchability = score.matchability;
+            ret.score = score.score;
+            ret.is_usable = score.quality.is_usable;
+        }
+        // the frames that weren't picked take tens of megabytes
+        burst.reset();
+    }
+    if (picked.empty()) {
+        return 0;
+    }
+    // converting and encoding a full resolution frame takes longer than the main thread should be held up
+    dispatch_async(dispatch_get_global_queue(QOS_CLASS_UTILITY, 0), ^{
+        ALIGNMENT_TRACE_SCOPE("writeAnchorBurst");
+        int written = 0;
+        for (; written < (int) picked.size(); written++) {
+            if (!writeAnchorCandidate(picked[written], pickedPaths[written])) {
+                ALIGNMENT_LOG_ERROR(General, "couldn't write anchor candidate %d to %s", written, pickedPaths[written].c_str());
+                break;
+            }
+        }
+        if (completion) {
+            dispatch_async(dispatch_get_main_queue(), ^{
+                completion(written);
+            });
+        }
+    });
+    return (int) picked.size();
+}
+
++ (void) startPipeline :(UIImage *)anchorImage :(simd_float4)anchorIntrinsics :(simd_float4x4)anchorPose :(int)downSampleFactor :(VisualAlignmentSolver)solver :(VisualAlignmentFeatureBackend)featureBackend :(float)yawPriorUncertainty {
+    std::lock_guard<std::mutex> lock(alignment_pipeline_mutex);
+    PipelineFrame anchor;
+    AlignmentPipelineOptions options;
+    if (anchorImage) {
+        UIImageToMat(anchorImage, anchor.image);
+        cv::cvtColor(anchor.image, anchor.image, cv::COLOR_RGB2GRAY);
+        anchor.intrinsics = intrinsicsToMatrix(anchorIntrinsics);
+    } else {
+        std::lock_guard<std::mutex> anchorLock(feature_tracker_mutex);
+        if (loaded_anchor_image.image.empty()) {
+            ALIGNMENT_LOG_ERROR(Pipeline, "startPipeline was called without an anchor image");
+            return;
+        }
+        anchor.image = loaded_anchor_image.image;
+        anchor.intrinsics = loaded_anchor_image.intrinsics;
+        options.anchorReduction = loaded_anchor_image.reduction;
+    }
+    anchor.pose = poseToMatrix(anchorPose);
+    anchor.timestamp = 0;
+    
+    options.downSampleFactor = downSampleFactor;
+    options.backend = toFeatureBackendType(featureBackend);
+    options.solver = solver == VisualAlignmentSolverTwoPointPlanar ? UprightSolverType::TwoPointPlanar : UprightSolverType::ThreePoint;
+    options.yawPriorUncertainty = yawPriorUncertainty;
+    {
+        std::lock_guard<std::mutex> configurationLock(alignment_configuration_mutex);
+        options.scoring = selected_configuration.scoring;
+        options.consensus = selected_configuration.consensus;
+    }
+    getAlignmentPipeline().start(anchor, options);
+}
+
++ (void) submitPipelineFrame :(CVPixelBufferRef)pixelBuffer :(simd_float4)intrinsics :(simd_float4x4)pose :(double)timestamp {
+    std::unique_ptr<PipelineFrame> frame(new PipelineFrame());
+    CVPixelBufferLockBaseAddress(pixelBuffer, kCVPixelBufferLock_ReadOnly);
+    // ARKit gives us bi-planar YCbCr, so the first plane is the grayscale image (copy it since ARKit reuses its buffers)
+    const bool isPlanar = CVPixelBufferIsPlanar(pixelBuffer);
+    cv::Mat luma((int) (isPlanar ? CVPixelBufferGetHeightOfPlane(pixelBuffer, 0) : CVPixelBufferGetHeight(pixelBuffer)),
+                 (int) (isPlanar ? CVPixelBufferGetWidthOfPlane(pixelBuffer, 0) : CVPixelBufferGetWidth(pixelBuffer)),
+                 CV_8UC1,
+                 isPlanar ? CVPixelBufferGetBaseAddressOfPlane(pixelBuffer, 0) : CVPixelBufferGetBaseAddress(pixelBuffer),
+                 isPlanar ? CVPixelBufferGetBytesPerRowOfPlane(pixelBuffer, 0) : CVPixelBufferGetBytesPerRow(pixelBuffer));
+    frame->image = luma.clone();
+    CVPixelBufferUnlockBaseAddress(pixelBuffer, kCVPixelBufferLock_ReadOnly);
+    frame->intrinsics = intrinsicsToMatrix(intrinsics);
+    frame->pose = poseToMatrix(pose);
+    frame->timestamp = timestamp;
+    getAlignmentPipeline().submit(std::move(frame));
+}
+
++ (bool) popPipelineResult :(VisualAlignmentPipelineResult *)result {
+    PipelineResult pipelineResult;
+    if (!getAlignmentPipeline().popResult(pipelineResult)) {
+        return false;
+    }
+    const UprightAlignment& alignment = pipelineResult.alignment;
+    result->alignment.yaw = alignment.yaw;
+    result->alignment.square_rotation1 = rotationToSIMD(pipelineResult.squareRotation1);
+    result->alignment.square_rotation2 = rotationToSIMD(pipelineResult.squareRotation2);
+    result->alignment.is_valid = alignment.is_valid;
+    result->alignment.numInliers = alignment.numInliers;
+    result->alignment.numMatches = alignment.numMatches;
+    result->alignment.residualAngle = alignment.residualAngle;
+    result->alignment.tx = alignment.tx;
+    result->alignment.ty = alignment.ty;
+    result->alignment.tz = alignment.tz;
+    result->alignment.numTrials = alignment.numTrials;
+    result->alignment.numTracked = 0;
+    result->alignment.anchorView = -1;
+    result->alignment.phaseCorrelationConfidence = 0;
+    // the stages of different frames overlap, so their memory use isn't attributed to either
+    result->alignment.peakBytes = 0;
+    result->alignment.allocatedBytes = 0;
+    for (int column = 0; column < 4; column++) {
+        result->pose.columns[column] = simd_make_float4(pipelineResult.pose(0, column), pipelineResult.pose(1, column), pipelineResult.pose(2, column), pipelineResult.pose(3, column));
+    }
+    result->timestamp = pipelineResult.timestamp;
+    return true;
+}
+
++ (void) stopPipeline {
+    std::lock_guard<std::mutex> lock(alignment_pipeline_mutex);
+    getAlignmentPipeline().stop();
+}
+
++ (NSArray<NSString *> *) configurationNames {
+    NSMutableArray<NSString *> *names = [NSMutableArray array];
+    for (const auto& configuration : getAlignmentConfigurations()) {
+        [names addObject:[NSString stringWithUTF8String:configuration.name]];
+    }
+    return names;
+}
+
++ (bool) selectConfiguration :(NSString *)name {
+    const AlignmentConfiguration* configuration = findAlignmentConfiguration(std::string([name UTF8String]));
+    if (!configuration) {
+        return false;
+    }
+    std::lock_guard<std::mutex> lock(alignment_configuration_mutex);
+    selected_configuration = *configuration;
+    return true;
+}
+
++ (VisualAlignmentSolver) selectedSolver {
+    std::lock_guard<std::mutex> lock(alignment_configuration_mutex);
+    switch (selected_configuration.solver) {
+        case AlignmentSolverType::TwoPointPlanar:
+            return VisualAlignmentSolverTwoPointPlanar;
+        case AlignmentSolverType::TwoPointAbsolute:
+            return VisualAlignmentSolverTwoPointAbsolute;
+        case AlignmentSolverType::Essential:
+            return VisualAlignmentSolverEssential;
+        case AlignmentSolverType::PhaseCorrelation:
+            return VisualAlignmentSolverPhaseCorrelation;
+        case AlignmentSolverType::ThreePoint:
+        default:
+            return VisualAlignmentSolverThreePoint;
+    }
+}
+
++ (VisualAlignmentFeatureBackend) selectedFeatureBackend {
+    std::lock_guard<std::mutex> lock(alignment_configuration_mutex);
+    switch (selected_configuration.backend) {
+        case FeatureBackendType::ORB:
+            return VisualAlignmentFeatureBackendORB;
+        case FeatureBackendType::BRISK:
+            return VisualAlignmentFeatureBackendBRISK;
+        case FeatureBackendType::AKAZE:
+        default:
+            return VisualAlignmentFeatureBackendAKAZE;
+    }
+}
+
++ (void) setLogHandler :(VisualAlignmentLogLevel)minimumLevel :(void (^)(VisualAlignmentLogLevel, NSString *, NSString *))handler {
+    setAlignmentLogFilter((AlignmentLogLevel) minimumLevel);
+    if (!handler) {
+        setAlignmentLogHandler(nullptr);
+        return;
+    }
+    setAlignmentLogHandler([handler](const AlignmentLogRecord& record) {
+        @autoreleasepool {
+            handler((VisualAlignmentLogLevel) record.level, [NSString stringWithUTF8String:getAlignmentLogCategoryName(record.category)], [NSString stringWithUTF8String:record.message]);
+        }
+    });
+}
+
++ (bool) writeTrace :(NSString *)path {
+    return writeAlignmentTrace(std::string([path UTF8String]));
+}
+
++ (void) clearTrace {
+    clearAlignmentTrace();
+}
+
 + (int) numFeatures :(UIImage *)image {
     cv::Mat mat;
     UIImageToMat(image, mat);
@@ -30,14 +30,127 @@ class VisualAlignmentManager {
     /// the relative yaws computed during visual alignment
     private var relativeYaws: [Float] = []
     
+    /// the relative yaws of attempts that fell back on phase correlation for lack of matches, which have no translation and only count when no attempt found features to align
+    private var phaseCorrelationYaws: [Float] = []
+    
+    /// the minimal solver used to generate pose hypotheses (the planar solver assumes the phone stays at roughly the same height), from the selected configuration
+    var solver: VisualAlignmentSolver {
+        return VisualAlignment.selectedSolver()
+    }
+    
+    /// the feature detector and descriptor used for visual alignment, from the selected configuration
+    var featureBackend: VisualAlignmentFeatureBackend {
+        return VisualAlignment.selectedFeatureBackend()
+    }
+    
+    /// how far (in radians) the visual yaw is allowed to stray from the one implied by ARKit (nil if the anchor pose is not in the current session's coordinate frame)
+    private var yawPriorUncertainty: Float?
+    
+    /// the number of frames in a row that were skipped for being unlikely to align
+    private var consecutiveRejectedFrames = 0
+    
+    /// after skipping this many frames in a row we try the next one anyway so that alignment still finishes (e.g., in a dark room)
+    private static let maxConsecutiveRejectedFrames = 20
+    
+    /// run alignment attempts back to back in the native pipeline (which extracts features from one frame while solving the previous one) instead of one at a time with pauses in between
+    var usePipeline = false
+    
+    /// how often to hand the pipeline a new frame and collect its results
+    private static let pipelinePollInterval = 1.0 / 30.0
+    
+    /// the timestamp of the last frame handed to the pipeline (so the same frame isn't submitted twice)
+    private var lastSubmittedFrameTimestamp: TimeInterval = 0
+    
+    /// the factor by which the leveled images are shrunk before finding features (when the quality is adaptive this is the smallest factor used, which the anchor image is decoded for)
+    static let downSampleFactor: Int32 = 2
+    
+    /// let the native quality controller pick the downsampling, the number of features, and the number of RANSAC trials of each attempt from how long the last ones took (off by default since even its default budget keeps fewer live features than the fixed settings)
+    var useAdaptiveQuality = false
+    
+    /// how long each attempt should take when the quality is adaptive (in milliseconds)
+    private static let targetAttemptLatency = 300.0
+    
+    /// true if the anchor image was decoded by the native code (see VisualAlignment.loadAnchorImage), in which case the anchor point's UIImage isn't needed
+    private var isAnchorImageLoaded = false
+    
+    /// the poses of the views of the anchor point loaded by the native code (see VisualAlignment.loadAnchorViews), in the order they were loaded (empty if the anchor point only has its own image)
+    private var anchorViewTransforms: [simd_float4x4] = []
+    
+    /// true if the panorama around the anchor point was loaded by the native code (see VisualAlignment.loadPanorama), which attempts fall back on when the features don't align
+    private var isPanoramaLoaded = false
+    
     private init() {
-        
+        // before anything is aligned so that all of the memory it uses is counted
+        VisualAlignment.installMemoryAccounting()
+        VisualAlignment.setThermalState(ProcessInfo.processInfo.thermalState)
+        NotificationCenter.default.addObserver(forName: ProcessInfo.thermalStateDidChangeNotification, object: nil, queue: nil) { _ in
+            VisualAlignment.setThermalState(ProcessInfo.processInfo.thermalState)
+        }
+        forwardNativeLogs(to: PathLogger.shared)
     }
     
-    func doVisualAlignment(delegate: VisualAlignmentManagerDelegate, alignAnchorPoint: RouteAnchorPoint, maxTries: Int, makeAnnouncement: Bool, isTutorial: Bool = false) {
+    /// Send the messages logged by the native alignment code to a path logger (or back to stderr).
+    ///
+    /// - Parameters:
+    ///   - logger: the logger to record the messages as events (nil to stop forwarding)
+    ///   - minimumLevel: the lowest severity to forward
+    func forwardNativeLogs(to logger: PathLogger?, minimumLevel: VisualAlignmentLogLevel = .warning) {
+        guard let logger = logger else {
+            VisualAlignment.setLogHandler(minimumLevel, nil)
+            return
+        }
+        VisualAlignment.setLogHandler(minimumLevel) { _, category, message in
+            // the handler is called on the native logging thread, and the path logger isn't thread safe
+            DispatchQueue.main.async {
+                logger.logEvent(eventDescription: "visual alignment [\(category)] \(message)")
+            }
+        }
+    }
+    
+    /// Write the events traced by the native alignment code since the last call as Chrome Trace Event JSON (open it with chrome://tracing or Perfetto) and start a new trace.  This only writes anything in builds with CLEW_ALIGNMENT_TRACE defined.
+    ///
+    /// - Returns: the file in the documents directory that was written, or nil if nothing was traced
+    @discardableResult
+    func writeAlignmentTrace() -> URL? {
+        let url = FileManager.default.urls(for: .documentDirectory, in: .userDomainMask)[0].appendingPathComponent("alignment_trace_\(Int(Date().timeIntervalSince1970)).json")
+        guard VisualAlignment.writeTrace(url.path) else {
+            return nil
+        }
+        VisualAlignment.clearTrace()
+        return url
+    }
+    
+    /// Use one of the named configurations of visual alignment (see VisualAlignment.configurationNames) for the solver, the feature backend, and how hypotheses are scored.
+    ///
+    /// - Parameter name: the name of the configuration
+    /// - Returns: false if there is no configuration with that name
+    @discardableResult
+    func selectConfiguration(named name: String) -> Bool {
+        return VisualAlignment.selectConfiguration(name)
+    }
+    
+    func doVisualAlignment(delegate: VisualAlignmentManagerDelegate, alignAnchorPoint: RouteAnchorPoint, maxTries: Int, makeAnnouncement: Bool, isTutorial: Bool = false, yawPriorUncertainty: Float? = nil) {
         reset()
         self.delegate = delegate
         self.alignAnchorPoint = alignAnchorPoint
+        self.yawPriorUncertainty = yawPriorUncertainty
+        // what was measured against the last anchor says little about this one
+        VisualAlignment.resetAdaptiveQuality()
+        VisualAlignment.setAdaptiveQuality(useAdaptiveQuality, Self.targetAttemptLatency)
+        if let imageFileName = alignAnchorPoint.imageFileName, let intrinsics = alignAnchorPoint.intrinsics {
+            // decoding straight to reduced grayscale is much cheaper than going through the full color UIImage
+            isAnchorImageLoaded = VisualAlignment.loadAnchorImage(imageFileName.documentURL.path, intrinsics, Self.downSampleFactor)
+            if isAnchorImageLoaded, !alignAnchorPoint.additionalViews.isEmpty, let anchorTransform = alignAnchorPoint.anchor?.transform {
+                // the anchor point image goes first so that it wins ties
+                let views = [RouteAnchorPointView(imageFileName: imageFileName, intrinsics: intrinsics, transform: anchorTransform)] + alignAnchorPoint.additionalViews
+                if VisualAlignment.loadAnchorViews(views.map { $0.imageFileName.documentURL.path }, views.map { $0.intrinsics }, views.map { $0.transform }, Self.downSampleFactor) {
+                    anchorViewTransforms = views.map { $0.transform }
+                }
+            }
+        }
+        if let panoramaFileName = alignAnchorPoint.panoramaFileName, let anchorTransform = alignAnchorPoint.anchor?.transform {
+            isPanoramaLoaded = VisualAlignment.loadPanorama(panoramaFileName.documentURL.path, anchorTransform)
+        }
         doVisualAlignmentHelper(triesLeft: maxTries, makeAnnouncement: makeAnnouncement, isTutorial: isTutorial)
     }
     
@@ -56,90 +169,190 @@ class VisualAlignmentManager {
             }
             return
         }
-        if let alignAnchorPoint = alignAnchorPoint, let alignAnchorPointImage = alignAnchorPoint.image, let alignTransform = alignAnchorPoint.anchor?.transform, let frame = ARSessionManager.shared.currentFrame {
+        if let alignAnchorPoint = alignAnchorPoint, isAnchorImageLoaded || alignAnchorPoint.image != nil, let alignTransform = alignAnchorPoint.anchor?.transform, let frame = ARSessionManager.shared.currentFrame {
+            if consecutiveRejectedFrames < Self.maxConsecutiveRejectedFrames, !VisualAlignment.frameQuality(frame.capturedImage, frame.camera.transform, frame.timestamp).is_usable {
+                // the frame is blurry, badly exposed, or the phone is moving too fast, so wait for a better one (this doesn't count as a try)
+                consecutiveRejectedFrames += 1
+                DispatchQueue.global(qos: .userInitiated).asyncAfter(deadline: .now() + 0.05) {
+                    self.doVisualAlignmentHelper(triesLeft: triesLeft, makeAnnouncement: makeAnnouncement, isTutorial: isTutorial)
+                }
+                return
+            }
+            consecutiveRejectedFrames = 0
             if makeAnnouncement {
                 AnnouncementManager.shared.announce(announcement: NSLocalizedString("visualAlignmentConfirmation", comment: "Announce that visual alignment process has began"))
             }
 
+            let alignAnchorPointImage = isAnchorImageLoaded ? nil : alignAnchorPoint.image
+            if usePipeline {
+                VisualAlignment.startPipeline(alignAnchorPointImage, alignAnchorPoint.intrinsics!, alignTransform, Self.downSampleFactor, solver, featureBackend, yawPriorUncertainty ?? -1.0)
+                DispatchQueue.global(qos: .userInitiated).async {
+                    self.doPipelinedVisualAlignment(triesLeft: triesLeft, alignTransform: alignTransform, isTutorial: isTutorial)
+                }
+                return
+            }
+
             DispatchQueue.global(qos: .userInitiated).async {
                 let intrinsics = frame.camera.intrinsics
                 let capturedUIImage = pixelBufferToUIImage(pixelBuffer: frame.capturedImage)!
-                let visualYawReturn = VisualAlignment.visualYaw(alignAnchorPointImage, alignAnchorPoint.intrinsics!, alignTransform, capturedUIImage, simd_float4(intrinsics[0, 0], intrinsics[1, 1], intrinsics[2, 0], intrinsics[2, 1]), frame.camera.transform, Int32(2))
-                
-                UIImpactFeedbackGenerator(style: .heavy).impactOccurred()
-                if self.firstAlignmentPose == nil {
-                    self.firstAlignmentPose = frame.camera.transform
-                }
-                if visualYawReturn.is_valid, abs(visualYawReturn.residualAngle) < 0.01 {
-                    let relativeTransform = Self
-                        .getRelativeTransform(cameraTransform: frame.camera.transform, alignTransform: alignTransform, visualYawReturn: visualYawReturn)
-                    let relativeYaw = atan2(relativeTransform.columns.0.z, relativeTransform.columns.0.x)
-                    self.relativeYaws.append(relativeYaw)
-                    
-                    PathLogger.shared.logAlignmentEvent(alignmentEvent: .successfulVisualAlignmentTrial(transform: frame.camera.transform, nInliers: Int(visualYawReturn.numInliers), nMatches: Int(visualYawReturn.numMatches), yaw: relativeYaw, isTutorial: isTutorial))
-
-                    SoundEffectManager.shared.success()
+                let anchorPoints = alignAnchorPoint.featurePoints ?? []
+                var visualYawReturn: VisualAlignmentReturn
+                if self.anchorViewTransforms.isEmpty {
+                    let downSampleFactor = self.useAdaptiveQuality ? VisualAlignment.recommendedDownSampleFactor() : Self.downSampleFactor
+                    visualYawReturn = VisualAlignment.visualYaw(alignAnchorPointImage, alignAnchorPoint.intrinsics!, alignTransform, capturedUIImage, simd_float4(intrinsics[0, 0], intrinsics[1, 1], intrinsics[2, 0], intrinsics[2, 1]), frame.camera.transform, downSampleFactor, self.solver, self.featureBackend, self.yawPriorUncertainty ?? -1.0, anchorPoints, Int32(anchorPoints.count))
                 } else {
-                    PathLogger.shared.logAlignmentEvent(alignmentEvent: .unsuccessfulVisualAlignmentTrial(transform: frame.camera.transform, nInliers: Int(visualYawReturn.numInliers), nMatches: Int(visualYawReturn.numMatches), isTutorial: isTutorial))
-                    
-                    if self.relativeYaws.isEmpty, triesLeft < ViewController.maxVisualAlignmentRetryCount - 3, -self.lastVisualAlignmentFailureAnnouncement.timeIntervalSinceNow > ViewController.timeBetweenVisualAlignmentFailureAnnouncements {
-                        self.lastVisualAlignmentFailureAnnouncement = Date()
-                        DispatchQueue.main.async {
-                            AnnouncementManager.shared.announce(announcement: NSLocalizedString("havingTroubleVisuallyAligning", comment: "this is announced if visual alignment hasn't succeeded after a while."))
-                        }
-                    } else {
-                        SoundEffectManager.shared.error()
+                    // align to whichever view of the anchor point overlaps the most with the frame
+                    visualYawReturn = VisualAlignment.visualYawToAnchorViews(capturedUIImage, simd_float4(intrinsics[0, 0], intrinsics[1, 1], intrinsics[2, 0], intrinsics[2, 1]), frame.camera.transform, self.solver, self.featureBackend, self.yawPriorUncertainty ?? -1.0)
+                }
+                if !visualYawReturn.is_valid, self.isPanoramaLoaded {
+                    // the phone may be facing away from every image of the anchor point, which the panorama covers in a few milliseconds
+                    let panoramaReturn = VisualAlignment.visualYawToPanorama(capturedUIImage, simd_float4(intrinsics[0, 0], intrinsics[1, 1], intrinsics[2, 0], intrinsics[2, 1]), frame.camera.transform)
+                    if panoramaReturn.is_valid {
+                        visualYawReturn = panoramaReturn
                     }
                 }
+                
+                UIImpactFeedbackGenerator(style: .heavy).impactOccurred()
+                self.recordAttempt(visualYawReturn: visualYawReturn, cameraTransform: frame.camera.transform, alignTransform: alignTransform, triesLeft: triesLeft, isTutorial: isTutorial)
                 if triesLeft > 1 && self.relativeYaws.count < ViewController.requiredSuccessfulVisualAlignmentFrames {
                     DispatchQueue.global(qos: .userInitiated).asyncAfter(deadline: .now() + (visualYawReturn.is_valid ? 0.25 : 1.0)) {
                         self.doVisualAlignmentHelper(triesLeft: triesLeft-1, isTutorial: isTutorial)
                     }
                     return
                 }
-                
-                DispatchQueue.main.async {
-                    if self.delegate?.shouldContinueAlignment() != true {
-                        return
-                    }
-                    if !self.relativeYaws.isEmpty {
-                        let quantizedYaws = self.relativeYaws.map({Int($0*50)})
-                        let mostFrequent = mostFrequent(array: quantizedYaws)!
-                        var suitableYaws: [Float] = []
-                        for relativeYaw in self.relativeYaws {
-                            if Int(relativeYaw*50) == mostFrequent.mostFrequent[0] {
-                                suitableYaws.append(relativeYaw)
-                            }
-                        }
-                        let consensusYaw: Float
-                        // If we don't have more than 2 colliding in the same bucket, fall back on a simple average
-                        if mostFrequent.count < 2 {
-                            let consensusUnitVec = self.relativeYaws.reduce(simd_float2(repeating: 0.0), { (x,y) in x + simd_float2(cos(y), sin(y))/Float(self.relativeYaws.count)})
-                            consensusYaw = atan2(consensusUnitVec.y, consensusUnitVec.x)
-                        } else {
-                            consensusYaw = suitableYaws.reduce(Float(0.0), { (x,y) in x + y/Float(mostFrequent.count)})
-                        }
-                        var relativeTransform = simd_float4x4.makeRotate(radians: consensusYaw, 0, 1, 0)
-                        relativeTransform.columns.3 = simd_float4(alignTransform.columns.3.dropW - relativeTransform.rotation() * self.firstAlignmentPose!.columns.3.dropW, 1)
-                        self.delegate?.alignmentSuccessful(manualAlignment: relativeTransform.inverse)
-                        PathLogger.shared.logAlignmentEvent(alignmentEvent: .finalVisualAlignmentSucceeded(transform: relativeTransform.inverse, isTutorial: isTutorial))
-                    } else {
-                        let alignmentPose = self.firstAlignmentPose ?? matrix_identity_float4x4
-                        var visualYawReturnCopy = visualYawReturn
-                        visualYawReturnCopy.is_valid = true
-                        visualYawReturnCopy.yaw = 0
-                        var cameraTransform = frame.camera.transform
-                        cameraTransform.columns.3 = alignmentPose.columns.3
-                        let relativeTransform = Self.getRelativeTransform(cameraTransform: cameraTransform, alignTransform: alignTransform, visualYawReturn: visualYawReturnCopy)
-                        self.delegate?.alignmentFailed(fallbackTransform: relativeTransform)
-                        PathLogger.shared.logAlignmentEvent(alignmentEvent: .finalVisualAlignmentFailed(transform: relativeTransform, isTutorial: isTutorial))
+                self.finishAlignment(lastVisualYawReturn: visualYawReturn, lastCameraTransform: frame.camera.transform, alignTransform: alignTransform, isTutorial: isTutorial)
+            }
+        }
+    }
+    
+    /// Feed the newest usable frame to the native alignment pipeline and collect whatever attempts it has finished since the last call.  Each finished attempt uses up a try.
+    private func doPipelinedVisualAlignment(triesLeft: Int, alignTransform: simd_float4x4, isTutorial: Bool, lastResult: VisualAlignmentPipelineResult? = nil) {
+        if delegate?.shouldContinueAlignment() != true {
+            VisualAlignment.stopPipeline()
+            return
+        }
+        if delegate?.isPhoneVertical() == false {
+            if -lastVisualAlignmentFailureAnnouncement.timeIntervalSinceNow > ViewController.timeBetweenVisualAlignmentFailureAnnouncements {
+                lastVisualAlignmentFailureAnnouncement = Date()
+                AnnouncementManager.shared.announce(announcement: NSLocalizedString("holdVerticallyToContinueAlignment", comment: "tell the user that they need to hold their phone vertically for visual alignment to proceed"))
+            }
+        } else if let frame = ARSessionManager.shared.currentFrame, frame.timestamp != lastSubmittedFrameTimestamp {
+            lastSubmittedFrameTimestamp = frame.timestamp
+            if VisualAlignment.frameQuality(frame.capturedImage, frame.camera.transform, frame.timestamp).is_usable {
+                let intrinsics = frame.camera.intrinsics
+                VisualAlignment.submitPipelineFrame(frame.capturedImage, simd_float4(intrinsics[0, 0], intrinsics[1, 1], intrinsics[2, 0], intrinsics[2, 1]), frame.camera.transform, frame.timestamp)
+            }
+        }
+        
+        var triesLeft = triesLeft
+        var lastResult = lastResult
+        var result = VisualAlignmentPipelineResult()
+        while triesLeft > 0, relativeYaws.count < ViewController.requiredSuccessfulVisualAlignmentFrames, VisualAlignment.popPipelineResult(&result) {
+            recordAttempt(visualYawReturn: result.alignment, cameraTransform: result.pose, alignTransform: alignTransform, triesLeft: triesLeft, isTutorial: isTutorial)
+            triesLeft -= 1
+            lastResult = result
+        }
+        if let lastResult = lastResult, triesLeft <= 0 || relativeYaws.count >= ViewController.requiredSuccessfulVisualAlignmentFrames {
+            VisualAlignment.stopPipeline()
+            finishAlignment(lastVisualYawReturn: lastResult.alignment, lastCameraTransform: lastResult.pose, alignTransform: alignTransform, isTutorial: isTutorial)
+            return
+        }
+        DispatchQueue.global(qos: .userInitiated).asyncAfter(deadline: .now() + Self.pipelinePollInterval) {
+            self.doPipelinedVisualAlignment(triesLeft: triesLeft, alignTransform: alignTransform, isTutorial: isTutorial, lastResult: lastResult)
+        }
+    }
+    
+    /// Log the outcome of one alignment attempt and remember its yaw if it succeeded.
+    private func recordAttempt(visualYawReturn: VisualAlignmentReturn, cameraTransform: simd_float4x4, alignTransform: simd_float4x4, triesLeft: Int, isTutorial: Bool) {
+        if self.firstAlignmentPose == nil {
+            self.firstAlignmentPose = cameraTransform
+        }
+        if visualYawReturn.is_valid, abs(visualYawReturn.residualAngle) < 0.01 {
+            let relativeTransform = Self
+                .getRelativeTransform(cameraTransform: cameraTransform, alignTransform: getViewTransform(visualYawReturn: visualYawReturn, alignTransform: alignTransform), visualYawReturn: visualYawReturn)
+            let relativeYaw = atan2(relativeTransform.columns.0.z, relativeTransform.columns.0.x)
+            if visualYawReturn.phaseCorrelationConfidence > 0, solver != .phaseCorrelation {
+                self.phaseCorrelationYaws.append(relativeYaw)
+            } else {
+                self.relativeYaws.append(relativeYaw)
+            }
+            
+            PathLogger.shared.logAlignmentEvent(alignmentEvent: .successfulVisualAlignmentTrial(transform: cameraTransform, nInliers: Int(visualYawReturn.numInliers), nMatches: Int(visualYawReturn.numMatches), yaw: relativeYaw, isTutorial: isTutorial))
 
+            SoundEffectManager.shared.success()
+        } else {
+            PathLogger.shared.logAlignmentEvent(alignmentEvent: .unsuccessfulVisualAlignmentTrial(transform: cameraTransform, nInliers: Int(visualYawReturn.numInliers), nMatches: Int(visualYawReturn.numMatches), isTutorial: isTutorial))
+            
+            if self.relativeYaws.isEmpty, triesLeft < ViewController.maxVisualAlignmentRetryCount - 3, -self.lastVisualAlignmentFailureAnnouncement.timeIntervalSinceNow > ViewController.timeBetweenVisualAlignmentFailureAnnouncements {
+                self.lastVisualAlignmentFailureAnnouncement = Date()
+                DispatchQueue.main.async {
+                    AnnouncementManager.shared.announce(announcement: NSLocalizedString("havingTroubleVisuallyAligning", comment: "this is announced if visual alignment hasn't succeeded after a while."))
+                }
+            } else {
+                SoundEffectManager.shared.error()
+            }
+        }
+    }
+    
+    /// Combine the yaws of the successful attempts and report the alignment (or fall back on the first pose if there weren't any).
+    private func finishAlignment(lastVisualYawReturn visualYawReturn: VisualAlignmentReturn, lastCameraTransform: simd_float4x4, alignTransform: simd_float4x4, isTutorial: Bool) {
+        DispatchQueue.main.async {
+            if self.delegate?.shouldContinueAlignment() != true {
+                return
+            }
+            // the phase correlation fallbacks are only used when there is nothing better
+            let relativeYaws = self.relativeYaws.isEmpty ? self.phaseCorrelationYaws : self.relativeYaws
+            if !relativeYaws.isEmpty {
+                let quantizedYaws = relativeYaws.map({Int($0*50)})
+                let mostFrequent = mostFrequent(array: quantizedYaws)!
+                var suitableYaws: [Float] = []
+                for relativeYaw in relativeYaws {
+                    if Int(relativeYaw*50) == mostFrequent.mostFrequent[0] {
+                        suitableYaws.append(relativeYaw)
                     }
                 }
+                let consensusYaw: Float
+                // If we don't have more than 2 colliding in the same bucket, fall back on a simple average
+                if mostFrequent.count < 2 {
+                    let consensusUnitVec = relativeYaws.reduce(simd_float2(repeating: 0.0), { (x,y) in x + simd_float2(cos(y), sin(y))/Float(relativeYaws.count)})
+                    consensusYaw = atan2(consensusUnitVec.y, consensusUnitVec.x)
+                } else {
+                    consensusYaw = suitableYaws.reduce(Float(0.0), { (x,y) in x + y/Float(mostFrequent.count)})
+                }
+                var relativeTransform = simd_float4x4.makeRotate(radians: consensusYaw, 0, 1, 0)
+                relativeTransform.columns.3 = simd_float4(alignTransform.columns.3.dropW - relativeTransform.rotation() * self.firstAlignmentPose!.columns.3.dropW, 1)
+                self.delegate?.alignmentSuccessful(manualAlignment: relativeTransform.inverse)
+                PathLogger.shared.logAlignmentEvent(alignmentEvent: .finalVisualAlignmentSucceeded(transform: relativeTransform.inverse, isTutorial: isTutorial))
+            } else {
+                let alignmentPose = self.firstAlignmentPose ?? matrix_identity_float4x4
+                var visualYawReturnCopy = visualYawReturn
+                visualYawReturnCopy.is_valid = true
+                visualYawReturnCopy.yaw = 0
+                var cameraTransform = lastCameraTransform
+                cameraTransform.columns.3 = alignmentPose.columns.3
+                let relativeTransform = Self.getRelativeTransform(cameraTransform: cameraTransform, alignTransform: self.getViewTransform(visualYawReturn: visualYawReturn, alignTransform: alignTransform), visualYawReturn: visualYawReturnCopy)
+                self.delegate?.alignmentFailed(fallbackTransform: relativeTransform)
+                PathLogger.shared.logAlignmentEvent(alignmentEvent: .finalVisualAlignmentFailed(transform: relativeTransform, isTutorial: isTutorial))
+
+            }
+            // one trace per alignment, so traced builds can be benchmarked by just aligning (written off the main queue since the trace can be long)
+            DispatchQueue.global(qos: .utility).async {
+                self.writeAlignmentTrace()
             }
         }
     }
     
+    /// Get the pose of the view of the anchor point that the yaw and leveling of an alignment attempt are relative to.
+    ///
+    /// - Parameters:
+    ///   - visualYawReturn: the result of the attempt
+    ///   - alignTransform: the pose of the anchor point image
+    /// - Returns: the pose of the view
+    private func getViewTransform(visualYawReturn: VisualAlignmentReturn, alignTransform: simd_float4x4) -> simd_float4x4 {
+        let view = Int(visualYawReturn.anchorView)
+        return view >= 0 && view < anchorViewTransforms.count ? anchorViewTransforms[view] : alignTransform
+    }
+    
     static func getRelativeTransform(cameraTransform: simd_float4x4, alignTransform: simd_float4x4, visualYawReturn: VisualAlignmentReturn)->simd_float4x4 {
         let alignRotation = simd_float3x3(simd_float3(alignTransform[0, 0], alignTransform[0, 1], alignTransform[0, 2]),
                                           simd_float3(alignTransform[1, 0], alignTransform[1, 1], alignTransform[1, 2]),
@@ -162,7 +375,16 @@ class VisualAlignmentManager {
     
     func reset() {
         relativeYaws = []
+        phaseCorrelationYaws = []
         firstAlignmentPose = nil
         delegate = nil
+        yawPriorUncertainty = nil
+        consecutiveRejectedFrames = 0
+        lastSubmittedFrameTimestamp = 0
+        isAnchorImageLoaded = false
+        anchorViewTransforms = []
+        isPanoramaLoaded = false
+        VisualAlignment.resetTracking()
+        VisualAlignment.stopPipeline()
     }
 }
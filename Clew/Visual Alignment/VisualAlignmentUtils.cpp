@@ -7,39 +7,336 @@
 //
 
 #include "VisualAlignmentUtils.hpp"
+#include "AlignmentTrace.hpp"
+#include "AlignmentLog.hpp"
 #include <opencv2/opencv.hpp>
 #include <opencv2/core/eigen.hpp>
 #include <Eigen/Core>
 #include <Eigen/Geometry>
 #include <simd/SIMD.h>
 #include <fstream>
+#include <atomic>
 
-KeyPointsAndDescriptors getKeyPointsAndDescriptors(cv::Mat image) {
-    // Acquire features and their descriptors, and match them.
-    auto feature_descriptor = cv::AKAZE::create(cv::AKAZE::DESCRIPTOR_MLDB_UPRIGHT);
-    std::vector<cv::KeyPoint> keypoints;
-    cv::Mat descriptors;
+/// the largest ratio of the distances to the best and second best descriptors for a match to be kept (Lowe's ratio test)
+static const double kLoweRatio = 0.7;
+
+/**
+ Stretch the intensities of an image to the full range if the backend detects features against an absolute threshold (AKAZE thresholds its detector response, so it finds few features in dim or low contrast frames).  This is done once per whole image, so the tiles of an image all see the same intensities.
+ 
+ - returns: The image to detect features in (image itself if it is left alone).
+ 
+ - parameters:
+ - image: The image.
+ - backend: The feature backend.
+ */
+static cv::Mat normalizeContrast(const cv::Mat& image, FeatureBackendType backend) {
+    if (backend != FeatureBackendType::AKAZE || image.empty()) {
+        return image;
+    }
+    cv::Mat normalized;
+    cv::normalize(image, normalized, 0, 255, cv::NORM_MINMAX);
+    return normalized;
+}
+
+/// Detect and describe features in an image (or tile) as it is.
+static KeyPointsAndDescriptors detectKeyPointsAndDescriptors(cv::Mat image, FeatureBackendType backend) {
+    switch (backend) {
+        case FeatureBackendType::ORB:
+            return getKeyPointsAndDescriptors<FeatureBackendType::ORB>(image);
+        case FeatureBackendType::BRISK:
+            return getKeyPointsAndDescriptors<FeatureBackendType::BRISK>(image);
+        case FeatureBackendType::AKAZE:
+        default:
+            return getKeyPointsAndDescriptors<FeatureBackendType::AKAZE>(image);
+    }
+}
+
+KeyPointsAndDescriptors getKeyPointsAndDescriptors(cv::Mat image, FeatureBackendType backend) {
+    return detectKeyPointsAndDescriptors(normalizeContrast(image, backend), backend);
+}
+
+std::vector<KeyPointsAndDescriptors> getKeyPointsAndDescriptorsTiled(const std::vector<cv::Mat>& images, FeatureBackendType backend, WorkerPool& pool, unsigned int tilesAcross, unsigned int tilesDown, int overlap, unsigned int maxKeypoints) {
+    ALIGNMENT_TRACE_SCOPE("getKeyPointsAndDescriptorsTiled");
+    typedef struct {
+        unsigned int image;
+        /// the part of the image this tile keeps keypoints from
+        cv::Rect core;
+        /// the core plus the overlap (clipped to the image)
+        cv::Rect expanded;
+    } Tile;
+    // normalize the contrast of each whole image rather than letting each tile normalize its own
+    std::vector<cv::Mat> normalizedImages;
+    for (const auto& image : images) {
+        normalizedImages.push_back(normalizeContrast(image, backend));
+    }
+    std::vector<Tile> tiles;
+    for (unsigned int i = 0; i < images.size(); i++) {
+        const cv::Rect bounds(0, 0, images[i].cols, images[i].rows);
+        for (unsigned int row = 0; row < tilesDown; row++) {
+            for (unsigned int column = 0; column < tilesAcross; column++) {
+                const int x0 = images[i].cols * column / tilesAcross;
+                const int x1 = images[i].cols * (column + 1) / tilesAcross;
+                const int y0 = images[i].rows * row / tilesDown;
+                const int y1 = images[i].rows * (row + 1) / tilesDown;
+                Tile tile;
+                tile.image = i;
+                tile.core = cv::Rect(x0, y0, x1 - x0, y1 - y0);
+                tile.expanded = cv::Rect(x0 - overlap, y0 - overlap, x1 - x0 + 2*overlap, y1 - y0 + 2*overlap) & bounds;
+                tiles.push_back(tile);
+            }
+        }
+    }
     
-    feature_descriptor->detectAndCompute(image, cv::Mat(), keypoints, descriptors);
+    const unsigned int maxTileKeypoints = maxKeypoints > 0 ? std::max(1u, maxKeypoints / (tilesAcross*tilesDown)) : 0;
+    std::vector<KeyPointsAndDescriptors> tileFeatures(tiles.size());
+    std::atomic<unsigned int> nextTile(0);
+    pool.run([&](unsigned int) {
+        for (unsigned int t = nextTile++; t < tiles.size(); t = nextTile++) {
+            const Tile& tile = tiles[t];
+            if (tile.expanded.area() == 0) {
+                continue;
+            }
+            const auto features = detectKeyPointsAndDescriptors(normalizedImages[tile.image](tile.expanded), backend);
+            std::vector<unsigned int> owned;
+            for (unsigned int k = 0; k < features.keypoints.size(); k++) {
+                const cv::Point2f pt(features.keypoints[k].pt.x + tile.expanded.x, features.keypoints[k].pt.y + tile.expanded.y);
+                // otherwise another tile owns this one
+                if (tile.core.contains(pt)) {
+                    owned.push_back(k);
+                }
+            }
+            if (maxTileKeypoints > 0 && owned.size() > maxTileKeypoints) {
+                // keep the strongest, in their original order so the output doesn't depend on the sort
+                std::vector<unsigned int> strongest = owned;
+                std::nth_element(strongest.begin(), strongest.begin() + maxTileKeypoints - 1, strongest.end(), [&](unsigned int a, unsigned int b) {
+                    return features.keypoints[a].response > features.keypoints[b].response || (features.keypoints[a].response == features.keypoints[b].response && a < b);
+                });
+                strongest.resize(maxTileKeypoints);
+                std::sort(strongest.begin(), strongest.end());
+                owned.swap(strongest);
+            }
+            KeyPointsAndDescriptors& kept = tileFeatures[t];
+            for (const unsigned int k : owned) {
+                cv::KeyPoint keypoint = features.keypoints[k];
+                keypoint.pt.x += tile.expanded.x;
+                keypoint.pt.y += tile.expanded.y;
+                kept.keypoints.push_back(keypoint);
+                kept.descriptors.push_back(features.descriptors.row(k));
+            }
+        }
+    });
     
-    return {.keypoints = keypoints, .descriptors = descriptors};
+    std::vector<KeyPointsAndDescriptors> keypoints_and_descriptors(images.size());
+    size_t numKeypoints = 0;
+    for (unsigned int t = 0; t < tiles.size(); t++) {
+        auto& merged = keypoints_and_descriptors[tiles[t].image];
+        merged.keypoints.insert(merged.keypoints.end(), tileFeatures[t].keypoints.begin(), tileFeatures[t].keypoints.end());
+        merged.descriptors.push_back(tileFeatures[t].descriptors);
+        numKeypoints += tileFeatures[t].keypoints.size();
+    }
+    ALIGNMENT_TRACE_COUNTER("keypoints", numKeypoints);
+    return keypoints_and_descriptors;
 }
 
-std::vector<cv::DMatch> getMatches(cv::Mat descriptors1, cv::Mat descriptors2) {
-    auto matcher = cv::BFMatcher();
+int getDescriptorNorm(FeatureBackendType backend) {
+    switch (backend) {
+        case FeatureBackendType::ORB:
+            return FeatureBackend<FeatureBackendType::ORB>::norm;
+        case FeatureBackendType::BRISK:
+            return FeatureBackend<FeatureBackendType::BRISK>::norm;
+        case FeatureBackendType::AKAZE:
+        default:
+            return FeatureBackend<FeatureBackendType::AKAZE>::norm;
+    }
+}
+
+std::vector<cv::DMatch> getMatches(cv::Mat descriptors1, cv::Mat descriptors2, int normType) {
+    auto matcher = cv::BFMatcher(normType);
     std::vector<std::vector<cv::DMatch>> matches;
     matcher.knnMatch(descriptors1, descriptors2, matches, 2);
     std::vector<cv::DMatch> good_matches;
     
     // Use Lowe's ratio test to select the good matches.
     for (const auto match : matches)
-        if (match.size() > 1 && match[0].distance < 0.7 * match[1].distance)
+        if (match.size() > 1 && match[0].distance < kLoweRatio * match[1].distance)
         {
             good_matches.push_back(match[0]);
         }
     return good_matches;
 }
 
+std::vector<cv::DMatch> getGuidedMatches(const KeyPointsAndDescriptors& keypoints_and_descriptors1, Eigen::Matrix3f intrinsics1, const KeyPointsAndDescriptors& keypoints_and_descriptors2, Eigen::Matrix3f intrinsics2, const YawPrior& prior, float parallaxMargin, int normType) {
+    std::vector<cv::DMatch> good_matches;
+    const auto& keypoints1 = keypoints_and_descriptors1.keypoints;
+    const auto& keypoints2 = keypoints_and_descriptors2.keypoints;
+    if (keypoints1.empty() || keypoints2.size() < 2) {
+        return good_matches;
+    }
+    
+    // Bucket the features of the second image into a grid so that each search only touches the cells overlapping its band.
+    const float cellSize = std::max(parallaxMargin, 8.0f);
+    float maxX = 0, maxY = 0;
+    for (const auto& keypoint : keypoints2) {
+        maxX = std::max(maxX, keypoint.pt.x);
+        maxY = std::max(maxY, keypoint.pt.y);
+    }
+    const int gridCols = (int) (maxX / cellSize) + 1;
+    const int gridRows = (int) (maxY / cellSize) + 1;
+    std::vector<std::vector<int>> grid(gridCols*gridRows);
+    for (unsigned int j = 0; j < keypoints2.size(); j++) {
+        grid[((int) (keypoints2[j].pt.y / cellSize))*gridCols + (int) (keypoints2[j].pt.x / cellSize)].push_back(j);
+    }
+    
+    const Eigen::Matrix3f intrinsics1_inverse = intrinsics1.inverse();
+    // The band spans the predictions at both ends of the window as well as the center.
+    const float windowYaws[3] = {prior.yaw - prior.uncertainty, prior.yaw, prior.yaw + prior.uncertainty};
+    Eigen::Matrix3f projections[3];
+    for (unsigned int k = 0; k < 3; k++) {
+        projections[k] = intrinsics2 * Eigen::AngleAxisf(windowYaws[k], Eigen::Vector3f::UnitY()).toRotationMatrix() * intrinsics1_inverse;
+    }
+    
+    for (unsigned int i = 0; i < keypoints1.size(); i++) {
+        const Eigen::Vector3f homogeneousKp1(keypoints1[i].pt.x, keypoints1[i].pt.y, 1.0);
+        float minX = std::numeric_limits<float>::max(), minY = std::numeric_limits<float>::max();
+        float bandMaxX = -std::numeric_limits<float>::max(), bandMaxY = -std::numeric_limits<float>::max();
+        bool inFront = true;
+        for (unsigned int k = 0; k < 3; k++) {
+            const Eigen::Vector3f predicted = projections[k] * homogeneousKp1;
+            if (predicted.z() <= 0) {
+                inFront = false;
+                break;
+            }
+            minX = std::min(minX, predicted.x() / predicted.z());
+            bandMaxX = std::max(bandMaxX, predicted.x() / predicted.z());
+            minY = std::min(minY, predicted.y() / predicted.z());
+            bandMaxY = std::max(bandMaxY, predicted.y() / predicted.z());
+        }
+        if (!inFront) {
+            continue;
+        }
+        minX -= parallaxMargin;
+        minY -= parallaxMargin;
+        bandMaxX += parallaxMargin;
+        bandMaxY += parallaxMargin;
+        if (bandMaxX < 0 || bandMaxY < 0 || minX > maxX || minY > maxY) {
+            continue;
+        }
+        
+        const int firstCol = std::max(0, (int) (minX / cellSize));
+        const int lastCol = std::min(gridCols - 1, (int) (bandMaxX / cellSize));
+        const int firstRow = std::max(0, (int) (minY / cellSize));
+        const int lastRow = std::min(gridRows - 1, (int) (bandMaxY / cellSize));
+        const cv::Mat descriptor1 = keypoints_and_descriptors1.descriptors.row(i);
+        double bestDistance = std::numeric_limits<double>::max(), secondBestDistance = std::numeric_limits<double>::max();
+        int bestIndex = -1;
+        for (int row = firstRow; row <= lastRow; row++) {
+            for (int col = firstCol; col <= lastCol; col++) {
+                for (const int j : grid[row*gridCols + col]) {
+                    const auto& pt = keypoints2[j].pt;
+                    if (pt.x < minX || pt.x > bandMaxX || pt.y < minY || pt.y > bandMaxY) {
+                        continue;
+                    }
+                    const double distance = cv::norm(descriptor1, keypoints_and_descriptors2.descriptors.row(j), normType);
+                    if (distance < bestDistance) {
+                        secondBestDistance = bestDistance;
+                        bestDistance = distance;
+                        bestIndex = j;
+                    } else if (distance < secondBestDistance) {
+                        secondBestDistance = distance;
+                    }
+                }
+            }
+        }
+        // Use Lowe's ratio test within the band (we need a runner up to compare against, same as getMatches).
+        if (bestIndex >= 0 && secondBestDistance < std::numeric_limits<double>::max() && bestDistance < kLoweRatio * secondBestDistance) {
+            good_matches.push_back(cv::DMatch(i, bestIndex, (float) bestDistance));
+        }
+    }
+    return good_matches;
+}
+
+std::vector<cv::DMatch> getEpipolarGuidedMatches(const KeyPointsAndDescriptors& keypoints_and_descriptors1, Eigen::Matrix3f intrinsics1, const KeyPointsAndDescriptors& keypoints_and_descriptors2, Eigen::Matrix3f intrinsics2, const Eigen::Matrix3d& essential, float bandWidth, float maxDistance, float ratio, int normType) {
+    const auto& keypoints1 = keypoints_and_descriptors1.keypoints;
+    const auto& keypoints2 = keypoints_and_descriptors2.keypoints;
+    // the best match of each feature of the second image so far
+    std::vector<cv::DMatch> bestMatches(keypoints2.size(), cv::DMatch(-1, -1, std::numeric_limits<float>::max()));
+    if (keypoints1.empty() || keypoints2.empty()) {
+        return {};
+    }
+    
+    // Bucket the features of the second image into a grid so that each search only touches the cells along its band.
+    const float cellSize = std::max(4*bandWidth, 16.0f);
+    float maxX = 0, maxY = 0;
+    for (const auto& keypoint : keypoints2) {
+        maxX = std::max(maxX, keypoint.pt.x);
+        maxY = std::max(maxY, keypoint.pt.y);
+    }
+    const int gridCols = (int) (maxX / cellSize) + 1;
+    const int gridRows = (int) (maxY / cellSize) + 1;
+    std::vector<std::vector<int>> grid(gridCols*gridRows);
+    for (unsigned int j = 0; j < keypoints2.size(); j++) {
+        grid[((int) (keypoints2[j].pt.y / cellSize))*gridCols + (int) (keypoints2[j].pt.x / cellSize)].push_back(j);
+    }
+    
+    // take the epipolar lines straight to the pixel coordinates of the second image
+    const Eigen::Matrix3d lineTransform = intrinsics2.cast<double>().inverse().transpose() * essential * intrinsics1.cast<double>().inverse();
+    for (unsigned int i = 0; i < keypoints1.size(); i++) {
+        const Eigen::Vector3d line = lineTransform * Eigen::Vector3d(keypoints1[i].pt.x, keypoints1[i].pt.y, 1.0);
+        const double lineNorm = line.head<2>().norm();
+        if (lineNorm == 0) {
+            continue;
+        }
+        // Walk the strips of cells along whichever axis the line runs closer to, so the band crosses at most a couple of cells of each strip.
+        const bool isSteep = std::abs(line(0)) > std::abs(line(1));
+        const int strips = isSteep ? gridRows : gridCols;
+        const int cellsAcross = isSteep ? gridCols : gridRows;
+        const double alongCoefficient = isSteep ? line(1) : line(0);
+        const double acrossCoefficient = isSteep ? line(0) : line(1);
+        const double halfBand = bandWidth * lineNorm / std::abs(acrossCoefficient);
+        const cv::Mat descriptor1 = keypoints_and_descriptors1.descriptors.row(i);
+        double bestDistance = std::numeric_limits<double>::max(), secondBestDistance = std::numeric_limits<double>::max();
+        int bestIndex = -1;
+        for (int strip = 0; strip < strips; strip++) {
+            const double across1 = -(alongCoefficient*strip*cellSize + line(2)) / acrossCoefficient;
+            const double across2 = -(alongCoefficient*(strip + 1)*cellSize + line(2)) / acrossCoefficient;
+            const double firstAcross = std::floor((std::min(across1, across2) - halfBand) / cellSize);
+            const double lastAcross = std::floor((std::max(across1, across2) + halfBand) / cellSize);
+            if (lastAcross < 0 || firstAcross > cellsAcross - 1) {
+                continue;
+            }
+            for (int across = (int) std::max(0.0, firstAcross); across <= (int) std::min(cellsAcross - 1.0, lastAcross); across++) {
+                for (const int j : grid[isSteep ? strip*gridCols + across : across*gridCols + strip]) {
+                    const auto& pt = keypoints2[j].pt;
+                    if (std::abs(line(0)*pt.x + line(1)*pt.y + line(2)) > bandWidth * lineNorm) {
+                        continue;
+                    }
+                    const double distance = cv::norm(descriptor1, keypoints_and_descriptors2.descriptors.row(j), normType);
+                    if (distance < bestDistance) {
+                        secondBestDistance = bestDistance;
+                        bestDistance = distance;
+                        bestIndex = j;
+                    } else if (distance < secondBestDistance) {
+                        secondBestDistance = distance;
+                    }
+                }
+            }
+        }
+        if (bestIndex < 0 || bestDistance > maxDistance || (secondBestDistance < std::numeric_limits<double>::max() && bestDistance >= ratio * secondBestDistance)) {
+            continue;
+        }
+        if (bestDistance < bestMatches[bestIndex].distance) {
+            bestMatches[bestIndex] = cv::DMatch(i, bestIndex, (float) bestDistance);
+        }
+    }
+    
+    std::vector<cv::DMatch> good_matches;
+    for (const auto& match : bestMatches) {
+        if (match.queryIdx >= 0) {
+            good_matches.push_back(match);
+        }
+    }
+    return good_matches;
+}
 
 Eigen::Matrix3f intrinsicsToMatrix(simd_float4 intrinsics) {
     Eigen::Matrix3f intrinsics_matrix;
@@ -70,6 +367,25 @@ cv::Mat warpPerspectiveWithGlobalRotation(cv::Mat image, Eigen::Matrix3f intrins
     return squared;
 }
 
+Eigen::Matrix3f getLeveledCameraRotation(Eigen::Matrix3f pose_rotation, Eigen::AngleAxisf rotation_in_global) {
+    // This mirrors warpPerspectiveWithGlobalRotation, which rotates rays in the camera by the global rotation expressed in camera coordinates.
+    Eigen::Matrix3f phone_to_camera;
+    phone_to_camera << 0, 1, 0, 1, 0, 0, 0, 0, -1;
+    return rotation_in_global.toRotationMatrix().inverse() * pose_rotation * phone_to_camera;
+}
+
+float getPredictedYaw(Eigen::Matrix3f leveled_rotation1, Eigen::Matrix3f leveled_rotation2) {
+    // ray_in_camera_2 = relative_rotation * ray_in_camera_1 when both rays point in the same global direction
+    const Eigen::Matrix3f relative_rotation = leveled_rotation2.transpose() * leveled_rotation1;
+    const auto rotated = relative_rotation * Eigen::Vector3f::UnitZ();
+    return atan2(rotated(0), rotated(2));
+}
+
+bool isYawWithinPrior(float yaw, const YawPrior& prior) {
+    const float difference = remainder(yaw - prior.yaw, 2*M_PI);
+    return fabs(difference) <= prior.uncertainty;
+}
+
 Eigen::Matrix4f poseToMatrix(simd_float4x4 pose) {
     Eigen::Matrix4f matrix;
     matrix << pose.columns[0].x, pose.columns[1].x, pose.columns[2].x, pose.columns[3].x,
@@ -79,8 +395,29 @@ Eigen::Matrix4f poseToMatrix(simd_float4x4 pose) {
     return matrix;
 }
 
-float getYaw(std::vector<cv::Point2f> points1, std::vector<cv::Point2f> points2, Eigen::Matrix3f intrinsics, int& numInliers, float& residualAngle, float& tx, float& ty, float& tz) {
-    const auto essential_mat = cv::findEssentialMat(points1, points2, intrinsics(0, 0), cv::Point2f(intrinsics(0, 2), intrinsics(1, 2)));
+simd_float4x4 matrixToPose(Eigen::Matrix4f matrix) {
+    simd_float4x4 pose;
+    for (int column = 0; column < 4; column++) {
+        pose.columns[column] = {matrix(0, column), matrix(1, column), matrix(2, column), matrix(3, column)};
+    }
+    return pose;
+}
+
+simd_float4 matrixToIntrinsics(Eigen::Matrix3f matrix) {
+    return {matrix(0, 0), matrix(1, 1), matrix(0, 2), matrix(1, 2)};
+}
+
+float getYaw(std::vector<cv::Point2f> points1, std::vector<cv::Point2f> points2, Eigen::Matrix3f intrinsics, int& numInliers, float& residualAngle, float& tx, float& ty, float& tz, std::vector<int>* inliers) {
+    cv::Mat inlierMask;
+    const auto essential_mat = cv::findEssentialMat(points1, points2, intrinsics(0, 0), cv::Point2f(intrinsics(0, 2), intrinsics(1, 2)), cv::RANSAC, 0.999, 1.0, inlierMask);
+    if (inliers) {
+        inliers->clear();
+        for (int i = 0; i < inlierMask.rows; i++) {
+            if (inlierMask.at<uchar>(i)) {
+                inliers->push_back(i);
+            }
+        }
+    }
     cv::Mat dcm_mat, translation_mat;
     Eigen::Matrix3f essential_matrix;
     cv2eigen(essential_mat, essential_matrix);
@@ -95,7 +432,7 @@ float getYaw(std::vector<cv::Point2f> points1, std::vector<cv::Point2f> points2,
     const auto rotated = dcm * Eigen::Vector3f::UnitZ();
     const float yaw = atan2(rotated(0), rotated(2));
     residualAngle = abs(yaw) - acos((dcm.trace() - 1)/2);
-    std::cout << "numInliers " << numInliers << " residualAngle " << residualAngle << " yaw " << yaw << std::endl;
+    ALIGNMENT_LOG_DEBUG(Solver, "essential matrix: %d inliers, residual angle %f, yaw %f", numInliers, residualAngle, yaw);
 
     return yaw;
 }
@@ -147,6 +484,7 @@ simd_float3x3 rotationToSIMD(Eigen::Matrix3f matrix) {
 #include <Eigen/Eigenvalues>
 #include <Eigen/SVD>
 #include <Eigen/Geometry>
+#include <Eigen/LU>
 #include <math.h>
 
 #include <limits>
@@ -328,3 +666,159 @@ void theia::ThreePointRelativePosePartialRotation(
     soln_translations->push_back(-eigenvector);
   }
 }
+
+void TwoPointPlanarRelativePose(const Vector3d image_1_rays[2],
+                                const Vector3d image_2_rays[2],
+                                std::vector<Quaterniond>* soln_rotations,
+                                std::vector<Vector3d>* soln_translations) {
+  // Parameterize the rotation as R = Ry(theta) and the unit translation as
+  // t = (sin(phi), 0, cos(phi)). Expanding the epipolar constraint
+  // q2' * [t]x * R * q1 = 0 with alpha = phi - theta gives:
+  //
+  //   y2 * x1 * cos(alpha) - y2 * z1 * sin(alpha)
+  //       - x2 * y1 * cos(phi) + z2 * y1 * sin(phi) = 0
+  //
+  // Stacking the two correspondences gives A * a + B * p = 0 where
+  // a = (cos(alpha), sin(alpha)) and p = (cos(phi), sin(phi)), so a = N * p
+  // with N = -inv(A) * B. Since a must be unit length this leaves a single
+  // equation in phi:
+  //
+  //   p' * (N' * N - I) * p = 0
+  Eigen::Matrix2d A;
+  Eigen::Matrix2d B;
+  for (int i = 0; i < 2; ++i) {
+    const Vector3d& q1(image_1_rays[i]);
+    const Vector3d& q2(image_2_rays[i]);
+    A.row(i) << q2.y() * q1.x(), -q2.y() * q1.z();
+    B.row(i) << -q2.x() * q1.y(), q2.z() * q1.y();
+  }
+
+  Eigen::Matrix2d inv_A;
+  bool invert_success;
+  static const double kDeterminantThreshold = 1e-12;
+  // A is singular when both points lie on the horizon of the second camera or
+  // the rays are degenerate, in which case the sample carries no information.
+  A.computeInverseWithCheck(inv_A, invert_success, kDeterminantThreshold);
+  if (!invert_success) {
+    return;
+  }
+  const Eigen::Matrix2d N = -inv_A * B;
+  const Eigen::Matrix2d S = N.transpose() * N - Eigen::Matrix2d::Identity();
+
+  // Rewrite p' * S * p = 0 in terms of the double angle:
+  //
+  //   mean + amplitude * cos(2 * phi - delta) = 0
+  const double mean = 0.5 * (S(0, 0) + S(1, 1));
+  const double half_difference = 0.5 * (S(0, 0) - S(1, 1));
+  const double amplitude = std::hypot(half_difference, S(0, 1));
+  if (amplitude < kDeterminantThreshold || fabs(mean) > amplitude) {
+    // no real solution for this sample
+    return;
+  }
+  const double delta = atan2(S(0, 1), half_difference);
+  const double spread = acos(-mean / amplitude);
+
+  for (const double two_phi : {delta + spread, delta - spread}) {
+    const double phi = 0.5 * two_phi;
+    const Eigen::Vector2d p(cos(phi), sin(phi));
+    const Eigen::Vector2d a = N * p;
+    const double theta = phi - atan2(a.y(), a.x());
+    const Quaterniond quat(AngleAxisd(theta, Vector3d::UnitY()));
+    const Vector3d translation(p.y(), 0.0, p.x());
+
+    // t and -t give the same essential matrix up to sign, so only one of
+    // them is returned and the cheirality check of recoverPose picks the sign.
+    soln_rotations->push_back(quat);
+    soln_translations->push_back(translation);
+  }
+}
+
+void TwoPointUprightAbsolutePose(const Vector3d points[2],
+                                 const Vector3d image_rays[2],
+                                 std::vector<double>* soln_yaws,
+                                 std::vector<Vector3d>* soln_translations) {
+  // With R = Ry(yaw) and p = R * X + t, each correspondence requires the ray
+  // r to be parallel to p, i.e. r.z * p.x - r.x * p.z = 0 and
+  // r.z * p.y - r.y * p.z = 0. Both are linear in
+  // x = (cos(yaw), sin(yaw), tx, ty, tz), so two correspondences give
+  // A * x = b with A 4x5. The solutions are x = x0 + lambda * n where n spans
+  // the null space of A, and cos^2 + sin^2 = 1 is a quadratic in lambda.
+  Eigen::Matrix<double, 4, 5> A;
+  Eigen::Vector4d b;
+  for (int i = 0; i < 2; ++i) {
+    const Vector3d& X(points[i]);
+    const Vector3d& r(image_rays[i]);
+    A.row(2 * i) << r.z() * X.x() - r.x() * X.z(), r.z() * X.z() + r.x() * X.x(),
+        r.z(), 0.0, -r.x();
+    b(2 * i) = 0.0;
+    A.row(2 * i + 1) << -r.y() * X.z(), r.y() * X.x(), 0.0, r.z(), -r.y();
+    b(2 * i + 1) = -r.z() * X.y();
+  }
+
+  const Eigen::FullPivLU<Eigen::Matrix<double, 4, 5> > lu(A);
+  // the points and rays are degenerate (e.g. both points on the same ray)
+  if (lu.rank() < 4) {
+    return;
+  }
+  const Eigen::Matrix<double, 5, 1> x0 = lu.solve(b);
+  const Eigen::Matrix<double, 5, 1> n = lu.kernel().col(0);
+
+  const double a = n(0) * n(0) + n(1) * n(1);
+  const double half_b = x0(0) * n(0) + x0(1) * n(1);
+  const double c = x0(0) * x0(0) + x0(1) * x0(1) - 1.0;
+  static const double kDegeneracyThreshold = 1e-12;
+  const double discriminant = half_b * half_b - a * c;
+  if (a < kDegeneracyThreshold || discriminant < 0) {
+    return;
+  }
+  const double root = sqrt(discriminant);
+  for (const double lambda : {(-half_b + root) / a, (-half_b - root) / a}) {
+    const Eigen::Matrix<double, 5, 1> x = x0 + lambda * n;
+    soln_yaws->push_back(atan2(x(1), x(0)));
+    soln_translations->push_back(x.tail<3>());
+  }
+}
+
+bool TwoPointUprightHomography(const Vector3d image_1_rays[2],
+                               const Vector3d image_2_rays[2],
+                               Eigen::Matrix3d* homography) {
+  // With H = [h1 0 h2; 0 1 0; h3 0 h4] and p = H * q1, each correspondence
+  // requires q2 to be parallel to p, i.e. q2.x * p.z - q2.z * p.x = 0 and
+  // q2.y * p.z - q2.z * p.y = 0. Both are linear in h = (h1, h2, h3, h4), so
+  // two correspondences give A * h = b with A 4x4.
+  Eigen::Matrix4d A;
+  Eigen::Vector4d b;
+  for (int i = 0; i < 2; ++i) {
+    const Vector3d& q1(image_1_rays[i]);
+    const Vector3d& q2(image_2_rays[i]);
+    A.row(2 * i) << -q2.z() * q1.x(), -q2.z() * q1.z(), q2.x() * q1.x(),
+        q2.x() * q1.z();
+    b(2 * i) = 0.0;
+    A.row(2 * i + 1) << 0.0, 0.0, q2.y() * q1.x(), q2.y() * q1.z();
+    b(2 * i + 1) = q2.z() * q1.y();
+  }
+
+  const Eigen::FullPivLU<Eigen::Matrix4d> lu(A);
+  // the rows of the y equations vanish for points at the height of the cameras
+  if (!lu.isInvertible()) {
+    return false;
+  }
+  const Eigen::Vector4d h = lu.solve(b);
+  if (!h.allFinite()) {
+    return false;
+  }
+  *homography << h(0), 0.0, h(1), 0.0, 1.0, 0.0, h(2), 0.0, h(3);
+  return true;
+}
+
+unsigned int adaptiveRansacTrials(double inlierRatio, unsigned int sampleSize, double confidence, unsigned int maxTrials) {
+    const double allInlierProbability = pow(inlierRatio, sampleSize);
+    if (allInlierProbability <= std::numeric_limits<double>::epsilon()) {
+        return maxTrials;
+    }
+    if (allInlierProbability >= 1.0) {
+        return 1;
+    }
+    const double trials = ceil(log(1.0 - confidence) / log(1.0 - allInlierProbability));
+    return trials < maxTrials ? std::max(1u, (unsigned int) trials) : maxTrials;
+}
@@ -14,6 +14,8 @@
 #include <Eigen/Core>
 #include <Eigen/Geometry>
 #include <simd/SIMD.h>
+#include "FeatureBackend.hpp"
+#include "WorkerPool.hpp"
 
 
 typedef struct {
@@ -21,15 +23,66 @@ typedef struct {
     cv::Mat descriptors;
 } KeyPointsAndDescriptors;
 
+/**
+ Get keypoints and descriptors from an image with a specific feature backend.
+ 
+ The detector is created once per thread and reused.
+ 
+ - returns: A KeyPointAndDescriptors containing the image's keypoints and the respective descriptors.
+ 
+ - parameters:
+ - image: The image to find features in.
+ */
+template <FeatureBackendType backend>
+KeyPointsAndDescriptors getKeyPointsAndDescriptors(cv::Mat image) {
+    thread_local const auto feature_descriptor = FeatureBackend<backend>::create();
+    KeyPointsAndDescriptors keypoints_and_descriptors;
+    FeatureBackend<backend>::detectAndCompute(*feature_descriptor, image, keypoints_and_descriptors.keypoints, keypoints_and_descriptors.descriptors);
+    return keypoints_and_descriptors;
+}
+
 /**
  Get keypoints and descriptors from an image.
  
+ For AKAZE, the intensities of the image are first stretched to the full range.
+ 
  - returns: A KeyPointAndDescriptors containing the image's keypoints and the respective descriptors.
  
  - parameters:
  - image: The image to find features in.
+ - backend: The feature detector and descriptor to use.
+ */
+KeyPointsAndDescriptors getKeyPointsAndDescriptors(cv::Mat image, FeatureBackendType backend = FeatureBackendType::AKAZE);
+
+/**
+ Get keypoints and descriptors from several images at once by splitting each image into overlapping tiles and handing the tiles out to a pool of workers.
+ 
+ Each tile is detected with a margin of overlap around it so that features near its edges still get their full support, and a keypoint is only kept by the tile whose (non-overlapping) core it falls in, which removes the duplicates along the tile borders.  The keypoints come out in the same order no matter how many workers there are.
+
+ The contrast of each image is normalized once before it is split up (as getKeyPointsAndDescriptors does for a whole image), but AKAZE still picks the contrast factor of its nonlinear diffusion from each tile it is given, and OpenCV doesn't let us set it.  So AKAZE keypoints can differ from those of the whole image, mostly in tiles whose texture is much busier or flatter than the rest of the image.
+ 
+ - returns: The keypoints and descriptors of each image (in the same order as images).
+ 
+ - parameters:
+ - images: The images to find features in.
+ - backend: The feature detector and descriptor to use.
+ - pool: The workers to spread the tiles over.
+ - tilesAcross: The number of columns of tiles.
+ - tilesDown: The number of rows of tiles.
+ - overlap: How many pixels each tile extends past its core on each side.
+ - maxKeypoints: The most keypoints to keep in each image, or 0 to keep them all (each tile keeps its strongest keypoints up to an even share, so they stay spread over the image).
  */
-KeyPointsAndDescriptors getKeyPointsAndDescriptors(cv::Mat image);
+std::vector<KeyPointsAndDescriptors> getKeyPointsAndDescriptorsTiled(const std::vector<cv::Mat>& images, FeatureBackendType backend, WorkerPool& pool, unsigned int tilesAcross = 2, unsigned int tilesDown = 2, int overlap = 32, unsigned int maxKeypoints = 0);
+
+/**
+ Get the norm used to compare the descriptors of a feature backend.
+ 
+ - returns: The OpenCV norm type.
+ 
+ - parameters:
+ - backend: The feature backend.
+ */
+int getDescriptorNorm(FeatureBackendType backend);
 
 /**
  Find matches between two sets of features.
@@ -39,8 +92,57 @@ KeyPointsAndDescriptors getKeyPointsAndDescriptors(cv::Mat image);
  - parameters:
  - descriptors1: The first set of descriptors.
  - descriptors2: The second set of descriptors.
+ - normType: The norm to compare descriptors with (see getDescriptorNorm).
  */
-std::vector<cv::DMatch> getMatches(cv::Mat descriptors1, cv::Mat descriptors2);
+std::vector<cv::DMatch> getMatches(cv::Mat descriptors1, cv::Mat descriptors2, int normType = cv::NORM_HAMMING);
+
+/**
+ An estimate of the yaw between two leveled cameras (in the same convention as the yaw returned by visualYaw).
+ */
+typedef struct {
+    /// The expected yaw in radians.
+    float yaw;
+    /// The half-width in radians of the window around the expected yaw that the true yaw is assumed to fall in.
+    float uncertainty;
+} YawPrior;
+
+/**
+ Find matches between two sets of features, only considering features in the second image that lie near where the yaw prior predicts each feature of the first image should land.
+ 
+ This replaces the all-pairs search of getMatches with a local search.  The band searched for each feature covers the predicted location over the whole window of the prior and is widened by a margin to allow for parallax from the unknown translation.
+ 
+ - returns: A list of matches.
+ 
+ - parameters:
+ - keypoints_and_descriptors1: The features of the first (leveled) image.
+ - intrinsics1: The intrinsics of the first image (in the coordinates of its keypoints).
+ - keypoints_and_descriptors2: The features of the second (leveled) image.
+ - intrinsics2: The intrinsics of the second image (in the coordinates of its keypoints).
+ - prior: The prior on the yaw from the first leveled camera to the second.
+ - parallaxMargin: How many pixels to widen the search band by in each direction.
+ - normType: The norm to compare descriptors with (see getDescriptorNorm).
+ */
+std::vector<cv::DMatch> getGuidedMatches(const KeyPointsAndDescriptors& keypoints_and_descriptors1, Eigen::Matrix3f intrinsics1, const KeyPointsAndDescriptors& keypoints_and_descriptors2, Eigen::Matrix3f intrinsics2, const YawPrior& prior, float parallaxMargin, int normType = cv::NORM_HAMMING);
+
+/**
+ Find matches between two sets of features once their relative pose is known, only considering features in the second image that lie close to the epipolar line of each feature of the first image.
+ 
+ Since the band is so narrow, the ratio test is relaxed and a feature with no competitor in its band is kept as long as its descriptor is as close as those of the matches that RANSAC already accepted.  Each feature of the second image is matched at most once (to its closest feature of the first image).
+ 
+ - returns: A list of matches.
+ 
+ - parameters:
+ - keypoints_and_descriptors1: The features of the first (leveled) image.
+ - intrinsics1: The intrinsics of the first image (in the coordinates of its keypoints).
+ - keypoints_and_descriptors2: The features of the second (leveled) image.
+ - intrinsics2: The intrinsics of the second image (in the coordinates of its keypoints).
+ - essential: The essential matrix from rays of the first camera to rays of the second (so that ray2' * essential * ray1 = 0).
+ - bandWidth: How far in pixels a feature of the second image may be from the epipolar line.
+ - maxDistance: The largest descriptor distance of a match.
+ - ratio: The ratio test threshold within the band.
+ - normType: The norm to compare descriptors with (see getDescriptorNorm).
+ */
+std::vector<cv::DMatch> getEpipolarGuidedMatches(const KeyPointsAndDescriptors& keypoints_and_descriptors1, Eigen::Matrix3f intrinsics1, const KeyPointsAndDescriptors& keypoints_and_descriptors2, Eigen::Matrix3f intrinsics2, const Eigen::Matrix3d& essential, float bandWidth, float maxDistance, float ratio, int normType = cv::NORM_HAMMING);
 
 /**
  Convert camera intrinsics encoded in a simd_float4 to one encoded in an Eigen::Matrix3f.
@@ -75,6 +177,39 @@ Eigen::AngleAxisf getIdealRotation(Eigen::Matrix4f pose);
  */
 cv::Mat warpPerspectiveWithGlobalRotation(cv::Mat image, Eigen::Matrix3f intrinsics, Eigen::Matrix3f pose_rotation, Eigen::AngleAxisf rotation_in_global);
 
+/**
+ Get the rotation from the leveled camera (the camera after warpPerspectiveWithGlobalRotation) to global coordinates.
+ 
+ - returns: The rotation converting a ray in the leveled camera's coordinate system to one in the global coordinate system.
+ 
+ - parameters:
+ - pose_rotation: The rotation converting a point in the camera's coordinate system to one in the global coordinate system.
+ - rotation_in_global: The rotation in global coordinates that was used to level the image.
+ */
+Eigen::Matrix3f getLeveledCameraRotation(Eigen::Matrix3f pose_rotation, Eigen::AngleAxisf rotation_in_global);
+
+/**
+ Get the yaw between two leveled cameras implied by their poses (e.g., as tracked by ARKit in the same session).
+ 
+ - returns: The yaw in the same convention as the yaw returned by visualYaw.
+ 
+ - parameters:
+ - leveled_rotation1: The rotation from the first leveled camera to global coordinates.
+ - leveled_rotation2: The rotation from the second leveled camera to global coordinates.
+ */
+float getPredictedYaw(Eigen::Matrix3f leveled_rotation1, Eigen::Matrix3f leveled_rotation2);
+
+/**
+ Check whether a yaw hypothesis is consistent with a prior.
+ 
+ - returns: True if the yaw is within the window of the prior.
+ 
+ - parameters:
+ - yaw: The yaw hypothesis.
+ - prior: The prior to check against.
+ */
+bool isYawWithinPrior(float yaw, const YawPrior& prior);
+
 /**
  Convert a pose encoded in a simd_float4x4 to one encoded in an Eigen::Matrix4f.
  
@@ -85,6 +220,26 @@ cv::Mat warpPerspectiveWithGlobalRotation(cv::Mat image, Eigen::Matrix3f intrins
  */
 Eigen::Matrix4f poseToMatrix(simd_float4x4 pose);
 
+/**
+ Convert a pose encoded in an Eigen::Matrix4f to one encoded in a simd_float4x4 (the inverse of poseToMatrix).
+ 
+ - returns: The pose encoded as a simd_float4x4.
+ 
+ - parameters:
+ - matrix: The pose encoded as an Eigen::Matrix4f.
+ */
+simd_float4x4 matrixToPose(Eigen::Matrix4f matrix);
+
+/**
+ Convert an intrinsics matrix to camera intrinsics encoded in a simd_float4 (the inverse of intrinsicsToMatrix).
+ 
+ - returns: The intrinsics in the format [fx, fy, ppx, ppy].
+ 
+ - parameters:
+ - matrix: The intrinsics matrix.
+ */
+simd_float4 matrixToIntrinsics(Eigen::Matrix3f matrix);
+
 /**
  Get the yaw given matching points between images.
  
@@ -94,8 +249,9 @@ Eigen::Matrix4f poseToMatrix(simd_float4x4 pose);
  - points1: The points in the first image which are matched by index to the specified points in the second image.
  - points2: The points in the second image which are matched by index to the specified points in the second image.
  - intrinsics: The camera intrinsics of the camera used to get the points.
+ - inliers: If not null, filled in with the indices of the points that agree with the essential matrix.
  */
-float getYaw(std::vector<cv::Point2f> points1, std::vector<cv::Point2f> points2, Eigen::Matrix3f intrinsics, int& numInliers, float& residualAngle, float& tx, float& ty, float& tz);
+float getYaw(std::vector<cv::Point2f> points1, std::vector<cv::Point2f> points2, Eigen::Matrix3f intrinsics, int& numInliers, float& residualAngle, float& tx, float& ty, float& tz, std::vector<int>* inliers = nullptr);
 
 /**
  Encode rotation matrix from an Eigen::Matrix3f to a simd_float3x3.
@@ -180,4 +336,65 @@ namespace theia {
 
 Eigen::Matrix3d CrossProductMatrix(const Eigen::Vector3d& cross_vec);
 
+/**
+ Solve for the relative pose between two leveled cameras under planar motion using two correspondences.
+ 
+ Planar motion means the rotation is purely about the vertical (y) axis and the translation has no vertical component, which holds well when the user walks on a floor holding the phone at a roughly constant height. The solutions follow the same conventions as theia::ThreePointRelativePosePartialRotation (ray_in_image_2 = Q * ray_in_image_1 + t) and the translations have unit length. There are at most 2 solutions: each translation is only determined up to sign (t and -t give the same essential matrix), so the sign is left to the cheirality check (e.g., recoverPose) rather than scoring both.
+ 
+ - parameters:
+ - image_1_rays: The rays of the two correspondences in the first (leveled) camera.
+ - image_2_rays: The rays of the two correspondences in the second (leveled) camera.
+ - soln_rotations: The rotations about the y axis that are consistent with the correspondences.
+ - soln_translations: The translations (in the x-z plane) that go with each rotation.
+ */
+void TwoPointPlanarRelativePose(const Eigen::Vector3d image_1_rays[2],
+                                const Eigen::Vector3d image_2_rays[2],
+                                std::vector<Eigen::Quaterniond>* soln_rotations,
+                                std::vector<Eigen::Vector3d>* soln_translations);
+
+/**
+ Solve for the pose of a leveled camera from two 3D points (e.g., ones ARKit saw from another leveled camera) and the rays along which the camera sees them.
+ 
+ Since the cameras are leveled, only the yaw about the vertical (y) axis and the translation are unknown, and two points determine them up to a twofold ambiguity. The solutions follow the same conventions as TwoPointPlanarRelativePose (ray ~ Ry(yaw) * point + t), except that the translations are metric (in the units of the points).
+ 
+ - parameters:
+ - points: The two points in the coordinates of the first camera.
+ - image_rays: The rays to the points in the second camera.
+ - soln_yaws: The yaws that are consistent with the correspondences.
+ - soln_translations: The translations that go with each yaw.
+ */
+void TwoPointUprightAbsolutePose(const Eigen::Vector3d points[2],
+                                 const Eigen::Vector3d image_rays[2],
+                                 std::vector<double>* soln_yaws,
+                                 std::vector<Eigen::Vector3d>* soln_translations);
+
+/**
+ Solve for the homography between two leveled cameras induced by a vertical plane (a wall, door, or shelf) under planar motion using two correspondences.
+ 
+ The homography is H = Ry(yaw) + t * n' where t = (tx, 0, tz) is the translation and n' = (nx, 0, nz) is the normal of the plane divided by its distance from the first camera, so that ray_in_image_2 ~ H * ray_in_image_1 for points on the plane. Its middle column is always (0, 1, 0), which leaves four unknowns that two correspondences determine linearly.
+ 
+ - returns: False if the correspondences are degenerate (e.g., both are at the height of the cameras).
+ 
+ - parameters:
+ - image_1_rays: The rays of the two correspondences in the first (leveled) camera.
+ - image_2_rays: The rays of the two correspondences in the second (leveled) camera.
+ - homography: Set to the homography.
+ */
+bool TwoPointUprightHomography(const Eigen::Vector3d image_1_rays[2],
+                               const Eigen::Vector3d image_2_rays[2],
+                               Eigen::Matrix3d* homography);
+
+/**
+ Get the number of RANSAC trials needed to draw at least one all-inlier sample with the specified confidence.
+ 
+ - returns: The number of trials, clamped to maxTrials.
+ 
+ - parameters:
+ - inlierRatio: The fraction of correspondences that agree with the best model so far.
+ - sampleSize: The number of correspondences in a minimal sample.
+ - confidence: The desired probability of drawing an all-inlier sample.
+ - maxTrials: The maximum number of trials to run.
+ */
+unsigned int adaptiveRansacTrials(double inlierRatio, unsigned int sampleSize, double confidence, unsigned int maxTrials);
+
 #endif /* VisualAlignmentUtils_hpp */
@@ -0,0 +1,71 @@
+//
+//  WorkerPool.cpp
+//  Clew
+//
+//  Created by OccamLab on 10/19/26.
+//  Copyright © 2026 OccamLab. All rights reserved.
+//
+
+#include "WorkerPool.hpp"
+#include <algorithm>
+
+WorkerPool::WorkerPool(unsigned int numWorkers) : task(nullptr), generation(0), running(0), stopping(false) {
+    for (unsigned int worker = 1; worker < std::max(1u, numWorkers); worker++) {
+        threads.emplace_back(&WorkerPool::workerLoop, this, worker);
+    }
+}
+
+WorkerPool::~WorkerPool() {
+    {
+        std::lock_guard<std::mutex> lock(mutex);
+        stopping = true;
+    }
+    wake.notify_all();
+    for (auto& thread : threads) {
+        thread.join();
+    }
+}
+
+unsigned int WorkerPool::size() const {
+    return threads.size() + 1;
+}
+
+void WorkerPool::run(const std::function<void(unsigned int)>& newTask) {
+    std::lock_guard<std::mutex> runLock(runMutex);
+    if (!threads.empty()) {
+        {
+            std::lock_guard<std::mutex> lock(mutex);
+            task = &newTask;
+            running = threads.size();
+            generation++;
+        }
+        wake.notify_all();
+    }
+    newTask(0);
+    
+    std::unique_lock<std::mutex> lock(mutex);
+    finished.wait(lock, [this] { return running == 0; });
+    task = nullptr;
+}
+
+void WorkerPool::workerLoop(unsigned int worker) {
+    unsigned long seenGeneration = 0;
+    while (true) {
+        const std::function<void(unsigned int)>* currentTask;
+        {
+            std::unique_lock<std::mutex> lock(mutex);
+            wake.wait(lock, [&] { return stopping || generation != seenGeneration; });
+            if (stopping) {
+                return;
+            }
+            seenGeneration = generation;
+            currentTask = task;
+        }
+        (*currentTask)(worker);
+        {
+            std::lock_guard<std::mutex> lock(mutex);
+            running--;
+        }
+        finished.notify_one();
+    }
+}
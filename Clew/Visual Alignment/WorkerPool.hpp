@@ -0,0 +1,64 @@
+//
+//  WorkerPool.hpp
+//  Clew
+//
+//  Created by OccamLab on 10/19/26.
+//  Copyright © 2026 OccamLab. All rights reserved.
+//
+
+#ifndef WorkerPool_hpp
+#define WorkerPool_hpp
+
+#include <condition_variable>
+#include <functional>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+/**
+ A fixed set of threads that all run the same task and then go back to sleep.  The thread that calls run is used as one of the workers, so a pool of size one never starts a thread.
+ */
+class WorkerPool {
+public:
+    /**
+     Start the workers.
+     
+     - parameters:
+     - numWorkers: The number of workers (including the calling thread).
+     */
+    WorkerPool(unsigned int numWorkers);
+    ~WorkerPool();
+    
+    WorkerPool(const WorkerPool&) = delete;
+    WorkerPool& operator=(const WorkerPool&) = delete;
+    
+    /// the number of workers (including the calling thread)
+    unsigned int size() const;
+    
+    /**
+     Run a task on every worker and wait for all of them to finish.  Only one task runs at a time.
+     
+     - parameters:
+     - task: The work to do, which is given the index of the worker running it (the calling thread is worker 0).  It must not throw.
+     */
+    void run(const std::function<void(unsigned int)>& task);
+    
+private:
+    void workerLoop(unsigned int worker);
+    
+    std::vector<std::thread> threads;
+    /// serializes calls to run
+    std::mutex runMutex;
+    /// guards everything below
+    std::mutex mutex;
+    std::condition_variable wake;
+    std::condition_variable finished;
+    const std::function<void(unsigned int)>* task;
+    /// incremented each time a task is handed out
+    unsigned long generation;
+    /// the number of threads still working on the current task
+    unsigned int running;
+    bool stopping;
+};
+
+#endif /* WorkerPool_hpp */